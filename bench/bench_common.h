@@ -0,0 +1,236 @@
+#ifndef SAC_BENCH_COMMON_H
+#define SAC_BENCH_COMMON_H
+/*
+ * ***** BEGIN LICENSE BLOCK *****
+ * Version: MIT
+ *
+ * Copyright (c) 2010-2013 Alan Antonuk
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * ***** END LICENSE BLOCK *****
+ */
+
+// Helpers shared by the sac_bench, sac_wire, sac_perf and sac_soak tools:
+// option parsing, timing and the JSON the results are written as.
+
+#include <SimpleAmqpClient/SimpleAmqpClient.h>
+
+#include <algorithm>
+#include <boost/chrono/system_clocks.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/lexical_cast.hpp>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace bench {
+
+using namespace AmqpClient;
+
+typedef boost::chrono::steady_clock clock_type;
+typedef std::vector<boost::uint64_t> number_list_t;
+
+const int CONSUME_TIMEOUT_MS = 30000;
+
+struct Result {
+  typedef std::vector<std::pair<std::string, boost::uint64_t> > param_list_t;
+
+  explicit Result(const std::string &name)
+      : name(name), messages(0), bytes(0), seconds(0), has_latency(false) {}
+
+  Result &Param(const std::string &key, boost::uint64_t value) {
+    params.push_back(std::make_pair(key, value));
+    return *this;
+  }
+
+  Result &Latency(const std::string &source,
+                  const LatencyHistogram &histogram) {
+    latency_source = source;
+    latency = histogram;
+    has_latency = true;
+    return *this;
+  }
+
+  std::string name;
+  param_list_t params;
+  boost::uint64_t messages;
+  boost::uint64_t bytes;
+  double seconds;
+  bool has_latency;
+  std::string latency_source;
+  LatencyHistogram latency;
+};
+
+typedef std::vector<Result> result_list_t;
+
+class Stopwatch {
+ public:
+  Stopwatch() : m_start(clock_type::now()) {}
+
+  double Seconds() const {
+    return boost::chrono::duration<double>(clock_type::now() - m_start).count();
+  }
+
+ private:
+  clock_type::time_point m_start;
+};
+
+inline std::vector<std::string> Split(const std::string &list) {
+  std::vector<std::string> ret;
+  std::string::size_type begin = 0;
+  while (begin <= list.size()) {
+    std::string::size_type end = list.find(',', begin);
+    if (std::string::npos == end) {
+      end = list.size();
+    }
+    if (end != begin) {
+      ret.push_back(list.substr(begin, end - begin));
+    }
+    begin = end + 1;
+  }
+  return ret;
+}
+
+inline boost::uint64_t ParseNumber(const std::string &option,
+                                   const std::string &value) {
+  try {
+    return boost::lexical_cast<boost::uint64_t>(value);
+  } catch (const boost::bad_lexical_cast &) {
+    throw std::invalid_argument(option + " expects a number, got '" + value +
+                                "'");
+  }
+}
+
+inline number_list_t ParseNumbers(const std::string &option,
+                                  const std::string &value) {
+  number_list_t ret;
+  const std::vector<std::string> items = Split(value);
+  for (std::vector<std::string>::const_iterator it = items.begin();
+       it != items.end(); ++it) {
+    ret.push_back(ParseNumber(option, *it));
+  }
+  if (ret.empty()) {
+    throw std::invalid_argument(option + " expects at least one number");
+  }
+  return ret;
+}
+
+inline Channel::OpenOpts OpenOptsFor(const std::string &broker) {
+  if (broker.compare(0, 7, "amqp://") == 0 ||
+      broker.compare(0, 8, "amqps://") == 0) {
+    return Channel::OpenOpts::FromUri(broker);
+  }
+  Channel::OpenOpts ret;
+  ret.host = broker.empty() ? std::string("localhost") : broker;
+  ret.auth = Channel::OpenOpts::BasicAuth("guest", "guest");
+  return ret;
+}
+
+inline void Report(const Result &result) {
+  std::cerr << result.name;
+  for (Result::param_list_t::const_iterator it = result.params.begin();
+       it != result.params.end(); ++it) {
+    std::cerr << ' ' << it->first << '=' << it->second;
+  }
+  std::cerr << ": " << result.messages << " in " << std::fixed
+            << std::setprecision(3) << result.seconds << "s" << std::endl;
+}
+
+inline Envelope::ptr_t Consume(Channel &channel) {
+  Envelope::ptr_t envelope;
+  if (!channel.BasicConsumeMessage(envelope, CONSUME_TIMEOUT_MS)) {
+    throw std::runtime_error("timed out waiting for a message");
+  }
+  return envelope;
+}
+
+inline std::string JsonString(const std::string &value) {
+  std::ostringstream out;
+  out << '"';
+  for (std::string::const_iterator it = value.begin(); it != value.end();
+       ++it) {
+    const unsigned char c = static_cast<unsigned char>(*it);
+    if ('"' == c || '\\' == c) {
+      out << '\\' << *it;
+    } else if (c < 0x20) {
+      out << "\\u" << std::hex << std::setw(4) << std::setfill('0')
+          << static_cast<int>(c) << std::dec << std::setfill(' ');
+    } else {
+      out << *it;
+    }
+  }
+  out << '"';
+  return out.str();
+}
+
+inline double PerSecond(double amount, double seconds) {
+  return seconds > 0 ? amount / seconds : 0;
+}
+
+// Writes results as the JSON document shared by the benchmark tools,
+// benchmark names the tool and broker where it ran.
+inline void WriteJson(std::ostream &out, const std::string &benchmark,
+                      const std::string &broker,
+                      const result_list_t &results) {
+  out << std::fixed << std::setprecision(6);
+  out << "{\n"
+      << "  \"benchmark\": " << JsonString(benchmark) << ",\n"
+      << "  \"version\": \"" << SIMPLEAMQPCLIENT_VERSION_MAJOR << '.'
+      << SIMPLEAMQPCLIENT_VERSION_MINOR << '.' << SIMPLEAMQPCLIENT_VERSION_PATCH
+      << "\",\n"
+      << "  \"broker\": " << JsonString(broker) << ",\n"
+      << "  \"results\": [";
+
+  for (result_list_t::const_iterator it = results.begin(); it != results.end();
+       ++it) {
+    out << (it == results.begin() ? "\n" : ",\n") << "    {\"name\": "
+        << JsonString(it->name);
+    for (Result::param_list_t::const_iterator param = it->params.begin();
+         param != it->params.end(); ++param) {
+      out << ", " << JsonString(param->first) << ": " << param->second;
+    }
+    out << ", \"messages\": " << it->messages << ", \"bytes\": " << it->bytes
+        << ", \"seconds\": " << it->seconds
+        << ", \"messages_per_second\": " << PerSecond(it->messages, it->seconds)
+        << ", \"bytes_per_second\": " << PerSecond(it->bytes, it->seconds);
+    if (it->has_latency) {
+      const LatencyHistogram &latency = it->latency;
+      out << ", \"latency_ns\": {\"source\": "
+          << JsonString(it->latency_source)
+          << ", \"count\": " << latency.Count()
+          << ", \"mean\": " << latency.Mean()
+          << ", \"p50\": " << latency.Percentile(50)
+          << ", \"p90\": " << latency.Percentile(90)
+          << ", \"p99\": " << latency.Percentile(99)
+          << ", \"p999\": " << latency.Percentile(99.9) << "}";
+    }
+    out << "}";
+  }
+  out << (results.empty() ? "]\n" : "\n  ]\n") << "}\n";
+}
+
+}  // namespace bench
+
+#endif  // SAC_BENCH_COMMON_H
@@ -0,0 +1,380 @@
+/*
+ * ***** BEGIN LICENSE BLOCK *****
+ * Version: MIT
+ *
+ * Copyright (c) 2010-2013 Alan Antonuk
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * ***** END LICENSE BLOCK *****
+ */
+
+// sac_bench: throughput and latency benchmarks against a live broker.
+//
+// Each scenario is run for every body size (and prefetch count, where it
+// applies) on a fresh exclusive queue, and the results are written as JSON,
+// so runs from before and after a change can be compared by a script.
+//
+// The broker is taken from --broker or the AMQP_BROKER environment variable,
+// either as an amqp:// URI or as a host name to log into as guest/guest, the
+// same as the test suite. Outside Windows, --fake-broker runs against the
+// FakeBroker of the tests instead, which measures the client without a
+// network or a real broker in the way.
+
+#include <SimpleAmqpClient/SimpleAmqpClient.h>
+
+#include <algorithm>
+#include <boost/cstdint.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "bench_common.h"
+#ifndef _WIN32
+#include "fake_broker.h"
+#endif
+
+using namespace AmqpClient;
+using namespace bench;
+
+namespace {
+
+struct Options {
+  Channel::OpenOpts open_opts;
+  std::string broker;
+  bool fake_broker;
+  boost::uint64_t messages;
+  boost::uint64_t max_bytes;
+  number_list_t body_sizes;
+  number_list_t prefetch_counts;
+  boost::uint64_t consumers;
+  std::set<std::string> scenarios;
+  std::string output;
+
+  Options()
+      : fake_broker(false),
+        messages(10000),
+        max_bytes(64 * 1024 * 1024),
+        consumers(4) {
+    const boost::uint64_t sizes[] = {100, 1024, 64 * 1024, 1024 * 1024,
+                                     10 * 1024 * 1024};
+    body_sizes.assign(sizes, sizes + sizeof(sizes) / sizeof(sizes[0]));
+    const boost::uint64_t prefetches[] = {1, 10, 100, 1000};
+    prefetch_counts.assign(
+        prefetches, prefetches + sizeof(prefetches) / sizeof(prefetches[0]));
+  }
+
+  bool Wants(const std::string &scenario) const {
+    return scenarios.empty() || scenarios.count(scenario) != 0;
+  }
+
+  // Large bodies are sent fewer times, so a run moves at most max_bytes but
+  // still has enough messages to give a rate.
+  boost::uint64_t MessagesFor(boost::uint64_t body_size) const {
+    const boost::uint64_t budget =
+        max_bytes / std::max<boost::uint64_t>(body_size, 1);
+    return std::max<boost::uint64_t>(std::min(messages, budget), 10);
+  }
+};
+
+void Usage(std::ostream &out) {
+  out << "usage: sac_bench [options]\n"
+         "  --broker URI|HOST     broker to use, default $AMQP_BROKER\n"
+#ifndef _WIN32
+         "  --fake-broker         run against a broker in this process\n"
+#endif
+         "  --messages N          messages per run, default 10000\n"
+         "  --max-bytes N         cap on the bytes moved per run, default "
+         "64MiB\n"
+         "  --body-sizes N,...    body sizes in bytes, default "
+         "100,1024,65536,1048576,10485760\n"
+         "  --prefetch N,...      consumer prefetch counts, default "
+         "1,10,100,1000\n"
+         "  --consumers N         consumers for fan_in, default 4\n"
+         "  --only NAME,...       scenarios to run: publish, consume, rpc, "
+         "fan_in\n"
+         "  --output FILE         where to write the JSON, default stdout\n";
+}
+
+Options ParseOptions(int argc, char *argv[]) {
+  Options opts;
+  const char *env_broker = std::getenv("AMQP_BROKER");
+  if (NULL != env_broker) {
+    opts.broker = env_broker;
+  }
+
+  for (int i = 1; i < argc; ++i) {
+    const std::string option = argv[i];
+    if ("--help" == option || "-h" == option) {
+      Usage(std::cout);
+      std::exit(EXIT_SUCCESS);
+    }
+#ifndef _WIN32
+    if ("--fake-broker" == option) {
+      opts.fake_broker = true;
+      continue;
+    }
+#endif
+    if (i + 1 == argc) {
+      throw std::invalid_argument(option + " expects a value");
+    }
+    const std::string value = argv[++i];
+    if ("--broker" == option) {
+      opts.broker = value;
+    } else if ("--messages" == option) {
+      opts.messages = ParseNumber(option, value);
+    } else if ("--max-bytes" == option) {
+      opts.max_bytes = ParseNumber(option, value);
+    } else if ("--body-sizes" == option) {
+      opts.body_sizes = ParseNumbers(option, value);
+    } else if ("--prefetch" == option) {
+      opts.prefetch_counts = ParseNumbers(option, value);
+      for (number_list_t::const_iterator it = opts.prefetch_counts.begin();
+           it != opts.prefetch_counts.end(); ++it) {
+        if (*it > 0xFFFF) {
+          throw std::invalid_argument("--prefetch counts must fit in 16 bits");
+        }
+      }
+    } else if ("--consumers" == option) {
+      opts.consumers = std::max<boost::uint64_t>(ParseNumber(option, value), 1);
+    } else if ("--only" == option) {
+      const std::vector<std::string> names = Split(value);
+      for (std::vector<std::string>::const_iterator it = names.begin();
+           it != names.end(); ++it) {
+        if ("publish" != *it && "consume" != *it && "rpc" != *it &&
+            "fan_in" != *it) {
+          throw std::invalid_argument("unknown scenario " + *it);
+        }
+        opts.scenarios.insert(*it);
+      }
+    } else if ("--output" == option) {
+      opts.output = value;
+    } else {
+      throw std::invalid_argument("unknown option " + option);
+    }
+  }
+
+  if (!opts.fake_broker) {
+    opts.open_opts = OpenOptsFor(opts.broker);
+  }
+  return opts;
+}
+
+void Publish(Channel &channel, const std::string &queue,
+             const BasicMessage::ptr_t &message, boost::uint64_t count) {
+  for (boost::uint64_t i = 0; i < count; ++i) {
+    channel.BasicPublish("", queue, message);
+  }
+}
+
+// Every publish waits for its confirm: channels opened by this library are
+// always in confirm mode.
+void BenchPublish(const Options &opts, result_list_t &results) {
+  Channel::ptr_t channel = Channel::Open(opts.open_opts);
+  channel->SetLatencyTracking(true);
+  const std::string queue = channel->DeclareQueue("");
+
+  for (number_list_t::const_iterator size = opts.body_sizes.begin();
+       size != opts.body_sizes.end(); ++size) {
+    const BasicMessage::ptr_t message =
+        BasicMessage::Create(std::string(*size, 'x'));
+    const boost::uint64_t count = opts.MessagesFor(*size);
+
+    channel->GetLatencyStats(true);
+    Stopwatch stopwatch;
+    Publish(*channel, queue, message, count);
+
+    Result result("publish");
+    result.seconds = stopwatch.Seconds();
+    result.Param("body_size", *size);
+    result.messages = count;
+    result.bytes = count * *size;
+    result.Latency("publish_confirm",
+                   channel->GetLatencyStats(true).publish_confirm);
+    results.push_back(result);
+    Report(result);
+
+    channel->PurgeQueue(queue);
+  }
+}
+
+void BenchConsume(const Options &opts, result_list_t &results) {
+  Channel::ptr_t channel = Channel::Open(opts.open_opts);
+  channel->SetLatencyTracking(true);
+  const std::string queue = channel->DeclareQueue("");
+
+  for (number_list_t::const_iterator prefetch = opts.prefetch_counts.begin();
+       prefetch != opts.prefetch_counts.end(); ++prefetch) {
+    for (number_list_t::const_iterator size = opts.body_sizes.begin();
+         size != opts.body_sizes.end(); ++size) {
+      const boost::uint64_t count = opts.MessagesFor(*size);
+      Publish(*channel, queue, BasicMessage::Create(std::string(*size, 'x')),
+              count);
+
+      const std::string tag =
+          channel->BasicConsume(queue, "", true, false, true,
+                                static_cast<boost::uint16_t>(*prefetch));
+      channel->GetLatencyStats(true);
+      Stopwatch stopwatch;
+      for (boost::uint64_t i = 0; i < count; ++i) {
+        channel->BasicAck(Consume(*channel));
+      }
+
+      Result result("consume");
+      result.seconds = stopwatch.Seconds();
+      result.Param("prefetch", *prefetch).Param("body_size", *size);
+      result.messages = count;
+      result.bytes = count * *size;
+      result.Latency("frame_wait", channel->GetLatencyStats(true).frame_wait);
+      results.push_back(result);
+      Report(result);
+
+      channel->BasicCancel(tag);
+    }
+  }
+}
+
+// A passive queue.declare is about the cheapest round trip to the broker.
+void BenchRpc(const Options &opts, result_list_t &results) {
+  Channel::ptr_t channel = Channel::Open(opts.open_opts);
+  channel->SetLatencyTracking(true);
+  const std::string queue = channel->DeclareQueue("");
+
+  channel->GetLatencyStats(true);
+  Stopwatch stopwatch;
+  for (boost::uint64_t i = 0; i < opts.messages; ++i) {
+    channel->DeclareQueue(queue, true);
+  }
+
+  Result result("rpc");
+  result.seconds = stopwatch.Seconds();
+  result.messages = opts.messages;
+  result.Latency("rpc", channel->GetLatencyStats(true).rpc);
+  results.push_back(result);
+  Report(result);
+}
+
+// Several consumers on one Channel, all read through the one
+// BasicConsumeMessage call that takes a message from any of them.
+void BenchFanIn(const Options &opts, result_list_t &results) {
+  Channel::ptr_t channel = Channel::Open(opts.open_opts);
+  channel->SetLatencyTracking(true);
+  std::vector<std::string> queues;
+  for (boost::uint64_t i = 0; i < opts.consumers; ++i) {
+    queues.push_back(channel->DeclareQueue(""));
+  }
+
+  for (number_list_t::const_iterator size = opts.body_sizes.begin();
+       size != opts.body_sizes.end(); ++size) {
+    const BasicMessage::ptr_t message =
+        BasicMessage::Create(std::string(*size, 'x'));
+    const boost::uint64_t per_queue = std::max<boost::uint64_t>(
+        opts.MessagesFor(*size) / opts.consumers, 1);
+    for (std::vector<std::string>::const_iterator queue = queues.begin();
+         queue != queues.end(); ++queue) {
+      Publish(*channel, *queue, message, per_queue);
+    }
+
+    std::vector<std::string> tags;
+    for (std::vector<std::string>::const_iterator queue = queues.begin();
+         queue != queues.end(); ++queue) {
+      tags.push_back(channel->BasicConsume(*queue, "", true, false, true, 100));
+    }
+
+    const boost::uint64_t count = per_queue * queues.size();
+    channel->GetLatencyStats(true);
+    Stopwatch stopwatch;
+    for (boost::uint64_t i = 0; i < count; ++i) {
+      channel->BasicAck(Consume(*channel));
+    }
+
+    Result result("fan_in");
+    result.seconds = stopwatch.Seconds();
+    result.Param("consumers", opts.consumers).Param("body_size", *size);
+    result.messages = count;
+    result.bytes = count * *size;
+    result.Latency("frame_wait", channel->GetLatencyStats(true).frame_wait);
+    results.push_back(result);
+    Report(result);
+
+    for (std::vector<std::string>::const_iterator tag = tags.begin();
+         tag != tags.end(); ++tag) {
+      channel->BasicCancel(*tag);
+    }
+  }
+}
+
+}  // namespace
+
+int main(int argc, char *argv[]) {
+  Options opts;
+  try {
+    opts = ParseOptions(argc, argv);
+  } catch (const std::exception &e) {
+    std::cerr << "sac_bench: " << e.what() << "\n";
+    Usage(std::cerr);
+    return EXIT_FAILURE;
+  }
+
+#ifndef _WIN32
+  boost::scoped_ptr<FakeBroker> fake_broker;
+#endif
+  result_list_t results;
+  try {
+#ifndef _WIN32
+    if (opts.fake_broker) {
+      fake_broker.reset(new FakeBroker);
+      opts.open_opts = fake_broker->GetOpenOpts();
+    }
+#endif
+    if (opts.Wants("publish")) {
+      BenchPublish(opts, results);
+    }
+    if (opts.Wants("consume")) {
+      BenchConsume(opts, results);
+    }
+    if (opts.Wants("rpc")) {
+      BenchRpc(opts, results);
+    }
+    if (opts.Wants("fan_in")) {
+      BenchFanIn(opts, results);
+    }
+  } catch (const std::exception &e) {
+    std::cerr << "sac_bench: " << e.what() << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  if (opts.output.empty()) {
+    WriteJson(std::cout, "sac_bench", opts.open_opts.host, results);
+  } else {
+    std::ofstream out(opts.output.c_str());
+    WriteJson(out, "sac_bench", opts.open_opts.host, results);
+    if (!out) {
+      std::cerr << "sac_bench: could not write " << opts.output << std::endl;
+      return EXIT_FAILURE;
+    }
+  }
+  return EXIT_SUCCESS;
+}
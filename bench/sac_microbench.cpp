@@ -0,0 +1,266 @@
+/*
+ * ***** BEGIN LICENSE BLOCK *****
+ * Version: MIT
+ *
+ * Copyright (c) 2010-2013 Alan Antonuk
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * ***** END LICENSE BLOCK *****
+ */
+
+// sac_microbench: CPU cost of converting header tables and message
+// properties, with no broker involved.
+//
+// Table benchmarks take two arguments, the header shape and the number of
+// top-level keys, e.g. BM_CreateAmqpTable/1/10 is a nested table of 10 keys.
+// Shapes are:
+//  0 flat: strings, integers, booleans and doubles,
+//  1 nested: each value is a table holding another table,
+//  2 arrays: each value is an array of mixed values.
+
+#include <benchmark/benchmark.h>
+
+#include <SimpleAmqpClient/SimpleAmqpClient.h>
+
+#include <boost/cstdint.hpp>
+#include <sstream>
+#include <string>
+
+#include "SimpleAmqpClient/BasicMessageImpl.h"
+#include "SimpleAmqpClient/TableImpl.h"
+
+using namespace AmqpClient;
+using AmqpClient::Detail::BasicMessageImpl;
+using AmqpClient::Detail::TableValueImpl;
+
+namespace {
+
+enum shape_t { flat = 0, nested = 1, arrays = 2 };
+
+std::string Key(int i) {
+  std::ostringstream key;
+  key << "x-header-" << i;
+  return key.str();
+}
+
+TableValue ScalarValue(int i) {
+  switch (i % 5) {
+    case 0:
+      return TableValue(std::string("a string header value"));
+    case 1:
+      return TableValue(static_cast<boost::int32_t>(i));
+    case 2:
+      return TableValue(static_cast<boost::int64_t>(i) << 40);
+    case 3:
+      return TableValue(i % 2 == 0);
+    default:
+      return TableValue(i * 0.5);
+  }
+}
+
+TableValue ShapedValue(shape_t shape, int i) {
+  switch (shape) {
+    case nested: {
+      Table inner;
+      inner["id"] = ScalarValue(i);
+      inner["name"] = TableValue(std::string("nested"));
+      Table outer;
+      outer["inner"] = TableValue(inner);
+      outer["count"] = TableValue(static_cast<boost::int32_t>(i));
+      return TableValue(outer);
+    }
+    case arrays: {
+      Array array;
+      for (int j = 0; j < 5; ++j) {
+        array.push_back(ScalarValue(i + j));
+      }
+      return TableValue(array);
+    }
+    default:
+      return ScalarValue(i);
+  }
+}
+
+Table MakeHeaders(shape_t shape, int keys) {
+  Table table;
+  for (int i = 0; i < keys; ++i) {
+    table[Key(i)] = ShapedValue(shape, i);
+  }
+  return table;
+}
+
+Table MakeHeaders(const benchmark::State &state) {
+  return MakeHeaders(static_cast<shape_t>(state.range(0)),
+                     static_cast<int>(state.range(1)));
+}
+
+BasicMessage::ptr_t MakeMessage(const Table &headers) {
+  BasicMessage::ptr_t message = BasicMessage::Create("a message body");
+  message->ContentType("application/json");
+  message->DeliveryMode(BasicMessage::dm_persistent);
+  message->CorrelationId("3c2d8f4e-0b8a-4d52-9d1f-6f0d3d2e8a11");
+  message->ReplyTo("amq.rabbitmq.reply-to");
+  message->MessageId("5a6b7c8d-1e2f-4a3b-8c9d-0e1f2a3b4c5d");
+  message->Timestamp(1700000000);
+  message->AppId("sac_microbench");
+  message->HeaderTable(headers);
+  return message;
+}
+
+class Pool {
+ public:
+  Pool() { init_amqp_pool(&m_pool, 4096); }
+  ~Pool() { empty_amqp_pool(&m_pool); }
+
+  amqp_pool_t &Get() { return m_pool; }
+
+ private:
+  Pool(const Pool &);
+  Pool &operator=(const Pool &);
+
+  amqp_pool_t m_pool;
+};
+
+void HeaderShapes(benchmark::internal::Benchmark *bench) {
+  bench->ArgNames({"shape", "keys"});
+  for (int shape = flat; shape <= arrays; ++shape) {
+    for (int keys = 1; keys <= 100; keys *= 10) {
+      bench->Args({shape, keys});
+    }
+  }
+}
+
+void BM_CreateAmqpTable(benchmark::State &state) {
+  const Table headers = MakeHeaders(state);
+  Pool pool;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(
+        TableValueImpl::CreateAmqpTable(headers, pool.Get()));
+    recycle_amqp_pool(&pool.Get());
+  }
+}
+BENCHMARK(BM_CreateAmqpTable)->Apply(HeaderShapes);
+
+void BM_CreateTable(benchmark::State &state) {
+  Pool pool;
+  const amqp_table_t amqp_table =
+      TableValueImpl::CreateAmqpTable(MakeHeaders(state), pool.Get());
+  for (auto _ : state) {
+    Table table = TableValueImpl::CreateTable(amqp_table);
+    benchmark::DoNotOptimize(table);
+  }
+}
+BENCHMARK(BM_CreateTable)->Apply(HeaderShapes);
+
+void BM_CopyTable(benchmark::State &state) {
+  Pool pool;
+  const amqp_table_t amqp_table =
+      TableValueImpl::CreateAmqpTable(MakeHeaders(state), pool.Get());
+  for (auto _ : state) {
+    Detail::amqp_pool_ptr_t copy_pool;
+    benchmark::DoNotOptimize(TableValueImpl::CopyTable(amqp_table, copy_pool));
+  }
+}
+BENCHMARK(BM_CopyTable)->Apply(HeaderShapes);
+
+void BM_EncodeTable(benchmark::State &state) {
+  const Table headers = MakeHeaders(state);
+  std::string encoded;
+  for (auto _ : state) {
+    encoded.clear();
+    TableValueImpl::EncodeTable(headers, encoded);
+    benchmark::DoNotOptimize(encoded.data());
+  }
+  state.SetBytesProcessed(state.iterations() * encoded.size());
+}
+BENCHMARK(BM_EncodeTable)->Apply(HeaderShapes);
+
+void BM_DecodeTable(benchmark::State &state) {
+  std::string encoded;
+  TableValueImpl::EncodeTable(MakeHeaders(state), encoded);
+  for (auto _ : state) {
+    std::size_t offset = 0;
+    Table table =
+        TableValueImpl::DecodeTable(encoded.data(), encoded.size(), offset);
+    benchmark::DoNotOptimize(table);
+  }
+  state.SetBytesProcessed(state.iterations() * encoded.size());
+}
+BENCHMARK(BM_DecodeTable)->Apply(HeaderShapes);
+
+void BM_CreateAmqpProperties(benchmark::State &state) {
+  const BasicMessage::ptr_t message = MakeMessage(MakeHeaders(state));
+  Pool pool;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(
+        BasicMessageImpl::CreateAmqpProperties(*message, pool.Get()));
+    recycle_amqp_pool(&pool.Get());
+  }
+}
+BENCHMARK(BM_CreateAmqpProperties)->Apply(HeaderShapes);
+
+// Decodes properties into a reused message, as consuming does.
+void BM_SetProperties(benchmark::State &state) {
+  const BasicMessage::ptr_t source = MakeMessage(MakeHeaders(state));
+  Pool pool;
+  const amqp_basic_properties_t properties =
+      BasicMessageImpl::CreateAmqpProperties(*source, pool.Get());
+  BasicMessage message;
+  for (auto _ : state) {
+    BasicMessageImpl::Reset(message);
+    BasicMessageImpl::SetProperties(message, properties);
+    benchmark::DoNotOptimize(message.HeaderTable());
+  }
+}
+BENCHMARK(BM_SetProperties)->Apply(HeaderShapes);
+
+void BM_TableValueCopy(benchmark::State &state) {
+  const TableValue value(MakeHeaders(state));
+  for (auto _ : state) {
+    TableValue copy(value);
+    benchmark::DoNotOptimize(copy);
+  }
+}
+BENCHMARK(BM_TableValueCopy)->Apply(HeaderShapes);
+
+void BM_TableValueAssign(benchmark::State &state) {
+  const TableValue value(MakeHeaders(state));
+  TableValue target(MakeHeaders(static_cast<shape_t>(state.range(0)), 1));
+  for (auto _ : state) {
+    target = value;
+    benchmark::DoNotOptimize(target);
+  }
+}
+BENCHMARK(BM_TableValueAssign)->Apply(HeaderShapes);
+
+// Builds a message the way a publisher does: properties, headers and body.
+void BM_BasicMessageCreate(benchmark::State &state) {
+  const Table headers = MakeHeaders(state);
+  for (auto _ : state) {
+    BasicMessage::ptr_t message = MakeMessage(headers);
+    benchmark::DoNotOptimize(message);
+  }
+}
+BENCHMARK(BM_BasicMessageCreate)->Apply(HeaderShapes);
+
+}  // namespace
+
+BENCHMARK_MAIN();
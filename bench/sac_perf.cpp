@@ -0,0 +1,565 @@
+/*
+ * ***** BEGIN LICENSE BLOCK *****
+ * Version: MIT
+ *
+ * Copyright (c) 2010-2013 Alan Antonuk
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * ***** END LICENSE BLOCK *****
+ */
+
+// sac_perf: a load generator in the spirit of RabbitMQ's PerfTest, built on
+// this library so the numbers come from the client stack being run.
+//
+// Producers and consumers each run on a thread of their own with their own
+// Channel, and share one queue. Every message carries the steady clock time
+// it was published at in its first 8 bytes, so consumers measure the latency
+// from publish to delivery. Rates and latencies are printed to stderr every
+// --interval seconds, and a summary is written as JSON when the run ends.
+// The end-to-end latencies can also be saved as an HdrHistogram percentile
+// distribution (.hgrm) with --hdr.
+//
+// Channels of this library always use publisher confirms and BasicPublish
+// waits for each one, so producers are confirmed one message at a time; the
+// time from publish to confirm is reported as the confirm latency.
+
+#include <SimpleAmqpClient/SimpleAmqpClient.h>
+#include <errno.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <boost/atomic.hpp>
+#include <boost/chrono/system_clocks.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/function.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "SimpleAmqpClient/ChannelStats.h"
+#include "bench_common.h"
+
+#define BOOST_BIND_GLOBAL_PLACEHOLDERS
+#include <boost/bind.hpp>
+
+using namespace AmqpClient;
+using namespace bench;
+using AmqpClient::Detail::LatencyRecorder;
+
+namespace {
+
+const std::size_t TIMESTAMP_SIZE = 8;
+const int POLL_TIMEOUT_MS = 100;
+
+struct Options {
+  std::string broker;
+  std::string queue;
+  boost::uint64_t producers;
+  boost::uint64_t consumers;
+  boost::uint64_t size;
+  boost::uint64_t rate;
+  boost::uint64_t prefetch;
+  boost::uint64_t multi_ack;
+  bool auto_ack;
+  boost::uint64_t duration;
+  boost::uint64_t interval;
+  std::string output;
+  std::string hdr;
+
+  Options()
+      : producers(1),
+        consumers(1),
+        size(1000),
+        rate(0),
+        prefetch(100),
+        multi_ack(1),
+        auto_ack(false),
+        duration(10),
+        interval(1) {}
+};
+
+/// What producers and consumers share with the thread reporting on them.
+/// The recorders count with atomics, so all threads record into them.
+struct Shared {
+  Shared() : stop(false), published(0), consumed(0) {}
+
+  Channel::OpenOpts open_opts;
+  boost::atomic<bool> stop;
+  boost::atomic<boost::uint64_t> published;
+  boost::atomic<boost::uint64_t> consumed;
+  /// From calling BasicPublish until it returns, once the broker confirmed
+  LatencyRecorder confirm_latency;
+  /// From calling BasicPublish until the message is delivered
+  LatencyRecorder latency;
+  // The same latencies, emptied by each report
+  LatencyRecorder interval_confirm_latency;
+  LatencyRecorder interval_latency;
+
+  void RecordConfirm(boost::int64_t ns) {
+    confirm_latency.Record(boost::chrono::nanoseconds(ns));
+    interval_confirm_latency.Record(boost::chrono::nanoseconds(ns));
+  }
+
+  void RecordLatency(boost::int64_t ns) {
+    latency.Record(boost::chrono::nanoseconds(ns));
+    interval_latency.Record(boost::chrono::nanoseconds(ns));
+  }
+};
+
+/// Tells producers and consumers to stop when leaving a scope
+class StopGuard : boost::noncopyable {
+ public:
+  explicit StopGuard(Shared &shared) : m_shared(shared) {}
+  ~StopGuard() { m_shared.stop.store(true); }
+
+ private:
+  Shared &m_shared;
+};
+
+void Usage(std::ostream &out) {
+  out << "usage: sac_perf [options]\n"
+         "  --broker URI|HOST     broker to use, default $AMQP_BROKER\n"
+         "  --queue NAME          queue to use, default sac-perf-<pid>, "
+         "deleted\n"
+         "                        at the end when sac_perf declared it\n"
+         "  --producers N         producer threads, default 1\n"
+         "  --consumers N         consumer threads, default 1\n"
+         "  --size N              body size in bytes, at least 8, default "
+         "1000\n"
+         "  --rate N              messages per second of each producer, "
+         "default\n"
+         "                        0 for as fast as possible\n"
+         "  --prefetch N          prefetch count of each consumer, 0 for no "
+         "limit,\n"
+         "                        default 100\n"
+         "  --multi-ack N         ack every N messages at once, default 1\n"
+         "  --auto-ack            consume without acknowledgements\n"
+         "  --duration N          seconds to run for, default 10\n"
+         "  --interval N          seconds between reports, default 1\n"
+         "  --output FILE         where to write the JSON, default stdout\n"
+         "  --hdr FILE            write the end-to-end latencies as an "
+         "HdrHistogram\n"
+         "                        percentile distribution in microseconds\n";
+}
+
+Options ParseOptions(int argc, char *argv[]) {
+  Options opts;
+  const char *env_broker = std::getenv("AMQP_BROKER");
+  if (NULL != env_broker) {
+    opts.broker = env_broker;
+  }
+
+  for (int i = 1; i < argc; ++i) {
+    const std::string option = argv[i];
+    if ("--help" == option || "-h" == option) {
+      Usage(std::cout);
+      std::exit(EXIT_SUCCESS);
+    }
+    if ("--auto-ack" == option) {
+      opts.auto_ack = true;
+      continue;
+    }
+    if (i + 1 == argc) {
+      throw std::invalid_argument(option + " expects a value");
+    }
+    const std::string value = argv[++i];
+    if ("--broker" == option) {
+      opts.broker = value;
+    } else if ("--queue" == option) {
+      opts.queue = value;
+    } else if ("--producers" == option) {
+      opts.producers = ParseNumber(option, value);
+    } else if ("--consumers" == option) {
+      opts.consumers = ParseNumber(option, value);
+    } else if ("--size" == option) {
+      opts.size = ParseNumber(option, value);
+      if (opts.size < TIMESTAMP_SIZE) {
+        throw std::invalid_argument("--size must be at least 8 bytes");
+      }
+    } else if ("--rate" == option) {
+      opts.rate = ParseNumber(option, value);
+    } else if ("--prefetch" == option) {
+      opts.prefetch = ParseNumber(option, value);
+      if (opts.prefetch > 0xFFFF) {
+        throw std::invalid_argument("--prefetch must fit in 16 bits");
+      }
+    } else if ("--multi-ack" == option) {
+      opts.multi_ack = std::max<boost::uint64_t>(ParseNumber(option, value), 1);
+    } else if ("--duration" == option) {
+      opts.duration = ParseNumber(option, value);
+    } else if ("--interval" == option) {
+      opts.interval = std::max<boost::uint64_t>(ParseNumber(option, value), 1);
+    } else if ("--output" == option) {
+      opts.output = value;
+    } else if ("--hdr" == option) {
+      opts.hdr = value;
+    } else {
+      throw std::invalid_argument("unknown option " + option);
+    }
+  }
+  if (0 == opts.producers && 0 == opts.consumers) {
+    throw std::invalid_argument("nothing to run without producers or "
+                                "consumers");
+  }
+  return opts;
+}
+
+void SleepUntil(clock_type::time_point deadline) {
+  const clock_type::duration remaining = deadline - clock_type::now();
+  if (remaining <= clock_type::duration::zero()) {
+    return;
+  }
+  const boost::int64_t ns =
+      boost::chrono::duration_cast<boost::chrono::nanoseconds>(remaining)
+          .count();
+  timespec delay;
+  delay.tv_sec = static_cast<time_t>(ns / 1000000000);
+  delay.tv_nsec = static_cast<long>(ns % 1000000000);
+  while (0 != nanosleep(&delay, &delay) && EINTR == errno) {
+  }
+}
+
+boost::int64_t NowNs() {
+  return boost::chrono::duration_cast<boost::chrono::nanoseconds>(
+             clock_type::now().time_since_epoch())
+      .count();
+}
+
+void WriteTimestamp(std::string &body, boost::int64_t ns) {
+  const boost::uint64_t value = static_cast<boost::uint64_t>(ns);
+  for (std::size_t i = 0; i < TIMESTAMP_SIZE; ++i) {
+    body[i] = static_cast<char>(value >> (8 * (TIMESTAMP_SIZE - 1 - i)));
+  }
+}
+
+boost::int64_t ReadTimestamp(const std::string &body) {
+  boost::uint64_t value = 0;
+  for (std::size_t i = 0; i < TIMESTAMP_SIZE; ++i) {
+    value = (value << 8) | static_cast<unsigned char>(body[i]);
+  }
+  return static_cast<boost::int64_t>(value);
+}
+
+/// Runs a function on a thread, keeping what it threw
+class Worker : boost::noncopyable {
+ public:
+  explicit Worker(const boost::function<void()> &work)
+      : m_work(work), m_joined(false) {
+    if (0 != pthread_create(&m_thread, NULL, &Worker::Run, this)) {
+      throw std::runtime_error("could not start a thread");
+    }
+  }
+
+  ~Worker() {
+    if (!m_joined) {
+      pthread_join(m_thread, NULL);
+    }
+  }
+
+  /// Waits for the function to return, throws what it threw
+  void Join() {
+    if (!m_joined) {
+      pthread_join(m_thread, NULL);
+      m_joined = true;
+    }
+    if (!m_error.empty()) {
+      throw std::runtime_error(m_error);
+    }
+  }
+
+ private:
+  static void *Run(void *worker) {
+    Worker *self = static_cast<Worker *>(worker);
+    try {
+      self->m_work();
+    } catch (const std::exception &e) {
+      self->m_error = e.what();
+    }
+    return NULL;
+  }
+
+  boost::function<void()> m_work;
+  pthread_t m_thread;
+  bool m_joined;
+  std::string m_error;
+};
+
+void RunProducer(const Options &opts, Shared &shared) {
+  Channel::ptr_t channel = Channel::Open(shared.open_opts);
+  BasicMessage::ptr_t message =
+      BasicMessage::Create(std::string(opts.size, 'x'));
+  const clock_type::time_point start = clock_type::now();
+
+  for (boost::uint64_t sent = 0; !shared.stop.load(); ++sent) {
+    if (0 != opts.rate) {
+      const double offset_ns = sent * 1e9 / static_cast<double>(opts.rate);
+      SleepUntil(start + boost::chrono::nanoseconds(
+                             static_cast<boost::int64_t>(offset_ns)));
+    }
+    const boost::int64_t now = NowNs();
+    WriteTimestamp(message->Body(), now);
+    channel->BasicPublish("", opts.queue, message);
+    shared.RecordConfirm(NowNs() - now);
+    shared.published.fetch_add(1, boost::memory_order_relaxed);
+  }
+}
+
+void RunConsumer(const Options &opts, Shared &shared) {
+  Channel::ptr_t channel = Channel::Open(shared.open_opts);
+  channel->BasicConsume(opts.queue, "", true, !opts.auto_ack, false,
+                        static_cast<boost::uint16_t>(opts.prefetch));
+
+  boost::uint64_t unacked = 0;
+  Envelope::DeliveryInfo last;
+  while (!shared.stop.load()) {
+    Envelope::ptr_t envelope;
+    if (!channel->BasicConsumeMessage(envelope, POLL_TIMEOUT_MS)) {
+      continue;
+    }
+    const std::string &body = envelope->Message()->Body();
+    if (body.size() >= TIMESTAMP_SIZE) {
+      shared.RecordLatency(NowNs() - ReadTimestamp(body));
+    }
+    shared.consumed.fetch_add(1, boost::memory_order_relaxed);
+
+    if (!opts.auto_ack) {
+      last = envelope->GetDeliveryInfo();
+      if (++unacked == opts.multi_ack) {
+        channel->BasicAck(last, true);
+        unacked = 0;
+      }
+    }
+  }
+  if (0 != unacked) {
+    channel->BasicAck(last, true);
+  }
+}
+
+std::string Micros(boost::uint64_t ns) {
+  std::ostringstream out;
+  out << std::fixed << std::setprecision(1) << ns / 1000.0;
+  return out.str();
+}
+
+std::string Percentiles(const LatencyHistogram &histogram) {
+  std::ostringstream out;
+  out << Micros(histogram.Percentile(50)) << '/'
+      << Micros(histogram.Percentile(75)) << '/'
+      << Micros(histogram.Percentile(95)) << '/'
+      << Micros(histogram.Percentile(99)) << '/'
+      << Micros(histogram.Percentile(99.9));
+  return out.str();
+}
+
+/// Writes histogram in the text format of HdrHistogram's
+/// outputPercentileDistribution, with values in microseconds, so its
+/// plotting tools can read it. Each line is the upper bound of a bucket.
+void WriteHdr(std::ostream &out, const LatencyHistogram &histogram) {
+  const LatencyHistogram::bucket_list_t &buckets = histogram.Buckets();
+  const double total = static_cast<double>(histogram.Count());
+  const double mean = histogram.Mean() / 1000.0;
+  double variance = 0;
+  boost::uint64_t cumulative = 0;
+  char line[128];
+
+  out << "       Value     Percentile TotalCount 1/(1-Percentile)\n\n";
+  for (LatencyHistogram::bucket_list_t::const_iterator it = buckets.begin();
+       it != buckets.end(); ++it) {
+    cumulative += it->count;
+    const double value = it->upper / 1000.0;
+    const double percentile = cumulative / total;
+    const double middle = (it->lower + it->upper) / 2000.0;
+    variance += it->count * (middle - mean) * (middle - mean);
+    if (cumulative < histogram.Count()) {
+      std::snprintf(line, sizeof(line), "%12.3f %2.12f %10llu %14.2f\n",
+                    value, percentile,
+                    static_cast<unsigned long long>(cumulative),
+                    1 / (1 - percentile));
+    } else {
+      std::snprintf(line, sizeof(line), "%12.3f %2.12f %10llu\n", value,
+                    percentile, static_cast<unsigned long long>(cumulative));
+    }
+    out << line;
+  }
+
+  const double max = buckets.empty() ? 0 : buckets.back().upper / 1000.0;
+  std::snprintf(line, sizeof(line),
+                "#[Mean    = %12.3f, StdDeviation   = %12.3f]\n", mean,
+                total > 0 ? std::sqrt(variance / total) : 0);
+  out << line;
+  std::snprintf(line, sizeof(line),
+                "#[Max     = %12.3f, Total count    = %12llu]\n", max,
+                static_cast<unsigned long long>(histogram.Count()));
+  out << line;
+  std::snprintf(line, sizeof(line),
+                "#[Buckets = %12llu, SubBuckets     = %12d]\n",
+                static_cast<unsigned long long>(buckets.size()),
+                1 << LatencyRecorder::SUB_BUCKET_BITS);
+  out << line;
+}
+
+void Run(Options &opts, result_list_t &results) {
+  Shared shared;
+  shared.open_opts = OpenOptsFor(opts.broker);
+
+  Channel::ptr_t channel = Channel::Open(shared.open_opts);
+  const bool declared = opts.queue.empty();
+  if (declared) {
+    opts.queue = "sac-perf-" + boost::lexical_cast<std::string>(getpid());
+    channel->DeclareQueue(opts.queue, false, false, false, false);
+  } else {
+    channel->DeclareQueue(opts.queue, true);
+  }
+
+  std::vector<boost::shared_ptr<Worker> > workers;
+  StopGuard stop_guard(shared);
+  // Consumers start first, so early messages aren't left queued.
+  for (boost::uint64_t i = 0; i < opts.consumers; ++i) {
+    workers.push_back(boost::shared_ptr<Worker>(new Worker(
+        boost::bind(&RunConsumer, boost::cref(opts), boost::ref(shared)))));
+  }
+  for (boost::uint64_t i = 0; i < opts.producers; ++i) {
+    workers.push_back(boost::shared_ptr<Worker>(new Worker(
+        boost::bind(&RunProducer, boost::cref(opts), boost::ref(shared)))));
+  }
+
+  const Stopwatch stopwatch;
+  const clock_type::time_point start = clock_type::now();
+  boost::uint64_t published = 0;
+  boost::uint64_t consumed = 0;
+  for (boost::uint64_t tick = 1; tick * opts.interval <= opts.duration;
+       ++tick) {
+    SleepUntil(start + boost::chrono::seconds(tick * opts.interval));
+    const boost::uint64_t now_published = shared.published.load();
+    const boost::uint64_t now_consumed = shared.consumed.load();
+    const LatencyHistogram confirms =
+        shared.interval_confirm_latency.Snapshot(true);
+    const LatencyHistogram latencies = shared.interval_latency.Snapshot(true);
+
+    std::cerr << "time " << tick * opts.interval << "s, sent "
+              << (now_published - published) / opts.interval
+              << " msg/s, received "
+              << (now_consumed - consumed) / opts.interval << " msg/s";
+    if (0 != latencies.Count()) {
+      std::cerr << ", latency p50/75/95/99/99.9 "
+                << Percentiles(latencies) << " us";
+    }
+    if (0 != confirms.Count()) {
+      std::cerr << ", confirm " << Percentiles(confirms) << " us";
+    }
+    std::cerr << std::endl;
+    published = now_published;
+    consumed = now_consumed;
+  }
+  shared.stop.store(true);
+  const double seconds = stopwatch.Seconds();
+
+  std::string error;
+  for (std::vector<boost::shared_ptr<Worker> >::const_iterator it =
+           workers.begin();
+       it != workers.end(); ++it) {
+    try {
+      (*it)->Join();
+    } catch (const std::exception &e) {
+      error = e.what();
+    }
+  }
+  if (declared) {
+    channel->DeleteQueue(opts.queue);
+  }
+  if (!error.empty()) {
+    throw std::runtime_error(error);
+  }
+
+  Result publish("publish");
+  publish.Param("producers", opts.producers)
+      .Param("size", opts.size)
+      .Param("rate", opts.rate);
+  publish.messages = shared.published.load();
+  publish.bytes = publish.messages * opts.size;
+  publish.seconds = seconds;
+  publish.Latency("publish_confirm", shared.confirm_latency.Snapshot(false));
+  results.push_back(publish);
+  Report(publish);
+
+  Result consume("consume");
+  consume.Param("consumers", opts.consumers)
+      .Param("prefetch", opts.prefetch)
+      .Param("multi_ack", opts.auto_ack ? 0 : opts.multi_ack);
+  consume.messages = shared.consumed.load();
+  consume.bytes = consume.messages * opts.size;
+  consume.seconds = seconds;
+  consume.Latency("end_to_end", shared.latency.Snapshot(false));
+  results.push_back(consume);
+  Report(consume);
+}
+
+}  // namespace
+
+int main(int argc, char *argv[]) {
+  Options opts;
+  try {
+    opts = ParseOptions(argc, argv);
+  } catch (const std::exception &e) {
+    std::cerr << "sac_perf: " << e.what() << "\n";
+    Usage(std::cerr);
+    return EXIT_FAILURE;
+  }
+
+  result_list_t results;
+  try {
+    Run(opts, results);
+  } catch (const std::exception &e) {
+    std::cerr << "sac_perf: " << e.what() << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  if (!opts.hdr.empty()) {
+    std::ofstream hdr(opts.hdr.c_str());
+    WriteHdr(hdr, results.back().latency);
+    if (!hdr) {
+      std::cerr << "sac_perf: could not write " << opts.hdr << std::endl;
+      return EXIT_FAILURE;
+    }
+  }
+
+  const std::string broker = OpenOptsFor(opts.broker).host;
+  if (opts.output.empty()) {
+    WriteJson(std::cout, "sac_perf", broker, results);
+  } else {
+    std::ofstream out(opts.output.c_str());
+    WriteJson(out, "sac_perf", broker, results);
+    if (!out) {
+      std::cerr << "sac_perf: could not write " << opts.output << std::endl;
+      return EXIT_FAILURE;
+    }
+  }
+  return EXIT_SUCCESS;
+}
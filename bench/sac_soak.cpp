@@ -0,0 +1,503 @@
+/*
+ * ***** BEGIN LICENSE BLOCK *****
+ * Version: MIT
+ *
+ * Copyright (c) 2010-2013 Alan Antonuk
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * ***** END LICENSE BLOCK *****
+ */
+
+// sac_soak: pushes a long run of messages through publish, consume and ack
+// cycles and samples the memory of the process and of the Channel, to catch
+// memory that grows with the number of messages rather than with the load.
+//
+// Messages are published in batches spread over --consumers queues, each
+// with its own consumer, and consumed by waiting on all of the consumers at
+// once. Between batches consumers are cancelled and consumed again and
+// channel errors are provoked, so the paths that release a channel's
+// buffers run as they would in a long-lived consumer. Every --sample
+// messages the RSS of the process is sampled with the Channel's queue
+// depths, read-ahead bytes and pool bytes, and the samples are written as
+// CSV. The run fails when the RSS or the pool bytes grew by more than
+// allowed after the warmup.
+//
+// The pools of rabbitmq-c are not visible to the Channel, growth in them
+// only shows in the RSS.
+
+#include <SimpleAmqpClient/SimpleAmqpClient.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <boost/cstdint.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "bench_common.h"
+#include "fake_broker.h"
+
+using namespace AmqpClient;
+using namespace bench;
+
+namespace {
+
+struct Options {
+  std::string broker;
+  bool fake_broker;
+  boost::uint64_t messages;
+  boost::uint64_t batch;
+  boost::uint64_t consumers;
+  boost::uint64_t size;
+  boost::uint64_t prefetch;
+  boost::uint64_t cancel_every;
+  boost::uint64_t error_every;
+  boost::uint64_t sample;
+  boost::uint64_t warmup;
+  boost::uint64_t max_growth;
+  boost::uint64_t max_pool_growth;
+  std::string output;
+
+  Options()
+      : fake_broker(false),
+        messages(20000000),
+        batch(1000),
+        consumers(4),
+        size(1000),
+        prefetch(100),
+        cancel_every(10),
+        error_every(10),
+        sample(100000),
+        warmup(0),
+        max_growth(64),
+        max_pool_growth(256) {}
+};
+
+/// The memory of the process and the Channel after some messages
+struct Sample {
+  boost::uint64_t messages;
+  double seconds;
+  std::size_t rss;
+  Channel::Stats stats;
+  std::size_t read_ahead_bytes;
+  std::size_t message_pool_size;
+  boost::uint64_t cancels;
+  boost::uint64_t channel_errors;
+};
+
+typedef std::vector<Sample> sample_list_t;
+
+void Usage(std::ostream &out) {
+  out << "usage: sac_soak [options]\n"
+         "  --broker URI|HOST     broker to use, default $AMQP_BROKER\n"
+         "  --fake-broker         run against a broker in this process, "
+         "whose\n"
+         "                        memory is then part of the RSS\n"
+         "  --messages N          messages to push through, default "
+         "20000000\n"
+         "  --batch N             messages published before consuming "
+         "them,\n"
+         "                        default 1000\n"
+         "  --consumers N         queues and consumers, default 4\n"
+         "  --size N              body size in bytes, default 1000\n"
+         "  --prefetch N          prefetch count of each consumer, default "
+         "100\n"
+         "  --cancel-every N      cancel and consume again one consumer "
+         "every N\n"
+         "                        batches, 0 for never, default 10\n"
+         "  --error-every N       provoke a channel error every N batches, 0 "
+         "for\n"
+         "                        never, default 10\n"
+         "  --sample N            messages between samples, default 100000\n"
+         "  --warmup N            messages before growth is measured, "
+         "default a\n"
+         "                        tenth of --messages\n"
+         "  --max-growth N        MiB the RSS may grow after the warmup, "
+         "default 64\n"
+         "  --max-pool-growth N   KiB the pool bytes may grow after the "
+         "warmup,\n"
+         "                        default 256\n"
+         "  --output FILE         where to write the CSV, default stdout\n";
+}
+
+Options ParseOptions(int argc, char *argv[]) {
+  Options opts;
+  const char *env_broker = std::getenv("AMQP_BROKER");
+  if (NULL != env_broker) {
+    opts.broker = env_broker;
+  }
+
+  bool has_warmup = false;
+  for (int i = 1; i < argc; ++i) {
+    const std::string option = argv[i];
+    if ("--help" == option || "-h" == option) {
+      Usage(std::cout);
+      std::exit(EXIT_SUCCESS);
+    }
+    if ("--fake-broker" == option) {
+      opts.fake_broker = true;
+      continue;
+    }
+    if (i + 1 == argc) {
+      throw std::invalid_argument(option + " expects a value");
+    }
+    const std::string value = argv[++i];
+    if ("--broker" == option) {
+      opts.broker = value;
+    } else if ("--messages" == option) {
+      opts.messages = ParseNumber(option, value);
+    } else if ("--batch" == option) {
+      opts.batch = std::max<boost::uint64_t>(ParseNumber(option, value), 1);
+    } else if ("--consumers" == option) {
+      opts.consumers =
+          std::max<boost::uint64_t>(ParseNumber(option, value), 1);
+    } else if ("--size" == option) {
+      opts.size = ParseNumber(option, value);
+    } else if ("--prefetch" == option) {
+      opts.prefetch = ParseNumber(option, value);
+      if (opts.prefetch > 0xFFFF) {
+        throw std::invalid_argument("--prefetch must fit in 16 bits");
+      }
+    } else if ("--cancel-every" == option) {
+      opts.cancel_every = ParseNumber(option, value);
+    } else if ("--error-every" == option) {
+      opts.error_every = ParseNumber(option, value);
+    } else if ("--sample" == option) {
+      opts.sample = std::max<boost::uint64_t>(ParseNumber(option, value), 1);
+    } else if ("--warmup" == option) {
+      opts.warmup = ParseNumber(option, value);
+      has_warmup = true;
+    } else if ("--max-growth" == option) {
+      opts.max_growth = ParseNumber(option, value);
+    } else if ("--max-pool-growth" == option) {
+      opts.max_pool_growth = ParseNumber(option, value);
+    } else if ("--output" == option) {
+      opts.output = value;
+    } else {
+      throw std::invalid_argument("unknown option " + option);
+    }
+  }
+  if (!has_warmup) {
+    opts.warmup = opts.messages / 10;
+  }
+  return opts;
+}
+
+/// The resident set size of the process in bytes. Off Linux this is the
+/// peak resident set size, which still shows growth but never a decrease.
+std::size_t ReadRss() {
+  std::FILE *statm = std::fopen("/proc/self/statm", "r");
+  if (NULL != statm) {
+    unsigned long size = 0;
+    unsigned long resident = 0;
+    const int read = std::fscanf(statm, "%lu %lu", &size, &resident);
+    std::fclose(statm);
+    if (2 == read) {
+      return static_cast<std::size_t>(resident) * sysconf(_SC_PAGESIZE);
+    }
+  }
+  struct rusage usage;
+  if (0 != getrusage(RUSAGE_SELF, &usage)) {
+    return 0;
+  }
+#ifdef __APPLE__
+  return static_cast<std::size_t>(usage.ru_maxrss);
+#else
+  return static_cast<std::size_t>(usage.ru_maxrss) * 1024;
+#endif
+}
+
+/// Runs the publish, consume and ack cycles on one Channel
+class Soak : boost::noncopyable {
+ public:
+  Soak(const Options &opts, Channel::ptr_t channel)
+      : m_opts(opts),
+        m_channel(channel),
+        m_message(BasicMessage::Create(std::string(opts.size, 'x'))),
+        m_missing("sac-soak-missing-" +
+                  boost::lexical_cast<std::string>(getpid())),
+        m_messages(0),
+        m_cancels(0),
+        m_channel_errors(0) {
+    for (boost::uint64_t i = 0; i < opts.consumers; ++i) {
+      m_queues.push_back(m_channel->DeclareQueue(""));
+      m_tags.push_back(Consume(m_queues.back()));
+    }
+  }
+
+  ~Soak() {
+    try {
+      for (std::vector<std::string>::const_iterator it = m_tags.begin();
+           it != m_tags.end(); ++it) {
+        m_channel->BasicCancel(*it);
+      }
+    } catch (const std::exception &) {
+    }
+  }
+
+  /// Publishes a batch of messages, then consumes and acks them
+  void Round(boost::uint64_t round) {
+    for (boost::uint64_t i = 0; i < m_opts.batch; ++i) {
+      m_channel->BasicPublish("", m_queues[i % m_queues.size()], m_message);
+    }
+    for (boost::uint64_t i = 0; i < m_opts.batch; ++i) {
+      Envelope::ptr_t envelope;
+      // Alternate between waiting on the consumers by their tags and on
+      // any consumer of the Channel
+      const bool consumed =
+          0 == round % 2
+              ? m_channel->BasicConsumeMessage(m_tags, envelope,
+                                               CONSUME_TIMEOUT_MS)
+              : m_channel->BasicConsumeMessage(envelope, CONSUME_TIMEOUT_MS);
+      if (!consumed) {
+        throw std::runtime_error("timed out waiting for a message");
+      }
+      m_channel->BasicAck(envelope);
+    }
+    m_messages += m_opts.batch;
+
+    // Every message of the batch has been acked, so no delivery is lost to
+    // the cancelled consumer
+    if (0 != m_opts.cancel_every && 0 == (round + 1) % m_opts.cancel_every) {
+      const std::size_t consumer = m_cancels % m_tags.size();
+      m_channel->BasicCancel(m_tags[consumer]);
+      m_tags[consumer] = Consume(m_queues[consumer]);
+      ++m_cancels;
+    }
+    if (0 != m_opts.error_every && 0 == (round + 1) % m_opts.error_every) {
+      ProvokeChannelError();
+    }
+  }
+
+  boost::uint64_t Messages() const { return m_messages; }
+
+  Sample TakeSample(double seconds) const {
+    Sample sample;
+    sample.messages = m_messages;
+    sample.seconds = seconds;
+    sample.rss = ReadRss();
+    sample.stats = m_channel->GetStats();
+    sample.read_ahead_bytes = m_channel->GetReadAheadBytes();
+    sample.message_pool_size = m_channel->GetMessagePoolSize();
+    sample.cancels = m_cancels;
+    sample.channel_errors = m_channel_errors;
+    return sample;
+  }
+
+ private:
+  std::string Consume(const std::string &queue) {
+    return m_channel->BasicConsume(queue, "", true, false, true,
+                                   static_cast<boost::uint16_t>(
+                                       m_opts.prefetch));
+  }
+
+  // Alternates between a passive declare of a missing queue and a publish
+  // to a missing exchange, either of which the broker closes the channel
+  // for
+  void ProvokeChannelError() {
+    try {
+      if (0 == m_channel_errors % 2) {
+        m_channel->DeclareQueue(m_missing, true);
+      } else {
+        m_channel->BasicPublish(m_missing, "", m_message);
+      }
+    } catch (const ChannelException &) {
+      ++m_channel_errors;
+      return;
+    }
+    throw std::runtime_error("expected a channel error for " + m_missing);
+  }
+
+  const Options &m_opts;
+  Channel::ptr_t m_channel;
+  BasicMessage::ptr_t m_message;
+  const std::string m_missing;
+  std::vector<std::string> m_queues;
+  std::vector<std::string> m_tags;
+  boost::uint64_t m_messages;
+  boost::uint64_t m_cancels;
+  boost::uint64_t m_channel_errors;
+};
+
+std::string MiB(double bytes) {
+  std::ostringstream out;
+  out << std::fixed << std::setprecision(1) << bytes / (1024 * 1024) << "MiB";
+  return out.str();
+}
+
+void ReportSample(const Sample &sample) {
+  std::cerr << sample.messages << " messages in " << std::fixed
+            << std::setprecision(1) << sample.seconds
+            << "s: rss=" << MiB(sample.rss)
+            << " pool_bytes=" << sample.stats.pool_bytes
+            << " read_ahead_bytes=" << sample.read_ahead_bytes
+            << " frame_queue=" << sample.stats.frame_queue_depth << '/'
+            << sample.stats.frame_queue_high_water
+            << " delivered_queue=" << sample.stats.delivered_queue_depth << '/'
+            << sample.stats.delivered_queue_high_water
+            << " open_channels=" << sample.stats.open_channels << std::endl;
+}
+
+void WriteCsv(std::ostream &out, const sample_list_t &samples) {
+  out << "messages,seconds,rss_bytes,pool_bytes,pool_bytes_high_water,"
+         "read_ahead_bytes,frame_queue_depth,frame_queue_high_water,"
+         "delivered_queue_depth,delivered_queue_high_water,"
+         "message_pool_size,open_channels,cancels,channel_errors\n";
+  out << std::fixed << std::setprecision(3);
+  for (sample_list_t::const_iterator it = samples.begin(); it != samples.end();
+       ++it) {
+    out << it->messages << ',' << it->seconds << ',' << it->rss << ','
+        << it->stats.pool_bytes << ',' << it->stats.pool_bytes_high_water
+        << ',' << it->read_ahead_bytes << ',' << it->stats.frame_queue_depth
+        << ',' << it->stats.frame_queue_high_water << ','
+        << it->stats.delivered_queue_depth << ','
+        << it->stats.delivered_queue_high_water << ','
+        << it->message_pool_size << ',' << it->stats.open_channels << ','
+        << it->cancels << ',' << it->channel_errors << '\n';
+  }
+}
+
+void Run(const Options &opts, sample_list_t &samples) {
+  boost::scoped_ptr<FakeBroker> fake_broker;
+  Channel::OpenOpts open_opts;
+  if (opts.fake_broker) {
+    fake_broker.reset(new FakeBroker);
+    open_opts = fake_broker->GetOpenOpts();
+  } else {
+    open_opts = OpenOptsFor(opts.broker);
+  }
+
+  Channel::ptr_t channel = Channel::Open(open_opts);
+  Soak soak(opts, channel);
+  Stopwatch stopwatch;
+  samples.push_back(soak.TakeSample(0));
+  ReportSample(samples.back());
+
+  boost::uint64_t next_sample = opts.sample;
+  for (boost::uint64_t round = 0; soak.Messages() < opts.messages; ++round) {
+    soak.Round(round);
+    if (soak.Messages() >= next_sample || soak.Messages() >= opts.messages) {
+      samples.push_back(soak.TakeSample(stopwatch.Seconds()));
+      ReportSample(samples.back());
+      while (next_sample <= soak.Messages()) {
+        next_sample += opts.sample;
+      }
+    }
+  }
+}
+
+/// Bytes per million messages of the least squares fit of the RSS samples
+double RssSlope(sample_list_t::const_iterator begin,
+                sample_list_t::const_iterator end) {
+  double n = 0, sx = 0, sy = 0, sxx = 0, sxy = 0;
+  for (sample_list_t::const_iterator it = begin; it != end; ++it) {
+    const double x = it->messages / 1e6;
+    const double y = static_cast<double>(it->rss);
+    n += 1;
+    sx += x;
+    sy += y;
+    sxx += x * x;
+    sxy += x * y;
+  }
+  const double denominator = n * sxx - sx * sx;
+  return denominator > 0 ? (n * sxy - sx * sy) / denominator : 0;
+}
+
+/// Compares the last sample with the first one after the warmup, returns
+/// whether the growth is within the limits
+bool CheckGrowth(const Options &opts, const sample_list_t &samples) {
+  sample_list_t::const_iterator baseline = samples.begin();
+  while (baseline + 1 != samples.end() && baseline->messages < opts.warmup) {
+    ++baseline;
+  }
+  const Sample &last = samples.back();
+  if (baseline->messages == last.messages) {
+    std::cerr << "sac_soak: no samples after the warmup, growth not checked"
+              << std::endl;
+    return true;
+  }
+
+  const double rss_growth =
+      static_cast<double>(last.rss) - static_cast<double>(baseline->rss);
+  const double pool_growth =
+      static_cast<double>(last.stats.pool_bytes_high_water) -
+      static_cast<double>(baseline->stats.pool_bytes_high_water);
+  std::cerr << "after " << baseline->messages << " messages: rss grew by "
+            << MiB(rss_growth) << " (" << MiB(RssSlope(baseline, samples.end()))
+            << " per million messages), pool bytes by " << std::fixed
+            << std::setprecision(0) << pool_growth << std::endl;
+
+  bool ok = true;
+  if (rss_growth > opts.max_growth * 1024.0 * 1024.0) {
+    std::cerr << "sac_soak: rss grew by more than " << opts.max_growth
+              << "MiB" << std::endl;
+    ok = false;
+  }
+  if (pool_growth > opts.max_pool_growth * 1024.0) {
+    std::cerr << "sac_soak: pool bytes grew by more than "
+              << opts.max_pool_growth << "KiB" << std::endl;
+    ok = false;
+  }
+  return ok;
+}
+
+}  // namespace
+
+int main(int argc, char *argv[]) {
+  Options opts;
+  try {
+    opts = ParseOptions(argc, argv);
+  } catch (const std::exception &e) {
+    std::cerr << "sac_soak: " << e.what() << "\n";
+    Usage(std::cerr);
+    return EXIT_FAILURE;
+  }
+
+  sample_list_t samples;
+  try {
+    Run(opts, samples);
+  } catch (const std::exception &e) {
+    std::cerr << "sac_soak: " << e.what() << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  if (opts.output.empty()) {
+    WriteCsv(std::cout, samples);
+  } else {
+    std::ofstream out(opts.output.c_str());
+    WriteCsv(out, samples);
+    if (!out) {
+      std::cerr << "sac_soak: could not write " << opts.output << std::endl;
+      return EXIT_FAILURE;
+    }
+  }
+  return CheckGrowth(opts, samples) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,624 @@
+/*
+ * ***** BEGIN LICENSE BLOCK *****
+ * Version: MIT
+ *
+ * Copyright (c) 2010-2013 Alan Antonuk
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * ***** END LICENSE BLOCK *****
+ */
+
+// sac_wire: records what a broker sends to a consumer and replays it into
+// a Channel, to benchmark the consume path on real traffic.
+//
+// `sac_wire record` consumes from the given queues through a proxy on the
+// loopback interface and saves every byte the broker sends. Running several
+// consumers on one connection captures the interleaving of deliveries on
+// different channels, along with the real sizes of bodies and headers.
+//
+// `sac_wire replay` runs the same consumer against a loopback server that
+// writes the capture back as fast as the socket takes it, whatever the
+// client sends. Frame reading, demultiplexing and the assembly of messages
+// are then timed with no broker involved. The consumer makes the same
+// requests in the same order as when recording, so the replies it finds in
+// the capture are the ones it expects.
+//
+// A capture is one line of text describing the consumer, e.g.
+//   sac_wire 1 consumers=2 prefetch=100 messages=10000 frame_max=131072
+// followed by the bytes read from the broker, as they were received.
+
+#include <SimpleAmqpClient/SimpleAmqpClient.h>
+#include <errno.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#define BOOST_BIND_GLOBAL_PLACEHOLDERS
+#include <boost/bind.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/function.hpp>
+#include <boost/noncopyable.hpp>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "bench_common.h"
+
+using namespace AmqpClient;
+using namespace bench;
+
+namespace {
+
+const char CAPTURE_MAGIC[] = "sac_wire";
+const int CAPTURE_VERSION = 1;
+
+struct Options {
+  std::string mode;
+  std::string broker;
+  std::vector<std::string> queues;
+  boost::uint64_t messages;
+  boost::uint64_t prefetch;
+  bool requeue;
+  std::string capture;
+  boost::uint64_t repeat;
+  std::string output;
+
+  Options()
+      : messages(10000),
+        prefetch(100),
+        requeue(false),
+        capture("sac_wire.capture"),
+        repeat(5) {}
+};
+
+/// The consumer a capture was recorded with
+struct CaptureInfo {
+  boost::uint64_t consumers;
+  boost::uint64_t prefetch;
+  boost::uint64_t messages;
+  boost::uint64_t frame_max;
+
+  CaptureInfo() : consumers(0), prefetch(0), messages(0), frame_max(0) {}
+};
+
+void Usage(std::ostream &out) {
+  out << "usage: sac_wire record --queues Q,... [options]\n"
+         "       sac_wire replay [options]\n"
+         "  --broker URI|HOST     broker to record from, default "
+         "$AMQP_BROKER\n"
+         "  --queues Q,...        queues to record, one consumer each\n"
+         "  --messages N          messages to record, default 10000\n"
+         "  --prefetch N          prefetch count of each consumer, default "
+         "100\n"
+         "  --requeue             reject recorded messages back onto their "
+         "queue\n"
+         "                        instead of acking them\n"
+         "  --capture FILE        capture to write or replay, default "
+         "sac_wire.capture\n"
+         "  --repeat N            times to replay the capture, default 5\n"
+         "  --output FILE         where to write the replay JSON, default "
+         "stdout\n";
+}
+
+Options ParseOptions(int argc, char *argv[]) {
+  Options opts;
+  const char *env_broker = std::getenv("AMQP_BROKER");
+  if (NULL != env_broker) {
+    opts.broker = env_broker;
+  }
+
+  for (int i = 1; i < argc; ++i) {
+    const std::string option = argv[i];
+    if ("--help" == option || "-h" == option) {
+      Usage(std::cout);
+      std::exit(EXIT_SUCCESS);
+    }
+    if (1 == i && ("record" == option || "replay" == option)) {
+      opts.mode = option;
+      continue;
+    }
+    if ("--requeue" == option) {
+      opts.requeue = true;
+      continue;
+    }
+    if (i + 1 == argc) {
+      throw std::invalid_argument(option + " expects a value");
+    }
+    const std::string value = argv[++i];
+    if ("--broker" == option) {
+      opts.broker = value;
+    } else if ("--queues" == option) {
+      opts.queues = Split(value);
+    } else if ("--messages" == option) {
+      opts.messages = ParseNumber(option, value);
+    } else if ("--prefetch" == option) {
+      opts.prefetch = ParseNumber(option, value);
+      if (opts.prefetch > 0xFFFF) {
+        throw std::invalid_argument("--prefetch must fit in 16 bits");
+      }
+    } else if ("--capture" == option) {
+      opts.capture = value;
+    } else if ("--repeat" == option) {
+      opts.repeat = std::max<boost::uint64_t>(ParseNumber(option, value), 1);
+    } else if ("--output" == option) {
+      opts.output = value;
+    } else {
+      throw std::invalid_argument("unknown option " + option);
+    }
+  }
+
+  if (opts.mode.empty()) {
+    throw std::invalid_argument("expected record or replay");
+  }
+  if ("record" == opts.mode && opts.queues.empty()) {
+    throw std::invalid_argument("record needs --queues");
+  }
+  return opts;
+}
+
+std::string SystemError(const std::string &what) {
+  return what + ": " + std::strerror(errno);
+}
+
+void WaitForEvents(std::vector<pollfd> &fds) {
+  while (poll(&fds[0], fds.size(), -1) < 0) {
+    if (EINTR != errno) {
+      throw std::runtime_error(SystemError("poll"));
+    }
+  }
+}
+
+void SendAll(int fd, const char *data, std::size_t size) {
+  while (size > 0) {
+    const ssize_t sent = send(fd, data, size, 0);
+    if (sent < 0) {
+      if (EINTR == errno) {
+        continue;
+      }
+      throw std::runtime_error(SystemError("send"));
+    }
+    data += sent;
+    size -= static_cast<std::size_t>(sent);
+  }
+}
+
+int ConnectTo(const std::string &host, int port) {
+  addrinfo hints;
+  std::memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  addrinfo *addresses = NULL;
+  const int ret = getaddrinfo(host.c_str(),
+                              boost::lexical_cast<std::string>(port).c_str(),
+                              &hints, &addresses);
+  if (0 != ret) {
+    throw std::runtime_error("could not resolve " + host + ": " +
+                             gai_strerror(ret));
+  }
+
+  int fd = -1;
+  for (addrinfo *it = addresses; it != NULL && fd < 0; it = it->ai_next) {
+    fd = socket(it->ai_family, it->ai_socktype, it->ai_protocol);
+    if (fd >= 0 && 0 != connect(fd, it->ai_addr, it->ai_addrlen)) {
+      close(fd);
+      fd = -1;
+    }
+  }
+  freeaddrinfo(addresses);
+  if (fd < 0) {
+    throw std::runtime_error(SystemError("could not connect to " + host));
+  }
+  return fd;
+}
+
+/**
+ * Serves one connection accepted on the loopback interface from a thread
+ *
+ * The serve function is given the connection and a descriptor that becomes
+ * readable when the server is being destroyed, and returns once it is done
+ * with the connection.
+ */
+class LoopbackServer : boost::noncopyable {
+ public:
+  typedef boost::function<void(int connection, int stop)> serve_t;
+
+  explicit LoopbackServer(const serve_t &serve)
+      : m_serve(serve), m_listen_fd(-1), m_port(0), m_joined(false) {
+    m_stop_fds[0] = m_stop_fds[1] = -1;
+    sockaddr_in addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t addr_len = sizeof(addr);
+    m_listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (m_listen_fd < 0 ||
+        0 != bind(m_listen_fd, reinterpret_cast<sockaddr *>(&addr),
+                  sizeof(addr)) ||
+        0 != listen(m_listen_fd, 1) ||
+        0 != getsockname(m_listen_fd, reinterpret_cast<sockaddr *>(&addr),
+                         &addr_len) ||
+        0 != pipe(m_stop_fds)) {
+      const std::string error = SystemError("could not listen");
+      Close();
+      throw std::runtime_error(error);
+    }
+    m_port = ntohs(addr.sin_port);
+    if (0 != pthread_create(&m_thread, NULL, &LoopbackServer::Run, this)) {
+      Close();
+      throw std::runtime_error("could not start the server thread");
+    }
+  }
+
+  ~LoopbackServer() {
+    if (!m_joined) {
+      const char stop = 0;
+      while (write(m_stop_fds[1], &stop, 1) < 0 && EINTR == errno) {
+      }
+      pthread_join(m_thread, NULL);
+    }
+    Close();
+  }
+
+  int Port() const { return m_port; }
+
+  /// Waits for the connection to be served, throws what serving it threw
+  void Join() {
+    if (!m_joined) {
+      pthread_join(m_thread, NULL);
+      m_joined = true;
+    }
+    if (!m_error.empty()) {
+      throw std::runtime_error(m_error);
+    }
+  }
+
+ private:
+  static void *Run(void *server) {
+    static_cast<LoopbackServer *>(server)->Serve();
+    return NULL;
+  }
+
+  void Serve() {
+    try {
+      std::vector<pollfd> fds(2);
+      fds[0].fd = m_listen_fd;
+      fds[0].events = POLLIN;
+      fds[1].fd = m_stop_fds[0];
+      fds[1].events = POLLIN;
+      WaitForEvents(fds);
+      if (0 != fds[1].revents) {
+        return;
+      }
+      const int connection = accept(m_listen_fd, NULL, NULL);
+      if (connection < 0) {
+        throw std::runtime_error(SystemError("accept"));
+      }
+      try {
+        m_serve(connection, m_stop_fds[0]);
+      } catch (...) {
+        close(connection);
+        throw;
+      }
+      close(connection);
+    } catch (const std::exception &e) {
+      m_error = e.what();
+    }
+  }
+
+  void Close() {
+    if (m_listen_fd >= 0) {
+      close(m_listen_fd);
+    }
+    if (m_stop_fds[0] >= 0) {
+      close(m_stop_fds[0]);
+      close(m_stop_fds[1]);
+    }
+  }
+
+  serve_t m_serve;
+  int m_listen_fd;
+  int m_stop_fds[2];
+  int m_port;
+  pthread_t m_thread;
+  bool m_joined;
+  std::string m_error;
+};
+
+// Forwards bytes both ways between the client and the broker until either
+// closes the connection, saving what the broker sends.
+void Proxy(int broker, std::ostream &capture, boost::uint64_t &captured,
+           int client, int stop) {
+  std::vector<pollfd> fds(3);
+  fds[0].fd = client;
+  fds[1].fd = broker;
+  fds[2].fd = stop;
+  for (std::size_t i = 0; i < fds.size(); ++i) {
+    fds[i].events = POLLIN;
+  }
+
+  char buffer[65536];
+  for (;;) {
+    WaitForEvents(fds);
+    if (0 != fds[2].revents) {
+      return;
+    }
+    for (std::size_t i = 0; i < 2; ++i) {
+      if (0 == fds[i].revents) {
+        continue;
+      }
+      const ssize_t received = recv(fds[i].fd, buffer, sizeof(buffer), 0);
+      if (received <= 0) {
+        return;
+      }
+      const std::size_t size = static_cast<std::size_t>(received);
+      if (broker == fds[i].fd) {
+        capture.write(buffer, size);
+        captured += size;
+      }
+      SendAll(fds[1 - i].fd, buffer, size);
+    }
+  }
+}
+
+// Writes the capture to the client as fast as it reads it, discarding what
+// the client sends, then waits for the client to close the connection.
+void Replay(const std::string &bytes, int client, int stop) {
+  std::vector<pollfd> fds(2);
+  fds[0].fd = client;
+  fds[1].fd = stop;
+  fds[1].events = POLLIN;
+
+  char buffer[65536];
+  std::size_t offset = 0;
+  for (;;) {
+    fds[0].events = offset < bytes.size() ? POLLIN | POLLOUT : POLLIN;
+    WaitForEvents(fds);
+    if (0 != fds[1].revents) {
+      return;
+    }
+    if (0 != (fds[0].revents & (POLLIN | POLLHUP | POLLERR))) {
+      const ssize_t received = recv(client, buffer, sizeof(buffer), 0);
+      if (received <= 0) {
+        return;
+      }
+    }
+    if (0 != (fds[0].revents & POLLOUT)) {
+      const ssize_t sent =
+          send(client, bytes.data() + offset, bytes.size() - offset, 0);
+      if (sent < 0 && EINTR != errno) {
+        throw std::runtime_error(SystemError("send"));
+      }
+      if (sent > 0) {
+        offset += static_cast<std::size_t>(sent);
+      }
+      if (offset == bytes.size()) {
+        // The client sees the end of the capture as the broker going away.
+        shutdown(client, SHUT_WR);
+      }
+    }
+  }
+}
+
+void WriteCaptureInfo(std::ostream &out, const CaptureInfo &info) {
+  out << CAPTURE_MAGIC << ' ' << CAPTURE_VERSION
+      << " consumers=" << info.consumers << " prefetch=" << info.prefetch
+      << " messages=" << info.messages << " frame_max=" << info.frame_max
+      << '\n';
+}
+
+CaptureInfo ReadCapture(const std::string &path, std::string &bytes) {
+  std::ifstream in(path.c_str(), std::ios::in | std::ios::binary);
+  if (!in) {
+    throw std::runtime_error("could not open " + path);
+  }
+  std::string line;
+  std::getline(in, line);
+  std::istringstream header(line);
+  std::string magic;
+  int version = 0;
+  header >> magic >> version;
+  if (CAPTURE_MAGIC != magic || CAPTURE_VERSION != version) {
+    throw std::runtime_error(path + " is not a sac_wire capture");
+  }
+
+  CaptureInfo info;
+  std::string field;
+  while (header >> field) {
+    const std::string::size_type equals = field.find('=');
+    const std::string key = field.substr(0, equals);
+    const boost::uint64_t value =
+        ParseNumber(key, std::string::npos == equals
+                             ? std::string()
+                             : field.substr(equals + 1));
+    if ("consumers" == key) {
+      info.consumers = value;
+    } else if ("prefetch" == key) {
+      info.prefetch = value;
+    } else if ("messages" == key) {
+      info.messages = value;
+    } else if ("frame_max" == key) {
+      info.frame_max = value;
+    }
+  }
+  if (0 == info.consumers || 0 == info.frame_max) {
+    throw std::runtime_error(path + " has an incomplete header");
+  }
+
+  bytes.assign(std::istreambuf_iterator<char>(in),
+               std::istreambuf_iterator<char>());
+  return info;
+}
+
+// The consumer that is recorded and replayed: one consumer per queue on a
+// single Channel, each message settled as it is read.
+void RunConsumer(Channel &channel, const std::vector<std::string> &queues,
+                 boost::uint64_t prefetch, boost::uint64_t messages,
+                 bool requeue, Result &result) {
+  for (std::vector<std::string>::const_iterator queue = queues.begin();
+       queue != queues.end(); ++queue) {
+    channel.BasicConsume(*queue, "", true, false, false,
+                         static_cast<boost::uint16_t>(prefetch));
+  }
+
+  boost::uint64_t bytes = 0;
+  channel.GetLatencyStats(true);
+  Stopwatch stopwatch;
+  for (boost::uint64_t i = 0; i < messages; ++i) {
+    Envelope::ptr_t envelope = Consume(channel);
+    bytes += envelope->Message()->Body().size();
+    if (requeue) {
+      channel.BasicReject(envelope, true);
+    } else {
+      channel.BasicAck(envelope);
+    }
+  }
+  result.seconds = stopwatch.Seconds();
+  result.messages = messages;
+  result.bytes = bytes;
+  result.Latency("frame_wait", channel.GetLatencyStats(true).frame_wait);
+}
+
+void Record(const Options &opts) {
+  Channel::OpenOpts open_opts = OpenOptsFor(opts.broker);
+  if (open_opts.tls_params) {
+    throw std::invalid_argument("record can't capture a TLS connection");
+  }
+
+  std::ofstream capture(opts.capture.c_str(),
+                        std::ios::out | std::ios::binary | std::ios::trunc);
+  CaptureInfo info;
+  info.consumers = opts.queues.size();
+  info.prefetch = opts.prefetch;
+  info.messages = opts.messages;
+  info.frame_max = static_cast<boost::uint64_t>(open_opts.frame_max);
+  WriteCaptureInfo(capture, info);
+
+  const int broker = ConnectTo(open_opts.host, open_opts.port);
+  boost::uint64_t captured = 0;
+  Result result("record");
+  {
+    LoopbackServer proxy(boost::bind(&Proxy, broker, boost::ref(capture),
+                                     boost::ref(captured), _1, _2));
+    open_opts.host = "127.0.0.1";
+    open_opts.port = proxy.Port();
+    try {
+      Channel::ptr_t channel = Channel::Open(open_opts);
+      channel->SetLatencyTracking(true);
+      RunConsumer(*channel, opts.queues, opts.prefetch, opts.messages,
+                  opts.requeue, result);
+    } catch (...) {
+      close(broker);
+      throw;
+    }
+    // The Channel has closed its connection, which ends the proxying.
+    proxy.Join();
+  }
+  close(broker);
+
+  capture.flush();
+  if (!capture) {
+    throw std::runtime_error("could not write " + opts.capture);
+  }
+  result.Param("consumers", info.consumers).Param("prefetch", info.prefetch);
+  Report(result);
+  std::cerr << "recorded " << captured << " bytes to " << opts.capture
+            << std::endl;
+}
+
+void ReplayCapture(const Options &opts, result_list_t &results) {
+  std::string bytes;
+  const CaptureInfo info = ReadCapture(opts.capture, bytes);
+  // The queue names are only sent, the capture holds the broker's replies.
+  std::vector<std::string> queues;
+  for (boost::uint64_t i = 0; i < info.consumers; ++i) {
+    queues.push_back("sac_wire_replay_" +
+                     boost::lexical_cast<std::string>(i));
+  }
+
+  for (boost::uint64_t run = 0; run < opts.repeat; ++run) {
+    Result result("replay");
+    {
+      LoopbackServer server(
+          boost::bind(&Replay, boost::cref(bytes), _1, _2));
+      Channel::OpenOpts open_opts = OpenOptsFor("127.0.0.1");
+      open_opts.port = server.Port();
+      open_opts.frame_max = static_cast<int>(info.frame_max);
+      Channel::ptr_t channel = Channel::Open(open_opts);
+      channel->SetLatencyTracking(true);
+      RunConsumer(*channel, queues, info.prefetch, info.messages, false,
+                  result);
+      channel.reset();
+      server.Join();
+    }
+    result.Param("consumers", info.consumers)
+        .Param("prefetch", info.prefetch)
+        .Param("capture_bytes", bytes.size())
+        .Param("run", run);
+    results.push_back(result);
+    Report(result);
+  }
+}
+
+}  // namespace
+
+int main(int argc, char *argv[]) {
+  Options opts;
+  try {
+    opts = ParseOptions(argc, argv);
+  } catch (const std::exception &e) {
+    std::cerr << "sac_wire: " << e.what() << "\n";
+    Usage(std::cerr);
+    return EXIT_FAILURE;
+  }
+
+  result_list_t results;
+  try {
+    if ("record" == opts.mode) {
+      Record(opts);
+      return EXIT_SUCCESS;
+    }
+    ReplayCapture(opts, results);
+  } catch (const std::exception &e) {
+    std::cerr << "sac_wire: " << e.what() << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  if (opts.output.empty()) {
+    WriteJson(std::cout, "sac_wire", opts.capture, results);
+  } else {
+    std::ofstream out(opts.output.c_str());
+    WriteJson(out, "sac_wire", opts.capture, results);
+    if (!out) {
+      std::cerr << "sac_wire: could not write " << opts.output << std::endl;
+      return EXIT_FAILURE;
+    }
+  }
+  return EXIT_SUCCESS;
+}
@@ -33,283 +33,469 @@
 #include <amqp_framing.h>
 
 #include <boost/optional/optional.hpp>
+#include <boost/static_assert.hpp>
 #include <cstring>
 #include <string>
 
+#include "SimpleAmqpClient/BasicMessageImpl.h"
 #include "SimpleAmqpClient/TableImpl.h"
 
 namespace AmqpClient {
 
 struct BasicMessage::Impl {
   std::string body;
-  boost::optional<std::string> content_type;
-  boost::optional<std::string> content_encoding;
-  boost::optional<delivery_mode_t> delivery_mode;
-  boost::optional<boost::uint8_t> priority;
-  boost::optional<std::string> correlation_id;
-  boost::optional<std::string> reply_to;
-  boost::optional<std::string> expiration;
-  boost::optional<std::string> message_id;
-  boost::optional<boost::uint64_t> timestamp;
-  boost::optional<std::string> type;
-  boost::optional<std::string> user_id;
-  boost::optional<std::string> app_id;
-  boost::optional<std::string> cluster_id;
+  // When set, the body of the message, body is then unused.
+  body_ptr_t shared_body;
   boost::optional<Table> header_table;
+  // When set, the header table property as it will be sent, header_table is
+  // then unset.
+  boost::optional<EncodedTable> encoded_header_table;
 };
 
-BasicMessage::BasicMessage() : m_impl(new Impl) {}
-
-BasicMessage::BasicMessage(const std::string& body) : m_impl(new Impl) {
+BasicMessage::BasicMessage()
+    : m_impl(new Impl),
+      m_flags(0),
+      m_delivery_mode(0),
+      m_priority(0),
+      m_timestamp(0) {}
+
+BasicMessage::BasicMessage(const std::string& body)
+    : m_impl(new Impl),
+      m_flags(0),
+      m_delivery_mode(0),
+      m_priority(0),
+      m_timestamp(0) {
   Body(body);
 }
 
 BasicMessage::~BasicMessage() {}
 
-const std::string& BasicMessage::Body() const { return m_impl->body; }
+void BasicMessage::SetShortString(short_string_t which, property_flags_t flag,
+                                  const boost::string_ref& value) {
+  m_short_strings[which].assign(value.data(), value.size());
+  m_flags |= flag;
+}
 
-std::string& BasicMessage::Body() { return m_impl->body; }
+void BasicMessage::ClearShortString(short_string_t which,
+                                    property_flags_t flag) {
+  m_short_strings[which].clear();
+  m_flags &= ~flag;
+}
 
-void BasicMessage::Body(const std::string& body) { m_impl->body = body; }
+const std::string& BasicMessage::Body() const {
+  return m_impl->shared_body ? *m_impl->shared_body : m_impl->body;
+}
 
-const std::string& BasicMessage::ContentType() const {
-  if (ContentTypeIsSet()) {
-    return m_impl->content_type.get();
+std::string& BasicMessage::Body() {
+  if (m_impl->shared_body) {
+    m_impl->body = *m_impl->shared_body;
+    m_impl->shared_body.reset();
   }
-  static const std::string empty;
-  return empty;
+  return m_impl->body;
 }
 
-void BasicMessage::ContentType(const std::string& content_type) {
-  m_impl->content_type = content_type;
+void BasicMessage::Body(const std::string& body) {
+  m_impl->shared_body.reset();
+  m_impl->body = body;
 }
 
-bool BasicMessage::ContentTypeIsSet() const {
-  return m_impl->content_type.is_initialized();
+BasicMessage::body_ptr_t BasicMessage::SharedBody() const {
+  return m_impl->shared_body;
 }
 
-void BasicMessage::ContentTypeClear() { m_impl->content_type.reset(); }
-
-const std::string& BasicMessage::ContentEncoding() const {
-  if (ContentEncodingIsSet()) {
-    return m_impl->content_encoding.get();
-  }
-  static const std::string empty;
-  return empty;
+void BasicMessage::SharedBody(const body_ptr_t& body) {
+  m_impl->shared_body = body;
+  m_impl->body.clear();
 }
 
-void BasicMessage::ContentEncoding(const std::string& content_encoding) {
-  m_impl->content_encoding = content_encoding;
+const std::string& BasicMessage::ContentType() const {
+  return m_short_strings[ss_content_type];
 }
 
-bool BasicMessage::ContentEncodingIsSet() const {
-  return m_impl->content_encoding.is_initialized();
+void BasicMessage::ContentType(const std::string& content_type) {
+  SetShortString(ss_content_type, pf_content_type, content_type);
 }
 
-void BasicMessage::ContentEncodingClear() { m_impl->content_encoding.reset(); }
+void BasicMessage::ContentTypeClear() {
+  ClearShortString(ss_content_type, pf_content_type);
+}
 
-BasicMessage::delivery_mode_t BasicMessage::DeliveryMode() const {
-  return m_impl->delivery_mode.value_or(dm_notset);
+const std::string& BasicMessage::ContentEncoding() const {
+  return m_short_strings[ss_content_encoding];
 }
 
-void BasicMessage::DeliveryMode(delivery_mode_t delivery_mode) {
-  m_impl->delivery_mode = delivery_mode;
+void BasicMessage::ContentEncoding(const std::string& content_encoding) {
+  SetShortString(ss_content_encoding, pf_content_encoding, content_encoding);
 }
 
-bool BasicMessage::DeliveryModeIsSet() const {
-  return m_impl->delivery_mode.is_initialized();
+void BasicMessage::ContentEncodingClear() {
+  ClearShortString(ss_content_encoding, pf_content_encoding);
 }
 
-void BasicMessage::DeliveryModeClear() { m_impl->delivery_mode.reset(); }
+void BasicMessage::DeliveryMode(delivery_mode_t delivery_mode) {
+  m_delivery_mode = delivery_mode;
+  m_flags |= pf_delivery_mode;
+}
 
-boost::uint8_t BasicMessage::Priority() const {
-  return m_impl->priority.value_or(0);
+void BasicMessage::DeliveryModeClear() {
+  m_delivery_mode = 0;
+  m_flags &= ~pf_delivery_mode;
 }
 
 void BasicMessage::Priority(boost::uint8_t priority) {
-  m_impl->priority = priority;
+  m_priority = priority;
+  m_flags |= pf_priority;
 }
 
-bool BasicMessage::PriorityIsSet() const {
-  return m_impl->priority.is_initialized();
+void BasicMessage::PriorityClear() {
+  m_priority = 0;
+  m_flags &= ~pf_priority;
 }
 
-void BasicMessage::PriorityClear() { m_impl->priority.reset(); }
-
 const std::string& BasicMessage::CorrelationId() const {
-  if (CorrelationIdIsSet()) {
-    return m_impl->correlation_id.get();
-  }
-  static const std::string empty;
-  return empty;
+  return m_short_strings[ss_correlation_id];
 }
 
 void BasicMessage::CorrelationId(const std::string& correlation_id) {
-  m_impl->correlation_id = correlation_id;
+  SetShortString(ss_correlation_id, pf_correlation_id, correlation_id);
 }
 
-bool BasicMessage::CorrelationIdIsSet() const {
-  return m_impl->correlation_id.is_initialized();
+void BasicMessage::CorrelationIdClear() {
+  ClearShortString(ss_correlation_id, pf_correlation_id);
 }
 
-void BasicMessage::CorrelationIdClear() { m_impl->correlation_id.reset(); }
-
 const std::string& BasicMessage::ReplyTo() const {
-  if (ReplyToIsSet()) {
-    return m_impl->reply_to.get();
-  }
-  static const std::string empty;
-  return empty;
+  return m_short_strings[ss_reply_to];
 }
 
 void BasicMessage::ReplyTo(const std::string& reply_to) {
-  m_impl->reply_to = reply_to;
+  SetShortString(ss_reply_to, pf_reply_to, reply_to);
 }
 
-bool BasicMessage::ReplyToIsSet() const {
-  return m_impl->reply_to.is_initialized();
+void BasicMessage::ReplyToClear() {
+  ClearShortString(ss_reply_to, pf_reply_to);
 }
 
-void BasicMessage::ReplyToClear() { m_impl->reply_to.reset(); }
-
 const std::string& BasicMessage::Expiration() const {
-  if (ExpirationIsSet()) {
-    return m_impl->expiration.get();
-  }
-  static const std::string empty;
-  return empty;
+  return m_short_strings[ss_expiration];
 }
 
 void BasicMessage::Expiration(const std::string& expiration) {
-  m_impl->expiration = expiration;
+  SetShortString(ss_expiration, pf_expiration, expiration);
 }
 
-bool BasicMessage::ExpirationIsSet() const {
-  return m_impl->expiration.is_initialized();
+void BasicMessage::ExpirationClear() {
+  ClearShortString(ss_expiration, pf_expiration);
 }
 
-void BasicMessage::ExpirationClear() { m_impl->expiration.reset(); }
-
 const std::string& BasicMessage::MessageId() const {
-  if (MessageIdIsSet()) {
-    return m_impl->message_id.get();
-  }
-  static const std::string empty;
-  return empty;
+  return m_short_strings[ss_message_id];
 }
 
 void BasicMessage::MessageId(const std::string& message_id) {
-  m_impl->message_id = message_id;
+  SetShortString(ss_message_id, pf_message_id, message_id);
 }
 
-bool BasicMessage::MessageIdIsSet() const {
-  return m_impl->message_id.is_initialized();
+void BasicMessage::MessageIdClear() {
+  ClearShortString(ss_message_id, pf_message_id);
 }
 
-void BasicMessage::MessageIdClear() { m_impl->message_id.reset(); }
-
-boost::uint64_t BasicMessage::Timestamp() const {
-  return m_impl->timestamp.value_or(0);
-}
 void BasicMessage::Timestamp(boost::uint64_t timestamp) {
-  m_impl->timestamp = timestamp;
+  m_timestamp = timestamp;
+  m_flags |= pf_timestamp;
 }
 
-bool BasicMessage::TimestampIsSet() const {
-  return m_impl->timestamp.is_initialized();
+void BasicMessage::TimestampClear() {
+  m_timestamp = 0;
+  m_flags &= ~pf_timestamp;
 }
 
-void BasicMessage::TimestampClear() { m_impl->timestamp.reset(); }
-
 const std::string& BasicMessage::Type() const {
-  if (TypeIsSet()) {
-    return m_impl->type.get();
-  }
-  static const std::string empty;
-  return empty;
+  return m_short_strings[ss_type];
 }
 
-void BasicMessage::Type(const std::string& type) { m_impl->type = type; }
-
-bool BasicMessage::TypeIsSet() const { return m_impl->type.is_initialized(); }
+void BasicMessage::Type(const std::string& type) {
+  SetShortString(ss_type, pf_type, type);
+}
 
-void BasicMessage::TypeClear() { m_impl->type.reset(); }
+void BasicMessage::TypeClear() { ClearShortString(ss_type, pf_type); }
 
 const std::string& BasicMessage::UserId() const {
-  if (UserIdIsSet()) {
-    return m_impl->user_id.get();
-  }
-  static const std::string empty;
-  return empty;
+  return m_short_strings[ss_user_id];
 }
 
 void BasicMessage::UserId(const std::string& user_id) {
-  m_impl->user_id = user_id;
-}
-
-bool BasicMessage::UserIdIsSet() const {
-  return m_impl->user_id.is_initialized();
+  SetShortString(ss_user_id, pf_user_id, user_id);
 }
 
-void BasicMessage::UserIdClear() { m_impl->user_id.reset(); }
+void BasicMessage::UserIdClear() { ClearShortString(ss_user_id, pf_user_id); }
 
 const std::string& BasicMessage::AppId() const {
-  if (AppIdIsSet()) {
-    return m_impl->app_id.get();
-  }
-  static const std::string empty;
-  return empty;
+  return m_short_strings[ss_app_id];
 }
 
-void BasicMessage::AppId(const std::string& app_id) { m_impl->app_id = app_id; }
-
-bool BasicMessage::AppIdIsSet() const {
-  return m_impl->app_id.is_initialized();
+void BasicMessage::AppId(const std::string& app_id) {
+  SetShortString(ss_app_id, pf_app_id, app_id);
 }
 
-void BasicMessage::AppIdClear() { m_impl->app_id.reset(); }
+void BasicMessage::AppIdClear() { ClearShortString(ss_app_id, pf_app_id); }
 
 const std::string& BasicMessage::ClusterId() const {
-  if (ClusterIdIsSet()) {
-    return m_impl->cluster_id.get();
-  }
-  static const std::string empty;
-  return empty;
+  return m_short_strings[ss_cluster_id];
 }
 
 void BasicMessage::ClusterId(const std::string& cluster_id) {
-  m_impl->cluster_id = cluster_id;
+  SetShortString(ss_cluster_id, pf_cluster_id, cluster_id);
 }
 
-bool BasicMessage::ClusterIdIsSet() const {
-  return m_impl->cluster_id.is_initialized();
+void BasicMessage::ClusterIdClear() {
+  ClearShortString(ss_cluster_id, pf_cluster_id);
 }
 
-void BasicMessage::ClusterIdClear() { m_impl->cluster_id.reset(); }
-
 Table& BasicMessage::HeaderTable() {
-  if (!HeaderTableIsSet()) {
+  if (m_impl->encoded_header_table) {
+    m_impl->header_table = m_impl->encoded_header_table->Decode();
+    m_impl->encoded_header_table.reset();
+  } else if (!m_impl->header_table) {
     m_impl->header_table = Table();
   }
+  m_flags |= pf_headers;
   return m_impl->header_table.get();
 }
 
-const Table& BasicMessage::HeaderTable() const {
-  if (HeaderTableIsSet()) {
+Table BasicMessage::HeaderTable() const {
+  if (m_impl->encoded_header_table) {
+    return m_impl->encoded_header_table->Decode();
+  }
+  if (m_impl->header_table) {
     return m_impl->header_table.get();
   }
-  static const Table empty;
-  return empty;
+  return Table();
 }
 
 void BasicMessage::HeaderTable(const Table& header_table) {
   m_impl->header_table = header_table;
+  m_impl->encoded_header_table.reset();
+  m_flags |= pf_headers;
+}
+
+void BasicMessage::HeaderTable(const EncodedTable& header_table) {
+  m_impl->encoded_header_table = header_table;
+  m_impl->header_table.reset();
+  m_flags |= pf_headers;
 }
 
-bool BasicMessage::HeaderTableIsSet() const {
-  return m_impl->header_table.is_initialized();
+bool BasicMessage::HeaderTableIsEncoded() const {
+  return m_impl->encoded_header_table.is_initialized();
 }
 
-void BasicMessage::HeaderTableClear() { m_impl->header_table.reset(); }
+EncodedTable BasicMessage::EncodedHeaderTable() const {
+  if (m_impl->encoded_header_table) {
+    return m_impl->encoded_header_table.get();
+  }
+  if (m_impl->header_table) {
+    return EncodedTable(m_impl->header_table.get());
+  }
+  return EncodedTable();
+}
+
+bool BasicMessage::HeaderTableFind(const boost::string_ref& key,
+                                   TableValue& value) const {
+  if (m_impl->header_table) {
+    Table::const_iterator it =
+        m_impl->header_table->find(std::string(key.data(), key.size()));
+    if (it == m_impl->header_table->end()) {
+      return false;
+    }
+    value = it->second;
+    return true;
+  }
+  if (m_impl->encoded_header_table) {
+    return m_impl->encoded_header_table->Find(key, value);
+  }
+  return false;
+}
+
+void BasicMessage::HeaderTableClear() {
+  m_impl->header_table.reset();
+  m_impl->encoded_header_table.reset();
+  m_flags &= ~pf_headers;
+}
+
+namespace Detail {
+
+namespace {
+// Locates the header table in the property list of a raw content header
+// frame. Only the content type and content encoding come before it.
+bool FindRawHeaderTable(const amqp_bytes_t& raw, const char*& table,
+                        std::size_t& table_len) {
+  const unsigned char* data = static_cast<const unsigned char*>(raw.bytes);
+  std::size_t offset = 0;
+
+  boost::uint16_t flags = 0;
+  boost::uint16_t word;
+  do {
+    if (offset + 2 > raw.len) {
+      return false;
+    }
+    word = static_cast<boost::uint16_t>((data[offset] << 8) | data[offset + 1]);
+    if (0 == offset) {
+      flags = word;
+    }
+    offset += 2;
+  } while (0 != (word & 1));
+
+  if (0 == (flags & AMQP_BASIC_HEADERS_FLAG)) {
+    return false;
+  }
+  const amqp_flags_t preceding[] = {AMQP_BASIC_CONTENT_TYPE_FLAG,
+                                    AMQP_BASIC_CONTENT_ENCODING_FLAG};
+  for (std::size_t i = 0; i < sizeof(preceding) / sizeof(preceding[0]); ++i) {
+    if (0 != (flags & preceding[i])) {
+      if (offset + 1 > raw.len) {
+        return false;
+      }
+      offset += 1 + data[offset];
+    }
+  }
+
+  if (offset + 4 > raw.len) {
+    return false;
+  }
+  const std::size_t size = (static_cast<std::size_t>(data[offset]) << 24) |
+                           (static_cast<std::size_t>(data[offset + 1]) << 16) |
+                           (static_cast<std::size_t>(data[offset + 2]) << 8) |
+                           static_cast<std::size_t>(data[offset + 3]);
+  if (size > raw.len - offset - 4) {
+    return false;
+  }
+  table = reinterpret_cast<const char*>(data + offset);
+  table_len = 4 + size;
+  return true;
+}
+}  // namespace
+
+BOOST_STATIC_ASSERT(BasicMessage::pf_content_type ==
+                    AMQP_BASIC_CONTENT_TYPE_FLAG);
+BOOST_STATIC_ASSERT(BasicMessage::pf_content_encoding ==
+                    AMQP_BASIC_CONTENT_ENCODING_FLAG);
+BOOST_STATIC_ASSERT(BasicMessage::pf_headers == AMQP_BASIC_HEADERS_FLAG);
+BOOST_STATIC_ASSERT(BasicMessage::pf_delivery_mode ==
+                    AMQP_BASIC_DELIVERY_MODE_FLAG);
+BOOST_STATIC_ASSERT(BasicMessage::pf_priority == AMQP_BASIC_PRIORITY_FLAG);
+BOOST_STATIC_ASSERT(BasicMessage::pf_correlation_id ==
+                    AMQP_BASIC_CORRELATION_ID_FLAG);
+BOOST_STATIC_ASSERT(BasicMessage::pf_reply_to == AMQP_BASIC_REPLY_TO_FLAG);
+BOOST_STATIC_ASSERT(BasicMessage::pf_expiration ==
+                    AMQP_BASIC_EXPIRATION_FLAG);
+BOOST_STATIC_ASSERT(BasicMessage::pf_message_id ==
+                    AMQP_BASIC_MESSAGE_ID_FLAG);
+BOOST_STATIC_ASSERT(BasicMessage::pf_timestamp == AMQP_BASIC_TIMESTAMP_FLAG);
+BOOST_STATIC_ASSERT(BasicMessage::pf_type == AMQP_BASIC_TYPE_FLAG);
+BOOST_STATIC_ASSERT(BasicMessage::pf_user_id == AMQP_BASIC_USER_ID_FLAG);
+BOOST_STATIC_ASSERT(BasicMessage::pf_app_id == AMQP_BASIC_APP_ID_FLAG);
+BOOST_STATIC_ASSERT(BasicMessage::pf_cluster_id ==
+                    AMQP_BASIC_CLUSTER_ID_FLAG);
+
+const BasicMessageImpl::short_string_field_t
+    BasicMessageImpl::SHORT_STRING_FIELDS[BasicMessage::ss_count] = {
+        {BasicMessage::ss_content_type, BasicMessage::pf_content_type,
+         &amqp_basic_properties_t::content_type},
+        {BasicMessage::ss_content_encoding, BasicMessage::pf_content_encoding,
+         &amqp_basic_properties_t::content_encoding},
+        {BasicMessage::ss_correlation_id, BasicMessage::pf_correlation_id,
+         &amqp_basic_properties_t::correlation_id},
+        {BasicMessage::ss_reply_to, BasicMessage::pf_reply_to,
+         &amqp_basic_properties_t::reply_to},
+        {BasicMessage::ss_expiration, BasicMessage::pf_expiration,
+         &amqp_basic_properties_t::expiration},
+        {BasicMessage::ss_message_id, BasicMessage::pf_message_id,
+         &amqp_basic_properties_t::message_id},
+        {BasicMessage::ss_type, BasicMessage::pf_type,
+         &amqp_basic_properties_t::type},
+        {BasicMessage::ss_user_id, BasicMessage::pf_user_id,
+         &amqp_basic_properties_t::user_id},
+        {BasicMessage::ss_app_id, BasicMessage::pf_app_id,
+         &amqp_basic_properties_t::app_id},
+        {BasicMessage::ss_cluster_id, BasicMessage::pf_cluster_id,
+         &amqp_basic_properties_t::cluster_id}};
+
+amqp_basic_properties_t BasicMessageImpl::CreateAmqpProperties(
+    const BasicMessage& mes, amqp_pool_t& pool) {
+  amqp_basic_properties_t ret;
+  ret._flags = mes.m_flags;
+
+  for (int i = 0; i < BasicMessage::ss_count; ++i) {
+    const short_string_field_t& field = SHORT_STRING_FIELDS[i];
+    boost::string_ref value = mes.ShortString(field.which);
+    amqp_bytes_t& bytes = ret.*field.member;
+    bytes.bytes = const_cast<char*>(value.data());
+    bytes.len = value.size();
+  }
+  ret.delivery_mode = mes.m_delivery_mode;
+  ret.priority = mes.m_priority;
+  ret.timestamp = mes.m_timestamp;
+
+  if (mes.HeaderTableIsSet()) {
+    if (mes.HeaderTableIsEncoded()) {
+      ret.headers = TableValueImpl::CreateAmqpTable(mes.EncodedHeaderTable(),
+                                                    pool);
+    } else {
+      ret.headers =
+          TableValueImpl::CreateAmqpTable(mes.m_impl->header_table.get(), pool);
+    }
+  }
+  return ret;
+}
+
+void BasicMessageImpl::SetProperties(BasicMessage& mes,
+                                     const amqp_basic_properties_t& props,
+                                     const amqp_bytes_t* raw) {
+  for (int i = 0; i < BasicMessage::ss_count; ++i) {
+    const short_string_field_t& field = SHORT_STRING_FIELDS[i];
+    if (0 != (props._flags & field.flag)) {
+      const amqp_bytes_t& bytes = props.*field.member;
+      mes.SetShortString(
+          field.which, field.flag,
+          boost::string_ref(static_cast<const char*>(bytes.bytes), bytes.len));
+    }
+  }
+  if (0 != (props._flags & AMQP_BASIC_DELIVERY_MODE_FLAG)) {
+    mes.DeliveryMode(
+        static_cast<BasicMessage::delivery_mode_t>(props.delivery_mode));
+  }
+  if (0 != (props._flags & AMQP_BASIC_PRIORITY_FLAG)) {
+    mes.Priority(props.priority);
+  }
+  if (0 != (props._flags & AMQP_BASIC_TIMESTAMP_FLAG)) {
+    mes.Timestamp(props.timestamp);
+  }
+  if (0 != (props._flags & AMQP_BASIC_HEADERS_FLAG)) {
+    const char* table;
+    std::size_t table_len;
+    if (NULL != raw && FindRawHeaderTable(*raw, table, table_len)) {
+      mes.HeaderTable(TableValueImpl::CreateEncodedTable(table, table_len));
+    } else {
+      mes.HeaderTable(TableValueImpl::CreateTable(props.headers));
+    }
+  }
+}
+
+void BasicMessageImpl::Reset(BasicMessage& mes) {
+  mes.m_impl->body.clear();
+  mes.m_impl->shared_body.reset();
+  mes.m_impl->header_table.reset();
+  mes.m_impl->encoded_header_table.reset();
+  // Cleared rather than replaced, so a pooled message keeps the capacity
+  // of its strings
+  for (int i = 0; i < BasicMessage::ss_count; ++i) {
+    mes.m_short_strings[i].clear();
+  }
+  mes.m_flags = 0;
+  mes.m_delivery_mode = 0;
+  mes.m_priority = 0;
+  mes.m_timestamp = 0;
+}
 
+}  // namespace Detail
 }  // namespace AmqpClient
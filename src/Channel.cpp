@@ -52,6 +52,7 @@
 #include "SimpleAmqpClient/AmqpLibraryException.h"
 #include "SimpleAmqpClient/AmqpResponseLibraryException.h"
 #include "SimpleAmqpClient/BadUriException.h"
+#include "SimpleAmqpClient/BasicMessageImpl.h"
 #include "SimpleAmqpClient/Bytes.h"
 #include "SimpleAmqpClient/Channel.h"
 #include "SimpleAmqpClient/ChannelImpl.h"
@@ -59,79 +60,22 @@
 #include "SimpleAmqpClient/ConsumerTagNotFoundException.h"
 #include "SimpleAmqpClient/MessageRejectedException.h"
 #include "SimpleAmqpClient/MessageReturnedException.h"
+#include "SimpleAmqpClient/Probes.h"
+#include "SimpleAmqpClient/PublishTemplateImpl.h"
 #include "SimpleAmqpClient/TableImpl.h"
 #include "SimpleAmqpClient/Util.h"
 
 namespace AmqpClient {
 
 namespace {
-
-amqp_basic_properties_t CreateAmqpProperties(const BasicMessage &mes,
-                                             Detail::amqp_pool_ptr_t &pool) {
-  amqp_basic_properties_t ret;
-  ret._flags = 0;
-
-  if (mes.ContentTypeIsSet()) {
-    ret.content_type = StringToBytes(mes.ContentType());
-    ret._flags |= AMQP_BASIC_CONTENT_TYPE_FLAG;
-  }
-  if (mes.ContentEncodingIsSet()) {
-    ret.content_encoding = StringToBytes(mes.ContentEncoding());
-    ret._flags |= AMQP_BASIC_CONTENT_ENCODING_FLAG;
-  }
-  if (mes.DeliveryModeIsSet()) {
-    // TODO: something more advanced?
-    ret.delivery_mode = mes.DeliveryMode();
-    ret._flags |= AMQP_BASIC_DELIVERY_MODE_FLAG;
-  }
-  if (mes.PriorityIsSet()) {
-    ret.priority = mes.Priority();
-    ret._flags |= AMQP_BASIC_PRIORITY_FLAG;
-  }
-  if (mes.CorrelationIdIsSet()) {
-    ret.correlation_id = StringToBytes(mes.CorrelationId());
-    ret._flags |= AMQP_BASIC_CORRELATION_ID_FLAG;
-  }
-  if (mes.ReplyToIsSet()) {
-    ret.reply_to = StringToBytes(mes.ReplyTo());
-    ret._flags |= AMQP_BASIC_REPLY_TO_FLAG;
-  }
-  if (mes.ExpirationIsSet()) {
-    ret.expiration = StringToBytes(mes.Expiration());
-    ret._flags |= AMQP_BASIC_EXPIRATION_FLAG;
-  }
-  if (mes.MessageIdIsSet()) {
-    ret.message_id = StringToBytes(mes.MessageId());
-    ret._flags |= AMQP_BASIC_MESSAGE_ID_FLAG;
-  }
-  if (mes.TimestampIsSet()) {
-    ret.timestamp = mes.Timestamp();
-    ret._flags |= AMQP_BASIC_TIMESTAMP_FLAG;
-  }
-  if (mes.TypeIsSet()) {
-    ret.type = StringToBytes(mes.Type());
-    ret._flags |= AMQP_BASIC_TYPE_FLAG;
-  }
-  if (mes.UserIdIsSet()) {
-    ret.user_id = StringToBytes(mes.UserId());
-    ret._flags |= AMQP_BASIC_USER_ID_FLAG;
-  }
-  if (mes.AppIdIsSet()) {
-    ret.app_id = StringToBytes(mes.AppId());
-    ret._flags |= AMQP_BASIC_APP_ID_FLAG;
-  }
-  if (mes.ClusterIdIsSet()) {
-    ret.cluster_id = StringToBytes(mes.ClusterId());
-    ret._flags |= AMQP_BASIC_CLUSTER_ID_FLAG;
-  }
-  if (mes.HeaderTableIsSet()) {
-    ret.headers =
-        Detail::TableValueImpl::CreateAmqpTable(mes.HeaderTable(), pool);
-    ret._flags |= AMQP_BASIC_HEADERS_FLAG;
-  }
-  return ret;
+// Reports a channel closed by the broker in a BasicResult
+Channel::BasicResult ChannelErrorResult(const ChannelException &e) {
+  Channel::BasicResult result;
+  result.status = Channel::BasicResult::channel_error;
+  result.reply_code = e.reply_code();
+  result.reply_text = e.reply_text();
+  return result;
 }
-
 }  // namespace
 
 const std::string Channel::EXCHANGE_TYPE_DIRECT("direct");
@@ -520,9 +464,9 @@ void Channel::DeclareExchange(const std::string &exchange_name,
   declare.internal = false;
   declare.nowait = false;
 
-  Detail::amqp_pool_ptr_t table_pool;
+  Detail::ScopedPoolRecycler scratch(m_impl->m_scratch_pool);
   declare.arguments =
-      Detail::TableValueImpl::CreateAmqpTable(arguments, table_pool);
+      Detail::TableValueImpl::CreateAmqpTable(arguments, scratch.Get());
 
   amqp_frame_t frame =
       m_impl->DoRpc(AMQP_EXCHANGE_DECLARE_METHOD, &declare, DECLARE_OK);
@@ -564,9 +508,9 @@ void Channel::BindExchange(const std::string &destination,
   bind.routing_key = StringToBytes(routing_key);
   bind.nowait = false;
 
-  Detail::amqp_pool_ptr_t table_pool;
+  Detail::ScopedPoolRecycler scratch(m_impl->m_scratch_pool);
   bind.arguments =
-      Detail::TableValueImpl::CreateAmqpTable(arguments, table_pool);
+      Detail::TableValueImpl::CreateAmqpTable(arguments, scratch.Get());
 
   amqp_frame_t frame = m_impl->DoRpc(AMQP_EXCHANGE_BIND_METHOD, &bind, BIND_OK);
   m_impl->MaybeReleaseBuffersOnChannel(frame.channel);
@@ -592,9 +536,9 @@ void Channel::UnbindExchange(const std::string &destination,
   unbind.routing_key = StringToBytes(routing_key);
   unbind.nowait = false;
 
-  Detail::amqp_pool_ptr_t table_pool;
+  Detail::ScopedPoolRecycler scratch(m_impl->m_scratch_pool);
   unbind.arguments =
-      Detail::TableValueImpl::CreateAmqpTable(arguments, table_pool);
+      Detail::TableValueImpl::CreateAmqpTable(arguments, scratch.Get());
 
   amqp_frame_t frame =
       m_impl->DoRpc(AMQP_EXCHANGE_UNBIND_METHOD, &unbind, UNBIND_OK);
@@ -665,9 +609,9 @@ std::string Channel::DeclareQueueWithCounts(const std::string &queue_name,
   declare.auto_delete = auto_delete;
   declare.nowait = false;
 
-  Detail::amqp_pool_ptr_t table_pool;
+  Detail::ScopedPoolRecycler scratch(m_impl->m_scratch_pool);
   declare.arguments =
-      Detail::TableValueImpl::CreateAmqpTable(arguments, table_pool);
+      Detail::TableValueImpl::CreateAmqpTable(arguments, scratch.Get());
 
   amqp_frame_t response =
       m_impl->DoRpc(AMQP_QUEUE_DECLARE_METHOD, &declare, DECLARE_OK);
@@ -720,9 +664,9 @@ void Channel::BindQueue(const std::string &queue_name,
   bind.routing_key = StringToBytes(routing_key);
   bind.nowait = false;
 
-  Detail::amqp_pool_ptr_t table_pool;
+  Detail::ScopedPoolRecycler scratch(m_impl->m_scratch_pool);
   bind.arguments =
-      Detail::TableValueImpl::CreateAmqpTable(arguments, table_pool);
+      Detail::TableValueImpl::CreateAmqpTable(arguments, scratch.Get());
 
   amqp_frame_t frame = m_impl->DoRpc(AMQP_QUEUE_BIND_METHOD, &bind, BIND_OK);
   m_impl->MaybeReleaseBuffersOnChannel(frame.channel);
@@ -747,9 +691,9 @@ void Channel::UnbindQueue(const std::string &queue_name,
   unbind.exchange = StringToBytes(exchange_name);
   unbind.routing_key = StringToBytes(routing_key);
 
-  Detail::amqp_pool_ptr_t table_pool;
+  Detail::ScopedPoolRecycler scratch(m_impl->m_scratch_pool);
   unbind.arguments =
-      Detail::TableValueImpl::CreateAmqpTable(arguments, table_pool);
+      Detail::TableValueImpl::CreateAmqpTable(arguments, scratch.Get());
 
   amqp_frame_t frame =
       m_impl->DoRpc(AMQP_QUEUE_UNBIND_METHOD, &unbind, UNBIND_OK);
@@ -791,6 +735,10 @@ void Channel::BasicAck(const Envelope::DeliveryInfo &info, bool multiple) {
 
   m_impl->CheckForError(amqp_basic_ack(m_impl->m_connection, channel,
                                        info.delivery_tag, multiple));
+  m_impl->m_stats.frames_sent.Add();
+  m_impl->ObserveFrameSent(channel, AMQP_FRAME_METHOD, AMQP_BASIC_ACK_METHOD,
+                           0);
+  SAC_PROBE3(ack_sent, channel, info.delivery_tag, multiple);
 }
 
 void Channel::BasicReject(const Envelope::ptr_t &message, bool requeue,
@@ -817,67 +765,198 @@ void Channel::BasicReject(const Envelope::DeliveryInfo &info, bool requeue,
 
   m_impl->CheckForError(amqp_send_method(m_impl->m_connection, channel,
                                          AMQP_BASIC_NACK_METHOD, &req));
+  m_impl->m_stats.frames_sent.Add();
+  m_impl->ObserveFrameSent(channel, AMQP_FRAME_METHOD, AMQP_BASIC_NACK_METHOD,
+                           0);
+  SAC_PROBE3(nack_sent, channel, info.delivery_tag, requeue);
 }
 
-void Channel::BasicPublish(const std::string &exchange_name,
-                           const std::string &routing_key,
-                           const BasicMessage::ptr_t message, bool mandatory,
+void Channel::BasicPublish(const boost::string_ref &exchange_name,
+                           const boost::string_ref &routing_key,
+                           const BasicMessage::ptr_t &message, bool mandatory,
                            bool immediate) {
   m_impl->CheckIsConnected();
-  amqp_channel_t channel = m_impl->GetChannel();
 
-  Detail::amqp_pool_ptr_t pool;
-  amqp_basic_properties_t properties = CreateAmqpProperties(*message, pool);
-
-  m_impl->CheckForError(amqp_basic_publish(
-      m_impl->m_connection, channel, StringToBytes(exchange_name),
-      StringToBytes(routing_key), mandatory, immediate, &properties,
-      StringToBytes(message->Body())));
-
-  // If we've done things correctly we can get one of 4 things back from the
-  // broker
-  // - basic.ack - our channel is in confirm mode, messsage was 'dealt with' by
-  // the broker
-  // - basic.nack - our channel is in confirm mode, queue has max-length set and
-  // is full, queue overflow stratege is reject-publish
-  // - basic.return then basic.ack - the message wasn't delievered, but was
-  // dealt with
-  // - channel.close - probably tried to publish to a non-existant exchange, in
-  // any case error!
-  // - connection.clsoe - something really bad happened
-  const boost::array<boost::uint32_t, 3> PUBLISH_ACK = {
-      {AMQP_BASIC_ACK_METHOD, AMQP_BASIC_RETURN_METHOD,
-       AMQP_BASIC_NACK_METHOD}};
-  amqp_frame_t response;
-  boost::array<amqp_channel_t, 1> channels = {{channel}};
-  m_impl->GetMethodOnChannel(channels, response, PUBLISH_ACK);
+  Detail::ScopedPoolRecycler scratch(m_impl->m_scratch_pool);
+  amqp_basic_properties_t properties =
+      Detail::BasicMessageImpl::CreateAmqpProperties(*message, scratch.Get());
+
+  // Read through a const reference so a shared body is not copied
+  const BasicMessage &content = *message;
+  const amqp_bytes_t exchange = StringRefToBytes(exchange_name);
+  const amqp_bytes_t key = StringRefToBytes(routing_key);
+  ChannelImpl::CheckPublishResult(
+      m_impl->PublishAndWaitForConfirm(exchange, key, mandatory, immediate,
+                                       properties,
+                                       StringToBytes(content.Body())),
+      exchange, key);
+}
 
-  if (AMQP_BASIC_NACK_METHOD == response.payload.method.id) {
-    amqp_basic_nack_t *return_method =
-        reinterpret_cast<amqp_basic_nack_t *>(response.payload.method.decoded);
-    MessageRejectedException message_rejected(return_method->delivery_tag);
-    m_impl->ReturnChannel(channel);
-    m_impl->MaybeReleaseBuffersOnChannel(channel);
-    throw message_rejected;
+void Channel::BasicPublish(const boost::string_ref &exchange_name,
+                           const boost::string_ref &routing_key,
+                           const BasicMessage::ptr_t &properties,
+                           const std::vector<boost::string_ref> &body_segments,
+                           bool mandatory, bool immediate) {
+  m_impl->CheckIsConnected();
+
+  Detail::ScopedPoolRecycler scratch(m_impl->m_scratch_pool);
+  amqp_basic_properties_t amqp_properties =
+      Detail::BasicMessageImpl::CreateAmqpProperties(*properties,
+                                                     scratch.Get());
+
+  const amqp_bytes_t exchange = StringRefToBytes(exchange_name);
+  const amqp_bytes_t key = StringRefToBytes(routing_key);
+  ChannelImpl::CheckPublishResult(
+      m_impl->PublishAndWaitForConfirm(exchange, key, mandatory, immediate,
+                                       amqp_properties, body_segments),
+      exchange, key);
+}
+
+Channel::Stats Channel::GetStats() const {
+  Stats stats;
+  m_impl->m_stats.Snapshot(stats);
+  return stats;
+}
+
+void Channel::SetLatencyTracking(bool enabled) {
+  m_impl->m_stats.track_latency = enabled;
+}
+
+bool Channel::GetLatencyTracking() const {
+  return m_impl->m_stats.track_latency;
+}
+
+Channel::LatencyStats Channel::GetLatencyStats(bool reset) {
+  LatencyStats stats;
+  m_impl->m_stats.SnapshotLatency(stats, reset);
+  return stats;
+}
+
+void Channel::SetReadAheadLimits(std::size_t max_count,
+                                 std::size_t max_bytes) {
+  m_impl->SetReadAheadLimits(max_count, max_bytes);
+}
+
+std::size_t Channel::GetReadAheadBytes() const {
+  return m_impl->GetReadAheadBytes();
+}
+
+void Channel::SetFrameObserver(const frame_observer_t &observer) {
+  m_impl->m_frame_observer = observer;
+}
+
+void Channel::SetReturnHandler(const return_handler_t &handler,
+                               bool with_body) {
+  m_impl->m_return_handler = handler;
+  m_impl->m_return_handler_body = with_body;
+}
+
+boost::uint64_t Channel::GetNextPublishSeqNo() const {
+  return m_impl->m_next_publish_seq_no;
+}
+
+Channel::BasicResult Channel::TryBasicPublish(
+    const boost::string_ref &exchange_name,
+    const boost::string_ref &routing_key, const BasicMessage::ptr_t &message,
+    bool mandatory, bool immediate) {
+  m_impl->CheckIsConnected();
+
+  Detail::ScopedPoolRecycler scratch(m_impl->m_scratch_pool);
+  amqp_basic_properties_t properties =
+      Detail::BasicMessageImpl::CreateAmqpProperties(*message, scratch.Get());
+
+  const BasicMessage &content = *message;
+  try {
+    return m_impl->PublishAndWaitForConfirm(
+        StringRefToBytes(exchange_name), StringRefToBytes(routing_key),
+        mandatory, immediate, properties, StringToBytes(content.Body()));
+  } catch (const ChannelException &e) {
+    return ChannelErrorResult(e);
   }
+}
 
-  if (AMQP_BASIC_RETURN_METHOD == response.payload.method.id) {
-    MessageReturnedException message_returned =
-        m_impl->CreateMessageReturnedException(
-            *(reinterpret_cast<amqp_basic_return_t *>(
-                response.payload.method.decoded)),
-            channel);
+void Channel::BasicPublishFanout(const boost::string_ref &exchange_name,
+                                 const std::vector<std::string> &routing_keys,
+                                 const BasicMessage::ptr_t &message,
+                                 bool mandatory, bool immediate) {
+  m_impl->CheckIsConnected();
 
-    const boost::array<boost::uint32_t, 1> BASIC_ACK = {
-        {AMQP_BASIC_ACK_METHOD}};
-    m_impl->GetMethodOnChannel(channels, response, BASIC_ACK);
-    m_impl->ReturnChannel(channel);
-    m_impl->MaybeReleaseBuffersOnChannel(channel);
-    throw message_returned;
+  Detail::ScopedPoolRecycler scratch(m_impl->m_scratch_pool);
+  amqp_basic_properties_t properties =
+      Detail::BasicMessageImpl::CreateAmqpProperties(*message, scratch.Get());
+
+  const BasicMessage &content = *message;
+  const amqp_bytes_t exchange = StringRefToBytes(exchange_name);
+  const amqp_bytes_t body = StringToBytes(content.Body());
+  for (std::vector<std::string>::const_iterator it = routing_keys.begin();
+       it != routing_keys.end(); ++it) {
+    const amqp_bytes_t key = StringToBytes(*it);
+    ChannelImpl::CheckPublishResult(
+        m_impl->PublishAndWaitForConfirm(exchange, key, mandatory, immediate,
+                                         properties, body),
+        exchange, key);
   }
+}
 
-  m_impl->ReturnChannel(channel);
-  m_impl->MaybeReleaseBuffersOnChannel(channel);
+void Channel::BasicPublish(const PublishTemplate::ptr_t &publish_template,
+                           const boost::string_ref &body) {
+  m_impl->CheckIsConnected();
+
+  const PublishTemplate::Impl &tmpl = *publish_template->m_impl;
+  const amqp_bytes_t exchange = StringToBytes(tmpl.exchange);
+  const amqp_bytes_t key = StringToBytes(tmpl.routing_key);
+  ChannelImpl::CheckPublishResult(
+      m_impl->PublishAndWaitForConfirm(exchange, key, tmpl.mandatory, false,
+                                       tmpl.properties,
+                                       StringRefToBytes(body)),
+      exchange, key);
+}
+
+void Channel::BasicPublish(const PublishTemplate::ptr_t &publish_template,
+                           const boost::string_ref &body,
+                           const boost::string_ref &message_id,
+                           boost::uint64_t timestamp) {
+  m_impl->CheckIsConnected();
+
+  const PublishTemplate::Impl &tmpl = *publish_template->m_impl;
+  amqp_basic_properties_t properties = tmpl.properties;
+  properties.message_id = StringRefToBytes(message_id);
+  properties.timestamp = timestamp;
+  properties._flags |= AMQP_BASIC_MESSAGE_ID_FLAG | AMQP_BASIC_TIMESTAMP_FLAG;
+
+  const amqp_bytes_t exchange = StringToBytes(tmpl.exchange);
+  const amqp_bytes_t key = StringToBytes(tmpl.routing_key);
+  ChannelImpl::CheckPublishResult(
+      m_impl->PublishAndWaitForConfirm(exchange, key, tmpl.mandatory, false,
+                                       properties, StringRefToBytes(body)),
+      exchange, key);
+}
+
+void Channel::SetLazyHeaderDecoding(bool lazy) {
+  m_impl->m_lazy_header_decoding = lazy;
+}
+
+bool Channel::GetLazyHeaderDecoding() const {
+  return m_impl->m_lazy_header_decoding;
+}
+
+void Channel::SetMessagePoolSize(std::size_t size) {
+  if (size == GetMessagePoolSize()) {
+    return;
+  }
+  if (0 == size) {
+    m_impl->m_message_pool.reset();
+  } else {
+    m_impl->m_message_pool = Detail::MessagePool::Create(size);
+  }
+}
+
+std::size_t Channel::GetMessagePoolSize() const {
+  return m_impl->m_message_pool ? m_impl->m_message_pool->MaxSize() : 0;
+}
+
+Envelope::string_ptr_t Channel::InternString(const boost::string_ref &value) {
+  return m_impl->m_interned_strings.Intern(value);
 }
 
 bool Channel::BasicGet(Envelope::ptr_t &envelope, const std::string &queue,
@@ -904,19 +983,34 @@ bool Channel::BasicGet(Envelope::ptr_t &envelope, const std::string &queue,
       (amqp_basic_get_ok_t *)response.payload.method.decoded;
   boost::uint64_t delivery_tag = get_ok->delivery_tag;
   bool redelivered = (get_ok->redelivered == 0 ? false : true);
-  std::string exchange((char *)get_ok->exchange.bytes, get_ok->exchange.len);
-  std::string routing_key((char *)get_ok->routing_key.bytes,
-                          get_ok->routing_key.len);
+  const Envelope::string_ptr_t exchange = m_impl->Intern(get_ok->exchange);
+  const Envelope::string_ptr_t routing_key =
+      m_impl->Intern(get_ok->routing_key);
 
   BasicMessage::ptr_t message = m_impl->ReadContent(channel);
-  envelope = Envelope::Create(message, "", delivery_tag, exchange, redelivered,
-                              routing_key, channel);
+  envelope = m_impl->NewEnvelope(message, m_impl->Intern(amqp_empty_bytes),
+                                 delivery_tag, exchange, redelivered,
+                                 routing_key, channel);
 
   m_impl->ReturnChannel(channel);
   m_impl->MaybeReleaseBuffersOnChannel(channel);
   return true;
 }
 
+Channel::BasicResult Channel::TryBasicGet(Envelope::ptr_t &envelope,
+                                          const std::string &queue,
+                                          bool no_ack) {
+  BasicResult result;
+  try {
+    if (!BasicGet(envelope, queue, no_ack)) {
+      result.status = BasicResult::empty;
+    }
+  } catch (const ChannelException &e) {
+    result = ChannelErrorResult(e);
+  }
+  return result;
+}
+
 void Channel::BasicRecover(const std::string &consumer) {
   const boost::array<boost::uint32_t, 1> RECOVER_OK = {
       {AMQP_BASIC_RECOVER_OK_METHOD}};
@@ -957,6 +1051,7 @@ std::string Channel::BasicConsume(const std::string &queue,
   qos.global = m_impl->BrokerHasNewQosBehavior();
 
   m_impl->DoRpcOnChannel(channel, AMQP_BASIC_QOS_METHOD, &qos, QOS_OK);
+  m_impl->SetConsumerPrefetch(channel, message_prefetch_count);
   m_impl->MaybeReleaseBuffersOnChannel(channel);
 
   const boost::array<boost::uint32_t, 1> CONSUME_OK = {
@@ -970,9 +1065,9 @@ std::string Channel::BasicConsume(const std::string &queue,
   consume.exclusive = exclusive;
   consume.nowait = false;
 
-  Detail::amqp_pool_ptr_t table_pool;
+  Detail::ScopedPoolRecycler scratch(m_impl->m_scratch_pool);
   consume.arguments =
-      Detail::TableValueImpl::CreateAmqpTable(arguments, table_pool);
+      Detail::TableValueImpl::CreateAmqpTable(arguments, scratch.Get());
 
   amqp_frame_t response = m_impl->DoRpcOnChannel(
       channel, AMQP_BASIC_CONSUME_METHOD, &consume, CONSUME_OK);
@@ -1001,6 +1096,7 @@ void Channel::BasicQos(const std::string &consumer_tag,
   qos.global = m_impl->BrokerHasNewQosBehavior();
 
   m_impl->DoRpcOnChannel(channel, AMQP_BASIC_QOS_METHOD, &qos, QOS_OK);
+  m_impl->SetConsumerPrefetch(channel, message_prefetch_count);
   m_impl->MaybeReleaseBuffersOnChannel(channel);
 }
 
@@ -1056,6 +1152,21 @@ bool Channel::BasicConsumeMessage(const std::string &consumer_tag,
   return m_impl->ConsumeMessageOnChannel(channels, message, timeout);
 }
 
+Channel::BasicResult Channel::TryBasicConsumeMessage(
+    const std::string &consumer_tag, Envelope::ptr_t &envelope, int timeout) {
+  BasicResult result;
+  try {
+    if (!BasicConsumeMessage(consumer_tag, envelope, timeout)) {
+      result.status = BasicResult::empty;
+    }
+  } catch (const ConsumerCancelledException &) {
+    result.status = BasicResult::consumer_cancelled;
+  } catch (const ChannelException &e) {
+    result = ChannelErrorResult(e);
+  }
+  return result;
+}
+
 bool Channel::BasicConsumeMessage(const std::vector<std::string> &consumer_tags,
                                   Envelope::ptr_t &message, int timeout) {
   m_impl->CheckIsConnected();
@@ -44,13 +44,17 @@
 #include "SimpleAmqpClient/AmqpException.h"
 #include "SimpleAmqpClient/AmqpLibraryException.h"
 #include "SimpleAmqpClient/AmqpResponseLibraryException.h"
+#include "SimpleAmqpClient/BasicMessageImpl.h"
 #include "SimpleAmqpClient/ChannelImpl.h"
 #include "SimpleAmqpClient/ConnectionClosedException.h"
 #include "SimpleAmqpClient/ConsumerTagNotFoundException.h"
+#include "SimpleAmqpClient/MessageRejectedException.h"
+#include "SimpleAmqpClient/Probes.h"
 #include "SimpleAmqpClient/TableImpl.h"
 #define BOOST_BIND_GLOBAL_PLACEHOLDERS
 #include <string.h>
 
+#include <algorithm>
 #include <boost/bind.hpp>
 #include <boost/lexical_cast.hpp>
 
@@ -59,65 +63,27 @@
 namespace AmqpClient {
 
 namespace {
-
-std::string BytesToString(amqp_bytes_t bytes) {
-  return std::string(reinterpret_cast<char *>(bytes.bytes), bytes.len);
-}
-
-void SetMessageProperties(BasicMessage &mes,
-                          const amqp_basic_properties_t &props) {
-  if (0 != (props._flags & AMQP_BASIC_CONTENT_TYPE_FLAG)) {
-    mes.ContentType(BytesToString(props.content_type));
-  }
-  if (0 != (props._flags & AMQP_BASIC_CONTENT_ENCODING_FLAG)) {
-    mes.ContentEncoding(BytesToString(props.content_encoding));
-  }
-  if (0 != (props._flags & AMQP_BASIC_DELIVERY_MODE_FLAG)) {
-    mes.DeliveryMode(
-        static_cast<BasicMessage::delivery_mode_t>(props.delivery_mode));
-  }
-  if (0 != (props._flags & AMQP_BASIC_PRIORITY_FLAG)) {
-    mes.Priority(props.priority);
-  }
-  if (0 != (props._flags & AMQP_BASIC_CORRELATION_ID_FLAG)) {
-    mes.CorrelationId(BytesToString(props.correlation_id));
-  }
-  if (0 != (props._flags & AMQP_BASIC_REPLY_TO_FLAG)) {
-    mes.ReplyTo(BytesToString(props.reply_to));
-  }
-  if (0 != (props._flags & AMQP_BASIC_EXPIRATION_FLAG)) {
-    mes.Expiration(BytesToString(props.expiration));
-  }
-  if (0 != (props._flags & AMQP_BASIC_MESSAGE_ID_FLAG)) {
-    mes.MessageId(BytesToString(props.message_id));
-  }
-  if (0 != (props._flags & AMQP_BASIC_TIMESTAMP_FLAG)) {
-    mes.Timestamp(props.timestamp);
-  }
-  if (0 != (props._flags & AMQP_BASIC_TYPE_FLAG)) {
-    mes.Type(BytesToString(props.type));
-  }
-  if (0 != (props._flags & AMQP_BASIC_USER_ID_FLAG)) {
-    mes.UserId(BytesToString(props.user_id));
-  }
-  if (0 != (props._flags & AMQP_BASIC_APP_ID_FLAG)) {
-    mes.AppId(BytesToString(props.app_id));
-  }
-  if (0 != (props._flags & AMQP_BASIC_CLUSTER_ID_FLAG)) {
-    mes.ClusterId(BytesToString(props.cluster_id));
-  }
-  if (0 != (props._flags & AMQP_BASIC_HEADERS_FLAG)) {
-    mes.HeaderTable(Detail::TableValueImpl::CreateTable(props.headers));
-  }
-}
+// The frame header and end octet around each frame payload
+const std::size_t FRAME_OVERHEAD = 8;
 }  // namespace
 
 Channel::ChannelImpl::ChannelImpl()
-    : m_last_used_channel(0), m_is_connected(false) {
+    : m_scratch_pool(4096),
+      m_lazy_header_decoding(false),
+      m_return_handler_body(false),
+      m_next_publish_seq_no(1),
+      m_read_ahead_limit_count(0),
+      m_read_ahead_limit_bytes(0),
+      m_read_ahead_bytes(0),
+      m_last_used_channel(0),
+      m_is_connected(false) {
   m_channels.push_back(CS_Used);
 }
 
-Channel::ChannelImpl::~ChannelImpl() {}
+Channel::ChannelImpl::~ChannelImpl() {
+  std::for_each(m_frame_queue.begin(), m_frame_queue.end(),
+                &Detail::FrameStore::Free);
+}
 
 void Channel::ChannelImpl::DoLogin(const std::string &username,
                                    const std::string &password,
@@ -192,6 +158,8 @@ amqp_channel_t Channel::ChannelImpl::CreateNewChannel() {
       new_channel, AMQP_CONFIRM_SELECT_METHOD, &confirm_select, CONFIRM_OK);
 
   m_channels.at(new_channel) = CS_Open;
+  m_stats.open_channels.Set(m_stats.open_channels.Get() + 1);
+  SAC_PROBE1(channel_open, new_channel);
 
   return new_channel;
 }
@@ -225,17 +193,28 @@ bool Channel::ChannelImpl::IsChannelOpen(amqp_channel_t channel) {
 }
 
 void Channel::ChannelImpl::FinishCloseChannel(amqp_channel_t channel) {
+  if (CS_Closed != m_channels.at(channel)) {
+    m_stats.open_channels.Set(m_stats.open_channels.Get() - 1);
+  }
   m_channels.at(channel) = CS_Closed;
+  SAC_PROBE1(channel_close, channel);
+  ForgetConsumerChannel(channel);
+  m_pending_qos_ok.erase(channel);
 
   amqp_channel_close_ok_t close_ok;
   CheckForError(amqp_send_method(m_connection, channel,
                                  AMQP_CHANNEL_CLOSE_OK_METHOD, &close_ok));
+  m_stats.frames_sent.Add();
+  ObserveFrameSent(channel, AMQP_FRAME_METHOD, AMQP_CHANNEL_CLOSE_OK_METHOD, 0);
 }
 
 void Channel::ChannelImpl::FinishCloseConnection() {
   SetIsConnected(false);
+  m_stats.open_channels.Set(0);
   amqp_connection_close_ok_t close_ok;
   amqp_send_method(m_connection, 0, AMQP_CONNECTION_CLOSE_OK_METHOD, &close_ok);
+  m_stats.frames_sent.Add();
+  ObserveFrameSent(0, AMQP_FRAME_METHOD, AMQP_CONNECTION_CLOSE_OK_METHOD, 0);
 }
 
 void Channel::ChannelImpl::CheckRpcReply(amqp_channel_t channel,
@@ -270,22 +249,233 @@ void Channel::ChannelImpl::CheckForError(int ret) {
   }
 }
 
-MessageReturnedException Channel::ChannelImpl::CreateMessageReturnedException(
-    amqp_basic_return_t &return_method, amqp_channel_t channel) {
-  const int reply_code = return_method.reply_code;
-  const std::string reply_text((char *)return_method.reply_text.bytes,
-                               return_method.reply_text.len);
-  const std::string exchange((char *)return_method.exchange.bytes,
-                             return_method.exchange.len);
-  const std::string routing_key((char *)return_method.routing_key.bytes,
-                                return_method.routing_key.len);
-  BasicMessage::ptr_t content = ReadContent(channel);
-  return MessageReturnedException(content, reply_code, reply_text, exchange,
-                                  routing_key);
+Channel::BasicResult Channel::ChannelImpl::PublishAndWaitForConfirm(
+    amqp_bytes_t exchange, amqp_bytes_t routing_key, bool mandatory,
+    bool immediate, const amqp_basic_properties_t &properties,
+    amqp_bytes_t body) {
+  amqp_channel_t channel = GetChannel();
+  const boost::uint64_t publish_seq_no = m_next_publish_seq_no++;
+
+  SAC_PROBE2(publish_start, channel, body.len);
+  Detail::LatencyTimer timer(m_stats.publish_confirm_latency,
+                             m_stats.track_latency);
+  CheckForError(amqp_basic_publish(m_connection, channel, exchange,
+                                   routing_key, mandatory, immediate,
+                                   &properties, body));
+  // The method, the content header and the body frames
+  const std::size_t max_payload =
+      amqp_get_frame_max(m_connection) - FRAME_OVERHEAD;
+  m_stats.frames_sent.Add(2 + (body.len + max_payload - 1) / max_payload);
+  m_stats.messages_published.Add();
+  m_stats.bytes_published.Add(body.len);
+  ObservePublishSent(channel, body.len);
+  BasicResult result = WaitForPublishConfirm(channel, publish_seq_no);
+  timer.Stop();
+  SAC_PROBE2(publish_end, channel, static_cast<int>(result.status));
+  return result;
 }
 
-BasicMessage::ptr_t Channel::ChannelImpl::ReadContent(amqp_channel_t channel) {
+Channel::BasicResult Channel::ChannelImpl::PublishAndWaitForConfirm(
+    amqp_bytes_t exchange, amqp_bytes_t routing_key, bool mandatory,
+    bool immediate, const amqp_basic_properties_t &properties,
+    const std::vector<boost::string_ref> &body) {
+  const std::size_t max_payload = amqp_get_frame_max(m_connection) -
+                                  FRAME_OVERHEAD;
+
+  boost::uint64_t body_size = 0;
+  for (std::vector<boost::string_ref>::const_iterator it = body.begin();
+       it != body.end(); ++it) {
+    body_size += it->size();
+  }
+
+  amqp_channel_t channel = GetChannel();
+  const boost::uint64_t publish_seq_no = m_next_publish_seq_no++;
+
+  SAC_PROBE2(publish_start, channel, body_size);
+  Detail::LatencyTimer timer(m_stats.publish_confirm_latency,
+                             m_stats.track_latency);
+  amqp_basic_publish_t publish = {};
+  publish.exchange = exchange;
+  publish.routing_key = routing_key;
+  publish.mandatory = mandatory;
+  publish.immediate = immediate;
+  CheckForError(amqp_send_method(m_connection, channel,
+                                 AMQP_BASIC_PUBLISH_METHOD, &publish));
+  m_stats.frames_sent.Add();
+  ObserveFrameSent(channel, AMQP_FRAME_METHOD, AMQP_BASIC_PUBLISH_METHOD, 0);
+
   amqp_frame_t frame;
+  frame.frame_type = AMQP_FRAME_HEADER;
+  frame.channel = channel;
+  frame.payload.properties.class_id = AMQP_BASIC_CLASS;
+  frame.payload.properties.body_size = body_size;
+  frame.payload.properties.decoded =
+      const_cast<amqp_basic_properties_t *>(&properties);
+  CheckForError(amqp_send_frame(m_connection, &frame));
+  m_stats.frames_sent.Add();
+  ObserveFrameSent(channel, AMQP_FRAME_HEADER, 0, body_size);
+
+  frame.frame_type = AMQP_FRAME_BODY;
+  for (std::vector<boost::string_ref>::const_iterator it = body.begin();
+       it != body.end(); ++it) {
+    for (std::size_t offset = 0; offset < it->size(); offset += max_payload) {
+      frame.payload.body_fragment.bytes =
+          const_cast<char *>(it->data() + offset);
+      frame.payload.body_fragment.len =
+          std::min(it->size() - offset, max_payload);
+      CheckForError(amqp_send_frame(m_connection, &frame));
+      m_stats.frames_sent.Add();
+      ObserveFrameSent(channel, AMQP_FRAME_BODY, 0,
+                       frame.payload.body_fragment.len);
+    }
+  }
+  m_stats.messages_published.Add();
+  m_stats.bytes_published.Add(body_size);
+  BasicResult result = WaitForPublishConfirm(channel, publish_seq_no);
+  timer.Stop();
+  SAC_PROBE2(publish_end, channel, static_cast<int>(result.status));
+  return result;
+}
+
+void Channel::ChannelImpl::NotifyFrameObserver(
+    FrameEvent::direction_t direction, amqp_channel_t channel,
+    boost::uint8_t frame_type, boost::uint32_t method_id,
+    boost::uint64_t size) {
+  FrameEvent event;
+  event.direction = direction;
+  event.channel = channel;
+  event.frame_type = static_cast<FrameEvent::frame_type_t>(frame_type);
+  event.method_id = method_id;
+  event.size = size;
+  event.timestamp = boost::chrono::steady_clock::now();
+  // A copy, so the observer may replace itself
+  frame_observer_t observer = m_frame_observer;
+  observer(event);
+}
+
+void Channel::ChannelImpl::NotifyPublishSent(amqp_channel_t channel,
+                                             boost::uint64_t body_size) {
+  // amqp_basic_publish sent the method, the content header and as many body
+  // frames as the frame size requires.
+  NotifyFrameObserver(FrameEvent::sent, channel, AMQP_FRAME_METHOD,
+                      AMQP_BASIC_PUBLISH_METHOD, 0);
+  NotifyFrameObserver(FrameEvent::sent, channel, AMQP_FRAME_HEADER, 0,
+                      body_size);
+  const boost::uint64_t max_payload =
+      amqp_get_frame_max(m_connection) - FRAME_OVERHEAD;
+  for (boost::uint64_t offset = 0; offset < body_size;
+       offset += max_payload) {
+    NotifyFrameObserver(FrameEvent::sent, channel, AMQP_FRAME_BODY, 0,
+                        std::min(body_size - offset, max_payload));
+  }
+}
+
+void Channel::ChannelImpl::NotifyFrameReceived(const amqp_frame_t &frame) {
+  boost::uint32_t method_id = 0;
+  boost::uint64_t size = 0;
+  switch (frame.frame_type) {
+    case AMQP_FRAME_METHOD:
+      method_id = frame.payload.method.id;
+      break;
+    case AMQP_FRAME_HEADER:
+      size = frame.payload.properties.body_size;
+      break;
+    case AMQP_FRAME_BODY:
+      size = frame.payload.body_fragment.len;
+      break;
+  }
+  NotifyFrameObserver(FrameEvent::received, frame.channel, frame.frame_type,
+                      method_id, size);
+}
+
+Channel::BasicResult Channel::ChannelImpl::WaitForPublishConfirm(
+    amqp_channel_t channel, boost::uint64_t publish_seq_no) {
+  // If we've done things correctly we can get one of 4 things back from the
+  // broker
+  // - basic.ack - our channel is in confirm mode, messsage was 'dealt with' by
+  // the broker
+  // - basic.nack - our channel is in confirm mode, queue has max-length set and
+  // is full, queue overflow stratege is reject-publish
+  // - basic.return then basic.ack - the message wasn't delievered, but was
+  // dealt with
+  // - channel.close - probably tried to publish to a non-existant exchange, in
+  // any case error!
+  // - connection.clsoe - something really bad happened
+  const boost::array<boost::uint32_t, 3> PUBLISH_ACK = {
+      {AMQP_BASIC_ACK_METHOD, AMQP_BASIC_RETURN_METHOD,
+       AMQP_BASIC_NACK_METHOD}};
+  amqp_frame_t response;
+  boost::array<amqp_channel_t, 1> channels = {{channel}};
+  GetMethodOnChannel(channels, response, PUBLISH_ACK);
+  SAC_PROBE2(confirm_received, channel, response.payload.method.id);
+
+  BasicResult result;
+  if (AMQP_BASIC_ACK_METHOD == response.payload.method.id) {
+    m_stats.acks_received.Add();
+  } else if (AMQP_BASIC_NACK_METHOD == response.payload.method.id) {
+    m_stats.nacks_received.Add();
+    amqp_basic_nack_t *nack_method =
+        reinterpret_cast<amqp_basic_nack_t *>(response.payload.method.decoded);
+    result.status = BasicResult::rejected;
+    result.delivery_tag = nack_method->delivery_tag;
+  } else if (AMQP_BASIC_RETURN_METHOD == response.payload.method.id) {
+    amqp_basic_return_t *return_method =
+        reinterpret_cast<amqp_basic_return_t *>(
+            response.payload.method.decoded);
+    ReturnedMessage returned;
+    returned.publish_seq_no = publish_seq_no;
+    returned.reply_code = return_method->reply_code;
+    returned.reply_text.assign((char *)return_method->reply_text.bytes,
+                               return_method->reply_text.len);
+    returned.exchange.assign((char *)return_method->exchange.bytes,
+                             return_method->exchange.len);
+    returned.routing_key.assign((char *)return_method->routing_key.bytes,
+                                return_method->routing_key.len);
+    returned.message =
+        ReadContent(channel, !m_return_handler || m_return_handler_body);
+
+    const boost::array<boost::uint32_t, 1> BASIC_ACK = {
+        {AMQP_BASIC_ACK_METHOD}};
+    GetMethodOnChannel(channels, response, BASIC_ACK);
+    m_stats.returns_received.Add();
+    m_stats.acks_received.Add();
+
+    if (m_return_handler) {
+      ReturnChannel(channel);
+      MaybeReleaseBuffersOnChannel(channel);
+      // A copy, so the handler may replace itself
+      const return_handler_t handler = m_return_handler;
+      handler(returned);
+      return result;
+    }
+    result.status = BasicResult::returned;
+    result.reply_code = returned.reply_code;
+    result.reply_text.swap(returned.reply_text);
+    result.returned_message = returned.message;
+  }
+
+  ReturnChannel(channel);
+  MaybeReleaseBuffersOnChannel(channel);
+  return result;
+}
+
+void Channel::ChannelImpl::CheckPublishResult(const BasicResult &result,
+                                              amqp_bytes_t exchange,
+                                              amqp_bytes_t routing_key) {
+  if (BasicResult::rejected == result.status) {
+    throw MessageRejectedException(result.delivery_tag);
+  }
+  if (BasicResult::returned == result.status) {
+    throw MessageReturnedException(
+        result.returned_message, result.reply_code, result.reply_text,
+        std::string((char *)exchange.bytes, exchange.len),
+        std::string((char *)routing_key.bytes, routing_key.len));
+  }
+}
+
+BasicMessage::ptr_t Channel::ChannelImpl::ReadContent(amqp_channel_t channel,
+                                                      bool with_body) {
+  amqp_frame_t frame = amqp_frame_t();
 
   GetNextFrameOnChannel(channel, frame);
 
@@ -308,9 +498,12 @@ BasicMessage::ptr_t Channel::ChannelImpl::ReadContent(amqp_channel_t channel) {
 
   size_t body_size = static_cast<size_t>(frame.payload.properties.body_size);
   size_t received_size = 0;
+  const amqp_bytes_t raw_properties = frame.payload.properties.raw;
 
-  BasicMessage::ptr_t message = BasicMessage::Create();
-  message->Body().reserve(body_size);
+  BasicMessage::ptr_t message = NewMessage();
+  if (with_body) {
+    message->Body().reserve(body_size);
+  }
 
   // frame #3 and up:
   while (received_size < body_size) {
@@ -322,13 +515,17 @@ BasicMessage::ptr_t Channel::ChannelImpl::ReadContent(amqp_channel_t channel) {
           "Channel::BasicConsumeMessage: received unexpected frame type (was "
           "expecting AMQP_FRAME_BODY)");
 
-    message->Body().append(
-        reinterpret_cast<char *>(frame.payload.body_fragment.bytes),
-        frame.payload.body_fragment.len);
+    if (with_body) {
+      message->Body().append(
+          reinterpret_cast<char *>(frame.payload.body_fragment.bytes),
+          frame.payload.body_fragment.len);
+    }
     received_size += frame.payload.body_fragment.len;
   }
 
-  SetMessageProperties(*message, *properties);
+  Detail::BasicMessageImpl::SetProperties(
+      *message, *properties,
+      m_lazy_header_decoding ? &raw_properties : NULL);
 
   return message;
 }
@@ -352,6 +549,32 @@ void Channel::ChannelImpl::CheckFrameForClose(amqp_frame_t &frame,
   }
 }
 
+BasicMessage::ptr_t Channel::ChannelImpl::NewMessage() {
+  if (m_message_pool) {
+    return m_message_pool->AcquireMessage();
+  }
+  return BasicMessage::Create();
+}
+
+Envelope::ptr_t Channel::ChannelImpl::NewEnvelope(
+    const BasicMessage::ptr_t &message,
+    const Envelope::string_ptr_t &consumer_tag, boost::uint64_t delivery_tag,
+    const Envelope::string_ptr_t &exchange, bool redelivered,
+    const Envelope::string_ptr_t &routing_key, amqp_channel_t channel) {
+  const std::size_t body_size =
+      static_cast<const BasicMessage &>(*message).Body().size();
+  m_stats.messages_consumed.Add();
+  m_stats.bytes_consumed.Add(body_size);
+  SAC_PROBE3(deliver_assembled, channel, delivery_tag, body_size);
+  if (m_message_pool) {
+    return m_message_pool->AcquireEnvelope(message, consumer_tag,
+                                           delivery_tag, exchange, redelivered,
+                                           routing_key, channel);
+  }
+  return Envelope::Create(message, consumer_tag, delivery_tag, exchange,
+                          redelivered, routing_key, channel);
+}
+
 void Channel::ChannelImpl::AddConsumer(const std::string &consumer_tag,
                                        amqp_channel_t channel) {
   m_consumer_channel_map.insert(std::make_pair(consumer_tag, channel));
@@ -368,6 +591,7 @@ amqp_channel_t Channel::ChannelImpl::RemoveConsumer(
   amqp_channel_t result = it->second;
 
   m_consumer_channel_map.erase(it);
+  ForgetConsumerChannel(result);
 
   return result;
 }
@@ -397,7 +621,8 @@ bool Channel::ChannelImpl::CheckForQueuedMessageOnChannel(
     amqp_channel_t channel) const {
   frame_queue_t::const_iterator it =
       std::find_if(m_frame_queue.begin(), m_frame_queue.end(),
-                   boost::bind(&Channel::ChannelImpl::is_method_on_channel, _1,
+                   boost::bind(&Channel::ChannelImpl::is_method_on_channel,
+                               boost::bind(&Detail::QueuedFrame::frame, _1),
                                AMQP_BASIC_DELIVER_METHOD, channel));
 
   if (it == m_frame_queue.end()) {
@@ -406,37 +631,40 @@ bool Channel::ChannelImpl::CheckForQueuedMessageOnChannel(
 
   it = std::find_if(
       it + 1, m_frame_queue.end(),
-      boost::bind(&Channel::ChannelImpl::is_on_channel, _1, channel));
+      boost::bind(&Channel::ChannelImpl::is_on_channel,
+                  boost::bind(&Detail::QueuedFrame::frame, _1), channel));
 
   if (it == m_frame_queue.end()) {
     return false;
   }
-  if (it->frame_type != AMQP_FRAME_HEADER) {
+  if (it->frame.frame_type != AMQP_FRAME_HEADER) {
     throw std::runtime_error("Protocol error");
   }
 
-  uint64_t body_length = it->payload.properties.body_size;
+  uint64_t body_length = it->frame.payload.properties.body_size;
   uint64_t body_received = 0;
 
   while (body_received < body_length) {
     it = std::find_if(
         it + 1, m_frame_queue.end(),
-        boost::bind(&Channel::ChannelImpl::is_on_channel, _1, channel));
+        boost::bind(&Channel::ChannelImpl::is_on_channel,
+                    boost::bind(&Detail::QueuedFrame::frame, _1), channel));
 
     if (it == m_frame_queue.end()) {
       return false;
     }
-    if (it->frame_type != AMQP_FRAME_BODY) {
+    if (it->frame.frame_type != AMQP_FRAME_BODY) {
       throw std::runtime_error("Protocol error");
     }
-    body_received += it->payload.body_fragment.len;
+    // The fragment itself is held in the payload of the queued frame
+    body_received += it->payload.len;
   }
 
   return true;
 }
 
 void Channel::ChannelImpl::AddToFrameQueue(const amqp_frame_t &frame) {
-  m_frame_queue.push_back(frame);
+  QueueFrame(frame);
 
   if (CheckForQueuedMessageOnChannel(frame.channel)) {
     boost::array<amqp_channel_t, 1> channel = {{frame.channel}};
@@ -446,16 +674,160 @@ void Channel::ChannelImpl::AddToFrameQueue(const amqp_frame_t &frame) {
           "ConsumeMessageOnChannelInner returned false unexpectedly");
     }
 
-    m_delivered_messages.push_back(envelope);
+    QueueDelivery(envelope);
   }
 }
 
+namespace {
+// The memory held by a frame read ahead
+std::size_t QueuedFrameBytes(const Detail::QueuedFrame &queued) {
+  return sizeof(Detail::QueuedFrame) + queued.payload.len;
+}
+
+std::size_t QueuedDeliveryBytes(const Envelope::ptr_t &envelope) {
+  return sizeof(Envelope) +
+         static_cast<const BasicMessage &>(*envelope->Message()).Body().size();
+}
+}  // namespace
+
+void Channel::ChannelImpl::QueueFrame(const amqp_frame_t &frame) {
+  const Detail::QueuedFrame queued =
+      m_frame_store.Detach(frame, amqp_get_frame_max(m_connection));
+  try {
+    m_frame_queue.push_back(queued);
+  } catch (...) {
+    Detail::FrameStore::Free(queued);
+    throw;
+  }
+  // Nothing refers to the connection's copy of a queued frame, the channel's
+  // buffers need not wait for the frame to be taken off the queue.
+  amqp_maybe_release_buffers_on_channel(m_connection, frame.channel);
+  m_read_ahead_bytes += QueuedFrameBytes(queued);
+  m_stats.frame_queue.Set(m_frame_queue.size());
+  SAC_PROBE3(frame_queued, frame.channel, frame.frame_type,
+             m_frame_queue.size());
+  CheckReadAheadLimits(frame.channel);
+}
+
+amqp_frame_t Channel::ChannelImpl::UnqueueFrame(frame_queue_t::iterator it) {
+  const amqp_frame_t frame = m_frame_store.Attach(*it);
+  m_read_ahead_bytes -= QueuedFrameBytes(*it);
+  m_frame_queue.erase(it);
+  m_stats.frame_queue.Set(m_frame_queue.size());
+  SAC_PROBE3(frame_dequeued, frame.channel, frame.frame_type,
+             m_frame_queue.size());
+  MaybeRestoreReadAhead();
+  return frame;
+}
+
+void Channel::ChannelImpl::QueueDelivery(const Envelope::ptr_t &envelope) {
+  m_delivered_messages.push_back(envelope);
+  m_read_ahead_bytes += QueuedDeliveryBytes(envelope);
+  m_stats.delivered_queue.Set(m_delivered_messages.size());
+  CheckReadAheadLimits(envelope->DeliveryChannel());
+}
+
+void Channel::ChannelImpl::UnqueueDelivery(envelope_list_t::iterator it) {
+  m_read_ahead_bytes -= QueuedDeliveryBytes(*it);
+  m_delivered_messages.erase(it);
+  m_stats.delivered_queue.Set(m_delivered_messages.size());
+  MaybeRestoreReadAhead();
+}
+
+void Channel::ChannelImpl::SetReadAheadLimits(std::size_t max_count,
+                                              std::size_t max_bytes) {
+  m_read_ahead_limit_count = max_count;
+  m_read_ahead_limit_bytes = max_bytes;
+  MaybeRestoreReadAhead();
+}
+
+void Channel::ChannelImpl::SetConsumerPrefetch(amqp_channel_t channel,
+                                               boost::uint16_t prefetch_count) {
+  m_consumer_prefetch[channel] = prefetch_count;
+  // The new prefetch count replaced any throttling on the broker
+  m_throttled_channels.erase(channel);
+}
+
+void Channel::ChannelImpl::ForgetConsumerChannel(amqp_channel_t channel) {
+  m_consumer_prefetch.erase(channel);
+  m_throttled_channels.erase(channel);
+}
+
+bool Channel::ChannelImpl::ReadAheadOverLimits() const {
+  return (0 != m_read_ahead_limit_count &&
+          m_frame_queue.size() + m_delivered_messages.size() >=
+              m_read_ahead_limit_count) ||
+         (0 != m_read_ahead_limit_bytes &&
+          m_read_ahead_bytes >= m_read_ahead_limit_bytes);
+}
+
+void Channel::ChannelImpl::CheckReadAheadLimits(amqp_channel_t channel) {
+  if (!ReadAheadOverLimits() ||
+      m_consumer_prefetch.end() == m_consumer_prefetch.find(channel) ||
+      !m_throttled_channels.insert(channel).second) {
+    return;
+  }
+  // RabbitMQ does not implement channel.flow from the client, so the
+  // consumer is slowed down by allowing it a single unacked message.
+  SendQosNoWait(channel, 1);
+}
+
+void Channel::ChannelImpl::MaybeRestoreReadAhead() {
+  if (m_throttled_channels.empty()) {
+    return;
+  }
+  // Wait until the read-ahead has halved, so a channel is not throttled and
+  // restored on every message.
+  const std::size_t count = m_frame_queue.size() + m_delivered_messages.size();
+  if ((0 != m_read_ahead_limit_count && count > m_read_ahead_limit_count / 2) ||
+      (0 != m_read_ahead_limit_bytes &&
+       m_read_ahead_bytes > m_read_ahead_limit_bytes / 2)) {
+    return;
+  }
+  std::set<amqp_channel_t> throttled;
+  throttled.swap(m_throttled_channels);
+  for (std::set<amqp_channel_t>::const_iterator it = throttled.begin();
+       it != throttled.end(); ++it) {
+    SendQosNoWait(*it, m_consumer_prefetch[*it]);
+  }
+}
+
+void Channel::ChannelImpl::SendQosNoWait(amqp_channel_t channel,
+                                         boost::uint16_t prefetch_count) {
+  amqp_basic_qos_t qos = {};
+  qos.prefetch_size = 0;
+  qos.prefetch_count = prefetch_count;
+  qos.global = BrokerHasNewQosBehavior();
+
+  CheckForError(
+      amqp_send_method(m_connection, channel, AMQP_BASIC_QOS_METHOD, &qos));
+  m_stats.frames_sent.Add();
+  ObserveFrameSent(channel, AMQP_FRAME_METHOD, AMQP_BASIC_QOS_METHOD, 0);
+  ++m_pending_qos_ok[channel];
+}
+
+bool Channel::ChannelImpl::DropUnsolicitedQosOk(const amqp_frame_t &frame) {
+  if (m_pending_qos_ok.empty() || AMQP_FRAME_METHOD != frame.frame_type ||
+      AMQP_BASIC_QOS_OK_METHOD != frame.payload.method.id) {
+    return false;
+  }
+  std::map<amqp_channel_t, unsigned int>::iterator it =
+      m_pending_qos_ok.find(frame.channel);
+  if (m_pending_qos_ok.end() == it) {
+    return false;
+  }
+  // Replies on a channel come in order, so this answers the oldest basic.qos
+  // sent by SendQosNoWait, not one sent by DoRpcOnChannel after it.
+  if (0 == --it->second) {
+    m_pending_qos_ok.erase(it);
+  }
+  return true;
+}
+
 bool Channel::ChannelImpl::GetNextFrameFromBroker(
     amqp_frame_t &frame, boost::chrono::microseconds timeout) {
-  struct timeval *tvp = NULL;
-  struct timeval tv_timeout;
-  memset(&tv_timeout, 0, sizeof(tv_timeout));
-
+  boost::chrono::steady_clock::time_point end_point;
+  boost::chrono::microseconds timeout_left = timeout;
   if (timeout != boost::chrono::microseconds::max()) {
     // boost::chrono::seconds.count() returns boost::int_atleast64_t,
     // long can be 32 or 64 bit depending on the platform/arch
@@ -466,21 +838,51 @@ bool Channel::ChannelImpl::GetNextFrameFromBroker(
         static_cast<boost::chrono::seconds::rep>(
             std::numeric_limits<long>::max()));
 
-    tv_timeout.tv_sec = static_cast<long>(
-        boost::chrono::duration_cast<boost::chrono::seconds>(timeout).count());
-    tv_timeout.tv_usec = static_cast<long>(
-        (timeout - boost::chrono::seconds(tv_timeout.tv_sec)).count());
-
-    tvp = &tv_timeout;
+    end_point = boost::chrono::steady_clock::now() + timeout;
   }
 
-  int ret = amqp_simple_wait_frame_noblock(m_connection, &frame, tvp);
+  for (;;) {
+    struct timeval *tvp = NULL;
+    struct timeval tv_timeout;
+    memset(&tv_timeout, 0, sizeof(tv_timeout));
 
-  if (AMQP_STATUS_TIMEOUT == ret) {
-    return false;
+    if (timeout != boost::chrono::microseconds::max()) {
+      tv_timeout.tv_sec = static_cast<long>(
+          boost::chrono::duration_cast<boost::chrono::seconds>(timeout_left)
+              .count());
+      tv_timeout.tv_usec = static_cast<long>(
+          (timeout_left - boost::chrono::seconds(tv_timeout.tv_sec)).count());
+
+      tvp = &tv_timeout;
+    }
+
+    Detail::LatencyTimer timer(m_stats.frame_wait_latency,
+                               m_stats.track_latency);
+    int ret = amqp_simple_wait_frame_noblock(m_connection, &frame, tvp);
+    timer.Stop();
+
+    if (AMQP_STATUS_TIMEOUT == ret) {
+      return false;
+    }
+    CheckForError(ret);
+    m_stats.frames_received.Add();
+    ObserveFrameReceived(frame);
+    if (!DropUnsolicitedQosOk(frame)) {
+      return true;
+    }
+
+    // A dropped frame does not restart the timeout, only what is left of it
+    // is waited for
+    if (timeout != boost::chrono::microseconds::max()) {
+      const boost::chrono::steady_clock::time_point now =
+          boost::chrono::steady_clock::now();
+      if (now >= end_point) {
+        return false;
+      }
+      timeout_left = boost::chrono::duration_cast<boost::chrono::microseconds>(
+          end_point - now);
+    }
   }
-  CheckForError(ret);
-  return true;
 }
 
 bool Channel::ChannelImpl::GetNextFrameOnChannel(
@@ -488,11 +890,11 @@ bool Channel::ChannelImpl::GetNextFrameOnChannel(
     boost::chrono::microseconds timeout) {
   frame_queue_t::iterator it = std::find_if(
       m_frame_queue.begin(), m_frame_queue.end(),
-      boost::bind(&Channel::ChannelImpl::is_on_channel, _1, channel));
+      boost::bind(&Channel::ChannelImpl::is_on_channel,
+                  boost::bind(&Detail::QueuedFrame::frame, _1), channel));
 
   if (m_frame_queue.end() != it) {
-    frame = *it;
-    m_frame_queue.erase(it);
+    frame = UnqueueFrame(it);
 
     if (AMQP_FRAME_METHOD == frame.frame_type &&
         AMQP_CHANNEL_CLOSE_METHOD == frame.payload.method.id) {
@@ -509,12 +911,12 @@ bool Channel::ChannelImpl::GetNextFrameOnChannel(
 
 void Channel::ChannelImpl::MaybeReleaseBuffersOnChannel(
     amqp_channel_t channel) {
-  if (m_frame_queue.end() ==
-      std::find_if(
-          m_frame_queue.begin(), m_frame_queue.end(),
-          boost::bind(&Channel::ChannelImpl::is_on_channel, _1, channel))) {
-    amqp_maybe_release_buffers_on_channel(m_connection, channel);
-  }
+  // Queued frames hold copies of their payloads, so the buffers of a
+  // channel can be released even while some of its frames are queued.
+  m_frame_store.Release(channel);
+  amqp_maybe_release_buffers_on_channel(m_connection, channel);
+  m_stats.pool_bytes.Set(Detail::PoolPageBytes(m_scratch_pool.pool) +
+                         m_frame_store.PoolBytes());
 }
 
 void Channel::ChannelImpl::CheckIsConnected() {
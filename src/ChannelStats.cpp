@@ -0,0 +1,161 @@
+/*
+ * ***** BEGIN LICENSE BLOCK *****
+ * Version: MIT
+ *
+ * Copyright (c) 2010-2013 Alan Antonuk
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * ***** END LICENSE BLOCK *****
+ */
+
+#include "SimpleAmqpClient/ChannelStats.h"
+
+#include <amqp.h>
+#include <amqp_framing.h>
+
+#include <limits>
+
+namespace AmqpClient {
+namespace Detail {
+
+const int LatencyRecorder::SUB_BUCKET_BITS;
+const int LatencyRecorder::MAX_EXPONENT;
+const std::size_t LatencyRecorder::BUCKET_COUNT;
+
+LatencyRecorder::LatencyRecorder() : m_sum(0) {
+  for (std::size_t i = 0; i < BUCKET_COUNT; ++i) {
+    m_buckets[i].store(0, boost::memory_order_relaxed);
+  }
+}
+
+std::size_t LatencyRecorder::BucketIndex(boost::uint64_t ns) {
+  const boost::uint64_t sub_buckets = 1u << SUB_BUCKET_BITS;
+  if (ns < sub_buckets) {
+    return static_cast<std::size_t>(ns);
+  }
+  int exponent = SUB_BUCKET_BITS;
+  while (exponent < MAX_EXPONENT && (ns >> (exponent + 1)) != 0) {
+    ++exponent;
+  }
+  if ((ns >> (exponent + 1)) != 0) {
+    return BUCKET_COUNT - 1;
+  }
+  const int shift = exponent - SUB_BUCKET_BITS;
+  return static_cast<std::size_t>((exponent - SUB_BUCKET_BITS + 1)
+                                  << SUB_BUCKET_BITS) +
+         static_cast<std::size_t>((ns >> shift) - sub_buckets);
+}
+
+boost::uint64_t LatencyRecorder::BucketLower(std::size_t index) {
+  const std::size_t sub_buckets = 1u << SUB_BUCKET_BITS;
+  if (index < sub_buckets) {
+    return index;
+  }
+  const int shift = static_cast<int>(index >> SUB_BUCKET_BITS) - 1;
+  return static_cast<boost::uint64_t>(sub_buckets + index % sub_buckets)
+         << shift;
+}
+
+boost::uint64_t LatencyRecorder::BucketUpper(std::size_t index) {
+  if (BUCKET_COUNT - 1 == index) {
+    return std::numeric_limits<boost::uint64_t>::max();
+  }
+  return BucketLower(index + 1) - 1;
+}
+
+LatencyHistogram LatencyRecorder::Snapshot(bool reset) {
+  LatencyHistogram::bucket_list_t buckets;
+  for (std::size_t i = 0; i < BUCKET_COUNT; ++i) {
+    const boost::uint64_t count =
+        reset ? m_buckets[i].exchange(0, boost::memory_order_relaxed)
+              : m_buckets[i].load(boost::memory_order_relaxed);
+    if (0 != count) {
+      LatencyHistogram::Bucket bucket = {BucketLower(i), BucketUpper(i),
+                                         count};
+      buckets.push_back(bucket);
+    }
+  }
+  const boost::uint64_t sum =
+      reset ? m_sum.exchange(0, boost::memory_order_relaxed)
+            : m_sum.load(boost::memory_order_relaxed);
+  return LatencyHistogram(buckets, sum);
+}
+
+const std::size_t ChannelStats::RPC_METHOD_COUNT;
+
+const boost::uint32_t ChannelStats::RPC_METHODS[RPC_METHOD_COUNT] = {
+    AMQP_CHANNEL_OPEN_METHOD,     AMQP_CONFIRM_SELECT_METHOD,
+    AMQP_EXCHANGE_DECLARE_METHOD, AMQP_EXCHANGE_DELETE_METHOD,
+    AMQP_EXCHANGE_BIND_METHOD,    AMQP_EXCHANGE_UNBIND_METHOD,
+    AMQP_QUEUE_DECLARE_METHOD,    AMQP_QUEUE_DELETE_METHOD,
+    AMQP_QUEUE_BIND_METHOD,       AMQP_QUEUE_UNBIND_METHOD,
+    AMQP_QUEUE_PURGE_METHOD,      AMQP_BASIC_GET_METHOD,
+    AMQP_BASIC_RECOVER_METHOD,    AMQP_BASIC_QOS_METHOD,
+    AMQP_BASIC_CONSUME_METHOD,    AMQP_BASIC_CANCEL_METHOD};
+
+void ChannelStats::CountRpc(boost::uint32_t method_id) {
+  std::size_t i = 0;
+  while (i < RPC_METHOD_COUNT && RPC_METHODS[i] != method_id) {
+    ++i;
+  }
+  rpcs[i].Add();
+}
+
+void ChannelStats::Snapshot(Channel::Stats &stats) const {
+  stats.messages_published = messages_published.Get();
+  stats.bytes_published = bytes_published.Get();
+  stats.messages_consumed = messages_consumed.Get();
+  stats.bytes_consumed = bytes_consumed.Get();
+  stats.frames_sent = frames_sent.Get();
+  stats.frames_received = frames_received.Get();
+  stats.acks_received = acks_received.Get();
+  stats.nacks_received = nacks_received.Get();
+  stats.returns_received = returns_received.Get();
+
+  stats.rpcs.clear();
+  for (std::size_t i = 0; i < RPC_METHOD_COUNT; ++i) {
+    const boost::uint64_t count = rpcs[i].Get();
+    if (0 != count) {
+      stats.rpcs[amqp_method_name(RPC_METHODS[i])] = count;
+    }
+  }
+  const boost::uint64_t other = rpcs[RPC_METHOD_COUNT].Get();
+  if (0 != other) {
+    stats.rpcs["other"] = other;
+  }
+
+  stats.frame_queue_depth = frame_queue.Get();
+  stats.frame_queue_high_water = frame_queue.HighWater();
+  stats.delivered_queue_depth = delivered_queue.Get();
+  stats.delivered_queue_high_water = delivered_queue.HighWater();
+  stats.open_channels = open_channels.Get();
+  stats.pool_bytes = pool_bytes.Get();
+  stats.pool_bytes_high_water = pool_bytes.HighWater();
+}
+
+void ChannelStats::SnapshotLatency(Channel::LatencyStats &stats, bool reset) {
+  stats.publish_confirm = publish_confirm_latency.Snapshot(reset);
+  stats.rpc = rpc_latency.Snapshot(reset);
+  stats.frame_wait = frame_wait_latency.Snapshot(reset);
+}
+
+}  // namespace Detail
+}  // namespace AmqpClient
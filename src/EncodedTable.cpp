@@ -0,0 +1,71 @@
+/*
+ * ***** BEGIN LICENSE BLOCK *****
+ * Version: MIT
+ *
+ * Copyright (c) 2010-2013 Alan Antonuk
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * ***** END LICENSE BLOCK *****
+ */
+
+#include "SimpleAmqpClient/EncodedTable.h"
+
+#include <boost/make_shared.hpp>
+#include <stdexcept>
+
+#include "SimpleAmqpClient/TableImpl.h"
+
+namespace AmqpClient {
+
+// An empty field-table is just its zero 32-bit size.
+EncodedTable::EncodedTable()
+    : m_bytes(boost::make_shared<const std::string>(4, '\0')) {}
+
+EncodedTable::EncodedTable(const Table &table) {
+  boost::shared_ptr<std::string> bytes = boost::make_shared<std::string>();
+  Detail::TableValueImpl::EncodeTable(table, *bytes);
+  m_bytes = bytes;
+}
+
+EncodedTable EncodedTable::FromBytes(const std::string &bytes) {
+  std::size_t offset = 0;
+  Detail::TableValueImpl::DecodeTable(bytes.data(), bytes.size(), offset);
+  if (offset != bytes.size()) {
+    throw std::runtime_error("Malformed AMQP field table");
+  }
+
+  EncodedTable encoded;
+  encoded.m_bytes = boost::make_shared<const std::string>(bytes);
+  return encoded;
+}
+
+Table EncodedTable::Decode() const {
+  std::size_t offset = 0;
+  return Detail::TableValueImpl::DecodeTable(m_bytes->data(), m_bytes->size(),
+                                             offset);
+}
+
+bool EncodedTable::Find(const boost::string_ref &key, TableValue &value) const {
+  return Detail::TableValueImpl::FindInTable(m_bytes->data(), m_bytes->size(),
+                                             key, value);
+}
+
+}  // namespace AmqpClient
@@ -36,6 +36,20 @@ Envelope::Envelope(const BasicMessage::ptr_t message,
                    const std::string &exchange, bool redelivered,
                    const std::string &routing_key,
                    const boost::uint16_t delivery_channel)
+    : m_message(message),
+      m_consumerTag(boost::make_shared<const std::string>(consumer_tag)),
+      m_deliveryTag(delivery_tag),
+      m_exchange(boost::make_shared<const std::string>(exchange)),
+      m_redelivered(redelivered),
+      m_routingKey(boost::make_shared<const std::string>(routing_key)),
+      m_deliveryChannel(delivery_channel) {}
+
+Envelope::Envelope(const BasicMessage::ptr_t message,
+                   const string_ptr_t &consumer_tag,
+                   const boost::uint64_t delivery_tag,
+                   const string_ptr_t &exchange, bool redelivered,
+                   const string_ptr_t &routing_key,
+                   const boost::uint16_t delivery_channel)
     : m_message(message),
       m_consumerTag(consumer_tag),
       m_deliveryTag(delivery_tag),
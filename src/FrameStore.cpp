@@ -0,0 +1,180 @@
+/*
+ * ***** BEGIN LICENSE BLOCK *****
+ * Version: MIT
+ *
+ * Copyright (c) 2010-2013 Alan Antonuk
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * ***** END LICENSE BLOCK *****
+ */
+
+#include "SimpleAmqpClient/FrameStore.h"
+
+#include <string.h>
+
+#include <algorithm>
+#include <new>
+
+#include "SimpleAmqpClient/AmqpLibraryException.h"
+
+namespace AmqpClient {
+namespace Detail {
+
+namespace {
+// Methods from the broker are encoded into a buffer of this size, doubled
+// until they fit or it reaches the frame size limit.
+const std::size_t INITIAL_ENCODE_BUFFER = AMQP_FRAME_MIN_SIZE;
+
+amqp_bytes_t CopyBytes(const void *bytes, std::size_t len) {
+  amqp_bytes_t copy = amqp_bytes_malloc(len);
+  if (NULL == copy.bytes && 0 != len) {
+    throw std::bad_alloc();
+  }
+  if (0 != len) {
+    memcpy(copy.bytes, bytes, len);
+  }
+  return copy;
+}
+
+void CheckForError(int ret) {
+  if (ret < 0) {
+    throw AmqpLibraryException::CreateException(ret);
+  }
+}
+}  // namespace
+
+FrameStore::FrameStore() : m_encode_buffer(INITIAL_ENCODE_BUFFER) {}
+
+FrameStore::~FrameStore() {
+  for (channel_memory_map_t::iterator it = m_channel_memory.begin();
+       it != m_channel_memory.end(); ++it) {
+    Release(it->first);
+    empty_amqp_pool(&it->second.pool);
+  }
+}
+
+QueuedFrame FrameStore::Detach(const amqp_frame_t &frame,
+                               std::size_t frame_max) {
+  QueuedFrame queued;
+  queued.frame = frame;
+  switch (frame.frame_type) {
+    case AMQP_FRAME_METHOD: {
+      int ret;
+      for (;;) {
+        amqp_bytes_t buffer;
+        buffer.bytes = &m_encode_buffer[0];
+        buffer.len = m_encode_buffer.size();
+        ret = amqp_encode_method(frame.payload.method.id,
+                                 frame.payload.method.decoded, buffer);
+        if (ret >= 0 || m_encode_buffer.size() >= frame_max) {
+          break;
+        }
+        m_encode_buffer.resize(
+            std::min(m_encode_buffer.size() * 2, frame_max));
+      }
+      CheckForError(ret);
+      queued.payload = CopyBytes(&m_encode_buffer[0], ret);
+      queued.frame.payload.method.decoded = NULL;
+      break;
+    }
+    case AMQP_FRAME_HEADER:
+      // The properties as they arrived, no need to encode them again
+      queued.payload = CopyBytes(frame.payload.properties.raw.bytes,
+                                 frame.payload.properties.raw.len);
+      queued.frame.payload.properties.decoded = NULL;
+      queued.frame.payload.properties.raw = amqp_empty_bytes;
+      break;
+    case AMQP_FRAME_BODY:
+      queued.payload = CopyBytes(frame.payload.body_fragment.bytes,
+                                 frame.payload.body_fragment.len);
+      queued.frame.payload.body_fragment = amqp_empty_bytes;
+      break;
+    default:
+      queued.payload = amqp_empty_bytes;
+      break;
+  }
+  return queued;
+}
+
+amqp_frame_t FrameStore::Attach(const QueuedFrame &queued) {
+  ChannelMemory &memory = GetChannelMemory(queued.frame.channel);
+  amqp_frame_t frame = queued.frame;
+  switch (frame.frame_type) {
+    case AMQP_FRAME_METHOD:
+      CheckForError(amqp_decode_method(frame.payload.method.id, &memory.pool,
+                                       queued.payload,
+                                       &frame.payload.method.decoded));
+      break;
+    case AMQP_FRAME_HEADER:
+      CheckForError(amqp_decode_properties(
+          frame.payload.properties.class_id, &memory.pool, queued.payload,
+          &frame.payload.properties.decoded));
+      frame.payload.properties.raw = queued.payload;
+      break;
+    case AMQP_FRAME_BODY:
+      frame.payload.body_fragment = queued.payload;
+      break;
+  }
+  // Decoded methods and properties point into the payload, it is kept
+  // until the channel is released. Until then the queued frame owns it.
+  memory.payloads.push_back(queued.payload);
+  return frame;
+}
+
+void FrameStore::Free(const QueuedFrame &queued) {
+  amqp_bytes_free(queued.payload);
+}
+
+void FrameStore::Release(amqp_channel_t channel) {
+  channel_memory_map_t::iterator it = m_channel_memory.find(channel);
+  if (m_channel_memory.end() == it) {
+    return;
+  }
+  ChannelMemory &memory = it->second;
+  for (std::vector<amqp_bytes_t>::iterator payload = memory.payloads.begin();
+       payload != memory.payloads.end(); ++payload) {
+    amqp_bytes_free(*payload);
+  }
+  memory.payloads.clear();
+  recycle_amqp_pool(&memory.pool);
+}
+
+std::size_t FrameStore::PoolBytes() const {
+  std::size_t bytes = 0;
+  for (channel_memory_map_t::const_iterator it = m_channel_memory.begin();
+       it != m_channel_memory.end(); ++it) {
+    bytes += PoolPageBytes(it->second.pool);
+  }
+  return bytes;
+}
+
+FrameStore::ChannelMemory &FrameStore::GetChannelMemory(
+    amqp_channel_t channel) {
+  std::pair<channel_memory_map_t::iterator, bool> inserted =
+      m_channel_memory.insert(std::make_pair(channel, ChannelMemory()));
+  if (inserted.second) {
+    init_amqp_pool(&inserted.first->second.pool, INITIAL_ENCODE_BUFFER);
+  }
+  return inserted.first->second;
+}
+
+}  // namespace Detail
+}  // namespace AmqpClient
@@ -0,0 +1,70 @@
+/*
+ * ***** BEGIN LICENSE BLOCK *****
+ * Version: MIT
+ *
+ * Copyright (c) 2010-2013 Alan Antonuk
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * ***** END LICENSE BLOCK *****
+ */
+
+#include "SimpleAmqpClient/LatencyHistogram.h"
+
+#include <cmath>
+
+namespace AmqpClient {
+
+LatencyHistogram::LatencyHistogram() : m_count(0), m_sum(0) {}
+
+LatencyHistogram::LatencyHistogram(const bucket_list_t &buckets,
+                                   boost::uint64_t sum)
+    : m_buckets(buckets), m_count(0), m_sum(sum) {
+  for (bucket_list_t::const_iterator it = m_buckets.begin();
+       it != m_buckets.end(); ++it) {
+    m_count += it->count;
+  }
+}
+
+boost::uint64_t LatencyHistogram::Mean() const {
+  return 0 == m_count ? 0 : m_sum / m_count;
+}
+
+boost::uint64_t LatencyHistogram::Percentile(double percentile) const {
+  if (m_buckets.empty()) {
+    return 0;
+  }
+  // The rank of the wanted latency, counting from 1
+  double rank = std::ceil(percentile / 100.0 * static_cast<double>(m_count));
+  boost::uint64_t wanted =
+      rank < 1.0 ? 1 : static_cast<boost::uint64_t>(rank);
+
+  boost::uint64_t seen = 0;
+  for (bucket_list_t::const_iterator it = m_buckets.begin();
+       it != m_buckets.end(); ++it) {
+    seen += it->count;
+    if (seen >= wanted) {
+      return it->upper;
+    }
+  }
+  return m_buckets.back().upper;
+}
+
+}  // namespace AmqpClient
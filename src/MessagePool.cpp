@@ -0,0 +1,160 @@
+/*
+ * ***** BEGIN LICENSE BLOCK *****
+ * Version: MIT
+ *
+ * Copyright (c) 2010-2013 Alan Antonuk
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * ***** END LICENSE BLOCK *****
+ */
+
+#ifdef _WIN32
+#define NOMINMAX
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#else
+#include <sched.h>
+#endif
+
+#include "SimpleAmqpClient/MessagePool.h"
+
+#include "SimpleAmqpClient/BasicMessageImpl.h"
+
+namespace AmqpClient {
+namespace Detail {
+
+namespace {
+// Attempts to take a SpinLock before each failed attempt yields
+const int SPIN_LIMIT = 64;
+
+void YieldThread() {
+#ifdef _WIN32
+  SwitchToThread();
+#else
+  sched_yield();
+#endif
+}
+}  // namespace
+
+void SpinLock::lock() {
+  for (int attempts = 1; m_flag.test_and_set(boost::memory_order_acquire);
+       ++attempts) {
+    if (attempts >= SPIN_LIMIT) {
+      YieldThread();
+    }
+  }
+}
+
+MessagePool::MessagePool(std::size_t max_size) : m_max_size(max_size) {
+  // Release runs in a shared_ptr deleter, where a failed allocation would
+  // terminate the program, so its push_back must never need to grow.
+  m_messages.reserve(m_max_size);
+  m_envelopes.reserve(m_max_size);
+}
+
+MessagePool::~MessagePool() {
+  for (std::vector<BasicMessage *>::iterator it = m_messages.begin();
+       it != m_messages.end(); ++it) {
+    delete *it;
+  }
+  for (std::vector<Envelope *>::iterator it = m_envelopes.begin();
+       it != m_envelopes.end(); ++it) {
+    delete *it;
+  }
+}
+
+BasicMessage::ptr_t MessagePool::AcquireMessage() {
+  BasicMessage *message = NULL;
+  {
+    SpinLock::ScopedLock lock(m_lock);
+    if (!m_messages.empty()) {
+      message = m_messages.back();
+      m_messages.pop_back();
+    }
+  }
+  if (NULL == message) {
+    message = new BasicMessage;
+  }
+  return BasicMessage::ptr_t(message, Recycler(shared_from_this()));
+}
+
+Envelope::ptr_t MessagePool::AcquireEnvelope(
+    const BasicMessage::ptr_t &message,
+    const Envelope::string_ptr_t &consumer_tag, boost::uint64_t delivery_tag,
+    const Envelope::string_ptr_t &exchange, bool redelivered,
+    const Envelope::string_ptr_t &routing_key,
+    boost::uint16_t delivery_channel) {
+  Envelope *envelope = NULL;
+  {
+    SpinLock::ScopedLock lock(m_lock);
+    if (!m_envelopes.empty()) {
+      envelope = m_envelopes.back();
+      m_envelopes.pop_back();
+    }
+  }
+  if (NULL == envelope) {
+    envelope = new Envelope(message, consumer_tag, delivery_tag, exchange,
+                            redelivered, routing_key, delivery_channel);
+  } else {
+    envelope->m_message = message;
+    envelope->m_consumerTag = consumer_tag;
+    envelope->m_deliveryTag = delivery_tag;
+    envelope->m_exchange = exchange;
+    envelope->m_redelivered = redelivered;
+    envelope->m_routingKey = routing_key;
+    envelope->m_deliveryChannel = delivery_channel;
+  }
+  return Envelope::ptr_t(envelope, Recycler(shared_from_this()));
+}
+
+void MessagePool::Release(BasicMessage *message) {
+  BasicMessageImpl::Reset(*message);
+  {
+    SpinLock::ScopedLock lock(m_lock);
+    if (m_messages.size() < m_max_size) {
+      m_messages.push_back(message);
+      return;
+    }
+  }
+  delete message;
+}
+
+void MessagePool::Release(Envelope *envelope) {
+  // Dropping the message may return it to this pool, so it is done before
+  // taking the lock.
+  envelope->m_message.reset();
+  envelope->m_consumerTag.reset();
+  envelope->m_exchange.reset();
+  envelope->m_routingKey.reset();
+  {
+    SpinLock::ScopedLock lock(m_lock);
+    if (m_envelopes.size() < m_max_size) {
+      m_envelopes.push_back(envelope);
+      return;
+    }
+  }
+  delete envelope;
+}
+
+}  // namespace Detail
+}  // namespace AmqpClient
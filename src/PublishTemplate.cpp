@@ -0,0 +1,116 @@
+/*
+ * ***** BEGIN LICENSE BLOCK *****
+ * Version: MIT
+ *
+ * Copyright (c) 2010-2013 Alan Antonuk
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * ***** END LICENSE BLOCK *****
+ */
+
+#include "SimpleAmqpClient/PublishTemplate.h"
+
+#include <amqp.h>
+#include <amqp_framing.h>
+#include <string.h>
+
+#include <new>
+
+#include "SimpleAmqpClient/BasicMessageImpl.h"
+#include "SimpleAmqpClient/PublishTemplateImpl.h"
+
+namespace AmqpClient {
+
+namespace {
+
+// Copies a string property that points into the prototype message into pool.
+void CopyBytesToPool(amqp_basic_properties_t &props, amqp_flags_t flag,
+                     amqp_bytes_t amqp_basic_properties_t::*field,
+                     amqp_pool_t &pool) {
+  amqp_bytes_t &bytes = props.*field;
+  if (0 == (props._flags & flag) || 0 == bytes.len) {
+    return;
+  }
+  amqp_bytes_t copy;
+  amqp_pool_alloc_bytes(&pool, bytes.len, &copy);
+  if (NULL == copy.bytes) {
+    throw std::bad_alloc();
+  }
+  memcpy(copy.bytes, bytes.bytes, bytes.len);
+  bytes = copy;
+}
+
+}  // namespace
+
+PublishTemplate::Impl::Impl() : mandatory(false) {
+  init_amqp_pool(&pool, 1024);
+}
+
+PublishTemplate::Impl::~Impl() { empty_amqp_pool(&pool); }
+
+PublishTemplate::PublishTemplate(const std::string &exchange,
+                                 const std::string &routing_key,
+                                 const BasicMessage &properties,
+                                 bool mandatory)
+    : m_impl(new Impl) {
+  m_impl->exchange = exchange;
+  m_impl->routing_key = routing_key;
+  m_impl->mandatory = mandatory;
+
+  amqp_basic_properties_t &props = m_impl->properties;
+  props = Detail::BasicMessageImpl::CreateAmqpProperties(properties,
+                                                         m_impl->pool);
+
+  CopyBytesToPool(props, AMQP_BASIC_CONTENT_TYPE_FLAG,
+                  &amqp_basic_properties_t::content_type, m_impl->pool);
+  CopyBytesToPool(props, AMQP_BASIC_CONTENT_ENCODING_FLAG,
+                  &amqp_basic_properties_t::content_encoding, m_impl->pool);
+  CopyBytesToPool(props, AMQP_BASIC_CORRELATION_ID_FLAG,
+                  &amqp_basic_properties_t::correlation_id, m_impl->pool);
+  CopyBytesToPool(props, AMQP_BASIC_REPLY_TO_FLAG,
+                  &amqp_basic_properties_t::reply_to, m_impl->pool);
+  CopyBytesToPool(props, AMQP_BASIC_EXPIRATION_FLAG,
+                  &amqp_basic_properties_t::expiration, m_impl->pool);
+  CopyBytesToPool(props, AMQP_BASIC_MESSAGE_ID_FLAG,
+                  &amqp_basic_properties_t::message_id, m_impl->pool);
+  CopyBytesToPool(props, AMQP_BASIC_TYPE_FLAG,
+                  &amqp_basic_properties_t::type, m_impl->pool);
+  CopyBytesToPool(props, AMQP_BASIC_USER_ID_FLAG,
+                  &amqp_basic_properties_t::user_id, m_impl->pool);
+  CopyBytesToPool(props, AMQP_BASIC_APP_ID_FLAG,
+                  &amqp_basic_properties_t::app_id, m_impl->pool);
+  CopyBytesToPool(props, AMQP_BASIC_CLUSTER_ID_FLAG,
+                  &amqp_basic_properties_t::cluster_id, m_impl->pool);
+}
+
+PublishTemplate::~PublishTemplate() {}
+
+const std::string &PublishTemplate::Exchange() const {
+  return m_impl->exchange;
+}
+
+const std::string &PublishTemplate::RoutingKey() const {
+  return m_impl->routing_key;
+}
+
+bool PublishTemplate::Mandatory() const { return m_impl->mandatory; }
+
+}  // namespace AmqpClient
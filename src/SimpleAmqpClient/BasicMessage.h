@@ -28,13 +28,17 @@
  * ***** END LICENSE BLOCK *****
  */
 
+#include <boost/config.hpp>
 #include <boost/cstdint.hpp>
 #include <boost/make_shared.hpp>
 #include <boost/scoped_ptr.hpp>
 #include <boost/shared_ptr.hpp>
 #include <boost/utility.hpp>
+#include <boost/utility/string_ref.hpp>
 #include <string>
+#include <utility>
 
+#include "SimpleAmqpClient/EncodedTable.h"
 #include "SimpleAmqpClient/Table.h"
 #include "SimpleAmqpClient/Util.h"
 
@@ -48,13 +52,22 @@
 
 namespace AmqpClient {
 
+namespace Detail {
+class BasicMessageImpl;
+}  // namespace Detail
+
 /**
  * An AMQP BasicMessage
+ *
+ * The IsSet, delivery mode, priority, timestamp and ...Ref() property
+ * accessors are inline and do not copy.
  */
 class SIMPLEAMQPCLIENT_EXPORT BasicMessage : boost::noncopyable {
  public:
   /// A shared pointer to BasicMessage
   typedef boost::shared_ptr<BasicMessage> ptr_t;
+  /// a `shared_ptr` to an immutable message body, see \ref SharedBody
+  typedef boost::shared_ptr<const std::string> body_ptr_t;
 
   /// With durable queues, messages can be requested to persist or not
   enum delivery_mode_t {
@@ -63,6 +76,24 @@ class SIMPLEAMQPCLIENT_EXPORT BasicMessage : boost::noncopyable {
     dm_persistent = 2
   };
 
+  /// Property presence bits, these match the AMQP basic.properties flags
+  enum property_flags_t {
+    pf_content_type = 1 << 15,
+    pf_content_encoding = 1 << 14,
+    pf_headers = 1 << 13,
+    pf_delivery_mode = 1 << 12,
+    pf_priority = 1 << 11,
+    pf_correlation_id = 1 << 10,
+    pf_reply_to = 1 << 9,
+    pf_expiration = 1 << 8,
+    pf_message_id = 1 << 7,
+    pf_timestamp = 1 << 6,
+    pf_type = 1 << 5,
+    pf_user_id = 1 << 4,
+    pf_app_id = 1 << 3,
+    pf_cluster_id = 1 << 2
+  };
+
   /**
    * Create a new empty BasicMessage object
    */
@@ -78,6 +109,32 @@ class SIMPLEAMQPCLIENT_EXPORT BasicMessage : boost::noncopyable {
     return boost::make_shared<BasicMessage>(body);
   }
 
+#ifndef BOOST_NO_CXX11_RVALUE_REFERENCES
+  /**
+   * Create a new BasicMessage object, taking ownership of the given body
+   *
+   * @param body the message body, left in a valid but unspecified state.
+   * @returns a new BasicMessage object
+   */
+  static ptr_t Create(std::string&& body) {
+    ptr_t message = boost::make_shared<BasicMessage>();
+    message->Body(std::move(body));
+    return message;
+  }
+#endif
+
+  /**
+   * Create a new BasicMessage object sharing the given body
+   *
+   * @param body the message body, see \ref SharedBody.
+   * @returns a new BasicMessage object
+   */
+  static ptr_t Create(const body_ptr_t& body) {
+    ptr_t message = boost::make_shared<BasicMessage>();
+    message->SharedBody(body);
+    return message;
+  }
+
   /// Construct empty BasicMessage
   BasicMessage();
   /// Construct BasicMessage with given body
@@ -91,6 +148,8 @@ class SIMPLEAMQPCLIENT_EXPORT BasicMessage : boost::noncopyable {
 
   /**
    * Gets the message body as a std::string
+   *
+   * The non-const overload first copies a shared body, see \ref SharedBody.
    */
   const std::string& Body() const;
   std::string& Body();
@@ -100,10 +159,55 @@ class SIMPLEAMQPCLIENT_EXPORT BasicMessage : boost::noncopyable {
    */
   void Body(const std::string& body);
 
+#ifndef BOOST_NO_CXX11_RVALUE_REFERENCES
+  /**
+   * Sets the message body, taking ownership of the string
+   */
+  void Body(std::string&& body) {
+    SharedBody(body_ptr_t());
+    Body() = std::move(body);
+  }
+#endif
+
+  /**
+   * Gets the shared message body
+   *
+   * @returns the body set by \ref SharedBody(const body_ptr_t&), or a null
+   * pointer when the message owns its body.
+   */
+  body_ptr_t SharedBody() const;
+
+  /**
+   * Shares an immutable message body
+   *
+   * The message refers to `body` instead of holding a copy, so one large
+   * payload can be published through many messages, and it is published
+   * without being copied. Reading the body through a const BasicMessage
+   * returns the shared string. Modifying it through the non-const
+   * \ref Body() accessor copies it into the message first, and setting a
+   * body stops sharing it.
+   * @param body the message body, a null pointer makes the message own an
+   * empty body
+   */
+  void SharedBody(const body_ptr_t& body);
+
+  /**
+   * Gets which properties are set
+   *
+   * @returns a bitmask of \ref property_flags_t values
+   */
+  boost::uint16_t PropertyFlags() const { return m_flags; }
+
   /**
    * Gets the content type property
    */
   const std::string& ContentType() const;
+  /**
+   * Gets the content type property without copying it, empty if it is not set
+   */
+  boost::string_ref ContentTypeRef() const {
+    return ShortString(ss_content_type);
+  }
   /**
    * Sets the content type property
    */
@@ -111,7 +215,7 @@ class SIMPLEAMQPCLIENT_EXPORT BasicMessage : boost::noncopyable {
   /**
    * Determines whether the content type property is set
    */
-  bool ContentTypeIsSet() const;
+  bool ContentTypeIsSet() const { return 0 != (m_flags & pf_content_type); }
   /**
    * Unsets the content type property if it is set
    */
@@ -121,6 +225,13 @@ class SIMPLEAMQPCLIENT_EXPORT BasicMessage : boost::noncopyable {
    * Gets the content encoding property
    */
   const std::string& ContentEncoding() const;
+  /**
+   * Gets the content encoding property without copying it, empty if it is not
+   * set
+   */
+  boost::string_ref ContentEncodingRef() const {
+    return ShortString(ss_content_encoding);
+  }
   /**
    * Sets the content encoding property
    */
@@ -128,7 +239,9 @@ class SIMPLEAMQPCLIENT_EXPORT BasicMessage : boost::noncopyable {
   /**
    * Determines whether the content encoding property is set
    */
-  bool ContentEncodingIsSet() const;
+  bool ContentEncodingIsSet() const {
+    return 0 != (m_flags & pf_content_encoding);
+  }
   /**
    * Unsets the content encoding property if it is set
    */
@@ -137,7 +250,10 @@ class SIMPLEAMQPCLIENT_EXPORT BasicMessage : boost::noncopyable {
   /**
    * Gets the delivery mode property
    */
-  delivery_mode_t DeliveryMode() const;
+  delivery_mode_t DeliveryMode() const {
+    return DeliveryModeIsSet() ? static_cast<delivery_mode_t>(m_delivery_mode)
+                               : dm_notset;
+  }
   /**
    * Sets the delivery mode property
    */
@@ -145,7 +261,7 @@ class SIMPLEAMQPCLIENT_EXPORT BasicMessage : boost::noncopyable {
   /**
    * Determines whether the delivery mode property is set
    */
-  bool DeliveryModeIsSet() const;
+  bool DeliveryModeIsSet() const { return 0 != (m_flags & pf_delivery_mode); }
   /**
    * Unsets the delivery mode property if it is set
    */
@@ -154,7 +270,7 @@ class SIMPLEAMQPCLIENT_EXPORT BasicMessage : boost::noncopyable {
   /**
    * Gets the priority property
    */
-  boost::uint8_t Priority() const;
+  boost::uint8_t Priority() const { return m_priority; }
   /**
    * Sets the priority property
    */
@@ -162,7 +278,7 @@ class SIMPLEAMQPCLIENT_EXPORT BasicMessage : boost::noncopyable {
   /**
    * Determines whether the priority property is set
    */
-  bool PriorityIsSet() const;
+  bool PriorityIsSet() const { return 0 != (m_flags & pf_priority); }
   /**
    * Unsets the priority property if it is set
    */
@@ -172,6 +288,12 @@ class SIMPLEAMQPCLIENT_EXPORT BasicMessage : boost::noncopyable {
    * Gets the correlation id property
    */
   const std::string& CorrelationId() const;
+  /**
+   * Gets the correlation id property without copying it, empty if it is not set
+   */
+  boost::string_ref CorrelationIdRef() const {
+    return ShortString(ss_correlation_id);
+  }
   /**
    * Sets the correlation id property
    */
@@ -179,7 +301,7 @@ class SIMPLEAMQPCLIENT_EXPORT BasicMessage : boost::noncopyable {
   /**
    * Determines whether the correlation id property is set
    */
-  bool CorrelationIdIsSet() const;
+  bool CorrelationIdIsSet() const { return 0 != (m_flags & pf_correlation_id); }
   /**
    * Unsets the correlation id property
    */
@@ -189,6 +311,10 @@ class SIMPLEAMQPCLIENT_EXPORT BasicMessage : boost::noncopyable {
    * Gets the reply to property
    */
   const std::string& ReplyTo() const;
+  /**
+   * Gets the reply to property without copying it, empty if it is not set
+   */
+  boost::string_ref ReplyToRef() const { return ShortString(ss_reply_to); }
   /**
    * Sets the reply to property
    */
@@ -196,7 +322,7 @@ class SIMPLEAMQPCLIENT_EXPORT BasicMessage : boost::noncopyable {
   /**
    * Determines whether the reply to property is set
    */
-  bool ReplyToIsSet() const;
+  bool ReplyToIsSet() const { return 0 != (m_flags & pf_reply_to); }
   /**
    * Unsets the reply to property
    */
@@ -206,6 +332,10 @@ class SIMPLEAMQPCLIENT_EXPORT BasicMessage : boost::noncopyable {
    * Gets the expiration property
    */
   const std::string& Expiration() const;
+  /**
+   * Gets the expiration property without copying it, empty if it is not set
+   */
+  boost::string_ref ExpirationRef() const { return ShortString(ss_expiration); }
   /**
    * Sets the expiration property
    */
@@ -213,7 +343,7 @@ class SIMPLEAMQPCLIENT_EXPORT BasicMessage : boost::noncopyable {
   /**
    * Determines whether the expiration property is set
    */
-  bool ExpirationIsSet() const;
+  bool ExpirationIsSet() const { return 0 != (m_flags & pf_expiration); }
   /**
    * Unsets the expiration property
    */
@@ -223,6 +353,10 @@ class SIMPLEAMQPCLIENT_EXPORT BasicMessage : boost::noncopyable {
    * Gets the message id property
    */
   const std::string& MessageId() const;
+  /**
+   * Gets the message id property without copying it, empty if it is not set
+   */
+  boost::string_ref MessageIdRef() const { return ShortString(ss_message_id); }
   /**
    * Sets the message id property
    */
@@ -230,7 +364,7 @@ class SIMPLEAMQPCLIENT_EXPORT BasicMessage : boost::noncopyable {
   /**
    * Determines if the message id property is set
    */
-  bool MessageIdIsSet() const;
+  bool MessageIdIsSet() const { return 0 != (m_flags & pf_message_id); }
   /**
    * Unsets the message id property
    */
@@ -239,7 +373,7 @@ class SIMPLEAMQPCLIENT_EXPORT BasicMessage : boost::noncopyable {
   /**
    * Gets the timestamp property
    */
-  boost::uint64_t Timestamp() const;
+  boost::uint64_t Timestamp() const { return m_timestamp; }
   /**
    * Sets the timestamp property
    */
@@ -247,7 +381,7 @@ class SIMPLEAMQPCLIENT_EXPORT BasicMessage : boost::noncopyable {
   /**
    * Determines whether the timestamp property is set
    */
-  bool TimestampIsSet() const;
+  bool TimestampIsSet() const { return 0 != (m_flags & pf_timestamp); }
   /**
    * Unsets the timestamp property
    */
@@ -257,6 +391,10 @@ class SIMPLEAMQPCLIENT_EXPORT BasicMessage : boost::noncopyable {
    * Gets the type property
    */
   const std::string& Type() const;
+  /**
+   * Gets the type property without copying it, empty if it is not set
+   */
+  boost::string_ref TypeRef() const { return ShortString(ss_type); }
   /**
    * Sets the type property
    */
@@ -264,7 +402,7 @@ class SIMPLEAMQPCLIENT_EXPORT BasicMessage : boost::noncopyable {
   /**
    * Determines whether the type property is set
    */
-  bool TypeIsSet() const;
+  bool TypeIsSet() const { return 0 != (m_flags & pf_type); }
   /**
    * Unsets the type property
    */
@@ -274,6 +412,10 @@ class SIMPLEAMQPCLIENT_EXPORT BasicMessage : boost::noncopyable {
    * Gets the user id property
    */
   const std::string& UserId() const;
+  /**
+   * Gets the user id property without copying it, empty if it is not set
+   */
+  boost::string_ref UserIdRef() const { return ShortString(ss_user_id); }
   /**
    * Sets the user id property
    */
@@ -281,7 +423,7 @@ class SIMPLEAMQPCLIENT_EXPORT BasicMessage : boost::noncopyable {
   /**
    * Determines whether the user id property is set
    */
-  bool UserIdIsSet() const;
+  bool UserIdIsSet() const { return 0 != (m_flags & pf_user_id); }
   /**
    * Unsets the user id property
    */
@@ -291,6 +433,10 @@ class SIMPLEAMQPCLIENT_EXPORT BasicMessage : boost::noncopyable {
    * Gets the app id property
    */
   const std::string& AppId() const;
+  /**
+   * Gets the app id property without copying it, empty if it is not set
+   */
+  boost::string_ref AppIdRef() const { return ShortString(ss_app_id); }
   /**
    * Sets the app id property
    */
@@ -298,7 +444,7 @@ class SIMPLEAMQPCLIENT_EXPORT BasicMessage : boost::noncopyable {
   /**
    * Determines whether the app id property is set
    */
-  bool AppIdIsSet() const;
+  bool AppIdIsSet() const { return 0 != (m_flags & pf_app_id); }
   /**
    * Unsets the app id property
    */
@@ -308,6 +454,10 @@ class SIMPLEAMQPCLIENT_EXPORT BasicMessage : boost::noncopyable {
    * Gets the cluster id property
    */
   const std::string& ClusterId() const;
+  /**
+   * Gets the cluster id property without copying it, empty if it is not set
+   */
+  boost::string_ref ClusterIdRef() const { return ShortString(ss_cluster_id); }
   /**
    * Sets the custer id property
    */
@@ -315,7 +465,7 @@ class SIMPLEAMQPCLIENT_EXPORT BasicMessage : boost::noncopyable {
   /**
    * Determines if the cluster id property is set
    */
-  bool ClusterIdIsSet() const;
+  bool ClusterIdIsSet() const { return 0 != (m_flags & pf_cluster_id); }
   /**
    * Unsets the cluster id property
    */
@@ -325,15 +475,63 @@ class SIMPLEAMQPCLIENT_EXPORT BasicMessage : boost::noncopyable {
    * Gets the header table property
    */
   Table& HeaderTable();
-  const Table& HeaderTable() const;
+  /**
+   * Gets a copy of the header table property
+   *
+   * A pre-encoded header table is decoded into the copy and the message is
+   * left unchanged, so several threads may call this on one message at
+   * once. To read a single header, HeaderTableFind avoids the copy.
+   */
+  Table HeaderTable() const;
   /**
    * Sets the header table property
    */
   void HeaderTable(const Table& header_table);
+
+#ifndef BOOST_NO_CXX11_RVALUE_REFERENCES
+  /**
+   * Sets the header table property, taking ownership of the table
+   */
+  void HeaderTable(Table&& header_table) {
+    HeaderTableClear();
+    HeaderTable() = std::move(header_table);
+  }
+#endif
+  /**
+   * Sets the header table property from a pre-encoded table
+   *
+   * The encoded bytes are shared with header_table and sent as-is when the
+   * message is published, skipping the per-publish Table conversion.
+   */
+  void HeaderTable(const EncodedTable& header_table);
+  /**
+   * Is the header table property set from a pre-encoded table
+   *
+   * Getting the header table through the non-const HeaderTable() accessor
+   * drops the pre-encoded form, as the table may then be modified.
+   */
+  bool HeaderTableIsEncoded() const;
+  /**
+   * Gets the header table property in wire format
+   *
+   * Returns the pre-encoded table if one was set, otherwise encodes the
+   * current header table.
+   */
+  EncodedTable EncodedHeaderTable() const;
+  /**
+   * Looks up a single entry of the header table
+   *
+   * When the header table is held encoded (see HeaderTableIsEncoded()), only
+   * the matching entry is decoded.
+   * @param key the header to look up
+   * @param value set to the header's value if it is present
+   * @returns true if the header is present
+   */
+  bool HeaderTableFind(const boost::string_ref& key, TableValue& value) const;
   /**
    * Is there a header table associated with the message
    */
-  bool HeaderTableIsSet() const;
+  bool HeaderTableIsSet() const { return 0 != (m_flags & pf_headers); }
   /**
    * Unsets the header table property
    */
@@ -343,6 +541,43 @@ class SIMPLEAMQPCLIENT_EXPORT BasicMessage : boost::noncopyable {
   struct Impl;
   /// PIMPL idiom
   boost::scoped_ptr<Impl> m_impl;
+
+ private:
+  friend class Detail::BasicMessageImpl;
+
+  /// The short-string properties, in AMQP property order
+  enum short_string_t {
+    ss_content_type,
+    ss_content_encoding,
+    ss_correlation_id,
+    ss_reply_to,
+    ss_expiration,
+    ss_message_id,
+    ss_type,
+    ss_user_id,
+    ss_app_id,
+    ss_cluster_id,
+    ss_count
+  };
+
+  boost::string_ref ShortString(short_string_t which) const {
+    return m_short_strings[which];
+  }
+  void SetShortString(short_string_t which, property_flags_t flag,
+                      const boost::string_ref& value);
+  void ClearShortString(short_string_t which, property_flags_t flag);
+
+  // The properties other than the body and header table are kept here
+  // rather than in Impl so they can be read inline. m_flags says which are
+  // set. Each short-string property keeps its own std::string, so the
+  // references returned by the getters stay valid and follow the setters.
+  // A value too long for the string's inline buffer costs an allocation,
+  // which a message reused through Channel::SetMessagePoolSize keeps.
+  boost::uint16_t m_flags;
+  boost::uint8_t m_delivery_mode;
+  boost::uint8_t m_priority;
+  boost::uint64_t m_timestamp;
+  std::string m_short_strings[ss_count];
 };
 
 }  // namespace AmqpClient
@@ -0,0 +1,69 @@
+#ifndef SIMPLEAMQPCLIENT_BASICMESSAGEIMPL_H
+#define SIMPLEAMQPCLIENT_BASICMESSAGEIMPL_H
+/*
+ * ***** BEGIN LICENSE BLOCK *****
+ * Version: MIT
+ *
+ * Copyright (c) 2010-2013 Alan Antonuk
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * ***** END LICENSE BLOCK *****
+ */
+
+#include <amqp.h>
+#include <amqp_framing.h>
+
+#include "SimpleAmqpClient/BasicMessage.h"
+
+namespace AmqpClient {
+namespace Detail {
+
+/// Converts BasicMessage properties to and from their rabbitmq-c form
+class BasicMessageImpl {
+ public:
+  /// Builds the wire properties of a message. String properties point into
+  /// mes, the header table is allocated from pool.
+  static amqp_basic_properties_t CreateAmqpProperties(const BasicMessage& mes,
+                                                      amqp_pool_t& pool);
+
+  /// Sets the properties of mes that are present in props. When raw, the
+  /// property list of the content header frame, is given the header table is
+  /// kept in its encoded form and only decoded when it is read.
+  static void SetProperties(BasicMessage& mes,
+                            const amqp_basic_properties_t& props,
+                            const amqp_bytes_t* raw = NULL);
+
+  /// Returns mes to the state of a newly created message while keeping the
+  /// capacity of its body and property strings.
+  static void Reset(BasicMessage& mes);
+
+ private:
+  struct short_string_field_t {
+    BasicMessage::short_string_t which;
+    BasicMessage::property_flags_t flag;
+    amqp_bytes_t amqp_basic_properties_t::*member;
+  };
+  static const short_string_field_t SHORT_STRING_FIELDS[BasicMessage::ss_count];
+};
+
+}  // namespace Detail
+}  // namespace AmqpClient
+#endif  // SIMPLEAMQPCLIENT_BASICMESSAGEIMPL_H
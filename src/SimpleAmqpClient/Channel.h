@@ -28,7 +28,9 @@
  * ***** END LICENSE BLOCK *****
  */
 
+#include <boost/chrono/system_clocks.hpp>
 #include <boost/cstdint.hpp>
+#include <boost/function.hpp>
 #include <boost/make_shared.hpp>
 #include <boost/optional.hpp>
 #include <boost/scoped_ptr.hpp>
@@ -36,11 +38,15 @@
 #include <boost/utility.hpp>
 #include <boost/utility/string_ref.hpp>
 #include <boost/variant.hpp>
+#include <cstddef>
+#include <map>
 #include <string>
 #include <vector>
 
 #include "SimpleAmqpClient/BasicMessage.h"
 #include "SimpleAmqpClient/Envelope.h"
+#include "SimpleAmqpClient/LatencyHistogram.h"
+#include "SimpleAmqpClient/PublishTemplate.h"
 #include "SimpleAmqpClient/Table.h"
 #include "SimpleAmqpClient/Util.h"
 
@@ -132,6 +138,136 @@ class SIMPLEAMQPCLIENT_EXPORT Channel : boost::noncopyable {
     bool operator==(const OpenOpts &) const;
   };
 
+  /// The outcome of \ref TryBasicPublish, \ref TryBasicGet or
+  /// \ref TryBasicConsumeMessage.
+  struct SIMPLEAMQPCLIENT_EXPORT BasicResult {
+    enum status_t {
+      ok,     ///< The message was confirmed, or a message was received.
+      empty,  ///< The queue was empty, or the consume timed out.
+      rejected,            ///< The broker nacked the published message.
+      returned,            ///< The broker returned the published message.
+      consumer_cancelled,  ///< The broker cancelled the consumer.
+      channel_error        ///< The broker closed the channel.
+    };
+
+    status_t status;
+    /// The reply code of a returned message or a channel error.
+    boost::uint16_t reply_code;
+    /// The reply text of a returned message or a channel error.
+    std::string reply_text;
+    /// The delivery tag of a rejected message.
+    boost::uint64_t delivery_tag;
+    /// The returned message.
+    BasicMessage::ptr_t returned_message;
+
+    BasicResult() : status(ok), reply_code(0), delivery_tag(0) {}
+    /// `true` when status is `ok`
+    bool Ok() const { return ok == status; }
+  };
+
+  /// A message returned by the broker, see \ref SetReturnHandler.
+  struct SIMPLEAMQPCLIENT_EXPORT ReturnedMessage {
+    boost::uint16_t reply_code;  ///< Why the message was returned.
+    std::string reply_text;      ///< Why the message was returned.
+    std::string exchange;     ///< The exchange the message was published to.
+    std::string routing_key;  ///< The routing key it was published with.
+    /// The returned message. Its body is only read when requested.
+    BasicMessage::ptr_t message;
+    /// The sequence number of the publish that was returned, see
+    /// \ref GetNextPublishSeqNo.
+    boost::uint64_t publish_seq_no;
+
+    ReturnedMessage() : reply_code(0), publish_seq_no(0) {}
+  };
+
+  /// Counters and queue depths of a Channel, see \ref GetStats.
+  struct SIMPLEAMQPCLIENT_EXPORT Stats {
+    boost::uint64_t messages_published;  ///< Messages sent by the publishes.
+    boost::uint64_t bytes_published;     ///< Body bytes of those messages.
+    boost::uint64_t messages_consumed;   ///< Messages received by BasicGet
+                                         ///< and BasicConsumeMessage.
+    boost::uint64_t bytes_consumed;      ///< Body bytes of those messages.
+    boost::uint64_t frames_sent;      ///< Frames sent, excluding heartbeats.
+    boost::uint64_t frames_received;  ///< Frames read from the broker.
+    boost::uint64_t acks_received;    ///< Publishes confirmed by basic.ack.
+    boost::uint64_t nacks_received;   ///< Publishes rejected by basic.nack.
+    boost::uint64_t returns_received;  ///< Publishes returned by the broker.
+    /// RPCs sent, keyed by the method name given by rabbitmq-c
+    std::map<std::string, boost::uint64_t> rpcs;
+    std::size_t frame_queue_depth;  ///< Frames queued for a later read.
+    std::size_t frame_queue_high_water;  ///< Most frames ever queued.
+    std::size_t delivered_queue_depth;   ///< Deliveries read ahead.
+    std::size_t delivered_queue_high_water;  ///< Most deliveries read ahead.
+    std::size_t open_channels;  ///< AMQP channels currently open.
+    /// Pool pages the Channel keeps for reuse: its scratch pool and the
+    /// pools read-ahead frames are decoded into. The pools of rabbitmq-c
+    /// are not included. Updated when a channel's buffers are released.
+    std::size_t pool_bytes;
+    std::size_t pool_bytes_high_water;  ///< Most pool bytes ever kept.
+
+    Stats()
+        : messages_published(0),
+          bytes_published(0),
+          messages_consumed(0),
+          bytes_consumed(0),
+          frames_sent(0),
+          frames_received(0),
+          acks_received(0),
+          nacks_received(0),
+          returns_received(0),
+          frame_queue_depth(0),
+          frame_queue_high_water(0),
+          delivered_queue_depth(0),
+          delivered_queue_high_water(0),
+          open_channels(0),
+          pool_bytes(0),
+          pool_bytes_high_water(0) {}
+  };
+
+  /// Latency histograms of a Channel, see \ref GetLatencyStats.
+  struct SIMPLEAMQPCLIENT_EXPORT LatencyStats {
+    /// From sending a publish until the broker confirms it.
+    LatencyHistogram publish_confirm;
+    /// From sending an RPC, e.g. queue.declare, until its reply is read.
+    LatencyHistogram rpc;
+    /// Time blocked waiting for a frame from the broker, including waits
+    /// that timed out.
+    LatencyHistogram frame_wait;
+  };
+
+  /// A handler of returned messages, see \ref SetReturnHandler.
+  typedef boost::function<void(const ReturnedMessage &)> return_handler_t;
+
+  /// A frame sent to or read from the broker, see \ref SetFrameObserver.
+  struct SIMPLEAMQPCLIENT_EXPORT FrameEvent {
+    /// Whether the frame was sent or received
+    enum direction_t { sent, received };
+    /// The type of a frame, with its value on the wire
+    enum frame_type_t { method = 1, header = 2, body = 3 };
+
+    direction_t direction;
+    boost::uint16_t channel;  ///< The AMQP channel, 0 for the connection.
+    frame_type_t frame_type;
+    /// The method of a method frame, as the AMQP_*_METHOD constants of
+    /// rabbitmq-c, 0 for other frames.
+    boost::uint32_t method_id;
+    /// The payload of a body frame or, for a header frame, the size of the
+    /// content body it announces. 0 for method frames.
+    boost::uint64_t size;
+    /// When the frame was sent or read
+    boost::chrono::steady_clock::time_point timestamp;
+
+    FrameEvent()
+        : direction(sent),
+          channel(0),
+          frame_type(method),
+          method_id(0),
+          size(0) {}
+  };
+
+  /// An observer of frames, see \ref SetFrameObserver.
+  typedef boost::function<void(const FrameEvent &)> frame_observer_t;
+
   /**
    * Open a new channel to the broker.
    *
@@ -717,11 +853,279 @@ class SIMPLEAMQPCLIENT_EXPORT Channel : boost::noncopyable {
    * a \ref MessageReturnedException is thrown. This has no effect when using
    * RabbitMQ v3.0 and newer.
    */
-  void BasicPublish(const std::string &exchange_name,
-                    const std::string &routing_key,
-                    const BasicMessage::ptr_t message, bool mandatory = false,
+  void BasicPublish(const boost::string_ref &exchange_name,
+                    const boost::string_ref &routing_key,
+                    const BasicMessage::ptr_t &message, bool mandatory = false,
                     bool immediate = false);
 
+  /**
+   * Gets the statistics of this Channel
+   *
+   * The counters run from when the Channel was opened. They are updated
+   * with relaxed atomics, so the statistics may be read from another thread
+   * while the Channel is in use. Values read this way are each current but
+   * not taken at a single instant.
+   * @returns a snapshot of the counters
+   */
+  Stats GetStats() const;
+
+  /**
+   * Enables or disables latency tracking
+   *
+   * While enabled, the publish-to-confirm time of each publish, the round
+   * trip of each RPC and the time spent blocked reading frames from the
+   * broker are recorded, see \ref GetLatencyStats. Tracking is disabled by
+   * default, as it reads the clock twice for each frame read. It should be
+   * changed from the thread using the Channel.
+   * @param enabled whether to record latencies
+   */
+  void SetLatencyTracking(bool enabled);
+
+  /**
+   * Whether latency tracking is enabled, see \ref SetLatencyTracking
+   */
+  bool GetLatencyTracking() const;
+
+  /**
+   * Gets the latency histograms of this Channel
+   *
+   * Like \ref GetStats, this may be called from another thread while the
+   * Channel is in use. Publishes and RPCs that fail are not recorded.
+   * @param reset when `true` the histograms are emptied, so the next call
+   * only covers what happened since this one. Each latency is counted in
+   * the buckets of exactly one call, and added to the sum of exactly one
+   * call. The buckets and the sum are not read together, so a latency
+   * recorded during the call may land in the buckets of one snapshot and
+   * the sum of the next, which skews LatencyHistogram::Mean slightly.
+   * @returns a snapshot of the histograms
+   */
+  LatencyStats GetLatencyStats(bool reset = false);
+
+  /**
+   * Sets the handler of messages returned by the broker
+   *
+   * Without a handler, a `basic.return` for a mandatory or immediate publish
+   * makes the publish fail with MessageReturnedException. With one, the
+   * returned message is passed to `handler` and the publish succeeds.
+   * ReturnedMessage::publish_seq_no says which publish was returned, see
+   * \ref GetNextPublishSeqNo.
+   *
+   * The handler is called on the publishing thread, from within the
+   * publish, after the broker has confirmed it. While it runs:
+   * - It may publish on this Channel and call its other methods, also when
+   *   it is called from within \ref BasicPublishFanout, which publishes its
+   *   remaining routing keys once the handler has returned. A return for a
+   *   publish made by the handler calls the handler again before the first
+   *   call has returned.
+   * - It may set a new handler. The handler that is running is kept alive
+   *   until it returns.
+   * - It must not destroy the Channel.
+   * - The ReturnedMessage is only valid until the handler returns, the
+   *   BasicMessage it points to may be kept.
+   *
+   * Exceptions thrown by the handler propagate out of the publish. A fanout
+   * then does not publish its remaining routing keys.
+   * @param handler The handler, an empty handler restores the default.
+   * @param with_body When `false`, the default, the body of the returned
+   * message is skipped rather than copied and ReturnedMessage::message only
+   * has its properties set.
+   */
+  void SetReturnHandler(const return_handler_t &handler,
+                        bool with_body = false);
+
+  /**
+   * Gets the sequence number the next publish on this Channel will get
+   *
+   * Every publish, whichever BasicPublish, TryBasicPublish or
+   * BasicPublishFanout call makes it, takes the next number, starting from
+   * 1. A fanout takes one per routing key. Read this before publishing to
+   * match a ReturnedMessage to its publish.
+   * @returns the sequence number
+   */
+  boost::uint64_t GetNextPublishSeqNo() const;
+
+  /**
+   * Limits the frames and messages read ahead for other consumers
+   *
+   * While waiting on one consumer, or for the reply to an RPC, frames and
+   * messages that arrive for other consumers are held in memory until they
+   * are consumed. Once either limit is reached, the consumer that received
+   * the message has its prefetch count lowered to 1 with `basic.qos`. Its
+   * prefetch count, as set by \ref BasicConsume or \ref BasicQos, is
+   * restored once what is read ahead has fallen to half of the limits.
+   *
+   * The limits are soft: messages already sent by the broker still arrive.
+   * Prefetch counts only limit unacknowledged messages, so consumers started
+   * with `no_ack` are not slowed down. `channel.flow` is not used as RabbitMQ
+   * does not support it being sent by clients.
+   * @param max_count the most frames and messages to hold, 0 for no limit,
+   * the default
+   * @param max_bytes the most bytes to hold, 0 for no limit, the default
+   */
+  void SetReadAheadLimits(std::size_t max_count, std::size_t max_bytes);
+
+  /**
+   * Gets the memory held by frames and messages read ahead
+   *
+   * This counts the frames waiting on the queue as they were read off the
+   * wire and the bodies of the messages assembled from them, not the
+   * properties decoded into those messages.
+   * @returns the size in bytes
+   */
+  std::size_t GetReadAheadBytes() const;
+
+  /**
+   * Sets the observer of the frames of this Channel
+   *
+   * The observer is called for each frame the Channel sends, including each
+   * frame of a publish, and for each frame it reads from the broker. It is
+   * called on the thread using the Channel, right after the frame was sent
+   * or read, so it should be quick, and it must not throw. Frames read ahead
+   * and queued are reported when they are read, not when they are used.
+   * Without an observer, each frame costs a single branch.
+   * @param observer The observer, an empty observer removes it.
+   */
+  void SetFrameObserver(const frame_observer_t &observer);
+
+  /**
+   * Publishes a Basic message, reporting broker refusals in the result
+   *
+   * As \ref BasicPublish, but a `basic.nack`, a `basic.return` or the broker
+   * closing the channel is returned as a \ref BasicResult instead of being
+   * thrown. A return goes to the return handler instead when one is set.
+   * Errors that are not broker outcomes, such as a lost connection, are
+   * still thrown.
+   * @param exchange_name The name of the exchange to publish the message to
+   * @param routing_key The routing key to publish with.
+   * @param message The \ref BasicMessage object to publish.
+   * @param mandatory As for \ref BasicPublish.
+   * @param immediate As for \ref BasicPublish.
+   * @returns `ok`, `rejected`, `returned` or `channel_error`
+   */
+  BasicResult TryBasicPublish(const boost::string_ref &exchange_name,
+                              const boost::string_ref &routing_key,
+                              const BasicMessage::ptr_t &message,
+                              bool mandatory = false, bool immediate = false);
+
+  /**
+   * Publishes a Basic message whose body is held in several buffers
+   *
+   * The body is sent straight from `body_segments`, in order, without being
+   * concatenated, so a large payload, such as a memory-mapped file, does not
+   * need to be copied into BasicMessage::Body() first. The segments must
+   * stay valid until the call returns.
+   * @param exchange_name The name of the exchange to publish the message to
+   * @param routing_key The routing key to publish with.
+   * @param properties The \ref BasicMessage holding the properties of the
+   * message, its body is ignored.
+   * @param body_segments The parts of the message body.
+   * @param mandatory As for \ref BasicPublish.
+   * @param immediate As for \ref BasicPublish.
+   */
+  void BasicPublish(const boost::string_ref &exchange_name,
+                    const boost::string_ref &routing_key,
+                    const BasicMessage::ptr_t &properties,
+                    const std::vector<boost::string_ref> &body_segments,
+                    bool mandatory = false, bool immediate = false);
+
+  /**
+   * Publishes a Basic message with each of several routing keys
+   *
+   * The message properties are encoded once and the body is sent from the
+   * message without copying it, which pairs well with
+   * BasicMessage::SharedBody. The message is published once per routing key,
+   * in order, each waiting for its confirm as \ref BasicPublish does. If one
+   * publish throws, the remaining routing keys are not published to.
+   * @param exchange_name The name of the exchange to publish the message to
+   * @param routing_keys The routing keys to publish with.
+   * @param message The \ref BasicMessage object to publish.
+   * @param mandatory As for \ref BasicPublish.
+   * @param immediate As for \ref BasicPublish.
+   */
+  void BasicPublishFanout(const boost::string_ref &exchange_name,
+                          const std::vector<std::string> &routing_keys,
+                          const BasicMessage::ptr_t &message,
+                          bool mandatory = false, bool immediate = false);
+
+  /**
+   * Publishes a Basic message using a PublishTemplate
+   *
+   * The exchange, routing key, mandatory flag and properties are taken from
+   * the template, so only the body is converted for each message.
+   * @param publish_template The \ref PublishTemplate to publish with.
+   * @param body The message body.
+   */
+  void BasicPublish(const PublishTemplate::ptr_t &publish_template,
+                    const boost::string_ref &body);
+
+  /**
+   * Publishes a Basic message using a PublishTemplate
+   *
+   * As \ref BasicPublish(const PublishTemplate::ptr_t&,
+   * const boost::string_ref&), but the message id and timestamp properties of
+   * the template are replaced for this message.
+   * @param publish_template The \ref PublishTemplate to publish with.
+   * @param body The message body.
+   * @param message_id The message id property for this message.
+   * @param timestamp The timestamp property for this message.
+   */
+  void BasicPublish(const PublishTemplate::ptr_t &publish_template,
+                    const boost::string_ref &body,
+                    const boost::string_ref &message_id,
+                    boost::uint64_t timestamp);
+
+  /**
+   * Enables or disables lazy decoding of received header tables
+   *
+   * When enabled, the header table of each message received by \ref BasicGet
+   * or \ref BasicConsumeMessage is kept as the encoded bytes from the
+   * broker. It is only decoded when it is read, and a single header can be
+   * read with BasicMessage::HeaderTableFind without decoding the rest.
+   * Disabled by default.
+   * @param lazy `true` to enable lazy decoding
+   */
+  void SetLazyHeaderDecoding(bool lazy);
+
+  /**
+   * Determines whether lazy decoding of received header tables is enabled
+   */
+  bool GetLazyHeaderDecoding() const;
+
+  /**
+   * Sets how many received messages and envelopes are kept for reuse
+   *
+   * When non-zero, the BasicMessage and Envelope objects returned by
+   * \ref BasicGet and \ref BasicConsumeMessage are taken from a pool. Once
+   * the last reference to one is released it is cleared and returned to the
+   * pool, keeping the memory of its body and strings, and up to `size` of
+   * each are cached for later deliveries. Objects may be released after the
+   * Channel is destroyed. Changing the size starts a new pool, which
+   * reserves room for `size` pointers of each kind up front. Disabled
+   * (`0`) by default.
+   * @param size the maximum number of cached messages, and of cached
+   * envelopes
+   */
+  void SetMessagePoolSize(std::size_t size);
+
+  /**
+   * Gets the number of received messages and envelopes kept for reuse
+   */
+  std::size_t GetMessagePoolSize() const;
+
+  /**
+   * Gets the shared string this Channel uses for a value
+   *
+   * Envelopes received on this Channel share one string object for each
+   * distinct exchange name, routing key and consumer tag. A consumer can
+   * look up the values it handles once and then match deliveries by
+   * pointer, e.g.:
+   * `envelope->InternedRoutingKey() == channel->InternString("orders")`.
+   * See Envelope::InternedExchange for the limits of this.
+   * @param value the string to look up
+   * @returns the shared string equal to `value`
+   */
+  Envelope::string_ptr_t InternString(const boost::string_ref &value);
+
   /**
    * Synchronously consume a message from a queue
    *
@@ -740,6 +1144,21 @@ class SIMPLEAMQPCLIENT_EXPORT Channel : boost::noncopyable {
   bool BasicGet(Envelope::ptr_t &message, const std::string &queue,
                 bool no_ack = true);
 
+  /**
+   * Synchronously consume a message from a queue, reporting broker errors in
+   * the result
+   *
+   * As \ref BasicGet, but the broker closing the channel, e.g. because the
+   * queue does not exist, is returned instead of being thrown.
+   * @param [out] envelope A message envelope pointer that will be populated
+   * if a message is delivered.
+   * @param queue The name of the queue to try to get the message from.
+   * @param no_ack As for \ref BasicGet.
+   * @returns `ok`, `empty` or `channel_error`
+   */
+  BasicResult TryBasicGet(Envelope::ptr_t &envelope, const std::string &queue,
+                          bool no_ack = true);
+
   /**
    * Redeliver unacknowledged messages from the broker
    * @param consumer The consumer to recover message from
@@ -886,6 +1305,23 @@ class SIMPLEAMQPCLIENT_EXPORT Channel : boost::noncopyable {
   bool BasicConsumeMessage(const std::string &consumer_tag,
                            Envelope::ptr_t &envelope, int timeout = -1);
 
+  /**
+   * Waits for a message on a consumer, reporting broker outcomes in the result
+   *
+   * As \ref BasicConsumeMessage(const std::string&, Envelope::ptr_t&, int),
+   * but the broker cancelling the consumer or closing the channel is
+   * returned instead of being thrown. An unknown consumer tag still throws
+   * ConsumerTagNotFoundException.
+   * @param consumer_tag Consumer ID (returned from \ref BasicConsume).
+   * @param [out] envelope The message object that is delivered.
+   * @param timeout As for \ref BasicConsumeMessage.
+   * @returns `ok`, `empty` on timeout, `consumer_cancelled` or
+   * `channel_error`
+   */
+  BasicResult TryBasicConsumeMessage(const std::string &consumer_tag,
+                                     Envelope::ptr_t &envelope,
+                                     int timeout = -1);
+
   /**
    * Consumes a single message with a timeout from multiple consumers
    *
@@ -37,14 +37,22 @@
 #include "SimpleAmqpClient/AmqpException.h"
 #include "SimpleAmqpClient/BasicMessage.h"
 #include "SimpleAmqpClient/Channel.h"
+#include "SimpleAmqpClient/ChannelStats.h"
 #include "SimpleAmqpClient/ConsumerCancelledException.h"
 #include "SimpleAmqpClient/Envelope.h"
+#include "SimpleAmqpClient/FrameStore.h"
+#include "SimpleAmqpClient/MessagePool.h"
+#include "SimpleAmqpClient/Probes.h"
+#include "SimpleAmqpClient/StringInterner.h"
+#include "SimpleAmqpClient/TableImpl.h"
 #include "SimpleAmqpClient/MessageReturnedException.h"
 #define BOOST_BIND_GLOBAL_PLACEHOLDERS
 #include <boost/bind.hpp>
 #include <boost/chrono.hpp>
 #include <boost/noncopyable.hpp>
+#include <boost/utility/string_ref.hpp>
 #include <map>
+#include <set>
 #include <vector>
 
 namespace AmqpClient {
@@ -55,8 +63,9 @@ class Channel::ChannelImpl : boost::noncopyable {
   virtual ~ChannelImpl();
 
   typedef std::vector<amqp_channel_t> channel_list_t;
-  typedef std::vector<amqp_frame_t> frame_queue_t;
+  typedef std::vector<Detail::QueuedFrame> frame_queue_t;
   typedef std::map<amqp_channel_t, frame_queue_t> channel_map_t;
+  typedef std::vector<Envelope::ptr_t> envelope_list_t;
   typedef channel_map_t::iterator channel_map_iterator_t;
 
   void DoLogin(const std::string &username, const std::string &password,
@@ -161,11 +170,11 @@ class Channel::ChannelImpl : boost::noncopyable {
         boost::bind(
             &ChannelImpl::is_expected_method_on_channel<ChannelListType,
                                                         ResponseListType>,
-            _1, channels, expected_responses));
+            boost::bind(&Detail::QueuedFrame::frame, _1), channels,
+            expected_responses));
 
     if (m_frame_queue.end() != desired_frame) {
-      frame = *desired_frame;
-      m_frame_queue.erase(desired_frame);
+      frame = UnqueueFrame(desired_frame);
       return true;
     }
 
@@ -194,7 +203,7 @@ class Channel::ChannelImpl : boost::noncopyable {
           throw;
         }
       }
-      m_frame_queue.push_back(incoming_frame);
+      QueueFrame(incoming_frame);
 
       if (timeout != boost::chrono::microseconds::max()) {
         boost::chrono::steady_clock::time_point now =
@@ -214,12 +223,19 @@ class Channel::ChannelImpl : boost::noncopyable {
   amqp_frame_t DoRpcOnChannel(amqp_channel_t channel, boost::uint32_t method_id,
                               void *decoded,
                               const ResponseListType &expected_responses) {
+    SAC_PROBE2(rpc_start, channel, method_id);
+    Detail::LatencyTimer timer(m_stats.rpc_latency, m_stats.track_latency);
     CheckForError(amqp_send_method(m_connection, channel, method_id, decoded));
+    m_stats.frames_sent.Add();
+    ObserveFrameSent(channel, AMQP_FRAME_METHOD, method_id, 0);
+    m_stats.CountRpc(method_id);
 
     amqp_frame_t response;
     boost::array<amqp_channel_t, 1> channels = {{channel}};
 
     GetMethodOnChannel(channels, response, expected_responses);
+    timer.Stop();
+    SAC_PROBE2(rpc_end, channel, method_id);
     return response;
   }
 
@@ -250,7 +266,7 @@ class Channel::ChannelImpl : boost::noncopyable {
 
     if (it != m_delivered_messages.end()) {
       message = *it;
-      m_delivered_messages.erase(it);
+      UnqueueDelivery(it);
       return true;
     }
 
@@ -291,13 +307,11 @@ class Channel::ChannelImpl : boost::noncopyable {
         reinterpret_cast<amqp_basic_deliver_t *>(
             deliver.payload.method.decoded);
 
-    const std::string exchange((char *)deliver_method->exchange.bytes,
-                               deliver_method->exchange.len);
-    const std::string routing_key((char *)deliver_method->routing_key.bytes,
-                                  deliver_method->routing_key.len);
-    const std::string in_consumer_tag(
-        (char *)deliver_method->consumer_tag.bytes,
-        deliver_method->consumer_tag.len);
+    const Envelope::string_ptr_t exchange = Intern(deliver_method->exchange);
+    const Envelope::string_ptr_t routing_key =
+        Intern(deliver_method->routing_key);
+    const Envelope::string_ptr_t in_consumer_tag =
+        Intern(deliver_method->consumer_tag);
     const boost::uint64_t delivery_tag = deliver_method->delivery_tag;
     const bool redelivered = (deliver_method->redelivered == 0 ? false : true);
     MaybeReleaseBuffersOnChannel(deliver.channel);
@@ -305,8 +319,8 @@ class Channel::ChannelImpl : boost::noncopyable {
     BasicMessage::ptr_t content = ReadContent(deliver.channel);
     MaybeReleaseBuffersOnChannel(deliver.channel);
 
-    message = Envelope::Create(content, in_consumer_tag, delivery_tag, exchange,
-                               redelivered, routing_key, deliver.channel);
+    message = NewEnvelope(content, in_consumer_tag, delivery_tag, exchange,
+                          redelivered, routing_key, deliver.channel);
     return true;
   }
 
@@ -316,13 +330,70 @@ class Channel::ChannelImpl : boost::noncopyable {
   void CheckRpcReply(amqp_channel_t channel, const amqp_rpc_reply_t &reply);
   void CheckForError(int ret);
 
+  // Report frames to m_frame_observer, these are no-ops without one.
+  void ObserveFrameSent(amqp_channel_t channel, boost::uint8_t frame_type,
+                        boost::uint32_t method_id, boost::uint64_t size) {
+    if (m_frame_observer) {
+      NotifyFrameObserver(FrameEvent::sent, channel, frame_type, method_id,
+                          size);
+    }
+  }
+  void ObservePublishSent(amqp_channel_t channel, boost::uint64_t body_size) {
+    if (m_frame_observer) {
+      NotifyPublishSent(channel, body_size);
+    }
+  }
+  void ObserveFrameReceived(const amqp_frame_t &frame) {
+    if (m_frame_observer) {
+      NotifyFrameReceived(frame);
+    }
+  }
+
   void CheckFrameForClose(amqp_frame_t &frame, amqp_channel_t channel);
   void FinishCloseChannel(amqp_channel_t channel);
   void FinishCloseConnection();
 
-  MessageReturnedException CreateMessageReturnedException(
-      amqp_basic_return_t &return_method, amqp_channel_t channel);
-  AmqpClient::BasicMessage::ptr_t ReadContent(amqp_channel_t channel);
+  // Publishes on a channel from the pool and waits for the broker to confirm
+  // it. A basic.nack or basic.return is reported in the result, other errors
+  // are thrown.
+  BasicResult PublishAndWaitForConfirm(
+      amqp_bytes_t exchange, amqp_bytes_t routing_key, bool mandatory,
+      bool immediate, const amqp_basic_properties_t &properties,
+      amqp_bytes_t body);
+  // As above, with the body sent from several buffers. Each segment is sent
+  // as one or more body frames without being copied.
+  BasicResult PublishAndWaitForConfirm(
+      amqp_bytes_t exchange, amqp_bytes_t routing_key, bool mandatory,
+      bool immediate, const amqp_basic_properties_t &properties,
+      const std::vector<boost::string_ref> &body);
+  BasicResult WaitForPublishConfirm(amqp_channel_t channel,
+                                    boost::uint64_t publish_seq_no);
+
+  // Throws MessageRejectedException or MessageReturnedException for a
+  // rejected or returned publish.
+  static void CheckPublishResult(const BasicResult &result,
+                                 amqp_bytes_t exchange,
+                                 amqp_bytes_t routing_key);
+
+  // Reads a content header and its body frames. When with_body is false the
+  // body frames are consumed but not copied into the message.
+  AmqpClient::BasicMessage::ptr_t ReadContent(amqp_channel_t channel,
+                                              bool with_body = true);
+
+  // Creates received messages and envelopes, from m_message_pool when set.
+  BasicMessage::ptr_t NewMessage();
+  Envelope::ptr_t NewEnvelope(const BasicMessage::ptr_t &message,
+                              const Envelope::string_ptr_t &consumer_tag,
+                              boost::uint64_t delivery_tag,
+                              const Envelope::string_ptr_t &exchange,
+                              bool redelivered,
+                              const Envelope::string_ptr_t &routing_key,
+                              amqp_channel_t channel);
+
+  Envelope::string_ptr_t Intern(amqp_bytes_t bytes) {
+    return m_interned_strings.Intern(
+        boost::string_ref(static_cast<const char *>(bytes.bytes), bytes.len));
+  }
 
   void AddConsumer(const std::string &consumer_tag, amqp_channel_t channel);
   amqp_channel_t RemoveConsumer(const std::string &consumer_tag);
@@ -330,6 +401,20 @@ class Channel::ChannelImpl : boost::noncopyable {
   std::vector<amqp_channel_t> GetAllConsumerChannels() const;
 
   void MaybeReleaseBuffersOnChannel(amqp_channel_t channel);
+
+  // Hold frames and deliveries read ahead for other channels, keeping the
+  // read-ahead accounting up to date and applying its limits.
+  void QueueFrame(const amqp_frame_t &frame);
+  amqp_frame_t UnqueueFrame(frame_queue_t::iterator it);
+  void QueueDelivery(const Envelope::ptr_t &envelope);
+  void UnqueueDelivery(envelope_list_t::iterator it);
+
+  void SetReadAheadLimits(std::size_t max_count, std::size_t max_bytes);
+  std::size_t GetReadAheadBytes() const { return m_read_ahead_bytes; }
+  // Records the prefetch count the application set on a consumer channel,
+  // the one restored once the channel is no longer throttled.
+  void SetConsumerPrefetch(amqp_channel_t channel,
+                           boost::uint16_t prefetch_count);
   void CheckIsConnected();
   void SetIsConnected(bool state) { m_is_connected = state; }
 
@@ -342,18 +427,71 @@ class Channel::ChannelImpl : boost::noncopyable {
 
   amqp_connection_state_t m_connection;
 
+  // Scratch arena for the tables and properties of one outgoing method. Use
+  // it through a Detail::ScopedPoolRecycler so it is recycled, not freed,
+  // once the method has been sent.
+  Detail::ScratchPool m_scratch_pool;
+
+  // Keep the header table of received messages encoded until it is read.
+  bool m_lazy_header_decoding;
+
+  // Receives basic.return instead of the publish failing, when set.
+  return_handler_t m_return_handler;
+  bool m_return_handler_body;
+  // Given to the next publish, see Channel::GetNextPublishSeqNo.
+  boost::uint64_t m_next_publish_seq_no;
+
+  // Called for each frame sent and received, when set.
+  frame_observer_t m_frame_observer;
+
+  // Recycles received messages and envelopes, empty when pooling is disabled.
+  Detail::MessagePool::ptr_t m_message_pool;
+
+  // Exchange names, routing keys and consumer tags shared by the envelopes
+  // received on this connection.
+  Detail::StringInterner m_interned_strings;
+
+  Detail::ChannelStats m_stats;
+
  private:
   static boost::uint32_t ComputeBrokerVersion(
       const amqp_connection_state_t state);
 
+  void NotifyFrameObserver(FrameEvent::direction_t direction,
+                           amqp_channel_t channel, boost::uint8_t frame_type,
+                           boost::uint32_t method_id, boost::uint64_t size);
+  void NotifyPublishSent(amqp_channel_t channel, boost::uint64_t body_size);
+  void NotifyFrameReceived(const amqp_frame_t &frame);
+
+  bool ReadAheadOverLimits() const;
+  void CheckReadAheadLimits(amqp_channel_t channel);
+  void MaybeRestoreReadAhead();
+  void SendQosNoWait(amqp_channel_t channel, boost::uint16_t prefetch_count);
+  bool DropUnsolicitedQosOk(const amqp_frame_t &frame);
+  void ForgetConsumerChannel(amqp_channel_t channel);
+
   frame_queue_t m_frame_queue;
+  // Holds the payloads of the queued frames, and of those taken off the
+  // queue until their channel's buffers are released.
+  Detail::FrameStore m_frame_store;
 
-  typedef std::vector<Envelope::ptr_t> envelope_list_t;
   envelope_list_t m_delivered_messages;
 
   typedef std::map<std::string, amqp_channel_t> consumer_map_t;
   consumer_map_t m_consumer_channel_map;
 
+  // Limits on what is read ahead for other channels, 0 for no limit, and
+  // the bytes it currently holds.
+  std::size_t m_read_ahead_limit_count;
+  std::size_t m_read_ahead_limit_bytes;
+  std::size_t m_read_ahead_bytes;
+  // The prefetch count the application set on each consumer channel, the
+  // consumer channels throttled to a prefetch of 1, and how many basic.qos-ok
+  // replies to drop for the basic.qos sent without waiting on each channel.
+  std::map<amqp_channel_t, boost::uint16_t> m_consumer_prefetch;
+  std::set<amqp_channel_t> m_throttled_channels;
+  std::map<amqp_channel_t, unsigned int> m_pending_qos_ok;
+
   enum channel_state_t { CS_Closed = 0, CS_Open, CS_Used };
   typedef std::vector<channel_state_t> channel_state_list_t;
 
@@ -0,0 +1,185 @@
+#ifndef SIMPLEAMQPCLIENT_CHANNELSTATS_H
+#define SIMPLEAMQPCLIENT_CHANNELSTATS_H
+/*
+ * ***** BEGIN LICENSE BLOCK *****
+ * Version: MIT
+ *
+ * Copyright (c) 2010-2013 Alan Antonuk
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * ***** END LICENSE BLOCK *****
+ */
+
+#include <boost/atomic.hpp>
+#include <boost/chrono.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/noncopyable.hpp>
+#include <cstddef>
+
+#include "SimpleAmqpClient/Channel.h"
+
+namespace AmqpClient {
+namespace Detail {
+
+/// A count updated with relaxed atomics so it can be read from any thread
+class StatCounter : boost::noncopyable {
+ public:
+  StatCounter() : m_value(0) {}
+
+  void Add(boost::uint64_t n = 1) {
+    m_value.fetch_add(n, boost::memory_order_relaxed);
+  }
+  boost::uint64_t Get() const {
+    return m_value.load(boost::memory_order_relaxed);
+  }
+
+ private:
+  boost::atomic<boost::uint64_t> m_value;
+};
+
+/// A current level and the highest level it has reached. It is set from a
+/// single thread, and may be read from any thread.
+class StatGauge : boost::noncopyable {
+ public:
+  StatGauge() : m_value(0), m_high_water(0) {}
+
+  void Set(std::size_t value) {
+    m_value.store(value, boost::memory_order_relaxed);
+    if (value > m_high_water.load(boost::memory_order_relaxed)) {
+      m_high_water.store(value, boost::memory_order_relaxed);
+    }
+  }
+  std::size_t Get() const { return m_value.load(boost::memory_order_relaxed); }
+  std::size_t HighWater() const {
+    return m_high_water.load(boost::memory_order_relaxed);
+  }
+
+ private:
+  boost::atomic<std::size_t> m_value;
+  boost::atomic<std::size_t> m_high_water;
+};
+
+/// Latencies counted in log-linear buckets, see LatencyHistogram. Latencies
+/// are recorded from a single thread, a snapshot may be taken from any thread.
+class LatencyRecorder : boost::noncopyable {
+ public:
+  // Values below 2^SUB_BUCKET_BITS have a bucket each, above that each power
+  // of two is split into 2^SUB_BUCKET_BITS buckets. Values from
+  // 2^(MAX_EXPONENT + 1) ns, about 37 minutes, go in the last bucket.
+  static const int SUB_BUCKET_BITS = 4;
+  static const int MAX_EXPONENT = 40;
+  static const std::size_t BUCKET_COUNT = (MAX_EXPONENT - SUB_BUCKET_BITS + 2)
+                                          << SUB_BUCKET_BITS;
+
+  LatencyRecorder();
+
+  void Record(boost::chrono::nanoseconds latency) {
+    const boost::uint64_t ns =
+        latency.count() < 0 ? 0 : static_cast<boost::uint64_t>(latency.count());
+    m_buckets[BucketIndex(ns)].fetch_add(1, boost::memory_order_relaxed);
+    m_sum.fetch_add(ns, boost::memory_order_relaxed);
+  }
+
+  /// Copies the buckets to a LatencyHistogram, emptying them when reset is
+  /// true. Each bucket and the sum are read on their own, so a concurrent
+  /// Record may show up in the buckets but not the sum, or the other way
+  /// round.
+  LatencyHistogram Snapshot(bool reset);
+
+  static std::size_t BucketIndex(boost::uint64_t ns);
+  static boost::uint64_t BucketLower(std::size_t index);
+  static boost::uint64_t BucketUpper(std::size_t index);
+
+ private:
+  boost::atomic<boost::uint64_t> m_buckets[BUCKET_COUNT];
+  boost::atomic<boost::uint64_t> m_sum;
+};
+
+/// Times an operation for a LatencyRecorder. Nothing is timed when disabled,
+/// so an idle timer costs no clock reads.
+class LatencyTimer {
+ public:
+  LatencyTimer(LatencyRecorder &recorder, bool enabled)
+      : m_recorder(enabled ? &recorder : NULL) {
+    if (enabled) {
+      m_start = boost::chrono::steady_clock::now();
+    }
+  }
+
+  /// Records the time since the timer was made. Operations that fail are
+  /// not recorded as the timer is only stopped on success.
+  void Stop() {
+    if (NULL != m_recorder) {
+      m_recorder->Record(boost::chrono::steady_clock::now() - m_start);
+      m_recorder = NULL;
+    }
+  }
+
+ private:
+  LatencyRecorder *m_recorder;
+  boost::chrono::steady_clock::time_point m_start;
+};
+
+/// The live counters behind Channel::GetStats
+struct ChannelStats : boost::noncopyable {
+  StatCounter messages_published;
+  StatCounter bytes_published;
+  StatCounter messages_consumed;
+  StatCounter bytes_consumed;
+  StatCounter frames_sent;
+  StatCounter frames_received;
+  StatCounter acks_received;
+  StatCounter nacks_received;
+  StatCounter returns_received;
+
+  StatGauge frame_queue;
+  StatGauge delivered_queue;
+  StatGauge open_channels;
+  StatGauge pool_bytes;
+
+  // Latencies are only timed while track_latency is set.
+  bool track_latency;
+  LatencyRecorder publish_confirm_latency;
+  LatencyRecorder rpc_latency;
+  LatencyRecorder frame_wait_latency;
+
+  ChannelStats() : track_latency(false) {}
+
+  /// Counts an RPC sent with the given method
+  void CountRpc(boost::uint32_t method_id);
+
+  /// Copies the current values to stats
+  void Snapshot(Channel::Stats &stats) const;
+
+  /// Copies the latency histograms to stats, emptying them when reset is true
+  void SnapshotLatency(Channel::LatencyStats &stats, bool reset);
+
+ private:
+  // The methods sent as RPCs, each has a counter in rpcs and the last one
+  // counts any other method.
+  static const boost::uint32_t RPC_METHODS[];
+  static const std::size_t RPC_METHOD_COUNT = 16;
+  StatCounter rpcs[RPC_METHOD_COUNT + 1];
+};
+
+}  // namespace Detail
+}  // namespace AmqpClient
+#endif  // SIMPLEAMQPCLIENT_CHANNELSTATS_H
@@ -0,0 +1,111 @@
+#ifndef SIMPLEAMQPCLIENT_ENCODEDTABLE_H
+#define SIMPLEAMQPCLIENT_ENCODEDTABLE_H
+/*
+ * ***** BEGIN LICENSE BLOCK *****
+ * Version: MIT
+ *
+ * Copyright (c) 2010-2013 Alan Antonuk
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * ***** END LICENSE BLOCK *****
+ */
+
+#include <boost/shared_ptr.hpp>
+#include <boost/utility/string_ref.hpp>
+#include <string>
+
+#include "SimpleAmqpClient/Table.h"
+#include "SimpleAmqpClient/Util.h"
+
+#ifdef _MSC_VER
+#pragma warning(push)
+#pragma warning(disable : 4251)
+#endif  // _MSC_VER
+
+/// @file SimpleAmqpClient/EncodedTable.h
+/// The AmqpClient::EncodedTable class is defined in this header file.
+
+namespace AmqpClient {
+
+/**
+ * A Table serialized in the AMQP 0-9-1 field-table wire format
+ *
+ * Encoding is done once, when the EncodedTable is created. Copies share the
+ * same immutable bytes, so a header table that is attached to many messages
+ * (see BasicMessage::HeaderTable(const EncodedTable&)) is only converted once.
+ */
+class SIMPLEAMQPCLIENT_EXPORT EncodedTable {
+ public:
+  /**
+   * Creates an encoded empty table
+   */
+  EncodedTable();
+
+  /**
+   * Encodes a table
+   *
+   * @param table the table to encode
+   * @throws std::invalid_argument if a key is longer than 255 bytes
+   */
+  explicit EncodedTable(const Table &table);
+
+  /**
+   * Wraps bytes that are already in field-table wire format
+   *
+   * The bytes are parsed once to check they are well-formed.
+   *
+   * @param bytes a field-table, starting with its 32-bit big-endian size
+   * @throws std::runtime_error if the bytes are not a well-formed table
+   */
+  static EncodedTable FromBytes(const std::string &bytes);
+
+  /**
+   * The encoded table, starting with its 32-bit big-endian size
+   */
+  const std::string &Bytes() const { return *m_bytes; }
+
+  /**
+   * Parses the encoded bytes back into a Table
+   */
+  Table Decode() const;
+
+  /**
+   * Looks up a single top-level entry without decoding the rest of the table
+   *
+   * @param key the key to look up
+   * @param value set to the entry's value if key is present
+   * @returns true if key is present
+   */
+  bool Find(const boost::string_ref &key, TableValue &value) const;
+
+ private:
+  friend class Detail::TableValueImpl;
+
+  boost::shared_ptr<const std::string> m_bytes;
+};
+
+}  // namespace AmqpClient
+
+#ifdef _MSC_VER
+#pragma warning(pop)
+#endif  // _MSC_VER
+
+#endif  // SIMPLEAMQPCLIENT_ENCODEDTABLE_H
@@ -47,6 +47,10 @@
 
 namespace AmqpClient {
 
+namespace Detail {
+class MessagePool;
+}
+
 /**
  * A "message envelope" object containing the message body and delivery metadata
  */
@@ -55,6 +59,9 @@ class SIMPLEAMQPCLIENT_EXPORT Envelope : boost::noncopyable {
   /// a `shared_ptr` pointer to Envelope
   typedef boost::shared_ptr<Envelope> ptr_t;
 
+  /// a `shared_ptr` to an immutable string, see \ref InternedExchange
+  typedef boost::shared_ptr<const std::string> string_ptr_t;
+
   /**
    * Creates an new envelope object
    * @param message the payload
@@ -79,6 +86,30 @@ class SIMPLEAMQPCLIENT_EXPORT Envelope : boost::noncopyable {
                                         delivery_channel);
   }
 
+  /**
+   * Creates an new envelope object that shares its strings
+   * @param message the payload
+   * @param consumer_tag the consumer tag the message was delivered to
+   * @param delivery_tag the delivery tag that the broker assigned to the
+   * message
+   * @param exchange the name of the exchange that the message was published to
+   * @param redelivered a flag indicating whether the message consumed as a
+   * result of a redelivery
+   * @param routing_key the routing key that the message was published with
+   * @param delivery_channel channel ID of the delivery (see DeliveryInfo)
+   * @returns a boost::shared_ptr to an envelope object
+   */
+  static ptr_t Create(const BasicMessage::ptr_t message,
+                      const string_ptr_t &consumer_tag,
+                      const boost::uint64_t delivery_tag,
+                      const string_ptr_t &exchange, bool redelivered,
+                      const string_ptr_t &routing_key,
+                      const boost::uint16_t delivery_channel) {
+    return boost::make_shared<Envelope>(message, consumer_tag, delivery_tag,
+                                        exchange, redelivered, routing_key,
+                                        delivery_channel);
+  }
+
   /**
    * Construct a new Envelope object
    * @param message the payload
@@ -98,6 +129,25 @@ class SIMPLEAMQPCLIENT_EXPORT Envelope : boost::noncopyable {
                     const std::string &routing_key,
                     const boost::uint16_t delivery_channel);
 
+  /**
+   * Construct a new Envelope object that shares its strings
+   * @param message the payload
+   * @param consumer_tag the consumer tag the message was delivered to
+   * @param delivery_tag the delivery tag that the broker assigned to the
+   * message
+   * @param exchange the name of the exchange that the message was published to
+   * @param redelivered a flag indicating whether the message consumed as a
+   * result of a redelivery
+   * @param routing_key the routing key that the message was published with
+   * @param delivery_channel channel ID of the delivery (see DeliveryInfo)
+   */
+  explicit Envelope(const BasicMessage::ptr_t message,
+                    const string_ptr_t &consumer_tag,
+                    const boost::uint64_t delivery_tag,
+                    const string_ptr_t &exchange, bool redelivered,
+                    const string_ptr_t &routing_key,
+                    const boost::uint16_t delivery_channel);
+
  public:
   /**
    * destructor
@@ -109,14 +159,24 @@ class SIMPLEAMQPCLIENT_EXPORT Envelope : boost::noncopyable {
    *
    * @returns the message
    */
-  inline BasicMessage::ptr_t Message() const { return m_message; }
+  inline const BasicMessage::ptr_t &Message() const { return m_message; }
 
   /**
    * Get the consumer tag for the consumer that delivered the message
    *
    * @returns the consumer that delivered the message
    */
-  inline std::string ConsumerTag() const { return m_consumerTag; }
+  inline const std::string &ConsumerTag() const { return *m_consumerTag; }
+
+  /**
+   * Get the consumer tag as a shared string
+   *
+   * @see InternedExchange
+   * @returns the consumer that delivered the message
+   */
+  inline const string_ptr_t &InternedConsumerTag() const {
+    return m_consumerTag;
+  }
 
   /**
    * Get the delivery tag for the message.
@@ -134,7 +194,22 @@ class SIMPLEAMQPCLIENT_EXPORT Envelope : boost::noncopyable {
    *
    * @returns the name of the exchange the message was published to
    */
-  inline std::string Exchange() const { return m_exchange; }
+  inline const std::string &Exchange() const { return *m_exchange; }
+
+  /**
+   * Get the name of the exchange as a shared string
+   *
+   * Envelopes received on a Channel share one string object for each
+   * distinct exchange name, routing key and consumer tag, so a delivery can
+   * be matched by comparing the pointer with one obtained from
+   * Channel::InternString instead of comparing the strings. The Channel
+   * shares a limited number of distinct values, beyond that equal strings
+   * may be separate objects, so a pointer mismatch is not proof that the
+   * strings differ.
+   *
+   * @returns the name of the exchange the message was published to
+   */
+  inline const string_ptr_t &InternedExchange() const { return m_exchange; }
 
   /**
    * Get the flag that indicates whether the message was redelivered
@@ -154,7 +229,17 @@ class SIMPLEAMQPCLIENT_EXPORT Envelope : boost::noncopyable {
    * @returns a string containing the routing key the message was published
    * with
    */
-  inline std::string RoutingKey() const { return m_routingKey; }
+  inline const std::string &RoutingKey() const { return *m_routingKey; }
+
+  /**
+   * Get the routing key as a shared string
+   *
+   * @see InternedExchange
+   * @returns the routing key the message was published with
+   */
+  inline const string_ptr_t &InternedRoutingKey() const {
+    return m_routingKey;
+  }
 
   /**
    * Get the delivery channel
@@ -193,13 +278,16 @@ class SIMPLEAMQPCLIENT_EXPORT Envelope : boost::noncopyable {
   }
 
  private:
-  const BasicMessage::ptr_t m_message;
-  const std::string m_consumerTag;
-  const boost::uint64_t m_deliveryTag;
-  const std::string m_exchange;
-  const bool m_redelivered;
-  const std::string m_routingKey;
-  const boost::uint16_t m_deliveryChannel;
+  // Pooled envelopes are refilled once released
+  friend class Detail::MessagePool;
+
+  BasicMessage::ptr_t m_message;
+  string_ptr_t m_consumerTag;
+  boost::uint64_t m_deliveryTag;
+  string_ptr_t m_exchange;
+  bool m_redelivered;
+  string_ptr_t m_routingKey;
+  boost::uint16_t m_deliveryChannel;
 };
 
 }  // namespace AmqpClient
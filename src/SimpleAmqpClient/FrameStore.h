@@ -0,0 +1,102 @@
+#ifndef SIMPLEAMQPCLIENT_FRAMESTORE_H
+#define SIMPLEAMQPCLIENT_FRAMESTORE_H
+/*
+ * ***** BEGIN LICENSE BLOCK *****
+ * Version: MIT
+ *
+ * Copyright (c) 2010-2013 Alan Antonuk
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * ***** END LICENSE BLOCK *****
+ */
+
+#include <amqp.h>
+#include <amqp_framing.h>
+
+#include <boost/noncopyable.hpp>
+#include <cstddef>
+#include <map>
+#include <vector>
+
+namespace AmqpClient {
+namespace Detail {
+
+/// Bytes of the pages pool holds, which it keeps when recycled
+inline std::size_t PoolPageBytes(const amqp_pool_t &pool) {
+  return static_cast<std::size_t>(pool.pages.num_blocks) * pool.pagesize;
+}
+
+/// A frame read ahead for a later call. The pointers of frame are cleared,
+/// what they pointed to is held in payload: the encoded method, the encoded
+/// properties or the body fragment.
+struct QueuedFrame {
+  amqp_frame_t frame;
+  amqp_bytes_t payload;
+};
+
+/// Moves frames read ahead out of the connection's channel pools, so that
+/// those pools can be released after every read however long frames stay
+/// queued.
+///
+/// A frame is detached when it is queued, copying its payload once into a
+/// buffer of its own. When taken off the queue it is attached again, decoded
+/// into memory kept for its channel until Release is called for the channel,
+/// as the connection's pools are by amqp_maybe_release_buffers_on_channel.
+class FrameStore : boost::noncopyable {
+ public:
+  FrameStore();
+  ~FrameStore();
+
+  /// Copies frame into a QueuedFrame, which must be passed to Attach or
+  /// Free. frame_max is the connection's frame size limit.
+  QueuedFrame Detach(const amqp_frame_t &frame, std::size_t frame_max);
+
+  /// Restores a frame detached by Detach. Once it returns, the FrameStore
+  /// owns the payload and frees it when the channel is released.
+  amqp_frame_t Attach(const QueuedFrame &queued);
+
+  /// Frees a frame detached by Detach that will not be attached
+  static void Free(const QueuedFrame &queued);
+
+  /// Frees the memory of the frames attached on channel
+  void Release(amqp_channel_t channel);
+
+  /// Bytes of the pool pages kept for all channels. Release recycles a
+  /// channel's pool, which keeps its pages for the next frames.
+  std::size_t PoolBytes() const;
+
+ private:
+  struct ChannelMemory {
+    amqp_pool_t pool;
+    std::vector<amqp_bytes_t> payloads;
+  };
+  typedef std::map<amqp_channel_t, ChannelMemory> channel_memory_map_t;
+
+  ChannelMemory &GetChannelMemory(amqp_channel_t channel);
+
+  // Where methods are encoded before being copied to their own buffer
+  std::vector<char> m_encode_buffer;
+  channel_memory_map_t m_channel_memory;
+};
+
+}  // namespace Detail
+}  // namespace AmqpClient
+#endif  // SIMPLEAMQPCLIENT_FRAMESTORE_H
@@ -0,0 +1,118 @@
+#ifndef SIMPLEAMQPCLIENT_LATENCYHISTOGRAM_H
+#define SIMPLEAMQPCLIENT_LATENCYHISTOGRAM_H
+/*
+ * ***** BEGIN LICENSE BLOCK *****
+ * Version: MIT
+ *
+ * Copyright (c) 2010-2013 Alan Antonuk
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * ***** END LICENSE BLOCK *****
+ */
+
+#include <boost/cstdint.hpp>
+#include <vector>
+
+#include "SimpleAmqpClient/Util.h"
+
+#ifdef _MSC_VER
+#pragma warning(push)
+#pragma warning(disable : 4275 4251)
+#endif  // _MSC_VER
+
+/// @file SimpleAmqpClient/LatencyHistogram.h
+/// The AmqpClient::LatencyHistogram class is defined in this header file.
+
+namespace AmqpClient {
+
+/**
+ * A snapshot of latencies recorded in log-linear buckets
+ *
+ * Each power of two is split into 16 equal buckets, so a bucket's bounds are
+ * within about 6% of each other. Latencies are in nanoseconds.
+ */
+class SIMPLEAMQPCLIENT_EXPORT LatencyHistogram {
+ public:
+  /// A bucket of the histogram, holding latencies from lower to upper
+  /// inclusive
+  struct Bucket {
+    boost::uint64_t lower;  ///< The smallest latency in the bucket.
+    boost::uint64_t upper;  ///< The largest latency in the bucket.
+    boost::uint64_t count;  ///< How many latencies fell in the bucket.
+  };
+
+  /// A list of buckets, ordered by their bounds
+  typedef std::vector<Bucket> bucket_list_t;
+
+  /// Creates an empty histogram
+  LatencyHistogram();
+
+  /**
+   * Creates a histogram from its buckets
+   *
+   * @param buckets the non-empty buckets, in increasing order
+   * @param sum the total of the recorded latencies
+   */
+  LatencyHistogram(const bucket_list_t &buckets, boost::uint64_t sum);
+
+  /**
+   * The buckets holding at least one latency
+   *
+   * @returns the buckets, in increasing order
+   */
+  const bucket_list_t &Buckets() const { return m_buckets; }
+
+  /**
+   * How many latencies were recorded
+   */
+  boost::uint64_t Count() const { return m_count; }
+
+  /**
+   * The average of the recorded latencies
+   *
+   * @returns the mean in nanoseconds, 0 when empty
+   */
+  boost::uint64_t Mean() const;
+
+  /**
+   * Gets a percentile of the recorded latencies
+   *
+   * The result is the upper bound of the bucket holding the percentile, so
+   * it overstates the exact value by at most the bucket width.
+   *
+   * @param percentile between 0 and 100, e.g. 99.9
+   * @returns the latency in nanoseconds, 0 when empty
+   */
+  boost::uint64_t Percentile(double percentile) const;
+
+ private:
+  bucket_list_t m_buckets;
+  boost::uint64_t m_count;
+  boost::uint64_t m_sum;
+};
+
+}  // namespace AmqpClient
+
+#ifdef _MSC_VER
+#pragma warning(pop)
+#endif  // _MSC_VER
+
+#endif  // SIMPLEAMQPCLIENT_LATENCYHISTOGRAM_H
@@ -0,0 +1,129 @@
+#ifndef SIMPLEAMQPCLIENT_MESSAGEPOOL_H
+#define SIMPLEAMQPCLIENT_MESSAGEPOOL_H
+/*
+ * ***** BEGIN LICENSE BLOCK *****
+ * Version: MIT
+ *
+ * Copyright (c) 2010-2013 Alan Antonuk
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * ***** END LICENSE BLOCK *****
+ */
+
+#include <boost/atomic.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/enable_shared_from_this.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "SimpleAmqpClient/BasicMessage.h"
+#include "SimpleAmqpClient/Envelope.h"
+
+namespace AmqpClient {
+namespace Detail {
+
+/// A lock for critical sections of a few instructions, spinning on an
+/// atomic_flag until it is free. After a short spin it yields the processor
+/// between attempts, so a holder that was preempted gets to run.
+class SpinLock : boost::noncopyable {
+ public:
+  SpinLock() { m_flag.clear(); }
+
+  void lock();
+  void unlock() { m_flag.clear(boost::memory_order_release); }
+
+  /// Holds the lock for its lifetime
+  class ScopedLock : boost::noncopyable {
+   public:
+    explicit ScopedLock(SpinLock &lock) : m_lock(lock) { m_lock.lock(); }
+    ~ScopedLock() { m_lock.unlock(); }
+
+   private:
+    SpinLock &m_lock;
+  };
+
+ private:
+  boost::atomic_flag m_flag;
+};
+
+/// Recycles received BasicMessage and Envelope objects.
+///
+/// Objects handed out by the pool go back to it when their last ptr_t is
+/// released, are reset and then reused. Messages keep the capacity of their
+/// body and property strings. Each outstanding object holds a reference to
+/// the pool, so it may outlive the Channel that created it. Objects may be
+/// released from any thread.
+class MessagePool : public boost::enable_shared_from_this<MessagePool>,
+                    boost::noncopyable {
+ public:
+  typedef boost::shared_ptr<MessagePool> ptr_t;
+
+  /// Creates a pool that caches at most max_size messages and as many
+  /// envelopes
+  static ptr_t Create(std::size_t max_size) {
+    return ptr_t(new MessagePool(max_size));
+  }
+
+  ~MessagePool();
+
+  std::size_t MaxSize() const { return m_max_size; }
+
+  /// Returns an empty message
+  BasicMessage::ptr_t AcquireMessage();
+
+  /// Returns an envelope holding message and the delivery details
+  Envelope::ptr_t AcquireEnvelope(const BasicMessage::ptr_t &message,
+                                  const Envelope::string_ptr_t &consumer_tag,
+                                  boost::uint64_t delivery_tag,
+                                  const Envelope::string_ptr_t &exchange,
+                                  bool redelivered,
+                                  const Envelope::string_ptr_t &routing_key,
+                                  boost::uint16_t delivery_channel);
+
+ private:
+  explicit MessagePool(std::size_t max_size);
+
+  void Release(BasicMessage *message);
+  void Release(Envelope *envelope);
+
+  // shared_ptr deleter returning the object to its pool
+  struct Recycler {
+    explicit Recycler(const ptr_t &pool) : m_pool(pool) {}
+    template <typename T>
+    void operator()(T *object) const {
+      m_pool->Release(object);
+    }
+    ptr_t m_pool;
+  };
+
+  const std::size_t m_max_size;
+  // Only guards taking objects from and putting them back on the vectors
+  SpinLock m_lock;
+  std::vector<BasicMessage *> m_messages;
+  std::vector<Envelope *> m_envelopes;
+};
+
+}  // namespace Detail
+}  // namespace AmqpClient
+#endif  // SIMPLEAMQPCLIENT_MESSAGEPOOL_H
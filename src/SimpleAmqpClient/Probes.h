@@ -0,0 +1,67 @@
+#ifndef SIMPLEAMQPCLIENT_PROBES_H
+#define SIMPLEAMQPCLIENT_PROBES_H
+/*
+ * ***** BEGIN LICENSE BLOCK *****
+ * Version: MIT
+ *
+ * Copyright (c) 2010-2013 Alan Antonuk
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * ***** END LICENSE BLOCK *****
+ */
+
+// USDT probes of the simpleamqpclient provider, built in when CMake is run
+// with -DENABLE_SDT_PROBES=ON. A probe is a single nop until a tracer such as
+// bpftrace or perf attaches to it, e.g.:
+//   bpftrace -e 'usdt:libSimpleAmqpClient.so:simpleamqpclient:rpc_start
+//                { @[arg1] = count(); }'
+// Without the option the probes compile to nothing and their arguments are
+// not evaluated.
+//
+// Probes and their arguments:
+//   publish_start(channel, body_size)
+//   publish_end(channel, status)              status is BasicResult::status_t
+//   confirm_received(channel, method_id)      basic.ack, basic.nack or
+//                                             basic.return
+//   deliver_assembled(channel, delivery_tag, body_size)
+//   ack_sent(channel, delivery_tag, multiple)
+//   nack_sent(channel, delivery_tag, requeue)
+//   frame_queued(channel, frame_type, queue_depth)
+//   frame_dequeued(channel, frame_type, queue_depth)
+//   rpc_start(channel, method_id)
+//   rpc_end(channel, method_id)
+//   channel_open(channel)
+//   channel_close(channel)
+
+#ifdef SAC_SDT_PROBES_ENABLED
+#include <sys/sdt.h>
+
+#define SAC_PROBE1(name, a) DTRACE_PROBE1(simpleamqpclient, name, a)
+#define SAC_PROBE2(name, a, b) DTRACE_PROBE2(simpleamqpclient, name, a, b)
+#define SAC_PROBE3(name, a, b, c) \
+  DTRACE_PROBE3(simpleamqpclient, name, a, b, c)
+#else
+#define SAC_PROBE1(name, a) ((void)0)
+#define SAC_PROBE2(name, a, b) ((void)0)
+#define SAC_PROBE3(name, a, b, c) ((void)0)
+#endif  // SAC_SDT_PROBES_ENABLED
+
+#endif  // SIMPLEAMQPCLIENT_PROBES_H
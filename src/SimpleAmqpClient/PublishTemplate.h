@@ -0,0 +1,128 @@
+#ifndef SIMPLEAMQPCLIENT_PUBLISHTEMPLATE_H
+#define SIMPLEAMQPCLIENT_PUBLISHTEMPLATE_H
+/*
+ * ***** BEGIN LICENSE BLOCK *****
+ * Version: MIT
+ *
+ * Copyright (c) 2010-2013 Alan Antonuk
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * ***** END LICENSE BLOCK *****
+ */
+
+#include <boost/make_shared.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/shared_ptr.hpp>
+#include <string>
+
+#include "SimpleAmqpClient/BasicMessage.h"
+#include "SimpleAmqpClient/Util.h"
+
+#ifdef _MSC_VER
+#pragma warning(push)
+#pragma warning(disable : 4251 4275)
+#endif  // _MSC_VER
+
+/// @file SimpleAmqpClient/PublishTemplate.h
+/// The AmqpClient::PublishTemplate class is defined in this header file.
+
+namespace AmqpClient {
+
+class Channel;
+
+/**
+ * A pre-built destination and set of properties for publishing many messages
+ *
+ * The exchange, routing key and message properties, including the header
+ * table, are converted to their wire form once when the template is
+ * created. Publishing with Channel::BasicPublish(const PublishTemplate::ptr_t&,
+ * ...) then only supplies a body, and optionally a message id and timestamp.
+ *
+ * The template keeps its own copy of the properties, so later changes to the
+ * BasicMessage it was created from do not affect it.
+ */
+class SIMPLEAMQPCLIENT_EXPORT PublishTemplate : boost::noncopyable {
+ public:
+  /// a `shared_ptr` to PublishTemplate
+  typedef boost::shared_ptr<PublishTemplate> ptr_t;
+
+  /**
+   * Creates a new PublishTemplate object
+   *
+   * @param exchange the exchange to publish to
+   * @param routing_key the routing key to publish with
+   * @param properties the properties to publish with. The body of this
+   * message is ignored.
+   * @param mandatory requires the message to be delivered to a queue; see
+   * Channel::BasicPublish
+   * @returns a new PublishTemplate object
+   */
+  static ptr_t Create(const std::string &exchange,
+                      const std::string &routing_key,
+                      const BasicMessage &properties, bool mandatory = false) {
+    return boost::make_shared<PublishTemplate>(exchange, routing_key,
+                                               properties, mandatory);
+  }
+
+  /**
+   * Construct a new PublishTemplate object
+   *
+   * See \ref Create
+   */
+  PublishTemplate(const std::string &exchange, const std::string &routing_key,
+                  const BasicMessage &properties, bool mandatory = false);
+
+  /**
+   * Destructor
+   */
+  virtual ~PublishTemplate();
+
+  /**
+   * Gets the exchange name
+   */
+  const std::string &Exchange() const;
+
+  /**
+   * Gets the routing key
+   */
+  const std::string &RoutingKey() const;
+
+  /**
+   * Gets the mandatory flag
+   */
+  bool Mandatory() const;
+
+ protected:
+  friend class Channel;
+
+  struct Impl;
+  /// PIMPL idiom
+  boost::scoped_ptr<Impl> m_impl;
+};
+
+}  // namespace AmqpClient
+
+#ifdef _MSC_VER
+#pragma warning(pop)
+#endif  // _MSC_VER
+
+#endif  // SIMPLEAMQPCLIENT_PUBLISHTEMPLATE_H
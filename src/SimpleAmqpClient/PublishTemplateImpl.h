@@ -0,0 +1,53 @@
+#ifndef SIMPLEAMQPCLIENT_PUBLISHTEMPLATEIMPL_H
+#define SIMPLEAMQPCLIENT_PUBLISHTEMPLATEIMPL_H
+/*
+ * ***** BEGIN LICENSE BLOCK *****
+ * Version: MIT
+ *
+ * Copyright (c) 2010-2013 Alan Antonuk
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * ***** END LICENSE BLOCK *****
+ */
+
+#include <amqp.h>
+#include <amqp_framing.h>
+
+#include <string>
+
+#include "SimpleAmqpClient/PublishTemplate.h"
+
+namespace AmqpClient {
+struct PublishTemplate::Impl {
+  Impl();
+  ~Impl();
+
+  std::string exchange;
+  std::string routing_key;
+  bool mandatory;
+
+  // Owns the strings and header table that properties points to.
+  amqp_pool_t pool;
+  amqp_basic_properties_t properties;
+};
+
+}  // namespace AmqpClient
+#endif  // SIMPLEAMQPCLIENT_PUBLISHTEMPLATEIMPL_H
@@ -40,9 +40,12 @@
 #include "SimpleAmqpClient/ConnectionClosedException.h"
 #include "SimpleAmqpClient/ConsumerCancelledException.h"
 #include "SimpleAmqpClient/ConsumerTagNotFoundException.h"
+#include "SimpleAmqpClient/EncodedTable.h"
 #include "SimpleAmqpClient/Envelope.h"
+#include "SimpleAmqpClient/LatencyHistogram.h"
 #include "SimpleAmqpClient/MessageRejectedException.h"
 #include "SimpleAmqpClient/MessageReturnedException.h"
+#include "SimpleAmqpClient/PublishTemplate.h"
 #include "SimpleAmqpClient/Table.h"
 #include "SimpleAmqpClient/Version.h"
 
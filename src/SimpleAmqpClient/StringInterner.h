@@ -0,0 +1,63 @@
+#ifndef SIMPLEAMQPCLIENT_STRINGINTERNER_H
+#define SIMPLEAMQPCLIENT_STRINGINTERNER_H
+/*
+ * ***** BEGIN LICENSE BLOCK *****
+ * Version: MIT
+ *
+ * Copyright (c) 2010-2013 Alan Antonuk
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * ***** END LICENSE BLOCK *****
+ */
+
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/utility/string_ref.hpp>
+#include <cstddef>
+#include <map>
+#include <string>
+
+namespace AmqpClient {
+namespace Detail {
+
+/// Shares one immutable string object between all equal values.
+///
+/// Once MAX_ENTRIES distinct values are held, further values are returned as
+/// new unshared strings. Not thread-safe.
+class StringInterner : boost::noncopyable {
+ public:
+  typedef boost::shared_ptr<const std::string> string_ptr_t;
+
+  static const std::size_t MAX_ENTRIES = 1024;
+
+  /// Returns the shared string equal to value
+  string_ptr_t Intern(const boost::string_ref &value);
+
+ private:
+  typedef std::map<std::string, string_ptr_t> table_t;
+  table_t m_table;
+  // Reused to look values up without allocating
+  std::string m_key;
+};
+
+}  // namespace Detail
+}  // namespace AmqpClient
+#endif  // SIMPLEAMQPCLIENT_STRINGINTERNER_H
@@ -28,11 +28,13 @@
  * ***** END LICENSE BLOCK *****
  */
 
+#include <boost/config.hpp>
 #include <boost/cstdint.hpp>
-#include <boost/scoped_ptr.hpp>
+#include <boost/shared_ptr.hpp>
 #include <ctime>
 #include <map>
 #include <string>
+#include <utility>
 #include <vector>
 
 #include "SimpleAmqpClient/Util.h"
@@ -76,6 +78,10 @@ typedef Table::value_type TableEntry;
 
 /**
  * A variant type for the Table Value
+ *
+ * Scalar values are stored inline. String, array and table values are kept in
+ * immutable storage that is shared between copies, so copying a TableValue (or
+ * a Table or Array of them) never deep-copies the nested data.
  */
 class SIMPLEAMQPCLIENT_EXPORT TableValue {
  public:
@@ -234,6 +240,63 @@ class SIMPLEAMQPCLIENT_EXPORT TableValue {
    */
   TableValue &operator=(const TableValue &l);
 
+#ifndef BOOST_NO_CXX11_RVALUE_REFERENCES
+  /**
+   * Construct a character string value, taking ownership of the string
+   *
+   * @param [in] value the value, left in a valid but unspecified state
+   */
+  TableValue(std::string &&value) : m_type(VT_void) {
+    m_scalar.u64 = 0;
+    Adopt(value);
+  }
+
+  /**
+   * Construct an array value, taking ownership of the array
+   *
+   * @param [in] values the value, left in a valid but unspecified state
+   */
+  TableValue(std::vector<TableValue> &&values) : m_type(VT_void) {
+    m_scalar.u64 = 0;
+    Adopt(values);
+  }
+
+  /**
+   * Construct a Table value, taking ownership of the table
+   *
+   * @param [in] value the value, left in a valid but unspecified state
+   */
+  TableValue(Table &&value) : m_type(VT_void) {
+    m_scalar.u64 = 0;
+    Adopt(value);
+  }
+
+  /**
+   * Move-constructor
+   *
+   * Leaves the moved-from value as a void value
+   */
+  TableValue(TableValue &&l)
+      : m_type(l.m_type), m_scalar(l.m_scalar), m_impl(std::move(l.m_impl)) {
+    l.m_type = VT_void;
+  }
+
+  /**
+   * Move-assignment operator
+   *
+   * Leaves the moved-from value as a void value
+   */
+  TableValue &operator=(TableValue &&l) {
+    if (this != &l) {
+      m_type = l.m_type;
+      m_scalar = l.m_scalar;
+      m_impl = std::move(l.m_impl);
+      l.m_type = VT_void;
+    }
+    return *this;
+  }
+#endif
+
   /**
    * Equality operator
    */
@@ -488,8 +551,59 @@ class SIMPLEAMQPCLIENT_EXPORT TableValue {
    */
   void Set(const Table &value);
 
+#ifndef BOOST_NO_CXX11_RVALUE_REFERENCES
+  /**
+   * Set the value as a string, taking ownership of the string
+   *
+   * @param [in] value the value, left in a valid but unspecified state
+   */
+  void Set(std::string &&value) { Adopt(value); }
+
+  /**
+   * Set the value as an array, taking ownership of the array
+   *
+   * @param [in] value the value, left in a valid but unspecified state
+   */
+  void Set(std::vector<TableValue> &&value) { Adopt(value); }
+
+  /**
+   * Set the value as a table, taking ownership of the table
+   *
+   * @param [in] value the value, left in a valid but unspecified state
+   */
+  void Set(Table &&value) { Adopt(value); }
+#endif
+
  private:
-  boost::scoped_ptr<Detail::TableValueImpl> m_impl;
+  /*
+   * Set the value by swapping the contents out of the argument.
+   *
+   * These back the rvalue overloads above, and are available regardless of
+   * the language standard the library is built with.
+   */
+  void Adopt(std::string &value);
+  void Adopt(std::vector<TableValue> &value);
+  void Adopt(Table &value);
+
+  /// Inline storage for scalar values, the active member is given by m_type
+  union scalar_t {
+    bool boolean;
+    boost::uint8_t u8;
+    boost::int8_t i8;
+    boost::uint16_t u16;
+    boost::int16_t i16;
+    boost::uint32_t u32;
+    boost::int32_t i32;
+    boost::uint64_t u64;
+    boost::int64_t i64;
+    float f32;
+    double f64;
+  };
+
+  ValueType m_type;
+  scalar_t m_scalar;
+  /// Shared storage for VT_string, VT_array and VT_table values, never mutated
+  boost::shared_ptr<const Detail::TableValueImpl> m_impl;
 };
 
 }  // namespace AmqpClient
@@ -31,12 +31,16 @@
 #include <amqp.h>
 
 #include <boost/cstdint.hpp>
+#include <boost/noncopyable.hpp>
 #include <boost/shared_ptr.hpp>
+#include <boost/utility/string_ref.hpp>
 #include <boost/variant/variant.hpp>
+#include <cstddef>
 #include <ctime>
 #include <string>
 #include <vector>
 
+#include "SimpleAmqpClient/EncodedTable.h"
 #include "SimpleAmqpClient/Table.h"
 
 namespace AmqpClient {
@@ -44,17 +48,44 @@ namespace Detail {
 
 typedef boost::shared_ptr<amqp_pool_t> amqp_pool_ptr_t;
 
-struct void_t {};
+/// A pool reused for the memory of outgoing methods, see
+/// ScopedPoolRecycler. Its users may nest, e.g. a return handler that
+/// publishes while a fanout still needs the properties it built in the pool,
+/// so it counts the scopes using it.
+struct ScratchPool : boost::noncopyable {
+  explicit ScratchPool(std::size_t pagesize) : depth(0) {
+    init_amqp_pool(&pool, pagesize);
+  }
+  ~ScratchPool() { empty_amqp_pool(&pool); }
+
+  amqp_pool_t pool;
+  int depth;
+};
+
+/// Recycles a ScratchPool when the outermost scope using it ends. Recycling
+/// keeps the pool's pages, so a pool that is reused this way stops
+/// allocating once warm.
+class ScopedPoolRecycler : boost::noncopyable {
+ public:
+  explicit ScopedPoolRecycler(ScratchPool &scratch) : m_scratch(scratch) {
+    ++m_scratch.depth;
+  }
+  ~ScopedPoolRecycler() {
+    if (0 == --m_scratch.depth) {
+      recycle_amqp_pool(&m_scratch.pool);
+    }
+  }
+
+  amqp_pool_t &Get() { return m_scratch.pool; }
 
-inline bool operator==(const void_t &, const void_t &) { return true; }
+ private:
+  ScratchPool &m_scratch;
+};
 
 typedef std::vector<TableValue> array_t;
 
-typedef boost::variant<void_t, bool, boost::int8_t, boost::int16_t,
-                       boost::int32_t, boost::int64_t, float, double,
-                       std::string, array_t, Table, boost::uint8_t,
-                       boost::uint16_t, boost::uint32_t, boost::uint64_t>
-    value_t;
+/// The TableValue types that are stored out-of-line
+typedef boost::variant<std::string, array_t, Table> value_t;
 
 class TableValueImpl {
  public:
@@ -63,49 +94,58 @@ class TableValueImpl {
 
   value_t m_value;
 
-  static amqp_table_t CreateAmqpTable(const Table &table,
-                                      amqp_pool_ptr_t &pool);
+  static amqp_table_t CreateAmqpTable(const Table &table, amqp_pool_t &pool);
+
+  /// Builds an amqp_table_t from pre-encoded bytes. The bytes are copied
+  /// into pool once and the table entries point into that copy.
+  static amqp_table_t CreateAmqpTable(const EncodedTable &table,
+                                      amqp_pool_t &pool);
 
   static Table CreateTable(const amqp_table_t &table);
 
   static amqp_table_t CopyTable(const amqp_table_t &table,
                                 amqp_pool_ptr_t &pool);
 
+  /// Appends table to out in the AMQP 0-9-1 field-table wire format,
+  /// including the leading 32-bit size
+  static void EncodeTable(const Table &table, std::string &out);
+
+  /// Parses a field-table, including its 32-bit size, from data starting at
+  /// offset. On return offset points just past the table. Tables and arrays
+  /// nested more than 64 levels deep are rejected as malformed.
+  static Table DecodeTable(const char *data, std::size_t len,
+                           std::size_t &offset);
+
+  /// Looks key up in the top level of an encoded field-table, decoding only
+  /// the value that matches. Returns false if key is not present.
+  static bool FindInTable(const char *data, std::size_t len,
+                          const boost::string_ref &key, TableValue &value);
+
+  /// Wraps bytes that are known to be a well-formed field-table, including
+  /// its 32-bit size, without parsing them
+  static EncodedTable CreateEncodedTable(const char *data, std::size_t len);
+
+  static const std::string &GetString(const TableValue &value);
+  static const array_t &GetArray(const TableValue &value);
+  static const Table &GetTable(const TableValue &value);
+
  private:
   static amqp_table_t CreateAmqpTableInner(const Table &table,
                                            amqp_pool_t &pool);
+  static amqp_field_value_t CreateFieldValue(const TableValue &value,
+                                             amqp_pool_t &pool);
   static TableValue CreateTableValue(const amqp_field_value_t &entry);
+  static void EncodeFieldValue(const TableValue &value, std::string &out);
+  static Table DecodeTableInner(const char *data, std::size_t len,
+                                std::size_t &offset, int depth);
+  static TableValue DecodeFieldValue(const char *data, std::size_t len,
+                                     std::size_t &offset, int depth);
+  static void SkipFieldValue(const char *data, std::size_t len,
+                             std::size_t &offset);
   static amqp_table_t CopyTableInner(const amqp_table_t &table,
                                      amqp_pool_t &pool);
   static amqp_field_value_t CopyValue(const amqp_field_value_t value,
                                       amqp_pool_t &pool);
-
- public:
-  class generate_field_value
-      : public boost::static_visitor<amqp_field_value_t> {
-   public:
-    explicit generate_field_value(amqp_pool_t &p) : pool(p) {}
-    virtual ~generate_field_value() {}
-
-    amqp_field_value_t operator()(const void_t) const;
-    amqp_field_value_t operator()(const bool value) const;
-    amqp_field_value_t operator()(const boost::uint8_t value) const;
-    amqp_field_value_t operator()(const boost::int8_t value) const;
-    amqp_field_value_t operator()(const boost::uint16_t value) const;
-    amqp_field_value_t operator()(const boost::int16_t value) const;
-    amqp_field_value_t operator()(const boost::uint32_t value) const;
-    amqp_field_value_t operator()(const boost::int32_t value) const;
-    amqp_field_value_t operator()(const boost::uint64_t value) const;
-    amqp_field_value_t operator()(const boost::int64_t value) const;
-    amqp_field_value_t operator()(const float value) const;
-    amqp_field_value_t operator()(const double value) const;
-    amqp_field_value_t operator()(const std::string &value) const;
-    amqp_field_value_t operator()(const array_t &value) const;
-    amqp_field_value_t operator()(const Table &value) const;
-
-   private:
-    amqp_pool_t &pool;
-  };
 };
 
 }  // namespace Detail
@@ -0,0 +1,54 @@
+/*
+ * ***** BEGIN LICENSE BLOCK *****
+ * Version: MIT
+ *
+ * Copyright (c) 2010-2013 Alan Antonuk
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * ***** END LICENSE BLOCK *****
+ */
+
+#include "SimpleAmqpClient/StringInterner.h"
+
+#include <boost/make_shared.hpp>
+
+namespace AmqpClient {
+namespace Detail {
+
+const std::size_t StringInterner::MAX_ENTRIES;
+
+StringInterner::string_ptr_t StringInterner::Intern(
+    const boost::string_ref &value) {
+  m_key.assign(value.data(), value.size());
+  table_t::iterator it = m_table.lower_bound(m_key);
+  if (it != m_table.end() && it->first == m_key) {
+    return it->second;
+  }
+
+  string_ptr_t interned = boost::make_shared<const std::string>(m_key);
+  if (m_table.size() < MAX_ENTRIES) {
+    m_table.insert(it, table_t::value_type(m_key, interned));
+  }
+  return interned;
+}
+
+}  // namespace Detail
+}  // namespace AmqpClient
@@ -29,7 +29,7 @@
 #include "SimpleAmqpClient/Table.h"
 
 #include <algorithm>
-#include <boost/type_traits/remove_cv.hpp>
+#include <boost/make_shared.hpp>
 #include <boost/variant/get.hpp>
 #include <ctime>
 #include <iterator>
@@ -39,88 +39,145 @@
 #include "SimpleAmqpClient/TableImpl.h"
 
 namespace AmqpClient {
-TableValue::TableValue()
-    : m_impl(new Detail::TableValueImpl(Detail::void_t())) {}
 
-TableValue::TableValue(bool value)
-    : m_impl(new Detail::TableValueImpl(value)) {}
+namespace {
+boost::shared_ptr<const Detail::TableValueImpl> MakeImpl(
+    const Detail::value_t &value) {
+  return boost::make_shared<Detail::TableValueImpl>(value);
+}
+}  // namespace
 
-TableValue::TableValue(boost::uint8_t value)
-    : m_impl(new Detail::TableValueImpl(value)) {}
+TableValue::TableValue() : m_type(VT_void) { m_scalar.u64 = 0; }
 
-TableValue::TableValue(boost::int8_t value)
-    : m_impl(new Detail::TableValueImpl(value)) {}
+TableValue::TableValue(bool value) : m_type(VT_bool) {
+  m_scalar.u64 = 0;
+  m_scalar.boolean = value;
+}
 
-TableValue::TableValue(boost::uint16_t value)
-    : m_impl(new Detail::TableValueImpl(value)) {}
+TableValue::TableValue(boost::uint8_t value) : m_type(VT_uint8) {
+  m_scalar.u64 = 0;
+  m_scalar.u8 = value;
+}
 
-TableValue::TableValue(boost::int16_t value)
-    : m_impl(new Detail::TableValueImpl(value)) {}
+TableValue::TableValue(boost::int8_t value) : m_type(VT_int8) {
+  m_scalar.u64 = 0;
+  m_scalar.i8 = value;
+}
 
-TableValue::TableValue(boost::uint32_t value)
-    : m_impl(new Detail::TableValueImpl(value)) {}
+TableValue::TableValue(boost::uint16_t value) : m_type(VT_uint16) {
+  m_scalar.u64 = 0;
+  m_scalar.u16 = value;
+}
 
-TableValue::TableValue(boost::int32_t value)
-    : m_impl(new Detail::TableValueImpl(value)) {}
+TableValue::TableValue(boost::int16_t value) : m_type(VT_int16) {
+  m_scalar.u64 = 0;
+  m_scalar.i16 = value;
+}
 
-TableValue::TableValue(boost::uint64_t value)
-    : m_impl(new Detail::TableValueImpl(value)) {}
+TableValue::TableValue(boost::uint32_t value) : m_type(VT_uint32) {
+  m_scalar.u64 = 0;
+  m_scalar.u32 = value;
+}
+
+TableValue::TableValue(boost::int32_t value) : m_type(VT_int32) {
+  m_scalar.u64 = 0;
+  m_scalar.i32 = value;
+}
+
+TableValue::TableValue(boost::uint64_t value) : m_type(VT_timestamp) {
+  m_scalar.u64 = value;
+}
 
 TableValue TableValue::Timestamp(std::time_t ts) {
   return TableValue(static_cast<boost::uint64_t>(ts));
 }
 
-TableValue::TableValue(boost::int64_t value)
-    : m_impl(new Detail::TableValueImpl(value)) {}
+TableValue::TableValue(boost::int64_t value) : m_type(VT_int64) {
+  m_scalar.i64 = value;
+}
 
-TableValue::TableValue(float value)
-    : m_impl(new Detail::TableValueImpl(value)) {}
+TableValue::TableValue(float value) : m_type(VT_float) {
+  m_scalar.u64 = 0;
+  m_scalar.f32 = value;
+}
 
-TableValue::TableValue(double value)
-    : m_impl(new Detail::TableValueImpl(value)) {}
+TableValue::TableValue(double value) : m_type(VT_double) {
+  m_scalar.f64 = value;
+}
 
 TableValue::TableValue(const char *value)
-    : m_impl(new Detail::TableValueImpl(std::string(value))) {}
+    : m_type(VT_string), m_impl(MakeImpl(std::string(value))) {
+  m_scalar.u64 = 0;
+}
 
 TableValue::TableValue(const std::string &value)
-    : m_impl(new Detail::TableValueImpl(value)) {}
+    : m_type(VT_string), m_impl(MakeImpl(value)) {
+  m_scalar.u64 = 0;
+}
 
 TableValue::TableValue(const std::vector<TableValue> &values)
-    : m_impl(new Detail::TableValueImpl(values)) {}
+    : m_type(VT_array), m_impl(MakeImpl(values)) {
+  m_scalar.u64 = 0;
+}
 
 TableValue::TableValue(const Table &value)
-    : m_impl(new Detail::TableValueImpl(value)) {}
+    : m_type(VT_table), m_impl(MakeImpl(value)) {
+  m_scalar.u64 = 0;
+}
 
 TableValue::TableValue(const TableValue &l)
-    : m_impl(new Detail::TableValueImpl(l.m_impl->m_value)) {}
+    : m_type(l.m_type), m_scalar(l.m_scalar), m_impl(l.m_impl) {}
 
 TableValue &TableValue::operator=(const TableValue &l) {
   if (this != &l) {
-    m_impl->m_value = l.m_impl->m_value;
+    m_type = l.m_type;
+    m_scalar = l.m_scalar;
+    m_impl = l.m_impl;
   }
   return *this;
 }
 
-bool operator==(const Array &l, const Array &r) {
-  if (l.size() == r.size()) {
-    return std::equal(l.begin(), l.end(), r.begin());
-  }
-  return false;
-}
-
-bool operator==(const Table &l, const Table &r) {
-  if (l.size() == r.size()) {
-    return std::equal(l.begin(), l.end(), r.begin());
-  }
-  return false;
-}
-
 bool TableValue::operator==(const TableValue &l) const {
   if (this == &l) {
     return true;
   }
+  if (m_type != l.m_type) {
+    return false;
+  }
 
-  return m_impl->m_value == l.m_impl->m_value;
+  switch (m_type) {
+    case VT_void:
+      return true;
+    case VT_bool:
+      return m_scalar.boolean == l.m_scalar.boolean;
+    case VT_uint8:
+      return m_scalar.u8 == l.m_scalar.u8;
+    case VT_int8:
+      return m_scalar.i8 == l.m_scalar.i8;
+    case VT_uint16:
+      return m_scalar.u16 == l.m_scalar.u16;
+    case VT_int16:
+      return m_scalar.i16 == l.m_scalar.i16;
+    case VT_uint32:
+      return m_scalar.u32 == l.m_scalar.u32;
+    case VT_int32:
+      return m_scalar.i32 == l.m_scalar.i32;
+    case VT_timestamp:
+      return m_scalar.u64 == l.m_scalar.u64;
+    case VT_int64:
+      return m_scalar.i64 == l.m_scalar.i64;
+    case VT_float:
+      return m_scalar.f32 == l.m_scalar.f32;
+    case VT_double:
+      return m_scalar.f64 == l.m_scalar.f64;
+    case VT_string:
+    case VT_array:
+    case VT_table:
+      // Copies share the same storage, which saves walking nested values
+      return m_impl == l.m_impl || m_impl->m_value == l.m_impl->m_value;
+    default:
+      return false;
+  }
 }
 
 bool TableValue::operator!=(const TableValue &l) const {
@@ -128,137 +185,196 @@ bool TableValue::operator!=(const TableValue &l) const {
     return false;
   }
 
-  return !(m_impl->m_value == l.m_impl->m_value);
+  return !(*this == l);
 }
 
 TableValue::~TableValue() {}
 
-TableValue::ValueType TableValue::GetType() const {
-  return static_cast<ValueType>(m_impl->m_value.which());
-}
+TableValue::ValueType TableValue::GetType() const { return m_type; }
 
-bool TableValue::GetBool() const { return boost::get<bool>(m_impl->m_value); }
+bool TableValue::GetBool() const {
+  if (VT_bool != m_type) {
+    throw boost::bad_get();
+  }
+  return m_scalar.boolean;
+}
 
 boost::uint8_t TableValue::GetUint8() const {
-  return boost::get<boost::uint8_t>(m_impl->m_value);
+  if (VT_uint8 != m_type) {
+    throw boost::bad_get();
+  }
+  return m_scalar.u8;
 }
 
 boost::int8_t TableValue::GetInt8() const {
-  return boost::get<boost::int8_t>(m_impl->m_value);
+  if (VT_int8 != m_type) {
+    throw boost::bad_get();
+  }
+  return m_scalar.i8;
 }
 
 boost::uint16_t TableValue::GetUint16() const {
-  return boost::get<boost::uint16_t>(m_impl->m_value);
+  if (VT_uint16 != m_type) {
+    throw boost::bad_get();
+  }
+  return m_scalar.u16;
 }
 
 boost::int16_t TableValue::GetInt16() const {
-  return boost::get<boost::int16_t>(m_impl->m_value);
+  if (VT_int16 != m_type) {
+    throw boost::bad_get();
+  }
+  return m_scalar.i16;
 }
 
 boost::uint32_t TableValue::GetUint32() const {
-  return boost::get<boost::uint32_t>(m_impl->m_value);
+  if (VT_uint32 != m_type) {
+    throw boost::bad_get();
+  }
+  return m_scalar.u32;
 }
 
 boost::int32_t TableValue::GetInt32() const {
-  return boost::get<boost::int32_t>(m_impl->m_value);
+  if (VT_int32 != m_type) {
+    throw boost::bad_get();
+  }
+  return m_scalar.i32;
 }
 
 std::time_t TableValue::GetTimestamp() const {
-  return static_cast<std::time_t>(boost::get<boost::uint64_t>(m_impl->m_value));
+  if (VT_timestamp != m_type) {
+    throw boost::bad_get();
+  }
+  return static_cast<std::time_t>(m_scalar.u64);
 }
 
 boost::int64_t TableValue::GetInt64() const {
-  return boost::get<boost::int64_t>(m_impl->m_value);
+  if (VT_int64 != m_type) {
+    throw boost::bad_get();
+  }
+  return m_scalar.i64;
 }
 
 boost::int64_t TableValue::GetInteger() const {
-  switch (m_impl->m_value.which()) {
+  switch (m_type) {
     case VT_uint8:
-      return GetUint8();
+      return m_scalar.u8;
     case VT_int8:
-      return GetInt8();
+      return m_scalar.i8;
     case VT_uint16:
-      return GetUint16();
+      return m_scalar.u16;
     case VT_int16:
-      return GetInt16();
+      return m_scalar.i16;
     case VT_uint32:
-      return GetUint32();
+      return m_scalar.u32;
     case VT_int32:
-      return GetInt32();
+      return m_scalar.i32;
     case VT_int64:
-      return GetInt64();
+      return m_scalar.i64;
     default:
       throw boost::bad_get();
   }
 }
 
 float TableValue::GetFloat() const {
-  return boost::get<float>(m_impl->m_value);
+  if (VT_float != m_type) {
+    throw boost::bad_get();
+  }
+  return m_scalar.f32;
 }
 
 double TableValue::GetDouble() const {
-  return boost::get<double>(m_impl->m_value);
+  if (VT_double != m_type) {
+    throw boost::bad_get();
+  }
+  return m_scalar.f64;
 }
 
 double TableValue::GetReal() const {
-  switch (m_impl->m_value.which()) {
+  switch (m_type) {
     case VT_float:
-      return GetFloat();
+      return m_scalar.f32;
     case VT_double:
-      return GetDouble();
+      return m_scalar.f64;
     default:
       throw boost::bad_get();
   }
 }
 
 std::string TableValue::GetString() const {
-  return boost::get<std::string>(m_impl->m_value);
+  return Detail::TableValueImpl::GetString(*this);
 }
 
 std::vector<TableValue> TableValue::GetArray() const {
-  return boost::get<Detail::array_t>(m_impl->m_value);
+  return Detail::TableValueImpl::GetArray(*this);
 }
 
 Table TableValue::GetTable() const {
-  return boost::get<Table>(m_impl->m_value);
+  return Detail::TableValueImpl::GetTable(*this);
 }
 
-void TableValue::Set() { m_impl->m_value = Detail::void_t(); }
+void TableValue::Set() { *this = TableValue(); }
 
-void TableValue::Set(bool value) { m_impl->m_value = value; }
+void TableValue::Set(bool value) { *this = TableValue(value); }
 
-void TableValue::Set(boost::uint8_t value) { m_impl->m_value = value; }
+void TableValue::Set(boost::uint8_t value) { *this = TableValue(value); }
 
-void TableValue::Set(boost::int8_t value) { m_impl->m_value = value; }
+void TableValue::Set(boost::int8_t value) { *this = TableValue(value); }
 
-void TableValue::Set(boost::uint16_t value) { m_impl->m_value = value; }
+void TableValue::Set(boost::uint16_t value) { *this = TableValue(value); }
 
-void TableValue::Set(boost::int16_t value) { m_impl->m_value = value; }
+void TableValue::Set(boost::int16_t value) { *this = TableValue(value); }
 
-void TableValue::Set(boost::uint32_t value) { m_impl->m_value = value; }
+void TableValue::Set(boost::uint32_t value) { *this = TableValue(value); }
 
-void TableValue::Set(boost::int32_t value) { m_impl->m_value = value; }
+void TableValue::Set(boost::int32_t value) { *this = TableValue(value); }
 
 void TableValue::SetTimestamp(std::time_t value) {
-  m_impl->m_value = static_cast<boost::uint64_t>(value);
+  *this = TableValue(static_cast<boost::uint64_t>(value));
 }
 
-void TableValue::Set(boost::int64_t value) { m_impl->m_value = value; }
+void TableValue::Set(boost::int64_t value) { *this = TableValue(value); }
 
-void TableValue::Set(float value) { m_impl->m_value = value; }
+void TableValue::Set(float value) { *this = TableValue(value); }
 
-void TableValue::Set(double value) { m_impl->m_value = value; }
+void TableValue::Set(double value) { *this = TableValue(value); }
 
-void TableValue::Set(const char *value) {
-  m_impl->m_value = std::string(value);
-}
+void TableValue::Set(const char *value) { *this = TableValue(value); }
 
-void TableValue::Set(const std::string &value) { m_impl->m_value = value; }
+void TableValue::Set(const std::string &value) { *this = TableValue(value); }
 
 void TableValue::Set(const std::vector<TableValue> &value) {
-  m_impl->m_value = value;
+  *this = TableValue(value);
+}
+
+void TableValue::Set(const Table &value) { *this = TableValue(value); }
+
+namespace {
+template <typename T>
+boost::shared_ptr<const Detail::TableValueImpl> AdoptImpl(T &value) {
+  boost::shared_ptr<Detail::TableValueImpl> impl =
+      boost::make_shared<Detail::TableValueImpl>(T());
+  boost::get<T>(impl->m_value).swap(value);
+  return impl;
+}
+}  // namespace
+
+void TableValue::Adopt(std::string &value) {
+  m_impl = AdoptImpl(value);
+  m_type = VT_string;
+  m_scalar.u64 = 0;
 }
 
-void TableValue::Set(const Table &value) { m_impl->m_value = value; }
+void TableValue::Adopt(std::vector<TableValue> &value) {
+  m_impl = AdoptImpl(value);
+  m_type = VT_array;
+  m_scalar.u64 = 0;
+}
+
+void TableValue::Adopt(Table &value) {
+  m_impl = AdoptImpl(value);
+  m_type = VT_table;
+  m_scalar.u64 = 0;
+}
 
 }  // namespace AmqpClient
@@ -36,10 +36,12 @@
 #include <string.h>
 
 #include <algorithm>
-#include <boost/foreach.hpp>
-#include <boost/variant/apply_visitor.hpp>
-#include <boost/variant/static_visitor.hpp>
+#include <boost/make_shared.hpp>
+#include <boost/variant/get.hpp>
 #include <new>
+#include <stdexcept>
+
+#include "SimpleAmqpClient/AmqpLibraryException.h"
 
 #ifdef _MSC_VER
 #pragma warning(disable : 4800)
@@ -48,135 +50,195 @@
 namespace AmqpClient {
 namespace Detail {
 
-amqp_field_value_t TableValueImpl::generate_field_value::operator()(
-    const void_t) const {
-  amqp_field_value_t v;
-  v.kind = AMQP_FIELD_KIND_VOID;
-  return v;
+namespace {
+// Field-table integers are big-endian on the wire.
+void PutUint8(std::string &out, boost::uint8_t v) {
+  out.push_back(static_cast<char>(v));
 }
 
-amqp_field_value_t TableValueImpl::generate_field_value::operator()(
-    const bool value) const {
-  amqp_field_value_t v;
-  v.kind = AMQP_FIELD_KIND_BOOLEAN;
-  v.value.boolean = value;
-  return v;
+void PutUint16(std::string &out, boost::uint16_t v) {
+  const char b[2] = {static_cast<char>(v >> 8), static_cast<char>(v)};
+  out.append(b, sizeof(b));
 }
 
-amqp_field_value_t TableValueImpl::generate_field_value::operator()(
-    const boost::uint8_t value) const {
-  amqp_field_value_t v;
-  v.kind = AMQP_FIELD_KIND_U8;
-  v.value.u8 = value;
-  return v;
+void PutUint32(std::string &out, boost::uint32_t v) {
+  const char b[4] = {static_cast<char>(v >> 24), static_cast<char>(v >> 16),
+                     static_cast<char>(v >> 8), static_cast<char>(v)};
+  out.append(b, sizeof(b));
 }
 
-amqp_field_value_t TableValueImpl::generate_field_value::operator()(
-    const boost::int8_t value) const {
-  amqp_field_value_t v;
-  v.kind = AMQP_FIELD_KIND_I8;
-  v.value.i8 = value;
-  return v;
+void PutUint64(std::string &out, boost::uint64_t v) {
+  PutUint32(out, static_cast<boost::uint32_t>(v >> 32));
+  PutUint32(out, static_cast<boost::uint32_t>(v));
 }
 
-amqp_field_value_t TableValueImpl::generate_field_value::operator()(
-    const boost::uint16_t value) const {
-  amqp_field_value_t v;
-  v.kind = AMQP_FIELD_KIND_U16;
-  v.value.u16 = value;
-  return v;
+// Overwrites the 32-bit size placeholder at start with the number of bytes
+// written after it.
+void PatchSize(std::string &out, std::string::size_type start) {
+  std::string::size_type size = out.size() - start - 4;
+  if (size > 0xFFFFFFFFu) {
+    throw std::length_error("AMQP field table too large");
+  }
+  boost::uint32_t v = static_cast<boost::uint32_t>(size);
+  out[start] = static_cast<char>(v >> 24);
+  out[start + 1] = static_cast<char>(v >> 16);
+  out[start + 2] = static_cast<char>(v >> 8);
+  out[start + 3] = static_cast<char>(v);
 }
 
-amqp_field_value_t TableValueImpl::generate_field_value::operator()(
-    const boost::int16_t value) const {
-  amqp_field_value_t v;
-  v.kind = AMQP_FIELD_KIND_I16;
-  v.value.i16 = value;
-  return v;
+void CheckAvailable(std::size_t len, std::size_t offset, std::size_t needed) {
+  if (offset > len || needed > len - offset) {
+    throw std::runtime_error("Malformed AMQP field table");
+  }
 }
 
-amqp_field_value_t TableValueImpl::generate_field_value::operator()(
-    const boost::uint32_t value) const {
-  amqp_field_value_t v;
-  v.kind = AMQP_FIELD_KIND_U32;
-  v.value.u32 = value;
-  return v;
-}
+// Nested tables and arrays are decoded recursively, so their depth is capped
+// to keep a malicious frame from exhausting the stack.
+const int MAX_DECODE_DEPTH = 64;
 
-amqp_field_value_t TableValueImpl::generate_field_value::operator()(
-    const boost::int32_t value) const {
-  amqp_field_value_t v;
-  v.kind = AMQP_FIELD_KIND_I32;
-  v.value.i32 = value;
-  return v;
+void CheckDepth(int depth) {
+  if (depth >= MAX_DECODE_DEPTH) {
+    throw std::runtime_error("Malformed AMQP field table");
+  }
 }
 
-amqp_field_value_t TableValueImpl::generate_field_value::operator()(
-    const boost::uint64_t value) const {
-  amqp_field_value_t v;
-  v.kind = AMQP_FIELD_KIND_TIMESTAMP;
-  v.value.u64 = value;
-  return v;
+boost::uint8_t GetUint8(const char *data, std::size_t len,
+                        std::size_t &offset) {
+  CheckAvailable(len, offset, 1);
+  return static_cast<boost::uint8_t>(data[offset++]);
 }
 
-amqp_field_value_t TableValueImpl::generate_field_value::operator()(
-    const boost::int64_t value) const {
-  amqp_field_value_t v;
-  v.kind = AMQP_FIELD_KIND_I64;
-  v.value.i64 = value;
-  return v;
+boost::uint16_t GetUint16(const char *data, std::size_t len,
+                          std::size_t &offset) {
+  CheckAvailable(len, offset, 2);
+  const unsigned char *p =
+      reinterpret_cast<const unsigned char *>(data + offset);
+  offset += 2;
+  return static_cast<boost::uint16_t>((p[0] << 8) | p[1]);
 }
 
-amqp_field_value_t TableValueImpl::generate_field_value::operator()(
-    const float value) const {
-  amqp_field_value_t v;
-  v.kind = AMQP_FIELD_KIND_F32;
-  v.value.f32 = value;
-  return v;
+boost::uint32_t GetUint32(const char *data, std::size_t len,
+                          std::size_t &offset) {
+  CheckAvailable(len, offset, 4);
+  const unsigned char *p =
+      reinterpret_cast<const unsigned char *>(data + offset);
+  offset += 4;
+  return (static_cast<boost::uint32_t>(p[0]) << 24) |
+         (static_cast<boost::uint32_t>(p[1]) << 16) |
+         (static_cast<boost::uint32_t>(p[2]) << 8) |
+         static_cast<boost::uint32_t>(p[3]);
 }
 
-amqp_field_value_t TableValueImpl::generate_field_value::operator()(
-    const double value) const {
-  amqp_field_value_t v;
-  v.kind = AMQP_FIELD_KIND_F64;
-  v.value.f64 = value;
-  return v;
+boost::uint64_t GetUint64(const char *data, std::size_t len,
+                          std::size_t &offset) {
+  boost::uint64_t hi = GetUint32(data, len, offset);
+  return (hi << 32) | GetUint32(data, len, offset);
 }
+}  // namespace
 
-amqp_field_value_t TableValueImpl::generate_field_value::operator()(
-    const std::string &value) const {
-  amqp_field_value_t v;
-  v.kind = AMQP_FIELD_KIND_UTF8;
-  amqp_pool_alloc_bytes(&pool, value.size(), &v.value.bytes);
-  memcpy(v.value.bytes.bytes, value.data(), v.value.bytes.len);
-  return v;
+const std::string &TableValueImpl::GetString(const TableValue &value) {
+  if (TableValue::VT_string != value.m_type) {
+    throw boost::bad_get();
+  }
+  return boost::get<std::string>(value.m_impl->m_value);
 }
 
-amqp_field_value_t TableValueImpl::generate_field_value::operator()(
-    const array_t &value) const {
-  amqp_field_value_t v;
-  v.kind = AMQP_FIELD_KIND_ARRAY;
-  v.value.array.num_entries = value.size();
-  v.value.array.entries = (amqp_field_value_t *)amqp_pool_alloc(
-      &pool, sizeof(amqp_field_value_t) * value.size());
-  if (NULL == v.value.array.entries) {
-    throw std::bad_alloc();
+const array_t &TableValueImpl::GetArray(const TableValue &value) {
+  if (TableValue::VT_array != value.m_type) {
+    throw boost::bad_get();
   }
+  return boost::get<array_t>(value.m_impl->m_value);
+}
 
-  amqp_field_value_t *output_iterator = v.value.array.entries;
-  for (array_t::const_iterator it = value.begin(); it != value.end();
-       ++it, ++output_iterator) {
-    *output_iterator =
-        boost::apply_visitor(generate_field_value(pool), it->m_impl->m_value);
+const Table &TableValueImpl::GetTable(const TableValue &value) {
+  if (TableValue::VT_table != value.m_type) {
+    throw boost::bad_get();
   }
-  return v;
+  return boost::get<Table>(value.m_impl->m_value);
 }
 
-amqp_field_value_t TableValueImpl::generate_field_value::operator()(
-    const Table &value) const {
+amqp_field_value_t TableValueImpl::CreateFieldValue(const TableValue &value,
+                                                    amqp_pool_t &pool) {
   amqp_field_value_t v;
-  v.kind = AMQP_FIELD_KIND_TABLE;
-  v.value.table = CreateAmqpTableInner(value, pool);
+  switch (value.m_type) {
+    case TableValue::VT_void:
+      v.kind = AMQP_FIELD_KIND_VOID;
+      break;
+    case TableValue::VT_bool:
+      v.kind = AMQP_FIELD_KIND_BOOLEAN;
+      v.value.boolean = value.m_scalar.boolean;
+      break;
+    case TableValue::VT_uint8:
+      v.kind = AMQP_FIELD_KIND_U8;
+      v.value.u8 = value.m_scalar.u8;
+      break;
+    case TableValue::VT_int8:
+      v.kind = AMQP_FIELD_KIND_I8;
+      v.value.i8 = value.m_scalar.i8;
+      break;
+    case TableValue::VT_uint16:
+      v.kind = AMQP_FIELD_KIND_U16;
+      v.value.u16 = value.m_scalar.u16;
+      break;
+    case TableValue::VT_int16:
+      v.kind = AMQP_FIELD_KIND_I16;
+      v.value.i16 = value.m_scalar.i16;
+      break;
+    case TableValue::VT_uint32:
+      v.kind = AMQP_FIELD_KIND_U32;
+      v.value.u32 = value.m_scalar.u32;
+      break;
+    case TableValue::VT_int32:
+      v.kind = AMQP_FIELD_KIND_I32;
+      v.value.i32 = value.m_scalar.i32;
+      break;
+    case TableValue::VT_timestamp:
+      v.kind = AMQP_FIELD_KIND_TIMESTAMP;
+      v.value.u64 = value.m_scalar.u64;
+      break;
+    case TableValue::VT_int64:
+      v.kind = AMQP_FIELD_KIND_I64;
+      v.value.i64 = value.m_scalar.i64;
+      break;
+    case TableValue::VT_float:
+      v.kind = AMQP_FIELD_KIND_F32;
+      v.value.f32 = value.m_scalar.f32;
+      break;
+    case TableValue::VT_double:
+      v.kind = AMQP_FIELD_KIND_F64;
+      v.value.f64 = value.m_scalar.f64;
+      break;
+    case TableValue::VT_string: {
+      const std::string &str = GetString(value);
+      v.kind = AMQP_FIELD_KIND_UTF8;
+      amqp_pool_alloc_bytes(&pool, str.size(), &v.value.bytes);
+      memcpy(v.value.bytes.bytes, str.data(), v.value.bytes.len);
+      break;
+    }
+    case TableValue::VT_array: {
+      const array_t &array = GetArray(value);
+      v.kind = AMQP_FIELD_KIND_ARRAY;
+      v.value.array.num_entries = array.size();
+      v.value.array.entries = (amqp_field_value_t *)amqp_pool_alloc(
+          &pool, sizeof(amqp_field_value_t) * array.size());
+      if (NULL == v.value.array.entries) {
+        throw std::bad_alloc();
+      }
+
+      amqp_field_value_t *output_iterator = v.value.array.entries;
+      for (array_t::const_iterator it = array.begin(); it != array.end();
+           ++it, ++output_iterator) {
+        *output_iterator = CreateFieldValue(*it, pool);
+      }
+      break;
+    }
+    case TableValue::VT_table:
+      v.kind = AMQP_FIELD_KIND_TABLE;
+      v.value.table = CreateAmqpTableInner(GetTable(value), pool);
+      break;
+    default:
+      throw std::logic_error("Unhandled TableValue type");
+  }
   return v;
 }
 
@@ -186,15 +248,35 @@ void free_pool(amqp_pool_t *pool) {
 }
 
 amqp_table_t TableValueImpl::CreateAmqpTable(const Table &table,
-                                             amqp_pool_ptr_t &pool) {
+                                             amqp_pool_t &pool) {
   if (0 == table.size()) {
     return AMQP_EMPTY_TABLE;
   }
 
-  pool = boost::shared_ptr<amqp_pool_t>(new amqp_pool_t, free_pool);
-  init_amqp_pool(pool.get(), 1024);
+  return CreateAmqpTableInner(table, pool);
+}
+
+amqp_table_t TableValueImpl::CreateAmqpTable(const EncodedTable &table,
+                                             amqp_pool_t &pool) {
+  const std::string &bytes = table.Bytes();
+  if (bytes.size() <= 4) {
+    return AMQP_EMPTY_TABLE;
+  }
+
+  amqp_bytes_t encoded;
+  amqp_pool_alloc_bytes(&pool, bytes.size(), &encoded);
+  if (NULL == encoded.bytes) {
+    throw std::bad_alloc();
+  }
+  memcpy(encoded.bytes, bytes.data(), bytes.size());
 
-  return CreateAmqpTableInner(table, *pool.get());
+  amqp_table_t new_table;
+  size_t offset = 0;
+  int status = amqp_decode_table(encoded, &pool, &new_table, &offset);
+  if (AMQP_STATUS_OK != status) {
+    throw AmqpLibraryException::CreateException(status);
+  }
+  return new_table;
 }
 
 amqp_table_t TableValueImpl::CreateAmqpTableInner(const Table &table,
@@ -221,8 +303,7 @@ amqp_table_t TableValueImpl::CreateAmqpTableInner(const Table &table,
 
     std::copy(it->first.begin(), it->first.end(), (char *)output_it->key.bytes);
 
-    output_it->value = boost::apply_visitor(
-        TableValueImpl::generate_field_value(pool), it->second.m_impl->m_value);
+    output_it->value = CreateFieldValue(it->second, pool);
   }
 
   return new_table;
@@ -241,6 +322,282 @@ Table TableValueImpl::CreateTable(const amqp_table_t &table) {
   return new_table;
 }
 
+void TableValueImpl::EncodeTable(const Table &table, std::string &out) {
+  std::string::size_type start = out.size();
+  PutUint32(out, 0);
+
+  for (Table::const_iterator it = table.begin(); it != table.end(); ++it) {
+    if (it->first.size() > 0xFF) {
+      throw std::invalid_argument("Table key too long: " + it->first);
+    }
+    PutUint8(out, static_cast<boost::uint8_t>(it->first.size()));
+    out.append(it->first);
+    EncodeFieldValue(it->second, out);
+  }
+
+  PatchSize(out, start);
+}
+
+void TableValueImpl::EncodeFieldValue(const TableValue &value,
+                                      std::string &out) {
+  switch (value.m_type) {
+    case TableValue::VT_void:
+      PutUint8(out, AMQP_FIELD_KIND_VOID);
+      break;
+    case TableValue::VT_bool:
+      PutUint8(out, AMQP_FIELD_KIND_BOOLEAN);
+      PutUint8(out, value.m_scalar.boolean ? 1 : 0);
+      break;
+    case TableValue::VT_uint8:
+      PutUint8(out, AMQP_FIELD_KIND_U8);
+      PutUint8(out, value.m_scalar.u8);
+      break;
+    case TableValue::VT_int8:
+      PutUint8(out, AMQP_FIELD_KIND_I8);
+      PutUint8(out, static_cast<boost::uint8_t>(value.m_scalar.i8));
+      break;
+    case TableValue::VT_uint16:
+      PutUint8(out, AMQP_FIELD_KIND_U16);
+      PutUint16(out, value.m_scalar.u16);
+      break;
+    case TableValue::VT_int16:
+      PutUint8(out, AMQP_FIELD_KIND_I16);
+      PutUint16(out, static_cast<boost::uint16_t>(value.m_scalar.i16));
+      break;
+    case TableValue::VT_uint32:
+      PutUint8(out, AMQP_FIELD_KIND_U32);
+      PutUint32(out, value.m_scalar.u32);
+      break;
+    case TableValue::VT_int32:
+      PutUint8(out, AMQP_FIELD_KIND_I32);
+      PutUint32(out, static_cast<boost::uint32_t>(value.m_scalar.i32));
+      break;
+    case TableValue::VT_timestamp:
+      PutUint8(out, AMQP_FIELD_KIND_TIMESTAMP);
+      PutUint64(out, value.m_scalar.u64);
+      break;
+    case TableValue::VT_int64:
+      PutUint8(out, AMQP_FIELD_KIND_I64);
+      PutUint64(out, static_cast<boost::uint64_t>(value.m_scalar.i64));
+      break;
+    case TableValue::VT_float: {
+      boost::uint32_t bits;
+      memcpy(&bits, &value.m_scalar.f32, sizeof(bits));
+      PutUint8(out, AMQP_FIELD_KIND_F32);
+      PutUint32(out, bits);
+      break;
+    }
+    case TableValue::VT_double: {
+      boost::uint64_t bits;
+      memcpy(&bits, &value.m_scalar.f64, sizeof(bits));
+      PutUint8(out, AMQP_FIELD_KIND_F64);
+      PutUint64(out, bits);
+      break;
+    }
+    case TableValue::VT_string: {
+      const std::string &str = GetString(value);
+      if (str.size() > 0xFFFFFFFFu) {
+        throw std::length_error("AMQP field table string too large");
+      }
+      PutUint8(out, AMQP_FIELD_KIND_UTF8);
+      PutUint32(out, static_cast<boost::uint32_t>(str.size()));
+      out.append(str);
+      break;
+    }
+    case TableValue::VT_array: {
+      const array_t &array = GetArray(value);
+      PutUint8(out, AMQP_FIELD_KIND_ARRAY);
+      std::string::size_type start = out.size();
+      PutUint32(out, 0);
+      for (array_t::const_iterator it = array.begin(); it != array.end();
+           ++it) {
+        EncodeFieldValue(*it, out);
+      }
+      PatchSize(out, start);
+      break;
+    }
+    case TableValue::VT_table:
+      PutUint8(out, AMQP_FIELD_KIND_TABLE);
+      EncodeTable(GetTable(value), out);
+      break;
+    default:
+      throw std::logic_error("Unhandled TableValue type");
+  }
+}
+
+Table TableValueImpl::DecodeTable(const char *data, std::size_t len,
+                                  std::size_t &offset) {
+  return DecodeTableInner(data, len, offset, 0);
+}
+
+Table TableValueImpl::DecodeTableInner(const char *data, std::size_t len,
+                                       std::size_t &offset, int depth) {
+  CheckDepth(depth);
+  boost::uint32_t size = GetUint32(data, len, offset);
+  CheckAvailable(len, offset, size);
+  const std::size_t end = offset + size;
+
+  Table new_table;
+  while (offset < end) {
+    boost::uint8_t key_len = GetUint8(data, end, offset);
+    CheckAvailable(end, offset, key_len);
+    std::string key(data + offset, key_len);
+    offset += key_len;
+
+    TableValue value = DecodeFieldValue(data, end, offset, depth);
+    new_table.insert(new_table.end(), TableEntry(key, value));
+  }
+  return new_table;
+}
+
+bool TableValueImpl::FindInTable(const char *data, std::size_t len,
+                                 const boost::string_ref &key,
+                                 TableValue &value) {
+  std::size_t offset = 0;
+  boost::uint32_t size = GetUint32(data, len, offset);
+  CheckAvailable(len, offset, size);
+  const std::size_t end = offset + size;
+
+  while (offset < end) {
+    boost::uint8_t key_len = GetUint8(data, end, offset);
+    CheckAvailable(end, offset, key_len);
+    boost::string_ref entry_key(data + offset, key_len);
+    offset += key_len;
+
+    if (entry_key == key) {
+      value = DecodeFieldValue(data, end, offset, 0);
+      return true;
+    }
+    SkipFieldValue(data, end, offset);
+  }
+  return false;
+}
+
+EncodedTable TableValueImpl::CreateEncodedTable(const char *data,
+                                                std::size_t len) {
+  EncodedTable table;
+  table.m_bytes = boost::make_shared<const std::string>(data, len);
+  return table;
+}
+
+void TableValueImpl::SkipFieldValue(const char *data, std::size_t len,
+                                    std::size_t &offset) {
+  std::size_t size;
+  switch (GetUint8(data, len, offset)) {
+    case AMQP_FIELD_KIND_VOID:
+      size = 0;
+      break;
+    case AMQP_FIELD_KIND_BOOLEAN:
+    case AMQP_FIELD_KIND_I8:
+    case AMQP_FIELD_KIND_U8:
+      size = 1;
+      break;
+    case AMQP_FIELD_KIND_I16:
+    case AMQP_FIELD_KIND_U16:
+      size = 2;
+      break;
+    case AMQP_FIELD_KIND_I32:
+    case AMQP_FIELD_KIND_U32:
+    case AMQP_FIELD_KIND_F32:
+      size = 4;
+      break;
+    case AMQP_FIELD_KIND_DECIMAL:
+      size = 5;
+      break;
+    case AMQP_FIELD_KIND_I64:
+    case AMQP_FIELD_KIND_U64:
+    case AMQP_FIELD_KIND_F64:
+    case AMQP_FIELD_KIND_TIMESTAMP:
+      size = 8;
+      break;
+    case AMQP_FIELD_KIND_UTF8:
+    case AMQP_FIELD_KIND_BYTES:
+    case AMQP_FIELD_KIND_ARRAY:
+    case AMQP_FIELD_KIND_TABLE:
+      size = GetUint32(data, len, offset);
+      break;
+    default:
+      throw std::runtime_error("Malformed AMQP field table");
+  }
+  CheckAvailable(len, offset, size);
+  offset += size;
+}
+
+TableValue TableValueImpl::DecodeFieldValue(const char *data, std::size_t len,
+                                            std::size_t &offset, int depth) {
+  switch (GetUint8(data, len, offset)) {
+    case AMQP_FIELD_KIND_VOID:
+      return TableValue();
+    case AMQP_FIELD_KIND_BOOLEAN:
+      return TableValue(0 != GetUint8(data, len, offset));
+    case AMQP_FIELD_KIND_U8:
+      return TableValue(GetUint8(data, len, offset));
+    case AMQP_FIELD_KIND_I8:
+      return TableValue(
+          static_cast<boost::int8_t>(GetUint8(data, len, offset)));
+    case AMQP_FIELD_KIND_U16:
+      return TableValue(GetUint16(data, len, offset));
+    case AMQP_FIELD_KIND_I16:
+      return TableValue(
+          static_cast<boost::int16_t>(GetUint16(data, len, offset)));
+    case AMQP_FIELD_KIND_U32:
+      return TableValue(GetUint32(data, len, offset));
+    case AMQP_FIELD_KIND_I32:
+      return TableValue(
+          static_cast<boost::int32_t>(GetUint32(data, len, offset)));
+    case AMQP_FIELD_KIND_TIMESTAMP:
+      return TableValue(GetUint64(data, len, offset));
+    case AMQP_FIELD_KIND_I64:
+      return TableValue(
+          static_cast<boost::int64_t>(GetUint64(data, len, offset)));
+    case AMQP_FIELD_KIND_F32: {
+      boost::uint32_t bits = GetUint32(data, len, offset);
+      float f;
+      memcpy(&f, &bits, sizeof(f));
+      return TableValue(f);
+    }
+    case AMQP_FIELD_KIND_F64: {
+      boost::uint64_t bits = GetUint64(data, len, offset);
+      double d;
+      memcpy(&d, &bits, sizeof(d));
+      return TableValue(d);
+    }
+    case AMQP_FIELD_KIND_UTF8:
+    case AMQP_FIELD_KIND_BYTES: {
+      boost::uint32_t size = GetUint32(data, len, offset);
+      CheckAvailable(len, offset, size);
+      TableValue value(std::string(data + offset, size));
+      offset += size;
+      return value;
+    }
+    case AMQP_FIELD_KIND_ARRAY: {
+      CheckDepth(depth + 1);
+      boost::uint32_t size = GetUint32(data, len, offset);
+      CheckAvailable(len, offset, size);
+      const std::size_t end = offset + size;
+      Detail::array_t new_array;
+      while (offset < end) {
+        new_array.push_back(DecodeFieldValue(data, end, offset, depth + 1));
+      }
+      return TableValue(new_array);
+    }
+    case AMQP_FIELD_KIND_TABLE:
+      return TableValue(DecodeTableInner(data, len, offset, depth + 1));
+    case AMQP_FIELD_KIND_DECIMAL:
+      // Decimals are unsupported, same as CreateTableValue.
+      CheckAvailable(len, offset, 5);
+      offset += 5;
+      return TableValue();
+    case AMQP_FIELD_KIND_U64:
+      // uint64_t is unsupported by RabbitMQ.
+      CheckAvailable(len, offset, 8);
+      offset += 8;
+      return TableValue();
+    default:
+      throw std::runtime_error("Malformed AMQP field table");
+  }
+}
+
 TableValue TableValueImpl::CreateTableValue(const amqp_field_value_t &entry) {
   switch (entry.kind) {
     case AMQP_FIELD_KIND_VOID:
@@ -274,6 +631,7 @@ TableValue TableValueImpl::CreateTableValue(const amqp_field_value_t &entry) {
     case AMQP_FIELD_KIND_ARRAY: {
       amqp_array_t array = entry.value.array;
       Detail::array_t new_array;
+      new_array.reserve(array.num_entries);
 
       for (int i = 0; i < array.num_entries; ++i) {
         new_array.push_back(CreateTableValue(array.entries[i]));
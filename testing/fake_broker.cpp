@@ -0,0 +1,1570 @@
+/*
+ * ***** BEGIN LICENSE BLOCK *****
+ * Version: MIT
+ *
+ * Copyright (c) 2010-2013 Alan Antonuk
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * ***** END LICENSE BLOCK *****
+ */
+
+#include "fake_broker.h"
+
+#include <amqp_framing.h>
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstring>
+#include <deque>
+#include <list>
+#include <map>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#ifdef MSG_NOSIGNAL
+#define FAKE_BROKER_SEND_FLAGS MSG_NOSIGNAL
+#else
+#define FAKE_BROKER_SEND_FLAGS 0
+#endif
+
+namespace {
+
+const char PROTOCOL_HEADER[] = {'A', 'M', 'Q', 'P', 0, 0, 9, 1};
+const std::size_t PROTOCOL_HEADER_SIZE = sizeof(PROTOCOL_HEADER);
+// Type, channel and size
+const std::size_t FRAME_HEADER_SIZE = 7;
+// The frame header and the frame-end octet
+const std::size_t FRAME_OVERHEAD = FRAME_HEADER_SIZE + 1;
+// Class id, weight and body size, before the property flags
+const std::size_t CONTENT_HEADER_PREFIX_SIZE = 12;
+const std::size_t ENCODE_BUFFER_SIZE = 131072;
+
+std::string ToString(amqp_bytes_t bytes) {
+  return std::string(static_cast<const char *>(bytes.bytes), bytes.len);
+}
+
+amqp_bytes_t ToBytes(const std::string &str) {
+  amqp_bytes_t ret;
+  ret.len = str.size();
+  ret.bytes = const_cast<char *>(str.data());
+  return ret;
+}
+
+void PutUint8(std::string &out, boost::uint8_t value) {
+  out.push_back(static_cast<char>(value));
+}
+
+void PutUint16(std::string &out, boost::uint16_t value) {
+  PutUint8(out, static_cast<boost::uint8_t>(value >> 8));
+  PutUint8(out, static_cast<boost::uint8_t>(value));
+}
+
+void PutUint32(std::string &out, boost::uint32_t value) {
+  PutUint16(out, static_cast<boost::uint16_t>(value >> 16));
+  PutUint16(out, static_cast<boost::uint16_t>(value));
+}
+
+void PutUint64(std::string &out, boost::uint64_t value) {
+  PutUint32(out, static_cast<boost::uint32_t>(value >> 32));
+  PutUint32(out, static_cast<boost::uint32_t>(value));
+}
+
+boost::uint16_t GetUint16(const char *data) {
+  const unsigned char *p = reinterpret_cast<const unsigned char *>(data);
+  return static_cast<boost::uint16_t>((p[0] << 8) | p[1]);
+}
+
+boost::uint32_t GetUint32(const char *data) {
+  return (static_cast<boost::uint32_t>(GetUint16(data)) << 16) |
+         GetUint16(data + 2);
+}
+
+boost::uint64_t GetUint64(const char *data) {
+  return (static_cast<boost::uint64_t>(GetUint32(data)) << 32) |
+         GetUint32(data + 4);
+}
+
+std::string SystemError(const std::string &what) {
+  return "FakeBroker: " + what + ": " + std::strerror(errno);
+}
+
+void SetNonBlocking(int fd) {
+  const int flags = fcntl(fd, F_GETFL, 0);
+  fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+}
+
+class ScopedLock : boost::noncopyable {
+ public:
+  explicit ScopedLock(pthread_mutex_t &mutex) : m_mutex(mutex) {
+    pthread_mutex_lock(&m_mutex);
+  }
+  ~ScopedLock() { pthread_mutex_unlock(&m_mutex); }
+
+ private:
+  pthread_mutex_t &m_mutex;
+};
+
+/// A reply code and text for a channel.close or connection.close
+struct Error {
+  Error(boost::uint16_t code, const std::string &text)
+      : code(code), text(text) {}
+  boost::uint16_t code;
+  std::string text;
+};
+
+/// Closes the channel the method was received on
+struct ChannelError : Error {
+  ChannelError(boost::uint16_t code, const std::string &text)
+      : Error(code, text) {}
+};
+
+/// Closes the connection
+struct ConnectionError : Error {
+  ConnectionError(boost::uint16_t code, const std::string &text)
+      : Error(code, text) {}
+};
+
+struct Message {
+  Message() : redelivered(false) {}
+
+  std::string exchange;
+  std::string routing_key;
+  /// The property flags and list, as the publisher sent them
+  std::string properties;
+  std::string body;
+  bool redelivered;
+};
+
+struct Connection;
+
+struct Consumer {
+  Connection *connection;
+  amqp_channel_t channel;
+  std::string tag;
+  bool no_ack;
+};
+
+struct Queue {
+  Queue() : auto_delete(false), had_consumers(false), owner(NULL), next(0) {}
+
+  std::deque<Message> messages;
+  std::vector<Consumer> consumers;
+  bool auto_delete;
+  bool had_consumers;
+  /// The connection that declared an exclusive queue
+  Connection *owner;
+  /// The consumer to try first for the next delivery
+  std::size_t next;
+};
+
+struct Exchange {
+  typedef std::set<std::pair<std::string, std::string> > binding_set_t;
+
+  std::string type;
+  /// Routing key and queue of each binding
+  binding_set_t bindings;
+};
+
+struct Unacked {
+  std::string queue;
+  Message message;
+};
+
+struct ChannelState {
+  typedef std::map<boost::uint64_t, Unacked> unacked_map_t;
+
+  ChannelState()
+      : closing(false),
+        confirm(false),
+        publish_seq(0),
+        delivery_tag(0),
+        prefetch(0),
+        publishing(false),
+        mandatory(false),
+        have_header(false),
+        body_size(0) {}
+
+  /// The broker sent channel.close and waits for close-ok
+  bool closing;
+  bool confirm;
+  boost::uint64_t publish_seq;
+  boost::uint64_t delivery_tag;
+  boost::uint16_t prefetch;
+  unacked_map_t unacked;
+
+  // The publish whose content is being received
+  bool publishing;
+  bool mandatory;
+  bool have_header;
+  boost::uint64_t body_size;
+  Message pending;
+};
+
+struct Connection {
+  typedef std::map<amqp_channel_t, ChannelState> channel_map_t;
+
+  explicit Connection(int fd)
+      : fd(fd),
+        got_header(false),
+        open(false),
+        closing(false),
+        dead(false),
+        frame_max(AMQP_FRAME_MIN_SIZE) {}
+
+  int fd;
+  std::string in;
+  std::string out;
+  bool got_header;
+  /// connection.open has been received
+  bool open;
+  /// Close the socket once out has been sent
+  bool closing;
+  bool dead;
+  std::size_t frame_max;
+  channel_map_t channels;
+};
+
+typedef std::map<std::string, Queue> queue_map_t;
+typedef std::map<std::string, Exchange> exchange_map_t;
+typedef std::list<Connection> connection_list_t;
+
+}  // namespace
+
+FakeBroker::Options::Options()
+    : reply_delay(0),
+      nack_publishes(false),
+      fail_method(0),
+      fail_reply_code(AMQP_PRECONDITION_FAILED),
+      frame_max(131072),
+      channel_max(2047) {}
+
+class FakeBroker::Impl : boost::noncopyable {
+ public:
+  explicit Impl(const Options &options);
+  ~Impl();
+
+  void SetOptions(const Options &options) {
+    ScopedLock lock(m_mutex);
+    m_options = options;
+  }
+
+  int Port() const { return m_port; }
+
+  std::size_t QueueDepth(const std::string &queue) const {
+    ScopedLock lock(m_mutex);
+    queue_map_t::const_iterator it = m_queues.find(queue);
+    return m_queues.end() == it ? 0 : it->second.messages.size();
+  }
+
+  bool HasQueue(const std::string &queue) const {
+    ScopedLock lock(m_mutex);
+    return m_queues.end() != m_queues.find(queue);
+  }
+
+  boost::uint64_t PublishCount() const {
+    ScopedLock lock(m_mutex);
+    return m_publish_count;
+  }
+
+  std::size_t ConnectionCount() const {
+    ScopedLock lock(m_mutex);
+    return m_connections.size();
+  }
+
+ private:
+  static void *ThreadMain(void *impl);
+  void Run();
+
+  void Accept();
+  bool Read(Connection &c);
+  void Flush(Connection &c);
+  void Process(Connection &c);
+
+  void HandleFrame(Connection &c, boost::uint8_t type, amqp_channel_t channel,
+                   const char *payload, std::size_t size);
+  void HandleConnectionMethod(Connection &c, amqp_method_number_t id,
+                              void *decoded);
+  void HandleChannelMethod(Connection &c, amqp_channel_t channel,
+                           amqp_method_number_t id, void *decoded);
+  void DispatchMethod(Connection &c, amqp_channel_t channel, ChannelState &ch,
+                      amqp_method_number_t id, void *decoded);
+  void HandleContent(Connection &c, boost::uint8_t type,
+                     amqp_channel_t channel, const char *payload,
+                     std::size_t size);
+
+  void DeclareExchange(Connection &c, amqp_channel_t channel,
+                       const amqp_exchange_declare_t &method);
+  void DeclareQueue(Connection &c, amqp_channel_t channel,
+                    const amqp_queue_declare_t &method);
+  void BindQueue(const std::string &queue, const std::string &exchange,
+                 const std::string &routing_key, bool bind);
+  void Consume(Connection &c, amqp_channel_t channel,
+               const amqp_basic_consume_t &method);
+  void CompletePublish(Connection &c, amqp_channel_t channel,
+                       ChannelState &ch);
+  void Settle(ChannelState &ch, boost::uint64_t delivery_tag, bool multiple,
+              bool requeue);
+
+  Queue &GetQueue(const std::string &name);
+  Exchange &GetExchange(const std::string &name);
+  void Dispatch(const std::string &queue);
+  void DispatchAll();
+  bool HasCapacity(const Consumer &consumer);
+  void Deliver(const Consumer &consumer, const std::string &queue,
+               const Message &message);
+  void Requeue(const Unacked &unacked);
+  void RemoveConsumers(const Connection &c, const amqp_channel_t *channel,
+                       const std::string *tag);
+  void DeleteQueue(const std::string &name);
+
+  void CloseChannel(Connection &c, amqp_channel_t channel,
+                    amqp_method_number_t id, const Error &error);
+  void CleanupChannel(Connection &c, amqp_channel_t channel, ChannelState &ch);
+  void CloseConnection(Connection &c, amqp_method_number_t id,
+                       const Error &error);
+  void CleanupConnection(Connection &c);
+
+  void SendStart(Connection &c);
+  void SendMethod(Connection &c, amqp_channel_t channel,
+                  amqp_method_number_t id, void *decoded);
+  void SendFrame(Connection &c, boost::uint8_t type, amqp_channel_t channel,
+                 const char *payload, std::size_t size);
+  void SendContent(Connection &c, amqp_channel_t channel,
+                   const Message &message);
+  void Delay();
+  std::string GenerateName(const char *prefix);
+
+  mutable pthread_mutex_t m_mutex;
+  Options m_options;
+  int m_listen_fd;
+  int m_wake_fds[2];
+  int m_port;
+  pthread_t m_thread;
+
+  connection_list_t m_connections;
+  queue_map_t m_queues;
+  exchange_map_t m_exchanges;
+  boost::uint64_t m_publish_count;
+  boost::uint64_t m_next_name;
+
+  amqp_pool_t m_pool;
+  std::vector<char> m_encode_buffer;
+};
+
+FakeBroker::Impl::Impl(const Options &options)
+    : m_options(options),
+      m_listen_fd(-1),
+      m_port(0),
+      m_publish_count(0),
+      m_next_name(0),
+      m_encode_buffer(ENCODE_BUFFER_SIZE) {
+  m_wake_fds[0] = m_wake_fds[1] = -1;
+  m_exchanges[""].type = "direct";
+  m_exchanges["amq.direct"].type = "direct";
+  m_exchanges["amq.fanout"].type = "fanout";
+
+  try {
+    m_listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (m_listen_fd < 0) {
+      throw std::runtime_error(SystemError("socket"));
+    }
+    sockaddr_in addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = 0;
+    if (0 != bind(m_listen_fd, reinterpret_cast<sockaddr *>(&addr),
+                  sizeof(addr)) ||
+        0 != listen(m_listen_fd, 16)) {
+      throw std::runtime_error(SystemError("listen"));
+    }
+    socklen_t addr_len = sizeof(addr);
+    if (0 != getsockname(m_listen_fd, reinterpret_cast<sockaddr *>(&addr),
+                         &addr_len)) {
+      throw std::runtime_error(SystemError("getsockname"));
+    }
+    m_port = ntohs(addr.sin_port);
+    SetNonBlocking(m_listen_fd);
+
+    if (0 != pipe(m_wake_fds)) {
+      throw std::runtime_error(SystemError("pipe"));
+    }
+  } catch (...) {
+    if (m_listen_fd >= 0) {
+      close(m_listen_fd);
+    }
+    throw;
+  }
+
+  init_amqp_pool(&m_pool, 4096);
+  pthread_mutex_init(&m_mutex, NULL);
+  if (0 != pthread_create(&m_thread, NULL, &Impl::ThreadMain, this)) {
+    pthread_mutex_destroy(&m_mutex);
+    empty_amqp_pool(&m_pool);
+    close(m_wake_fds[0]);
+    close(m_wake_fds[1]);
+    close(m_listen_fd);
+    throw std::runtime_error("FakeBroker: could not start the broker thread");
+  }
+}
+
+FakeBroker::Impl::~Impl() {
+  const char stop = 0;
+  while (write(m_wake_fds[1], &stop, 1) < 0 && EINTR == errno) {
+  }
+  pthread_join(m_thread, NULL);
+
+  for (connection_list_t::iterator it = m_connections.begin();
+       it != m_connections.end(); ++it) {
+    close(it->fd);
+  }
+  close(m_wake_fds[0]);
+  close(m_wake_fds[1]);
+  close(m_listen_fd);
+  empty_amqp_pool(&m_pool);
+  pthread_mutex_destroy(&m_mutex);
+}
+
+void *FakeBroker::Impl::ThreadMain(void *impl) {
+  static_cast<Impl *>(impl)->Run();
+  return NULL;
+}
+
+void FakeBroker::Impl::Run() {
+  std::vector<pollfd> fds;
+  std::vector<Connection *> polled;
+  for (;;) {
+    fds.clear();
+    polled.clear();
+    pollfd wake = {m_wake_fds[0], POLLIN, 0};
+    pollfd listener = {m_listen_fd, POLLIN, 0};
+    fds.push_back(wake);
+    fds.push_back(listener);
+    {
+      ScopedLock lock(m_mutex);
+      for (connection_list_t::iterator it = m_connections.begin();
+           it != m_connections.end(); ++it) {
+        pollfd fd = {it->fd,
+                     static_cast<short>(it->out.empty() ? POLLIN
+                                                        : POLLIN | POLLOUT),
+                     0};
+        fds.push_back(fd);
+        polled.push_back(&*it);
+      }
+    }
+
+    if (poll(&fds[0], fds.size(), -1) < 0) {
+      if (EINTR == errno) {
+        continue;
+      }
+      return;
+    }
+    if (0 != fds[0].revents) {
+      return;
+    }
+
+    ScopedLock lock(m_mutex);
+    if (0 != (fds[1].revents & POLLIN)) {
+      Accept();
+    }
+    for (std::size_t i = 0; i < polled.size(); ++i) {
+      if (0 != (fds[i + 2].revents & (POLLIN | POLLHUP | POLLERR))) {
+        if (Read(*polled[i])) {
+          Process(*polled[i]);
+        } else {
+          polled[i]->dead = true;
+        }
+      }
+    }
+
+    // Handling one connection's frames can queue frames to any other.
+    for (connection_list_t::iterator it = m_connections.begin();
+         it != m_connections.end();) {
+      if (!it->dead && !it->out.empty()) {
+        Flush(*it);
+      }
+      if (it->closing && it->out.empty()) {
+        it->dead = true;
+      }
+      if (it->dead) {
+        CleanupConnection(*it);
+        close(it->fd);
+        it = m_connections.erase(it);
+      } else {
+        ++it;
+      }
+    }
+  }
+}
+
+void FakeBroker::Impl::Accept() {
+  for (;;) {
+    const int fd = accept(m_listen_fd, NULL, NULL);
+    if (fd < 0) {
+      return;
+    }
+    SetNonBlocking(fd);
+    const int nodelay = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+    m_connections.push_back(Connection(fd));
+  }
+}
+
+bool FakeBroker::Impl::Read(Connection &c) {
+  char buffer[65536];
+  for (;;) {
+    const ssize_t received = recv(c.fd, buffer, sizeof(buffer), 0);
+    if (received > 0) {
+      c.in.append(buffer, static_cast<std::size_t>(received));
+    } else if (0 == received) {
+      return false;
+    } else if (EINTR == errno) {
+      continue;
+    } else {
+      return EAGAIN == errno || EWOULDBLOCK == errno;
+    }
+  }
+}
+
+void FakeBroker::Impl::Flush(Connection &c) {
+  std::size_t sent = 0;
+  while (sent < c.out.size()) {
+    const ssize_t ret = send(c.fd, c.out.data() + sent, c.out.size() - sent,
+                             FAKE_BROKER_SEND_FLAGS);
+    if (ret > 0) {
+      sent += static_cast<std::size_t>(ret);
+    } else if (ret < 0 && EINTR == errno) {
+      continue;
+    } else {
+      if (ret < 0 && EAGAIN != errno && EWOULDBLOCK != errno) {
+        c.dead = true;
+      }
+      break;
+    }
+  }
+  c.out.erase(0, sent);
+}
+
+void FakeBroker::Impl::Process(Connection &c) {
+  if (c.closing) {
+    c.in.clear();
+    return;
+  }
+
+  std::size_t offset = 0;
+  if (!c.got_header) {
+    if (c.in.size() < PROTOCOL_HEADER_SIZE) {
+      return;
+    }
+    if (0 != c.in.compare(0, PROTOCOL_HEADER_SIZE, PROTOCOL_HEADER,
+                          PROTOCOL_HEADER_SIZE)) {
+      // As the spec asks, reply with the protocol we do speak.
+      c.out.append(PROTOCOL_HEADER, PROTOCOL_HEADER_SIZE);
+      c.closing = true;
+      c.in.clear();
+      return;
+    }
+    c.got_header = true;
+    offset = PROTOCOL_HEADER_SIZE;
+    SendStart(c);
+  }
+
+  while (!c.closing && c.in.size() - offset >= FRAME_HEADER_SIZE) {
+    const char *frame = c.in.data() + offset;
+    const boost::uint8_t type = static_cast<boost::uint8_t>(frame[0]);
+    const amqp_channel_t channel = GetUint16(frame + 1);
+    const std::size_t size = GetUint32(frame + 3);
+    if (size + FRAME_OVERHEAD > m_options.frame_max) {
+      CloseConnection(c, 0,
+                      Error(AMQP_FRAME_ERROR, "FRAME_ERROR - frame too large"));
+      break;
+    }
+    if (c.in.size() - offset < size + FRAME_OVERHEAD) {
+      break;
+    }
+    if (AMQP_FRAME_END !=
+        static_cast<boost::uint8_t>(frame[FRAME_HEADER_SIZE + size])) {
+      CloseConnection(c, 0,
+                      Error(AMQP_FRAME_ERROR, "FRAME_ERROR - bad frame end"));
+      break;
+    }
+
+    HandleFrame(c, type, channel, frame + FRAME_HEADER_SIZE, size);
+    recycle_amqp_pool(&m_pool);
+    offset += size + FRAME_OVERHEAD;
+  }
+  c.in.erase(0, offset);
+}
+
+void FakeBroker::Impl::HandleFrame(Connection &c, boost::uint8_t type,
+                                   amqp_channel_t channel,
+                                   const char *payload, std::size_t size) {
+  amqp_method_number_t id = 0;
+  try {
+    switch (type) {
+      case AMQP_FRAME_METHOD: {
+        if (size < 4) {
+          throw ConnectionError(AMQP_FRAME_ERROR, "FRAME_ERROR - short method");
+        }
+        id = GetUint32(payload);
+        amqp_bytes_t encoded;
+        encoded.bytes = const_cast<char *>(payload + 4);
+        encoded.len = size - 4;
+        void *decoded = NULL;
+        if (amqp_decode_method(id, &m_pool, encoded, &decoded) < 0) {
+          throw ConnectionError(AMQP_SYNTAX_ERROR,
+                                "SYNTAX_ERROR - could not decode method");
+        }
+        if (0 == channel) {
+          HandleConnectionMethod(c, id, decoded);
+        } else {
+          HandleChannelMethod(c, channel, id, decoded);
+        }
+        break;
+      }
+      case AMQP_FRAME_HEADER:
+      case AMQP_FRAME_BODY:
+        id = AMQP_BASIC_PUBLISH_METHOD;
+        HandleContent(c, type, channel, payload, size);
+        break;
+      case AMQP_FRAME_HEARTBEAT:
+        break;
+      default:
+        throw ConnectionError(AMQP_FRAME_ERROR,
+                              "FRAME_ERROR - unknown frame type");
+    }
+  } catch (const ConnectionError &e) {
+    CloseConnection(c, id, e);
+  }
+}
+
+void FakeBroker::Impl::HandleConnectionMethod(Connection &c,
+                                              amqp_method_number_t id,
+                                              void *decoded) {
+  switch (id) {
+    case AMQP_CONNECTION_START_OK_METHOD: {
+      const amqp_connection_start_ok_t *start_ok =
+          static_cast<amqp_connection_start_ok_t *>(decoded);
+      if ("PLAIN" != ToString(start_ok->mechanism)) {
+        throw ConnectionError(AMQP_ACCESS_REFUSED,
+                              "ACCESS_REFUSED - only PLAIN is supported");
+      }
+      amqp_connection_tune_t tune;
+      tune.channel_max = m_options.channel_max;
+      tune.frame_max = m_options.frame_max;
+      tune.heartbeat = 0;
+      SendMethod(c, 0, AMQP_CONNECTION_TUNE_METHOD, &tune);
+      break;
+    }
+    case AMQP_CONNECTION_TUNE_OK_METHOD: {
+      const amqp_connection_tune_ok_t *tune_ok =
+          static_cast<amqp_connection_tune_ok_t *>(decoded);
+      c.frame_max = 0 == tune_ok->frame_max
+                        ? m_options.frame_max
+                        : std::min(tune_ok->frame_max, m_options.frame_max);
+      break;
+    }
+    case AMQP_CONNECTION_OPEN_METHOD: {
+      c.open = true;
+      amqp_connection_open_ok_t open_ok;
+      open_ok.known_hosts = amqp_empty_bytes;
+      Delay();
+      SendMethod(c, 0, AMQP_CONNECTION_OPEN_OK_METHOD, &open_ok);
+      break;
+    }
+    case AMQP_CONNECTION_CLOSE_METHOD: {
+      CleanupConnection(c);
+      amqp_connection_close_ok_t close_ok;
+      SendMethod(c, 0, AMQP_CONNECTION_CLOSE_OK_METHOD, &close_ok);
+      c.closing = true;
+      break;
+    }
+    case AMQP_CONNECTION_CLOSE_OK_METHOD:
+      c.closing = true;
+      break;
+    default:
+      throw ConnectionError(AMQP_NOT_IMPLEMENTED,
+                            "NOT_IMPLEMENTED - unsupported connection method");
+  }
+}
+
+void FakeBroker::Impl::HandleChannelMethod(Connection &c,
+                                           amqp_channel_t channel,
+                                           amqp_method_number_t id,
+                                           void *decoded) {
+  if (!c.open) {
+    throw ConnectionError(AMQP_CHANNEL_ERROR,
+                          "CHANNEL_ERROR - connection is not open");
+  }
+
+  Connection::channel_map_t::iterator it = c.channels.find(channel);
+  if (AMQP_CHANNEL_OPEN_METHOD == id) {
+    if (c.channels.end() != it) {
+      throw ConnectionError(AMQP_CHANNEL_ERROR,
+                            "CHANNEL_ERROR - channel is already open");
+    }
+    c.channels[channel];
+    amqp_channel_open_ok_t open_ok;
+    open_ok.channel_id = amqp_empty_bytes;
+    Delay();
+    SendMethod(c, channel, AMQP_CHANNEL_OPEN_OK_METHOD, &open_ok);
+    return;
+  }
+  if (c.channels.end() == it) {
+    throw ConnectionError(AMQP_CHANNEL_ERROR,
+                          "CHANNEL_ERROR - channel is not open");
+  }
+
+  ChannelState &ch = it->second;
+  if (ch.closing) {
+    // Until the client acknowledges the close, only the close handshake
+    // matters.
+    if (AMQP_CHANNEL_CLOSE_METHOD == id) {
+      amqp_channel_close_ok_t close_ok;
+      SendMethod(c, channel, AMQP_CHANNEL_CLOSE_OK_METHOD, &close_ok);
+    }
+    if (AMQP_CHANNEL_CLOSE_METHOD == id ||
+        AMQP_CHANNEL_CLOSE_OK_METHOD == id) {
+      c.channels.erase(it);
+    }
+    return;
+  }
+  if (ch.publishing) {
+    throw ConnectionError(AMQP_UNEXPECTED_FRAME,
+                          "UNEXPECTED_FRAME - expected content");
+  }
+
+  try {
+    if (0 != m_options.fail_method && m_options.fail_method == id) {
+      throw ChannelError(m_options.fail_reply_code, "injected failure");
+    }
+    DispatchMethod(c, channel, ch, id, decoded);
+  } catch (const ChannelError &e) {
+    CloseChannel(c, channel, id, e);
+  }
+}
+
+void FakeBroker::Impl::DispatchMethod(Connection &c, amqp_channel_t channel,
+                                      ChannelState &ch,
+                                      amqp_method_number_t id,
+                                      void *decoded) {
+  switch (id) {
+    case AMQP_CHANNEL_CLOSE_METHOD: {
+      CleanupChannel(c, channel, ch);
+      c.channels.erase(channel);
+      amqp_channel_close_ok_t close_ok;
+      SendMethod(c, channel, AMQP_CHANNEL_CLOSE_OK_METHOD, &close_ok);
+      break;
+    }
+    case AMQP_CONFIRM_SELECT_METHOD: {
+      ch.confirm = true;
+      if (!static_cast<amqp_confirm_select_t *>(decoded)->nowait) {
+        amqp_confirm_select_ok_t select_ok;
+        Delay();
+        SendMethod(c, channel, AMQP_CONFIRM_SELECT_OK_METHOD, &select_ok);
+      }
+      break;
+    }
+    case AMQP_EXCHANGE_DECLARE_METHOD:
+      DeclareExchange(c, channel,
+                      *static_cast<amqp_exchange_declare_t *>(decoded));
+      break;
+    case AMQP_EXCHANGE_DELETE_METHOD: {
+      const amqp_exchange_delete_t *del =
+          static_cast<amqp_exchange_delete_t *>(decoded);
+      const std::string name = ToString(del->exchange);
+      GetExchange(name);
+      m_exchanges.erase(name);
+      if (!del->nowait) {
+        amqp_exchange_delete_ok_t delete_ok;
+        Delay();
+        SendMethod(c, channel, AMQP_EXCHANGE_DELETE_OK_METHOD, &delete_ok);
+      }
+      break;
+    }
+    case AMQP_QUEUE_DECLARE_METHOD:
+      DeclareQueue(c, channel, *static_cast<amqp_queue_declare_t *>(decoded));
+      break;
+    case AMQP_QUEUE_BIND_METHOD: {
+      const amqp_queue_bind_t *bind = static_cast<amqp_queue_bind_t *>(decoded);
+      BindQueue(ToString(bind->queue), ToString(bind->exchange),
+                ToString(bind->routing_key), true);
+      if (!bind->nowait) {
+        amqp_queue_bind_ok_t bind_ok;
+        Delay();
+        SendMethod(c, channel, AMQP_QUEUE_BIND_OK_METHOD, &bind_ok);
+      }
+      break;
+    }
+    case AMQP_QUEUE_UNBIND_METHOD: {
+      const amqp_queue_unbind_t *unbind =
+          static_cast<amqp_queue_unbind_t *>(decoded);
+      BindQueue(ToString(unbind->queue), ToString(unbind->exchange),
+                ToString(unbind->routing_key), false);
+      amqp_queue_unbind_ok_t unbind_ok;
+      Delay();
+      SendMethod(c, channel, AMQP_QUEUE_UNBIND_OK_METHOD, &unbind_ok);
+      break;
+    }
+    case AMQP_QUEUE_PURGE_METHOD: {
+      const amqp_queue_purge_t *purge =
+          static_cast<amqp_queue_purge_t *>(decoded);
+      Queue &queue = GetQueue(ToString(purge->queue));
+      amqp_queue_purge_ok_t purge_ok;
+      purge_ok.message_count =
+          static_cast<boost::uint32_t>(queue.messages.size());
+      queue.messages.clear();
+      if (!purge->nowait) {
+        Delay();
+        SendMethod(c, channel, AMQP_QUEUE_PURGE_OK_METHOD, &purge_ok);
+      }
+      break;
+    }
+    case AMQP_QUEUE_DELETE_METHOD: {
+      const amqp_queue_delete_t *del =
+          static_cast<amqp_queue_delete_t *>(decoded);
+      const std::string name = ToString(del->queue);
+      amqp_queue_delete_ok_t delete_ok;
+      delete_ok.message_count = 0;
+      queue_map_t::iterator queue = m_queues.find(name);
+      if (m_queues.end() != queue) {
+        if (del->if_unused && !queue->second.consumers.empty()) {
+          throw ChannelError(AMQP_PRECONDITION_FAILED,
+                             "PRECONDITION_FAILED - queue '" + name +
+                                 "' in use");
+        }
+        if (del->if_empty && !queue->second.messages.empty()) {
+          throw ChannelError(AMQP_PRECONDITION_FAILED,
+                             "PRECONDITION_FAILED - queue '" + name +
+                                 "' not empty");
+        }
+        delete_ok.message_count =
+            static_cast<boost::uint32_t>(queue->second.messages.size());
+        DeleteQueue(name);
+      }
+      if (!del->nowait) {
+        Delay();
+        SendMethod(c, channel, AMQP_QUEUE_DELETE_OK_METHOD, &delete_ok);
+      }
+      break;
+    }
+    case AMQP_BASIC_QOS_METHOD: {
+      ch.prefetch = static_cast<amqp_basic_qos_t *>(decoded)->prefetch_count;
+      amqp_basic_qos_ok_t qos_ok;
+      Delay();
+      SendMethod(c, channel, AMQP_BASIC_QOS_OK_METHOD, &qos_ok);
+      DispatchAll();
+      break;
+    }
+    case AMQP_BASIC_CONSUME_METHOD:
+      Consume(c, channel, *static_cast<amqp_basic_consume_t *>(decoded));
+      break;
+    case AMQP_BASIC_CANCEL_METHOD: {
+      const amqp_basic_cancel_t *cancel =
+          static_cast<amqp_basic_cancel_t *>(decoded);
+      const std::string tag = ToString(cancel->consumer_tag);
+      RemoveConsumers(c, &channel, &tag);
+      if (!cancel->nowait) {
+        amqp_basic_cancel_ok_t cancel_ok;
+        cancel_ok.consumer_tag = cancel->consumer_tag;
+        Delay();
+        SendMethod(c, channel, AMQP_BASIC_CANCEL_OK_METHOD, &cancel_ok);
+      }
+      break;
+    }
+    case AMQP_BASIC_PUBLISH_METHOD: {
+      const amqp_basic_publish_t *publish =
+          static_cast<amqp_basic_publish_t *>(decoded);
+      ch.publishing = true;
+      ch.have_header = false;
+      ch.mandatory = 0 != publish->mandatory;
+      ch.pending = Message();
+      ch.pending.exchange = ToString(publish->exchange);
+      ch.pending.routing_key = ToString(publish->routing_key);
+      break;
+    }
+    case AMQP_BASIC_GET_METHOD: {
+      const amqp_basic_get_t *get = static_cast<amqp_basic_get_t *>(decoded);
+      const std::string queue_name = ToString(get->queue);
+      Queue &queue = GetQueue(queue_name);
+      Delay();
+      if (queue.messages.empty()) {
+        amqp_basic_get_empty_t get_empty;
+        get_empty.cluster_id = amqp_empty_bytes;
+        SendMethod(c, channel, AMQP_BASIC_GET_EMPTY_METHOD, &get_empty);
+        break;
+      }
+      Unacked unacked;
+      unacked.queue = queue_name;
+      std::swap(unacked.message, queue.messages.front());
+      queue.messages.pop_front();
+
+      amqp_basic_get_ok_t get_ok;
+      get_ok.delivery_tag = ++ch.delivery_tag;
+      get_ok.redelivered = unacked.message.redelivered;
+      get_ok.exchange = ToBytes(unacked.message.exchange);
+      get_ok.routing_key = ToBytes(unacked.message.routing_key);
+      get_ok.message_count =
+          static_cast<boost::uint32_t>(queue.messages.size());
+      SendMethod(c, channel, AMQP_BASIC_GET_OK_METHOD, &get_ok);
+      SendContent(c, channel, unacked.message);
+      if (!get->no_ack) {
+        ch.unacked[get_ok.delivery_tag] = unacked;
+      }
+      break;
+    }
+    case AMQP_BASIC_ACK_METHOD: {
+      const amqp_basic_ack_t *ack = static_cast<amqp_basic_ack_t *>(decoded);
+      Settle(ch, ack->delivery_tag, 0 != ack->multiple, false);
+      break;
+    }
+    case AMQP_BASIC_NACK_METHOD: {
+      const amqp_basic_nack_t *nack =
+          static_cast<amqp_basic_nack_t *>(decoded);
+      Settle(ch, nack->delivery_tag, 0 != nack->multiple,
+             0 != nack->requeue);
+      break;
+    }
+    case AMQP_BASIC_REJECT_METHOD: {
+      const amqp_basic_reject_t *reject =
+          static_cast<amqp_basic_reject_t *>(decoded);
+      Settle(ch, reject->delivery_tag, false, 0 != reject->requeue);
+      break;
+    }
+    default:
+      throw ConnectionError(AMQP_NOT_IMPLEMENTED,
+                            "NOT_IMPLEMENTED - unsupported method");
+  }
+}
+
+void FakeBroker::Impl::HandleContent(Connection &c, boost::uint8_t type,
+                                     amqp_channel_t channel,
+                                     const char *payload, std::size_t size) {
+  Connection::channel_map_t::iterator it = c.channels.find(channel);
+  if (c.channels.end() == it) {
+    throw ConnectionError(AMQP_CHANNEL_ERROR,
+                          "CHANNEL_ERROR - channel is not open");
+  }
+  ChannelState &ch = it->second;
+  if (ch.closing) {
+    // The rest of a publish the broker refused
+    return;
+  }
+  if (!ch.publishing || (AMQP_FRAME_HEADER == type) == ch.have_header) {
+    throw ConnectionError(AMQP_UNEXPECTED_FRAME,
+                          "UNEXPECTED_FRAME - content out of order");
+  }
+
+  if (AMQP_FRAME_HEADER == type) {
+    if (size < CONTENT_HEADER_PREFIX_SIZE ||
+        AMQP_BASIC_CLASS != GetUint16(payload)) {
+      throw ConnectionError(AMQP_FRAME_ERROR,
+                            "FRAME_ERROR - bad content header");
+    }
+    ch.have_header = true;
+    ch.body_size = GetUint64(payload + 4);
+    ch.pending.properties.assign(payload + CONTENT_HEADER_PREFIX_SIZE,
+                                 size - CONTENT_HEADER_PREFIX_SIZE);
+    ch.pending.body.reserve(static_cast<std::size_t>(ch.body_size));
+  } else {
+    ch.pending.body.append(payload, size);
+    if (ch.pending.body.size() > ch.body_size) {
+      throw ConnectionError(AMQP_FRAME_ERROR,
+                            "FRAME_ERROR - body larger than its header");
+    }
+  }
+
+  if (ch.pending.body.size() == ch.body_size) {
+    try {
+      CompletePublish(c, channel, ch);
+    } catch (const ChannelError &e) {
+      CloseChannel(c, channel, AMQP_BASIC_PUBLISH_METHOD, e);
+    }
+  }
+}
+
+void FakeBroker::Impl::DeclareExchange(Connection &c, amqp_channel_t channel,
+                                       const amqp_exchange_declare_t &method) {
+  const std::string name = ToString(method.exchange);
+  const std::string type = ToString(method.type);
+  exchange_map_t::iterator it = m_exchanges.find(name);
+  if (method.passive) {
+    GetExchange(name);
+  } else if (m_exchanges.end() != it) {
+    if (it->second.type != type) {
+      throw ChannelError(AMQP_PRECONDITION_FAILED,
+                         "PRECONDITION_FAILED - inequivalent arg 'type' for "
+                         "exchange '" +
+                             name + "'");
+    }
+  } else {
+    if ("direct" != type && "fanout" != type) {
+      throw ChannelError(AMQP_COMMAND_INVALID,
+                         "COMMAND_INVALID - unknown exchange type '" + type +
+                             "'");
+    }
+    m_exchanges[name].type = type;
+  }
+
+  if (!method.nowait) {
+    amqp_exchange_declare_ok_t declare_ok;
+    Delay();
+    SendMethod(c, channel, AMQP_EXCHANGE_DECLARE_OK_METHOD, &declare_ok);
+  }
+}
+
+void FakeBroker::Impl::DeclareQueue(Connection &c, amqp_channel_t channel,
+                                    const amqp_queue_declare_t &method) {
+  std::string name = ToString(method.queue);
+  if (method.passive) {
+    GetQueue(name);
+  } else {
+    if (name.empty()) {
+      name = GenerateName("amq.gen-");
+    }
+    queue_map_t::iterator it = m_queues.find(name);
+    if (m_queues.end() == it) {
+      Queue &queue = m_queues[name];
+      queue.auto_delete = 0 != method.auto_delete;
+      queue.owner = method.exclusive ? &c : NULL;
+    } else if (NULL != it->second.owner && &c != it->second.owner) {
+      throw ChannelError(AMQP_RESOURCE_LOCKED,
+                         "RESOURCE_LOCKED - queue '" + name +
+                             "' is exclusive to another connection");
+    }
+  }
+
+  if (!method.nowait) {
+    const Queue &queue = GetQueue(name);
+    amqp_queue_declare_ok_t declare_ok;
+    declare_ok.queue = ToBytes(name);
+    declare_ok.message_count =
+        static_cast<boost::uint32_t>(queue.messages.size());
+    declare_ok.consumer_count =
+        static_cast<boost::uint32_t>(queue.consumers.size());
+    Delay();
+    SendMethod(c, channel, AMQP_QUEUE_DECLARE_OK_METHOD, &declare_ok);
+  }
+}
+
+void FakeBroker::Impl::BindQueue(const std::string &queue,
+                                 const std::string &exchange,
+                                 const std::string &routing_key, bool bind) {
+  GetQueue(queue);
+  if (exchange.empty()) {
+    throw ChannelError(AMQP_ACCESS_REFUSED,
+                       "ACCESS_REFUSED - the default exchange can't be bound");
+  }
+  Exchange &ex = GetExchange(exchange);
+  if (bind) {
+    ex.bindings.insert(std::make_pair(routing_key, queue));
+  } else {
+    ex.bindings.erase(std::make_pair(routing_key, queue));
+  }
+}
+
+void FakeBroker::Impl::Consume(Connection &c, amqp_channel_t channel,
+                               const amqp_basic_consume_t &method) {
+  const std::string queue_name = ToString(method.queue);
+  Queue &queue = GetQueue(queue_name);
+
+  Consumer consumer;
+  consumer.connection = &c;
+  consumer.channel = channel;
+  consumer.tag = ToString(method.consumer_tag);
+  consumer.no_ack = 0 != method.no_ack;
+  if (consumer.tag.empty()) {
+    consumer.tag = GenerateName("amq.ctag-");
+  }
+  for (queue_map_t::const_iterator it = m_queues.begin();
+       it != m_queues.end(); ++it) {
+    for (std::vector<Consumer>::const_iterator other =
+             it->second.consumers.begin();
+         other != it->second.consumers.end(); ++other) {
+      if (&c == other->connection && channel == other->channel &&
+          consumer.tag == other->tag) {
+        throw ChannelError(AMQP_NOT_ALLOWED, "NOT_ALLOWED - consumer tag '" +
+                                                 consumer.tag + "' in use");
+      }
+    }
+  }
+  queue.consumers.push_back(consumer);
+  queue.had_consumers = true;
+
+  if (!method.nowait) {
+    amqp_basic_consume_ok_t consume_ok;
+    consume_ok.consumer_tag = ToBytes(consumer.tag);
+    Delay();
+    SendMethod(c, channel, AMQP_BASIC_CONSUME_OK_METHOD, &consume_ok);
+  }
+  Dispatch(queue_name);
+}
+
+void FakeBroker::Impl::CompletePublish(Connection &c, amqp_channel_t channel,
+                                       ChannelState &ch) {
+  ch.publishing = false;
+  ++m_publish_count;
+  const boost::uint64_t seq = ch.confirm ? ++ch.publish_seq : 0;
+  Message message;
+  std::swap(message, ch.pending);
+
+  const Exchange &exchange = GetExchange(message.exchange);
+  std::vector<std::string> queues;
+  if (message.exchange.empty()) {
+    if (m_queues.end() != m_queues.find(message.routing_key)) {
+      queues.push_back(message.routing_key);
+    }
+  } else {
+    for (Exchange::binding_set_t::const_iterator it =
+             exchange.bindings.begin();
+         it != exchange.bindings.end(); ++it) {
+      if (("fanout" == exchange.type || it->first == message.routing_key) &&
+          queues.end() == std::find(queues.begin(), queues.end(), it->second)) {
+        queues.push_back(it->second);
+      }
+    }
+  }
+
+  if (queues.empty() && ch.mandatory) {
+    amqp_basic_return_t ret;
+    ret.reply_code = AMQP_NO_ROUTE;
+    ret.reply_text = amqp_cstring_bytes("NO_ROUTE");
+    ret.exchange = ToBytes(message.exchange);
+    ret.routing_key = ToBytes(message.routing_key);
+    SendMethod(c, channel, AMQP_BASIC_RETURN_METHOD, &ret);
+    SendContent(c, channel, message);
+  }
+  for (std::vector<std::string>::const_iterator it = queues.begin();
+       it != queues.end(); ++it) {
+    m_queues[*it].messages.push_back(message);
+  }
+
+  if (ch.confirm) {
+    Delay();
+    if (m_options.nack_publishes) {
+      amqp_basic_nack_t nack;
+      nack.delivery_tag = seq;
+      nack.multiple = 0;
+      nack.requeue = 0;
+      SendMethod(c, channel, AMQP_BASIC_NACK_METHOD, &nack);
+    } else {
+      amqp_basic_ack_t ack;
+      ack.delivery_tag = seq;
+      ack.multiple = 0;
+      SendMethod(c, channel, AMQP_BASIC_ACK_METHOD, &ack);
+    }
+  }
+
+  for (std::vector<std::string>::const_iterator it = queues.begin();
+       it != queues.end(); ++it) {
+    Dispatch(*it);
+  }
+}
+
+void FakeBroker::Impl::Settle(ChannelState &ch, boost::uint64_t delivery_tag,
+                              bool multiple, bool requeue) {
+  ChannelState::unacked_map_t::iterator end;
+  ChannelState::unacked_map_t::iterator begin;
+  if (multiple) {
+    begin = ch.unacked.begin();
+    end = 0 == delivery_tag ? ch.unacked.end()
+                            : ch.unacked.upper_bound(delivery_tag);
+  } else {
+    begin = ch.unacked.find(delivery_tag);
+    if (ch.unacked.end() == begin) {
+      std::ostringstream text;
+      text << "PRECONDITION_FAILED - unknown delivery tag " << delivery_tag;
+      throw ChannelError(AMQP_PRECONDITION_FAILED, text.str());
+    }
+    end = begin;
+    ++end;
+  }
+
+  if (requeue) {
+    // Newest first, so the messages keep their order at the head of the
+    // queue.
+    for (ChannelState::unacked_map_t::iterator it = end; it != begin;) {
+      --it;
+      Requeue(it->second);
+    }
+  }
+  ch.unacked.erase(begin, end);
+  DispatchAll();
+}
+
+Queue &FakeBroker::Impl::GetQueue(const std::string &name) {
+  queue_map_t::iterator it = m_queues.find(name);
+  if (m_queues.end() == it) {
+    throw ChannelError(AMQP_NOT_FOUND,
+                       "NOT_FOUND - no queue '" + name + "' in vhost '/'");
+  }
+  return it->second;
+}
+
+Exchange &FakeBroker::Impl::GetExchange(const std::string &name) {
+  exchange_map_t::iterator it = m_exchanges.find(name);
+  if (m_exchanges.end() == it) {
+    throw ChannelError(AMQP_NOT_FOUND,
+                       "NOT_FOUND - no exchange '" + name + "' in vhost '/'");
+  }
+  return it->second;
+}
+
+void FakeBroker::Impl::Dispatch(const std::string &name) {
+  queue_map_t::iterator it = m_queues.find(name);
+  if (m_queues.end() == it) {
+    return;
+  }
+  Queue &queue = it->second;
+  while (!queue.messages.empty() && !queue.consumers.empty()) {
+    const std::size_t count = queue.consumers.size();
+    const Consumer *consumer = NULL;
+    for (std::size_t i = 0; i < count; ++i) {
+      const std::size_t index = (queue.next + i) % count;
+      if (HasCapacity(queue.consumers[index])) {
+        consumer = &queue.consumers[index];
+        queue.next = (index + 1) % count;
+        break;
+      }
+    }
+    if (NULL == consumer) {
+      return;
+    }
+    Deliver(*consumer, name, queue.messages.front());
+    queue.messages.pop_front();
+  }
+}
+
+void FakeBroker::Impl::DispatchAll() {
+  for (queue_map_t::iterator it = m_queues.begin(); it != m_queues.end();
+       ++it) {
+    if (!it->second.consumers.empty()) {
+      Dispatch(it->first);
+    }
+  }
+}
+
+bool FakeBroker::Impl::HasCapacity(const Consumer &consumer) {
+  const Connection &c = *consumer.connection;
+  Connection::channel_map_t::const_iterator it =
+      c.channels.find(consumer.channel);
+  if (c.closing || c.channels.end() == it || it->second.closing) {
+    return false;
+  }
+  const ChannelState &ch = it->second;
+  return consumer.no_ack || 0 == ch.prefetch ||
+         ch.unacked.size() < ch.prefetch;
+}
+
+void FakeBroker::Impl::Deliver(const Consumer &consumer,
+                               const std::string &queue,
+                               const Message &message) {
+  Connection &c = *consumer.connection;
+  ChannelState &ch = c.channels[consumer.channel];
+  const boost::uint64_t delivery_tag = ++ch.delivery_tag;
+
+  amqp_basic_deliver_t deliver;
+  deliver.consumer_tag = ToBytes(consumer.tag);
+  deliver.delivery_tag = delivery_tag;
+  deliver.redelivered = message.redelivered;
+  deliver.exchange = ToBytes(message.exchange);
+  deliver.routing_key = ToBytes(message.routing_key);
+  SendMethod(c, consumer.channel, AMQP_BASIC_DELIVER_METHOD, &deliver);
+  SendContent(c, consumer.channel, message);
+
+  if (!consumer.no_ack) {
+    Unacked &unacked = ch.unacked[delivery_tag];
+    unacked.queue = queue;
+    unacked.message = message;
+  }
+}
+
+void FakeBroker::Impl::Requeue(const Unacked &unacked) {
+  queue_map_t::iterator it = m_queues.find(unacked.queue);
+  if (m_queues.end() != it) {
+    it->second.messages.push_front(unacked.message);
+    it->second.messages.front().redelivered = true;
+  }
+}
+
+void FakeBroker::Impl::RemoveConsumers(const Connection &c,
+                                       const amqp_channel_t *channel,
+                                       const std::string *tag) {
+  std::vector<std::string> unused;
+  for (queue_map_t::iterator it = m_queues.begin(); it != m_queues.end();
+       ++it) {
+    std::vector<Consumer> &consumers = it->second.consumers;
+    for (std::vector<Consumer>::iterator consumer = consumers.begin();
+         consumer != consumers.end();) {
+      if (&c == consumer->connection &&
+          (NULL == channel || *channel == consumer->channel) &&
+          (NULL == tag || *tag == consumer->tag)) {
+        consumer = consumers.erase(consumer);
+      } else {
+        ++consumer;
+      }
+    }
+    it->second.next = 0;
+    if (it->second.auto_delete && it->second.had_consumers &&
+        consumers.empty()) {
+      unused.push_back(it->first);
+    }
+  }
+  for (std::vector<std::string>::const_iterator it = unused.begin();
+       it != unused.end(); ++it) {
+    DeleteQueue(*it);
+  }
+}
+
+void FakeBroker::Impl::DeleteQueue(const std::string &name) {
+  queue_map_t::iterator it = m_queues.find(name);
+  if (m_queues.end() == it) {
+    return;
+  }
+  // Consumers of other channels are told, as RabbitMQ does for clients
+  // that support consumer_cancel_notify.
+  for (std::vector<Consumer>::const_iterator consumer =
+           it->second.consumers.begin();
+       consumer != it->second.consumers.end(); ++consumer) {
+    amqp_basic_cancel_t cancel;
+    cancel.consumer_tag = ToBytes(consumer->tag);
+    cancel.nowait = 1;
+    SendMethod(*consumer->connection, consumer->channel,
+               AMQP_BASIC_CANCEL_METHOD, &cancel);
+  }
+  m_queues.erase(it);
+
+  for (exchange_map_t::iterator ex = m_exchanges.begin();
+       ex != m_exchanges.end(); ++ex) {
+    Exchange::binding_set_t &bindings = ex->second.bindings;
+    for (Exchange::binding_set_t::iterator binding = bindings.begin();
+         binding != bindings.end();) {
+      if (name == binding->second) {
+        bindings.erase(binding++);
+      } else {
+        ++binding;
+      }
+    }
+  }
+}
+
+void FakeBroker::Impl::CloseChannel(Connection &c, amqp_channel_t channel,
+                                    amqp_method_number_t id,
+                                    const Error &error) {
+  ChannelState &ch = c.channels[channel];
+  CleanupChannel(c, channel, ch);
+  ch.closing = true;
+  ch.publishing = false;
+
+  amqp_channel_close_t close;
+  close.reply_code = error.code;
+  close.reply_text = ToBytes(error.text);
+  close.class_id = static_cast<boost::uint16_t>(id >> 16);
+  close.method_id = static_cast<boost::uint16_t>(id & 0xFFFF);
+  Delay();
+  SendMethod(c, channel, AMQP_CHANNEL_CLOSE_METHOD, &close);
+}
+
+void FakeBroker::Impl::CleanupChannel(Connection &c, amqp_channel_t channel,
+                                      ChannelState &ch) {
+  RemoveConsumers(c, &channel, NULL);
+  for (ChannelState::unacked_map_t::reverse_iterator it =
+           ch.unacked.rbegin();
+       it != ch.unacked.rend(); ++it) {
+    Requeue(it->second);
+  }
+  ch.unacked.clear();
+  DispatchAll();
+}
+
+void FakeBroker::Impl::CloseConnection(Connection &c, amqp_method_number_t id,
+                                       const Error &error) {
+  amqp_connection_close_t close;
+  close.reply_code = error.code;
+  close.reply_text = ToBytes(error.text);
+  close.class_id = static_cast<boost::uint16_t>(id >> 16);
+  close.method_id = static_cast<boost::uint16_t>(id & 0xFFFF);
+  SendMethod(c, 0, AMQP_CONNECTION_CLOSE_METHOD, &close);
+  CleanupConnection(c);
+  c.closing = true;
+}
+
+void FakeBroker::Impl::CleanupConnection(Connection &c) {
+  RemoveConsumers(c, NULL, NULL);
+  for (Connection::channel_map_t::iterator it = c.channels.begin();
+       it != c.channels.end(); ++it) {
+    CleanupChannel(c, it->first, it->second);
+  }
+  c.channels.clear();
+
+  std::vector<std::string> owned;
+  for (queue_map_t::const_iterator it = m_queues.begin();
+       it != m_queues.end(); ++it) {
+    if (&c == it->second.owner) {
+      owned.push_back(it->first);
+    }
+  }
+  for (std::vector<std::string>::const_iterator it = owned.begin();
+       it != owned.end(); ++it) {
+    DeleteQueue(*it);
+  }
+}
+
+void FakeBroker::Impl::SendStart(Connection &c) {
+  amqp_table_entry_t capabilities[4];
+  const char *capability_names[4] = {"publisher_confirms", "basic.nack",
+                                     "consumer_cancel_notify",
+                                     "exchange_exchange_bindings"};
+  for (int i = 0; i < 4; ++i) {
+    capabilities[i].key = amqp_cstring_bytes(capability_names[i]);
+    capabilities[i].value.kind = AMQP_FIELD_KIND_BOOLEAN;
+    capabilities[i].value.value.boolean = i < 3;
+  }
+
+  amqp_table_entry_t properties[2];
+  properties[0].key = amqp_cstring_bytes("product");
+  properties[0].value.kind = AMQP_FIELD_KIND_UTF8;
+  properties[0].value.value.bytes =
+      amqp_cstring_bytes("SimpleAmqpClient FakeBroker");
+  properties[1].key = amqp_cstring_bytes("capabilities");
+  properties[1].value.kind = AMQP_FIELD_KIND_TABLE;
+  properties[1].value.value.table.num_entries = 4;
+  properties[1].value.value.table.entries = capabilities;
+
+  amqp_connection_start_t start;
+  start.version_major = AMQP_PROTOCOL_VERSION_MAJOR;
+  start.version_minor = AMQP_PROTOCOL_VERSION_MINOR;
+  start.server_properties.num_entries = 2;
+  start.server_properties.entries = properties;
+  start.mechanisms = amqp_cstring_bytes("PLAIN");
+  start.locales = amqp_cstring_bytes("en_US");
+  SendMethod(c, 0, AMQP_CONNECTION_START_METHOD, &start);
+}
+
+void FakeBroker::Impl::SendMethod(Connection &c, amqp_channel_t channel,
+                                  amqp_method_number_t id, void *decoded) {
+  amqp_bytes_t encoded;
+  encoded.bytes = &m_encode_buffer[0];
+  encoded.len = m_encode_buffer.size();
+  const int size = amqp_encode_method(id, decoded, encoded);
+  if (size < 0) {
+    throw std::runtime_error("FakeBroker: could not encode a method");
+  }
+
+  PutUint8(c.out, AMQP_FRAME_METHOD);
+  PutUint16(c.out, channel);
+  PutUint32(c.out, static_cast<boost::uint32_t>(size + 4));
+  PutUint32(c.out, id);
+  c.out.append(&m_encode_buffer[0], static_cast<std::size_t>(size));
+  PutUint8(c.out, AMQP_FRAME_END);
+}
+
+void FakeBroker::Impl::SendFrame(Connection &c, boost::uint8_t type,
+                                 amqp_channel_t channel, const char *payload,
+                                 std::size_t size) {
+  PutUint8(c.out, type);
+  PutUint16(c.out, channel);
+  PutUint32(c.out, static_cast<boost::uint32_t>(size));
+  c.out.append(payload, size);
+  PutUint8(c.out, AMQP_FRAME_END);
+}
+
+void FakeBroker::Impl::SendContent(Connection &c, amqp_channel_t channel,
+                                   const Message &message) {
+  std::string header;
+  PutUint16(header, AMQP_BASIC_CLASS);
+  PutUint16(header, 0);
+  PutUint64(header, message.body.size());
+  header.append(message.properties);
+  SendFrame(c, AMQP_FRAME_HEADER, channel, header.data(), header.size());
+
+  const std::size_t fragment = c.frame_max - FRAME_OVERHEAD;
+  for (std::size_t offset = 0; offset < message.body.size();
+       offset += fragment) {
+    SendFrame(c, AMQP_FRAME_BODY, channel, message.body.data() + offset,
+              std::min(fragment, message.body.size() - offset));
+  }
+}
+
+void FakeBroker::Impl::Delay() {
+  const boost::int64_t us = m_options.reply_delay.count();
+  if (us <= 0) {
+    return;
+  }
+  timespec delay;
+  delay.tv_sec = static_cast<time_t>(us / 1000000);
+  delay.tv_nsec = static_cast<long>((us % 1000000) * 1000);
+  while (0 != nanosleep(&delay, &delay) && EINTR == errno) {
+  }
+}
+
+std::string FakeBroker::Impl::GenerateName(const char *prefix) {
+  std::ostringstream name;
+  name << prefix << ++m_next_name;
+  return name.str();
+}
+
+FakeBroker::FakeBroker(const Options &options)
+    : m_impl(new Impl(options)) {}
+
+FakeBroker::~FakeBroker() {}
+
+void FakeBroker::SetOptions(const Options &options) {
+  m_impl->SetOptions(options);
+}
+
+int FakeBroker::Port() const { return m_impl->Port(); }
+
+AmqpClient::Channel::OpenOpts FakeBroker::GetOpenOpts() const {
+  AmqpClient::Channel::OpenOpts opts;
+  opts.host = "127.0.0.1";
+  opts.port = Port();
+  opts.auth = AmqpClient::Channel::OpenOpts::BasicAuth("guest", "guest");
+  return opts;
+}
+
+std::size_t FakeBroker::QueueDepth(const std::string &queue) const {
+  return m_impl->QueueDepth(queue);
+}
+
+bool FakeBroker::HasQueue(const std::string &queue) const {
+  return m_impl->HasQueue(queue);
+}
+
+boost::uint64_t FakeBroker::PublishCount() const {
+  return m_impl->PublishCount();
+}
+
+std::size_t FakeBroker::ConnectionCount() const {
+  return m_impl->ConnectionCount();
+}
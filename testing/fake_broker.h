@@ -0,0 +1,118 @@
+#ifndef FAKE_BROKER_H
+#define FAKE_BROKER_H
+/*
+ * ***** BEGIN LICENSE BLOCK *****
+ * Version: MIT
+ *
+ * Copyright (c) 2010-2013 Alan Antonuk
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * ***** END LICENSE BLOCK *****
+ */
+
+#include <SimpleAmqpClient/SimpleAmqpClient.h>
+#include <amqp.h>
+
+#include <boost/chrono/duration.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <cstddef>
+#include <string>
+
+/**
+ * A loopback AMQP 0-9-1 broker run on a thread of the test process
+ *
+ * It listens on an ephemeral port of 127.0.0.1 and serves any number of
+ * connections from a single thread, so frames are handled in the order
+ * they arrive. It implements what the Channel needs to publish and
+ * consume:
+ *  - the connection handshake, accepting any user and password,
+ *  - channel open and close, confirm.select,
+ *  - exchange declare and delete for `direct` and `fanout` exchanges,
+ *  - queue declare, bind, unbind, purge and delete,
+ *  - basic.publish with confirms and returns for mandatory publishes,
+ *  - basic.get, basic.qos, basic.consume, basic.cancel, basic.deliver,
+ *    basic.ack, basic.nack and basic.reject.
+ *
+ * Other methods close the connection with NOT_IMPLEMENTED. Nothing is
+ * persisted, and queues live as long as the FakeBroker.
+ *
+ * The broker uses POSIX sockets and threads.
+ */
+class FakeBroker : boost::noncopyable {
+ public:
+  /// How the broker replies
+  struct Options {
+    Options();
+
+    /// Slept before replying to each synchronous method and before each
+    /// publish confirm. Default: 0.
+    boost::chrono::microseconds reply_delay;
+    /// Confirm publishes with basic.nack instead of basic.ack.
+    /// Default: false.
+    bool nack_publishes;
+    /// When non-zero, the broker closes the channel instead of handling
+    /// this method, as if it had failed. Default: 0.
+    amqp_method_number_t fail_method;
+    /// Reply code of the channel.close sent for fail_method.
+    /// Default: 406, PRECONDITION_FAILED.
+    boost::uint16_t fail_reply_code;
+    /// Largest frame the broker offers in connection.tune.
+    /// Default: 131072.
+    boost::uint32_t frame_max;
+    /// Most channels the broker offers in connection.tune. Default: 2047.
+    boost::uint16_t channel_max;
+  };
+
+  /// Starts the broker, throws std::runtime_error if it can't listen
+  explicit FakeBroker(const Options &options = Options());
+
+  /// Closes all connections and stops the broker
+  ~FakeBroker();
+
+  /// Changes how the broker replies from now on
+  void SetOptions(const Options &options);
+
+  /// The port the broker listens on
+  int Port() const;
+
+  /// Options to open a Channel to this broker
+  AmqpClient::Channel::OpenOpts GetOpenOpts() const;
+
+  /// Messages ready for delivery on queue, 0 if there is no such queue
+  std::size_t QueueDepth(const std::string &queue) const;
+
+  /// Whether queue has been declared and not deleted
+  bool HasQueue(const std::string &queue) const;
+
+  /// Complete messages received through basic.publish
+  boost::uint64_t PublishCount() const;
+
+  /// Connections currently open
+  std::size_t ConnectionCount() const;
+
+ private:
+  class Impl;
+  boost::scoped_ptr<Impl> m_impl;
+};
+
+#endif  // FAKE_BROKER_H
@@ -226,3 +226,80 @@ TEST_F(connected_test, consume_multiple) {
 
   EXPECT_EQ(Body, env->Message()->Body());
 }
+
+TEST_F(connected_test, basic_consume_message_pooled) {
+  channel->SetMessagePoolSize(4);
+  EXPECT_EQ(4u, channel->GetMessagePoolSize());
+
+  std::string queue = channel->DeclareQueue("");
+  std::string consumer = channel->BasicConsume(queue);
+
+  BasicMessage::ptr_t first = BasicMessage::Create("First message body");
+  first->ContentType("text/plain");
+  channel->BasicPublish("", queue, first);
+  channel->BasicPublish("", queue, BasicMessage::Create("Second"));
+
+  Envelope::ptr_t delivered = channel->BasicConsumeMessage(consumer);
+  EXPECT_EQ(first->Body(), delivered->Message()->Body());
+  EXPECT_EQ("text/plain", delivered->Message()->ContentType());
+  const Envelope *recycled_envelope = delivered.get();
+  const BasicMessage *recycled_message = delivered->Message().get();
+  delivered.reset();
+
+  delivered = channel->BasicConsumeMessage(consumer);
+  EXPECT_EQ(recycled_envelope, delivered.get());
+  EXPECT_EQ(recycled_message, delivered->Message().get());
+  EXPECT_EQ("Second", delivered->Message()->Body());
+  EXPECT_FALSE(delivered->Message()->ContentTypeIsSet());
+  EXPECT_EQ(consumer, delivered->ConsumerTag());
+  EXPECT_EQ(queue, delivered->RoutingKey());
+
+  channel->SetMessagePoolSize(0);
+  EXPECT_EQ(0u, channel->GetMessagePoolSize());
+}
+
+TEST_F(connected_test, basic_consume_message_interned_strings) {
+  std::string queue = channel->DeclareQueue("");
+  std::string consumer = channel->BasicConsume(queue);
+  channel->BasicPublish("", queue, BasicMessage::Create("Message1"));
+  channel->BasicPublish("", queue, BasicMessage::Create("Message2"));
+
+  Envelope::ptr_t first = channel->BasicConsumeMessage(consumer);
+  Envelope::ptr_t second = channel->BasicConsumeMessage(consumer);
+
+  EXPECT_EQ(queue, *second->InternedRoutingKey());
+  EXPECT_EQ(first->InternedRoutingKey(), second->InternedRoutingKey());
+  EXPECT_EQ(first->InternedExchange(), second->InternedExchange());
+  EXPECT_EQ(first->InternedConsumerTag(), second->InternedConsumerTag());
+  EXPECT_EQ(channel->InternString(queue), second->InternedRoutingKey());
+  EXPECT_EQ(channel->InternString(consumer), second->InternedConsumerTag());
+}
+
+TEST_F(connected_test, basic_consume_read_ahead_limits) {
+  channel->SetReadAheadLimits(4, 0);
+  std::string waited_queue = channel->DeclareQueue("");
+  std::string busy_queue = channel->DeclareQueue("");
+  std::string waited =
+      channel->BasicConsume(waited_queue, "", true, false, true, 0);
+  std::string busy =
+      channel->BasicConsume(busy_queue, "", true, false, true, 0);
+
+  BasicMessage::ptr_t message = BasicMessage::Create("Message Body");
+  for (int i = 0; i < 10; ++i) {
+    channel->BasicPublish("", busy_queue, message);
+  }
+  channel->BasicPublish("", waited_queue, message);
+
+  Envelope::ptr_t delivered;
+  ASSERT_TRUE(channel->BasicConsumeMessage(waited, delivered, 5000));
+  channel->BasicAck(delivered);
+  EXPECT_LT(0u, channel->GetReadAheadBytes());
+
+  // The busy consumer was throttled, its prefetch must come back for all of
+  // its messages to arrive.
+  for (int i = 0; i < 10; ++i) {
+    ASSERT_TRUE(channel->BasicConsumeMessage(busy, delivered, 5000));
+    channel->BasicAck(delivered);
+  }
+  EXPECT_EQ(0u, channel->GetReadAheadBytes());
+}
@@ -0,0 +1,113 @@
+/*
+ * ***** BEGIN LICENSE BLOCK *****
+ * Version: MIT
+ *
+ * Copyright (c) 2010-2013 Alan Antonuk
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * ***** END LICENSE BLOCK *****
+ */
+
+#include <gtest/gtest.h>
+// Built as C++11 or later even when the library is built as C++98, to check
+// that the exported functions can be called from either standard. Types
+// such as boost::string_ref are trivially copyable in one and not in the
+// other, so passing them by value would not work across the two.
+
+#include <gtest/gtest.h>
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "SimpleAmqpClient/SimpleAmqpClient.h"
+
+#ifndef _WIN32
+#include "fake_broker.h"
+#endif
+
+using namespace AmqpClient;
+
+TEST(cxx11, encoded_find) {
+  Table table_in;
+  table_in.insert(TableEntry("string_key", "A string!"));
+  table_in.insert(TableEntry("int32_key", int32_t(32)));
+  EncodedTable encoded(table_in);
+
+  TableValue value;
+  EXPECT_TRUE(encoded.Find("string_key", value));
+  EXPECT_EQ("A string!", value.GetString());
+  EXPECT_TRUE(encoded.Find(std::string("int32_key"), value));
+  EXPECT_EQ(32, value.GetInteger());
+  EXPECT_FALSE(encoded.Find("missing_key", value));
+
+  BasicMessage::ptr_t message = BasicMessage::Create();
+  message->HeaderTable(encoded);
+  EXPECT_TRUE(message->HeaderTableFind("string_key", value));
+  EXPECT_EQ("A string!", value.GetString());
+  EXPECT_FALSE(message->HeaderTableFind("missing_key", value));
+}
+
+TEST(cxx11, message_properties) {
+  std::string body(100, 'b');
+  BasicMessage::ptr_t message = BasicMessage::Create(std::move(body));
+  message->ContentType("text/plain");
+  message->MessageId("message id");
+  message->ReplyTo("reply queue");
+
+  EXPECT_EQ(std::string(100, 'b'), message->Body());
+  EXPECT_EQ("text/plain", message->ContentType());
+  EXPECT_EQ("message id", message->MessageIdRef());
+  EXPECT_EQ("reply queue", message->ReplyTo());
+  message->ContentTypeClear();
+  EXPECT_FALSE(message->ContentTypeIsSet());
+  EXPECT_EQ("message id", message->MessageId());
+}
+
+#ifndef _WIN32
+TEST(cxx11, publish) {
+  FakeBroker broker;
+  Channel::ptr_t channel = Channel::Open(broker.GetOpenOpts());
+  const std::string queue = channel->DeclareQueue("");
+
+  BasicMessage::ptr_t message = BasicMessage::Create("message body");
+  channel->BasicPublish("", queue, message);
+  EXPECT_TRUE(channel->TryBasicPublish("", queue, message).Ok());
+
+  std::vector<boost::string_ref> segments;
+  segments.push_back("message ");
+  segments.push_back("body");
+  channel->BasicPublish("", queue, BasicMessage::Create(), segments);
+
+  PublishTemplate::ptr_t publish_template =
+      PublishTemplate::Create("", queue, *BasicMessage::Create());
+  channel->BasicPublish(publish_template, "message body");
+  channel->BasicPublish(publish_template, "message body", "message id", 42);
+  EXPECT_EQ(5u, broker.QueueDepth(queue));
+
+  for (int i = 0; i < 5; ++i) {
+    Envelope::ptr_t envelope;
+    ASSERT_TRUE(channel->BasicGet(envelope, queue));
+    EXPECT_EQ("message body", envelope->Message()->Body());
+    EXPECT_EQ(queue, envelope->RoutingKey());
+  }
+}
+#endif
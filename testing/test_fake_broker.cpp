@@ -0,0 +1,340 @@
+/*
+ * ***** BEGIN LICENSE BLOCK *****
+ * Version: MIT
+ *
+ * Copyright (c) 2010-2013 Alan Antonuk
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * ***** END LICENSE BLOCK *****
+ */
+
+#include <gtest/gtest.h>
+
+#include <boost/bind.hpp>
+#include <boost/chrono/system_clocks.hpp>
+#include <string>
+#include <vector>
+
+#include "fake_broker.h"
+
+using namespace AmqpClient;
+
+TEST(fake_broker, connect) {
+  FakeBroker broker;
+  Channel::ptr_t channel = Channel::Open(broker.GetOpenOpts());
+  EXPECT_EQ(1u, broker.ConnectionCount());
+}
+
+TEST(fake_broker, publish_consume) {
+  FakeBroker broker;
+  Channel::ptr_t channel = Channel::Open(broker.GetOpenOpts());
+  std::string queue = channel->DeclareQueue("");
+
+  BasicMessage::ptr_t message = BasicMessage::Create("message body");
+  message->ContentType("text/plain");
+  channel->BasicPublish("", queue, message);
+  EXPECT_EQ(1u, broker.PublishCount());
+  EXPECT_EQ(1u, broker.QueueDepth(queue));
+
+  std::string consumer = channel->BasicConsume(queue, "", true, false);
+  Envelope::ptr_t envelope = channel->BasicConsumeMessage(consumer);
+  EXPECT_EQ("message body", envelope->Message()->Body());
+  EXPECT_EQ("text/plain", envelope->Message()->ContentType());
+  EXPECT_EQ(queue, envelope->RoutingKey());
+  channel->BasicAck(envelope);
+  EXPECT_EQ(0u, broker.QueueDepth(queue));
+}
+
+TEST(fake_broker, large_message) {
+  FakeBroker broker;
+  Channel::OpenOpts opts = broker.GetOpenOpts();
+  opts.frame_max = 4096;
+  Channel::ptr_t channel = Channel::Open(opts);
+  std::string queue = channel->DeclareQueue("");
+
+  const std::string body(3 * 4096 + 17, 'a');
+  channel->BasicPublish("", queue, BasicMessage::Create(body));
+
+  Envelope::ptr_t envelope;
+  ASSERT_TRUE(channel->BasicGet(envelope, queue));
+  EXPECT_EQ(body, envelope->Message()->Body());
+}
+
+TEST(fake_broker, reject_requeue) {
+  FakeBroker broker;
+  Channel::ptr_t channel = Channel::Open(broker.GetOpenOpts());
+  std::string queue = channel->DeclareQueue("");
+  channel->BasicPublish("", queue, BasicMessage::Create("message body"));
+
+  std::string consumer = channel->BasicConsume(queue, "", true, false);
+  Envelope::ptr_t envelope = channel->BasicConsumeMessage(consumer);
+  EXPECT_FALSE(envelope->Redelivered());
+  channel->BasicReject(envelope, true);
+
+  envelope = channel->BasicConsumeMessage(consumer);
+  EXPECT_TRUE(envelope->Redelivered());
+  EXPECT_EQ("message body", envelope->Message()->Body());
+  channel->BasicReject(envelope, false);
+}
+
+TEST(fake_broker, nack_publishes) {
+  FakeBroker::Options options;
+  options.nack_publishes = true;
+  FakeBroker broker(options);
+  Channel::ptr_t channel = Channel::Open(broker.GetOpenOpts());
+  std::string queue = channel->DeclareQueue("");
+
+  Channel::BasicResult result =
+      channel->TryBasicPublish("", queue, BasicMessage::Create("body"));
+  EXPECT_EQ(Channel::BasicResult::rejected, result.status);
+}
+
+TEST(fake_broker, mandatory_return) {
+  FakeBroker broker;
+  Channel::ptr_t channel = Channel::Open(broker.GetOpenOpts());
+
+  Channel::BasicResult result = channel->TryBasicPublish(
+      "", "fake_broker_notexist", BasicMessage::Create("body"), true);
+  EXPECT_EQ(Channel::BasicResult::returned, result.status);
+  EXPECT_EQ(312, result.reply_code);
+  ASSERT_TRUE(result.returned_message);
+  EXPECT_EQ("body", result.returned_message->Body());
+}
+
+namespace {
+// Publishes a message with headers of its own, so the publish needs the
+// scratch pool of the Channel
+void PublishFromReturnHandler(Channel *channel, const std::string &queue,
+                              int *returns, const Channel::ReturnedMessage &) {
+  ++*returns;
+  Table headers;
+  headers.insert(TableEntry("nested", std::string(6000, 'n')));
+  BasicMessage::ptr_t message = BasicMessage::Create("nested");
+  message->HeaderTable(headers);
+  channel->BasicPublish("", queue, message);
+}
+}  // namespace
+
+TEST(fake_broker, return_handler_publishes_during_fanout) {
+  FakeBroker broker;
+  Channel::ptr_t channel = Channel::Open(broker.GetOpenOpts());
+  const std::string queue = channel->DeclareQueue("");
+  const std::string nested_queue = channel->DeclareQueue("");
+  int returns = 0;
+  channel->SetReturnHandler(boost::bind(
+      PublishFromReturnHandler, channel.get(), nested_queue, &returns, _1));
+
+  // The fanout builds its properties once, then publishes to the missing
+  // queue, whose return handler publishes, and then to queue.
+  Table headers;
+  headers.insert(TableEntry("small", "value"));
+  headers.insert(TableEntry("large", std::string(6000, 'l')));
+  BasicMessage::ptr_t message = BasicMessage::Create("fanout");
+  message->HeaderTable(headers);
+  std::vector<std::string> routing_keys;
+  routing_keys.push_back("fake_broker_notexist");
+  routing_keys.push_back(queue);
+  const boost::uint64_t publish_seq_no = channel->GetNextPublishSeqNo();
+  channel->BasicPublishFanout("", routing_keys, message, true);
+  channel->SetReturnHandler(Channel::return_handler_t());
+  EXPECT_EQ(1, returns);
+  // One number for each routing key and one for the nested publish
+  EXPECT_EQ(publish_seq_no + 3, channel->GetNextPublishSeqNo());
+
+  Envelope::ptr_t envelope;
+  ASSERT_TRUE(channel->BasicGet(envelope, queue));
+  EXPECT_EQ("fanout", envelope->Message()->Body());
+  EXPECT_EQ(headers, envelope->Message()->HeaderTable());
+  ASSERT_TRUE(channel->BasicGet(envelope, nested_queue));
+  EXPECT_EQ("nested", envelope->Message()->Body());
+}
+
+TEST(fake_broker, try_consume) {
+  FakeBroker broker;
+  Channel::ptr_t channel = Channel::Open(broker.GetOpenOpts());
+  std::string queue = channel->DeclareQueue("");
+  std::string consumer = channel->BasicConsume(queue, "", true, false);
+
+  Envelope::ptr_t envelope;
+  EXPECT_EQ(Channel::BasicResult::empty,
+            channel->TryBasicConsumeMessage(consumer, envelope, 1).status);
+
+  channel->BasicPublish("", queue, BasicMessage::Create("body"));
+  EXPECT_TRUE(channel->TryBasicConsumeMessage(consumer, envelope).Ok());
+  EXPECT_EQ("body", envelope->Message()->Body());
+
+  channel->DeleteQueue(queue);
+  EXPECT_EQ(Channel::BasicResult::consumer_cancelled,
+            channel->TryBasicConsumeMessage(consumer, envelope).status);
+}
+
+TEST(fake_broker, injected_failure) {
+  FakeBroker broker;
+  Channel::ptr_t channel = Channel::Open(broker.GetOpenOpts());
+
+  FakeBroker::Options options;
+  options.fail_method = AMQP_QUEUE_DECLARE_METHOD;
+  broker.SetOptions(options);
+  EXPECT_THROW(channel->DeclareQueue(""), ChannelException);
+
+  broker.SetOptions(FakeBroker::Options());
+  std::string queue = channel->DeclareQueue("");
+  EXPECT_TRUE(broker.HasQueue(queue));
+}
+
+TEST(fake_broker, reply_delay) {
+  FakeBroker::Options options;
+  options.reply_delay = boost::chrono::milliseconds(2);
+  FakeBroker broker(options);
+  Channel::ptr_t channel = Channel::Open(broker.GetOpenOpts());
+  std::string queue = channel->DeclareQueue("");
+
+  channel->SetLatencyTracking(true);
+  channel->BasicPublish("", queue, BasicMessage::Create("body"));
+  channel->PurgeQueue(queue);
+
+  Channel::LatencyStats stats = channel->GetLatencyStats();
+  ASSERT_EQ(1u, stats.publish_confirm.Count());
+  EXPECT_LE(2000000u, stats.publish_confirm.Percentile(100));
+  ASSERT_EQ(1u, stats.rpc.Count());
+  EXPECT_LE(2000000u, stats.rpc.Percentile(100));
+}
+
+namespace {
+void CountQosOk(int *count, const Channel::FrameEvent &event) {
+  if (Channel::FrameEvent::received == event.direction &&
+      AMQP_BASIC_QOS_OK_METHOD == event.method_id) {
+    ++*count;
+  }
+}
+}  // namespace
+
+TEST(fake_broker, consume_timeout_while_throttling) {
+  FakeBroker broker;
+  Channel::ptr_t channel = Channel::Open(broker.GetOpenOpts());
+  channel->SetReadAheadLimits(2, 0);
+  std::string waited_queue = channel->DeclareQueue("");
+  std::string busy_queue = channel->DeclareQueue("");
+  BasicMessage::ptr_t message = BasicMessage::Create("body");
+  for (int i = 0; i < 10; ++i) {
+    channel->BasicPublish("", busy_queue, message);
+  }
+  std::string waited =
+      channel->BasicConsume(waited_queue, "", true, false, true, 0);
+
+  // The busy consumer's deliveries are read while waiting on the other one
+  // and throttle it. The qos-ok for that arrives after reply_delay, while
+  // the wait is still going on.
+  FakeBroker::Options options;
+  options.reply_delay = boost::chrono::milliseconds(200);
+  broker.SetOptions(options);
+  channel->BasicConsume(busy_queue, "", true, false, true, 0);
+  int qos_oks = 0;
+  channel->SetFrameObserver(boost::bind(CountQosOk, &qos_oks, _1));
+
+  Envelope::ptr_t envelope;
+  const boost::chrono::steady_clock::time_point start =
+      boost::chrono::steady_clock::now();
+  EXPECT_FALSE(channel->BasicConsumeMessage(waited, envelope, 300));
+  const boost::chrono::milliseconds elapsed =
+      boost::chrono::duration_cast<boost::chrono::milliseconds>(
+          boost::chrono::steady_clock::now() - start);
+  channel->SetFrameObserver(Channel::frame_observer_t());
+  broker.SetOptions(FakeBroker::Options());
+
+  EXPECT_EQ(1, qos_oks);
+  // Restarting the timeout after the qos-ok would take about 500ms.
+  EXPECT_LE(300, elapsed.count());
+  EXPECT_GT(450, elapsed.count());
+}
+
+namespace {
+BasicMessage::ptr_t NumberedMessage(const std::string &queue, int i) {
+  BasicMessage::ptr_t message =
+      BasicMessage::Create(queue + std::string(10000, 'a' + i % 26));
+  Table headers;
+  headers.insert(TableEntry("index", int32_t(i)));
+  headers.insert(TableEntry("queue", queue));
+  message->HeaderTable(headers);
+  return message;
+}
+
+void ExpectNumberedMessage(const std::string &queue, int i,
+                           const Envelope::ptr_t &envelope) {
+  const BasicMessage::ptr_t expected = NumberedMessage(queue, i);
+  EXPECT_EQ(expected->Body(), envelope->Message()->Body());
+  EXPECT_EQ(expected->HeaderTable(), envelope->Message()->HeaderTable());
+}
+}  // namespace
+
+TEST(fake_broker, read_ahead_two_channels) {
+  // Small frames split each body over several frames
+  FakeBroker::Options options;
+  options.frame_max = 4096;
+  FakeBroker broker(options);
+  Channel::ptr_t channel = Channel::Open(broker.GetOpenOpts());
+  const std::string first_queue = channel->DeclareQueue("");
+  const std::string second_queue = channel->DeclareQueue("");
+  const std::string first =
+      channel->BasicConsume(first_queue, "", true, true, true, 0);
+  const std::string second =
+      channel->BasicConsume(second_queue, "", true, true, true, 0);
+
+  Channel::Stats round_stats;
+  for (int round = 0; round < 2; ++round) {
+    // The deliveries to both consumers arrive interleaved while waiting for
+    // the publish confirms, and are queued. The connection's buffers for
+    // their channels are released after every queued frame.
+    for (int i = 0; i < 20; ++i) {
+      channel->BasicPublish("", first_queue, NumberedMessage(first_queue, i));
+      channel->BasicPublish("", second_queue,
+                            NumberedMessage(second_queue, i));
+    }
+    EXPECT_LT(0u, channel->GetReadAheadBytes());
+
+    Envelope::ptr_t envelope;
+    for (int i = 0; i < 20; ++i) {
+      ASSERT_TRUE(channel->BasicConsumeMessage(second, envelope, 5000));
+      ExpectNumberedMessage(second_queue, i, envelope);
+    }
+    for (int i = 0; i < 20; ++i) {
+      ASSERT_TRUE(channel->BasicConsumeMessage(first, envelope, 5000));
+      ExpectNumberedMessage(first_queue, i, envelope);
+    }
+    EXPECT_EQ(0u, channel->GetReadAheadBytes());
+
+    // Attached frames are released with their channel's buffers, so the
+    // second round reuses the pool pages of the first.
+    const Channel::Stats stats = channel->GetStats();
+    if (0 != round) {
+      EXPECT_EQ(round_stats.pool_bytes_high_water,
+                stats.pool_bytes_high_water);
+    }
+    round_stats = stats;
+  }
+
+  // Frames still queued when the Channel goes are freed with it. Each
+  // delivery arrives after the confirm of its publish, so it takes a second
+  // publish for the first one to be read ahead.
+  channel->BasicPublish("", second_queue, NumberedMessage(second_queue, 0));
+  channel->BasicPublish("", second_queue, NumberedMessage(second_queue, 1));
+  EXPECT_LT(0u, channel->GetReadAheadBytes());
+}
@@ -69,6 +69,44 @@ TEST_F(connected_test, bad_queue) {
                ChannelException);
 }
 
+TEST_F(connected_test, try_get) {
+  std::string queue = channel->DeclareQueue("");
+  Envelope::ptr_t new_message;
+  EXPECT_EQ(Channel::BasicResult::empty,
+            channel->TryBasicGet(new_message, queue).status);
+
+  channel->BasicPublish("", queue, BasicMessage::Create("Message Body"));
+  EXPECT_TRUE(channel->TryBasicGet(new_message, queue).Ok());
+  EXPECT_EQ("Message Body", new_message->Message()->Body());
+
+  Channel::BasicResult result =
+      channel->TryBasicGet(new_message, "test_get_nonexistantqueue");
+  EXPECT_EQ(Channel::BasicResult::channel_error, result.status);
+  EXPECT_EQ(404, result.reply_code);
+}
+
+TEST_F(connected_test, try_consume_timeout) {
+  std::string queue = channel->DeclareQueue("");
+  std::string consumer = channel->BasicConsume(queue, "", true, false);
+  Envelope::ptr_t new_message;
+  EXPECT_EQ(Channel::BasicResult::empty,
+            channel->TryBasicConsumeMessage(consumer, new_message, 1).status);
+
+  channel->BasicPublish("", queue, BasicMessage::Create("Message Body"));
+  EXPECT_TRUE(channel->TryBasicConsumeMessage(consumer, new_message).Ok());
+  EXPECT_EQ("Message Body", new_message->Message()->Body());
+}
+
+TEST_F(connected_test, try_consume_cancelled) {
+  std::string queue = channel->DeclareQueue("");
+  std::string consumer = channel->BasicConsume(queue, "", true, false);
+  channel->DeleteQueue(queue);
+
+  Envelope::ptr_t new_message;
+  EXPECT_EQ(Channel::BasicResult::consumer_cancelled,
+            channel->TryBasicConsumeMessage(consumer, new_message).status);
+}
+
 TEST_F(connected_test, ack_message) {
   BasicMessage::ptr_t message = BasicMessage::Create("Message Body");
   std::string queue = channel->DeclareQueue("");
@@ -79,3 +117,24 @@ TEST_F(connected_test, ack_message) {
   channel->BasicAck(new_message);
   EXPECT_FALSE(channel->BasicGet(new_message, queue, false));
 }
+
+TEST_F(connected_test, get_stats) {
+  std::string queue = channel->DeclareQueue("");
+  const Channel::Stats before = channel->GetStats();
+  EXPECT_LT(0u, before.open_channels);
+
+  channel->BasicPublish("", queue, BasicMessage::Create("Message Body"));
+  Envelope::ptr_t new_message;
+  ASSERT_TRUE(channel->BasicGet(new_message, queue));
+
+  const Channel::Stats after = channel->GetStats();
+  EXPECT_EQ(before.messages_published + 1, after.messages_published);
+  EXPECT_EQ(before.bytes_published + 12, after.bytes_published);
+  EXPECT_EQ(before.messages_consumed + 1, after.messages_consumed);
+  EXPECT_EQ(before.bytes_consumed + 12, after.bytes_consumed);
+  EXPECT_EQ(before.acks_received + 1, after.acks_received);
+  EXPECT_LT(before.frames_sent, after.frames_sent);
+  EXPECT_LT(before.frames_received, after.frames_received);
+  EXPECT_EQ(1u, after.rpcs.count("AMQP_BASIC_GET_METHOD"));
+  EXPECT_LE(after.pool_bytes, after.pool_bytes_high_water);
+}
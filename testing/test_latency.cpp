@@ -0,0 +1,88 @@
+/*
+ * ***** BEGIN LICENSE BLOCK *****
+ * Version: MIT
+ *
+ * Copyright (c) 2010-2013 Alan Antonuk
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * ***** END LICENSE BLOCK *****
+ */
+
+#include "connected_test.h"
+
+using namespace AmqpClient;
+
+namespace {
+LatencyHistogram::Bucket MakeBucket(boost::uint64_t lower,
+                                    boost::uint64_t upper,
+                                    boost::uint64_t count) {
+  LatencyHistogram::Bucket bucket = {lower, upper, count};
+  return bucket;
+}
+}  // namespace
+
+TEST(latency_histogram, empty) {
+  LatencyHistogram histogram;
+  EXPECT_EQ(0u, histogram.Count());
+  EXPECT_EQ(0u, histogram.Mean());
+  EXPECT_EQ(0u, histogram.Percentile(50));
+  EXPECT_TRUE(histogram.Buckets().empty());
+}
+
+TEST(latency_histogram, percentiles) {
+  LatencyHistogram::bucket_list_t buckets;
+  buckets.push_back(MakeBucket(1000, 1063, 90));
+  buckets.push_back(MakeBucket(2048, 2175, 9));
+  buckets.push_back(MakeBucket(65536, 69631, 1));
+  LatencyHistogram histogram(buckets, 130000);
+
+  EXPECT_EQ(100u, histogram.Count());
+  EXPECT_EQ(1300u, histogram.Mean());
+  EXPECT_EQ(1063u, histogram.Percentile(0));
+  EXPECT_EQ(1063u, histogram.Percentile(50));
+  EXPECT_EQ(1063u, histogram.Percentile(90));
+  EXPECT_EQ(2175u, histogram.Percentile(90.5));
+  EXPECT_EQ(2175u, histogram.Percentile(99));
+  EXPECT_EQ(69631u, histogram.Percentile(99.9));
+  EXPECT_EQ(69631u, histogram.Percentile(100));
+  ASSERT_EQ(3u, histogram.Buckets().size());
+  EXPECT_EQ(2048u, histogram.Buckets()[1].lower);
+}
+
+TEST_F(connected_test, latency_stats) {
+  EXPECT_FALSE(channel->GetLatencyTracking());
+  std::string queue = channel->DeclareQueue("");
+  EXPECT_EQ(0u, channel->GetLatencyStats().rpc.Count());
+
+  channel->SetLatencyTracking(true);
+  channel->BasicPublish("", queue, BasicMessage::Create("Message Body"));
+  channel->PurgeQueue(queue);
+
+  Channel::LatencyStats stats = channel->GetLatencyStats(true);
+  EXPECT_EQ(1u, stats.publish_confirm.Count());
+  EXPECT_LT(0u, stats.publish_confirm.Percentile(50));
+  EXPECT_EQ(1u, stats.rpc.Count());
+  EXPECT_LT(0u, stats.frame_wait.Count());
+
+  stats = channel->GetLatencyStats();
+  EXPECT_EQ(0u, stats.publish_confirm.Count());
+  EXPECT_EQ(0u, stats.rpc.Count());
+}
@@ -116,6 +116,96 @@ TEST(basic_message, embedded_nulls) {
   EXPECT_EQ(body2, message->Body());
 }
 
+#ifndef BOOST_NO_CXX11_RVALUE_REFERENCES
+TEST(basic_message, move_body_and_headers) {
+  const std::string body("Message Body");
+  std::string moved_body(body);
+  BasicMessage::ptr_t message = BasicMessage::Create(std::move(moved_body));
+  EXPECT_EQ(body, message->Body());
+
+  const std::string body2("Second body");
+  std::string moved_body2(body2);
+  message->Body(std::move(moved_body2));
+  EXPECT_EQ(body2, message->Body());
+
+  Table headers;
+  headers.insert(TableEntry("key", "value"));
+  Table moved_headers(headers);
+  message->HeaderTable(std::move(moved_headers));
+  EXPECT_TRUE(message->HeaderTableIsSet());
+  EXPECT_EQ(headers, message->HeaderTable());
+}
+#endif
+
+TEST(basic_message, shared_body) {
+  const BasicMessage::body_ptr_t body =
+      boost::make_shared<const std::string>("Shared body");
+  BasicMessage::ptr_t message1 = BasicMessage::Create(body);
+  BasicMessage::ptr_t message2 = BasicMessage::Create(body);
+  EXPECT_EQ(body, message1->SharedBody());
+
+  const BasicMessage &const_message = *message1;
+  EXPECT_EQ(body.get(), &const_message.Body());
+  EXPECT_EQ(body, message2->SharedBody());
+
+  // Writing through the mutable accessor copies the shared body.
+  message1->Body().append(" changed");
+  EXPECT_EQ("Shared body changed", message1->Body());
+  EXPECT_FALSE(message1->SharedBody());
+  EXPECT_EQ("Shared body", *body);
+  EXPECT_EQ("Shared body", static_cast<const BasicMessage &>(*message2).Body());
+
+  message2->Body("Owned");
+  EXPECT_FALSE(message2->SharedBody());
+  EXPECT_EQ("Owned", message2->Body());
+}
+
+TEST(basic_message, inline_properties) {
+  BasicMessage::ptr_t message = BasicMessage::Create();
+  EXPECT_EQ(0, message->PropertyFlags());
+  EXPECT_TRUE(message->ContentTypeRef().empty());
+
+  message->ContentType("text/plain");
+  message->MessageId("message id");
+  message->AppId("app");
+  message->Priority(3);
+  EXPECT_EQ(BasicMessage::pf_content_type | BasicMessage::pf_message_id |
+                BasicMessage::pf_app_id | BasicMessage::pf_priority,
+            message->PropertyFlags());
+
+  // Replacing a property must not disturb the others.
+  message->MessageId("a much longer message id");
+  EXPECT_EQ("text/plain", message->ContentTypeRef());
+  EXPECT_EQ("a much longer message id", message->MessageIdRef());
+  EXPECT_EQ("app", message->AppIdRef());
+  EXPECT_EQ("app", message->AppId());
+
+  message->ContentTypeClear();
+  EXPECT_FALSE(message->ContentTypeIsSet());
+  EXPECT_EQ("", message->ContentType());
+  EXPECT_EQ("a much longer message id", message->MessageId());
+  EXPECT_EQ("app", message->AppIdRef());
+
+  message->PriorityClear();
+  EXPECT_FALSE(message->PriorityIsSet());
+  EXPECT_EQ(0, message->Priority());
+  EXPECT_EQ(BasicMessage::pf_message_id | BasicMessage::pf_app_id,
+            message->PropertyFlags());
+}
+
+TEST(basic_message, property_references) {
+  BasicMessage::ptr_t message = BasicMessage::Create();
+  message->ContentType("a content type longer than a small string");
+  const BasicMessage &const_message = *message;
+  const std::string &content_type = const_message.ContentType();
+  EXPECT_EQ(&content_type, &const_message.ContentType());
+
+  message->ContentType("text/plain");
+  EXPECT_EQ("text/plain", content_type);
+  message->ContentTypeClear();
+  EXPECT_EQ("", content_type);
+}
+
 TEST_F(connected_test, replaced_received_body) {
   const std::string queue = channel->DeclareQueue("");
   const std::string consumer = channel->BasicConsume(queue);
@@ -26,6 +26,11 @@
  * ***** END LICENSE BLOCK *****
  */
 
+#include <amqp.h>
+
+#define BOOST_BIND_GLOBAL_PLACEHOLDERS
+#include <boost/bind.hpp>
+
 #include "connected_test.h"
 
 using namespace AmqpClient;
@@ -86,3 +91,181 @@ TEST_F(connected_test, publish_immediate_success) {
 
   channel->BasicPublish("", queue, message, true);
 }
+
+TEST(test_publish, publish_template_copies_properties) {
+  BasicMessage::ptr_t properties = BasicMessage::Create();
+  properties->ContentType("text/plain");
+
+  PublishTemplate::ptr_t publish_template =
+      PublishTemplate::Create("exchange", "routing_key", *properties, true);
+  properties->ContentType("application/octet-stream");
+
+  EXPECT_EQ("exchange", publish_template->Exchange());
+  EXPECT_EQ("routing_key", publish_template->RoutingKey());
+  EXPECT_TRUE(publish_template->Mandatory());
+}
+
+TEST_F(connected_test, publish_template) {
+  std::string queue = channel->DeclareQueue("");
+
+  BasicMessage::ptr_t properties = BasicMessage::Create();
+  properties->ContentType("text/plain");
+  properties->MessageId("template id");
+  Table headers;
+  headers.insert(TableEntry("key", "value"));
+  properties->HeaderTable(headers);
+
+  PublishTemplate::ptr_t publish_template =
+      PublishTemplate::Create("", queue, *properties, true);
+  properties->ContentType("application/octet-stream");
+
+  channel->BasicPublish(publish_template, "first");
+  channel->BasicPublish(publish_template, "second", "override id", 1234);
+
+  Envelope::ptr_t envelope;
+  ASSERT_TRUE(channel->BasicGet(envelope, queue));
+  EXPECT_EQ("first", envelope->Message()->Body());
+  EXPECT_EQ("text/plain", envelope->Message()->ContentType());
+  EXPECT_EQ("template id", envelope->Message()->MessageId());
+  EXPECT_FALSE(envelope->Message()->TimestampIsSet());
+  EXPECT_EQ(headers, envelope->Message()->HeaderTable());
+
+  ASSERT_TRUE(channel->BasicGet(envelope, queue));
+  EXPECT_EQ("second", envelope->Message()->Body());
+  EXPECT_EQ("text/plain", envelope->Message()->ContentType());
+  EXPECT_EQ("override id", envelope->Message()->MessageId());
+  EXPECT_EQ(1234, envelope->Message()->Timestamp());
+  EXPECT_EQ(headers, envelope->Message()->HeaderTable());
+}
+
+TEST_F(connected_test, publish_fanout) {
+  std::vector<std::string> queues;
+  queues.push_back(channel->DeclareQueue(""));
+  queues.push_back(channel->DeclareQueue(""));
+
+  BasicMessage::ptr_t message = BasicMessage::Create(
+      boost::make_shared<const std::string>("Fanout message body"));
+  message->ContentType("text/plain");
+  channel->BasicPublishFanout("", queues, message);
+
+  for (std::vector<std::string>::const_iterator it = queues.begin();
+       it != queues.end(); ++it) {
+    Envelope::ptr_t envelope;
+    ASSERT_TRUE(channel->BasicGet(envelope, *it, true));
+    EXPECT_EQ(*it, envelope->RoutingKey());
+    EXPECT_EQ("Fanout message body", envelope->Message()->Body());
+    EXPECT_EQ("text/plain", envelope->Message()->ContentType());
+  }
+}
+
+TEST(test_publish, publish_body_segments) {
+  Channel::OpenOpts opts = connected_test::GetTestOpenOpts();
+  opts.frame_max = 4096;
+  Channel::ptr_t channel = Channel::Open(opts);
+  std::string queue = channel->DeclareQueue("");
+
+  // Segments larger than a frame are split, short ones are sent as they are
+  const std::string first(5000, 'a');
+  const std::string second("bc");
+  const std::string third(4100, 'd');
+  std::vector<boost::string_ref> segments;
+  segments.push_back(first);
+  segments.push_back(boost::string_ref());
+  segments.push_back(second);
+  segments.push_back(third);
+
+  BasicMessage::ptr_t properties = BasicMessage::Create();
+  properties->ContentType("application/octet-stream");
+  channel->BasicPublish("", queue, properties, segments);
+
+  Envelope::ptr_t envelope;
+  ASSERT_TRUE(channel->BasicGet(envelope, queue, true));
+  EXPECT_EQ(first + second + third, envelope->Message()->Body());
+  EXPECT_EQ("application/octet-stream", envelope->Message()->ContentType());
+}
+
+TEST_F(connected_test, try_publish) {
+  BasicMessage::ptr_t message = BasicMessage::Create("message body");
+  std::string queue = channel->DeclareQueue("");
+
+  EXPECT_TRUE(channel->TryBasicPublish("", queue, message, true).Ok());
+
+  Channel::BasicResult returned =
+      channel->TryBasicPublish("", "test_publish_notexist", message, true);
+  EXPECT_EQ(Channel::BasicResult::returned, returned.status);
+  EXPECT_EQ(312, returned.reply_code);
+  ASSERT_TRUE(returned.returned_message);
+  EXPECT_EQ(message->Body(), returned.returned_message->Body());
+
+  Channel::BasicResult closed = channel->TryBasicPublish(
+      "test_publish_notexist", "test_publish_rk", message);
+  EXPECT_EQ(Channel::BasicResult::channel_error, closed.status);
+  EXPECT_EQ(404, closed.reply_code);
+
+  EXPECT_TRUE(channel->TryBasicPublish("", queue, message).Ok());
+}
+
+namespace {
+void CollectReturn(std::vector<Channel::ReturnedMessage> *returns,
+                   const Channel::ReturnedMessage &returned) {
+  returns->push_back(returned);
+}
+}  // namespace
+
+TEST_F(connected_test, publish_return_handler) {
+  std::vector<Channel::ReturnedMessage> returns;
+  channel->SetReturnHandler(boost::bind(CollectReturn, &returns, _1));
+
+  BasicMessage::ptr_t message = BasicMessage::Create("message body");
+  message->MessageId("returned-1");
+  const boost::uint64_t publish_seq_no = channel->GetNextPublishSeqNo();
+  channel->BasicPublish("", "test_publish_notexist", message, true);
+  EXPECT_EQ(publish_seq_no + 1, channel->GetNextPublishSeqNo());
+
+  ASSERT_EQ(1u, returns.size());
+  EXPECT_EQ(publish_seq_no, returns[0].publish_seq_no);
+  EXPECT_EQ(312, returns[0].reply_code);
+  EXPECT_EQ("", returns[0].exchange);
+  EXPECT_EQ("test_publish_notexist", returns[0].routing_key);
+  EXPECT_EQ("returned-1", returns[0].message->MessageId());
+  EXPECT_TRUE(returns[0].message->Body().empty());
+
+  channel->SetReturnHandler(boost::bind(CollectReturn, &returns, _1), true);
+  channel->BasicPublish("", "test_publish_notexist", message, true);
+  ASSERT_EQ(2u, returns.size());
+  EXPECT_EQ(message->Body(), returns[1].message->Body());
+
+  channel->SetReturnHandler(Channel::return_handler_t());
+  EXPECT_THROW(
+      channel->BasicPublish("", "test_publish_notexist", message, true),
+      MessageReturnedException);
+}
+
+namespace {
+void CollectFrame(std::vector<Channel::FrameEvent> *frames,
+                  const Channel::FrameEvent &frame) {
+  frames->push_back(frame);
+}
+}  // namespace
+
+TEST_F(connected_test, publish_frame_observer) {
+  std::vector<Channel::FrameEvent> frames;
+  channel->SetFrameObserver(boost::bind(CollectFrame, &frames, _1));
+
+  channel->BasicPublish("", "test_publish_rk",
+                        BasicMessage::Create("message body"));
+  channel->SetFrameObserver(Channel::frame_observer_t());
+
+  ASSERT_EQ(4u, frames.size());
+  EXPECT_EQ(Channel::FrameEvent::sent, frames[0].direction);
+  EXPECT_EQ(Channel::FrameEvent::method, frames[0].frame_type);
+  EXPECT_EQ(AMQP_BASIC_PUBLISH_METHOD, frames[0].method_id);
+  EXPECT_EQ(Channel::FrameEvent::header, frames[1].frame_type);
+  EXPECT_EQ(12u, frames[1].size);
+  EXPECT_EQ(Channel::FrameEvent::body, frames[2].frame_type);
+  EXPECT_EQ(12u, frames[2].size);
+  EXPECT_EQ(Channel::FrameEvent::received, frames[3].direction);
+  EXPECT_EQ(AMQP_BASIC_ACK_METHOD, frames[3].method_id);
+  EXPECT_EQ(frames[0].channel, frames[3].channel);
+  EXPECT_LE(frames[0].timestamp, frames[3].timestamp);
+}
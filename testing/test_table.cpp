@@ -783,6 +783,50 @@ TEST(table_value, equality) {
   EXPECT_NE(table_val1, table_val3);
 }
 
+TEST(table_value, copies_are_independent) {
+  Table inner;
+  inner.insert(TableEntry("key", "value"));
+
+  TableValue original(inner);
+  TableValue copy(original);
+  EXPECT_EQ(original, copy);
+
+  copy.Set(int32_t(10));
+  EXPECT_EQ(TableValue::VT_table, original.GetType());
+  EXPECT_EQ(inner.size(), original.GetTable().size());
+  EXPECT_EQ(std::string("value"), original.GetTable()["key"].GetString());
+  EXPECT_EQ(10, copy.GetInteger());
+
+  TableValue assigned;
+  assigned = original;
+  original.Set("replaced");
+  EXPECT_EQ(TableValue::VT_table, assigned.GetType());
+  EXPECT_EQ(std::string("value"), assigned.GetTable()["key"].GetString());
+  EXPECT_EQ(std::string("replaced"), original.GetString());
+}
+
+#ifndef BOOST_NO_CXX11_RVALUE_REFERENCES
+TEST(table_value, move_value) {
+  const std::string str("A string");
+  std::string moved_str(str);
+  TableValue value(std::move(moved_str));
+  EXPECT_EQ(TableValue::VT_string, value.GetType());
+  EXPECT_EQ(str, value.GetString());
+
+  Table table;
+  table.insert(TableEntry("key", int32_t(1)));
+  Table moved_table(table);
+  value.Set(std::move(moved_table));
+  EXPECT_EQ(TableValue::VT_table, value.GetType());
+  EXPECT_EQ(table, value.GetTable());
+
+  TableValue moved_to(std::move(value));
+  EXPECT_EQ(TableValue::VT_table, moved_to.GetType());
+  EXPECT_EQ(table, moved_to.GetTable());
+  EXPECT_EQ(TableValue::VT_void, value.GetType());
+}
+#endif
+
 TEST(table, convert_to_rabbitmq) {
   Table table_in;
   table_in.insert(TableEntry("void_key", TableValue()));
@@ -831,6 +875,129 @@ TEST(table, convert_to_rabbitmq_empty) {
   EXPECT_EQ(0, table_out.size());
 }
 
+TEST(table, encode_decode) {
+  Table table_in;
+  table_in.insert(TableEntry("void_key", TableValue()));
+  table_in.insert(TableEntry("bool_key", true));
+  table_in.insert(TableEntry("uint8_key", uint8_t(8)));
+  table_in.insert(TableEntry("int8_key", int8_t(-8)));
+  table_in.insert(TableEntry("uint16_key", uint16_t(16)));
+  table_in.insert(TableEntry("int16_key", int16_t(-16)));
+  table_in.insert(TableEntry("uint32_key", uint32_t(32)));
+  table_in.insert(TableEntry("int32_key", int32_t(-32)));
+  table_in.insert(TableEntry("timestamp_key", TableValue::Timestamp(64)));
+  table_in.insert(TableEntry("int64_key", int64_t(-64)));
+  table_in.insert(TableEntry("float_key", float(1.5)));
+  table_in.insert(TableEntry("double_key", double(2.25)));
+  table_in.insert(TableEntry("string_key", "A string!"));
+
+  std::vector<TableValue> array_in;
+  array_in.push_back(TableValue(false));
+  array_in.push_back(TableValue(int32_t(10)));
+  array_in.push_back(TableValue(std::string("Another string")));
+  table_in.insert(TableEntry("array_key", array_in));
+
+  Table table_inner;
+  table_inner.insert(TableEntry("inner_string", "An inner table"));
+  table_inner.insert(TableEntry("inner array", array_in));
+  table_in.insert(TableEntry("table_key", table_inner));
+
+  EncodedTable encoded(table_in);
+  EXPECT_EQ(table_in, encoded.Decode());
+  EXPECT_EQ(table_in, EncodedTable::FromBytes(encoded.Bytes()).Decode());
+}
+
+TEST(table, encode_wire_format) {
+  Table table_in;
+  table_in.insert(TableEntry("a", int32_t(1)));
+
+  const char expected[] = {0, 0, 0, 7, 1, 'a', 'I', 0, 0, 0, 1};
+  EXPECT_EQ(std::string(expected, sizeof(expected)),
+            EncodedTable(table_in).Bytes());
+
+  EXPECT_EQ(std::string(4, '\0'), EncodedTable().Bytes());
+  EXPECT_TRUE(EncodedTable().Decode().empty());
+}
+
+TEST(table, decode_malformed) {
+  Table table_in;
+  table_in.insert(TableEntry("key", "value"));
+  std::string bytes = EncodedTable(table_in).Bytes();
+
+  EXPECT_THROW(EncodedTable::FromBytes(bytes.substr(0, bytes.size() - 1)),
+               std::runtime_error);
+  EXPECT_THROW(EncodedTable::FromBytes(bytes + 'x'), std::runtime_error);
+}
+
+TEST(table, decode_nesting_limit) {
+  Table table;
+  table.insert(TableEntry("array", Array(1, TableValue(Array()))));
+  for (int i = 0; i < 61; ++i) {
+    Table outer;
+    outer.insert(TableEntry("table", table));
+    table.swap(outer);
+  }
+  // 62 tables with two arrays in the innermost one is 64 levels.
+  std::string bytes = EncodedTable(table).Bytes();
+  EXPECT_EQ(table, EncodedTable::FromBytes(bytes).Decode());
+
+  Table outer;
+  outer.insert(TableEntry("table", table));
+  bytes = EncodedTable(outer).Bytes();
+  EXPECT_THROW(EncodedTable::FromBytes(bytes), std::runtime_error);
+}
+
+TEST(table, basic_message_encoded_header_table) {
+  Table table_in;
+  table_in.insert(TableEntry("string_key", "A string!"));
+  table_in.insert(TableEntry("int32_key", int32_t(32)));
+  EncodedTable encoded(table_in);
+
+  BasicMessage::ptr_t message = BasicMessage::Create();
+  message->HeaderTable(encoded);
+  EXPECT_TRUE(message->HeaderTableIsSet());
+  EXPECT_TRUE(message->HeaderTableIsEncoded());
+  EXPECT_EQ(encoded.Bytes(), message->EncodedHeaderTable().Bytes());
+
+  const BasicMessage &const_message = *message;
+  EXPECT_EQ(table_in, const_message.HeaderTable());
+  EXPECT_TRUE(message->HeaderTableIsEncoded());
+
+  message->HeaderTable().insert(TableEntry("added", true));
+  EXPECT_FALSE(message->HeaderTableIsEncoded());
+  EXPECT_EQ(3, message->EncodedHeaderTable().Decode().size());
+
+  message->HeaderTableClear();
+  EXPECT_FALSE(message->HeaderTableIsSet());
+  EXPECT_TRUE(const_message.HeaderTable().empty());
+}
+
+TEST(table, encoded_find) {
+  Table table_in;
+  table_in.insert(TableEntry("array_key", Array(2, TableValue(int8_t(1)))));
+  table_in.insert(TableEntry("string_key", "A string!"));
+  table_in.insert(TableEntry("uint64_key", TableValue::Timestamp(64)));
+  EncodedTable encoded(table_in);
+
+  TableValue value;
+  EXPECT_TRUE(encoded.Find("string_key", value));
+  EXPECT_EQ("A string!", value.GetString());
+  EXPECT_TRUE(encoded.Find("uint64_key", value));
+  EXPECT_EQ(64, value.GetTimestamp());
+  EXPECT_FALSE(encoded.Find("missing_key", value));
+
+  BasicMessage::ptr_t message = BasicMessage::Create();
+  message->HeaderTable(encoded);
+  EXPECT_TRUE(message->HeaderTableFind("string_key", value));
+  EXPECT_EQ("A string!", value.GetString());
+  EXPECT_TRUE(message->HeaderTableIsEncoded());
+
+  message->HeaderTable(table_in);
+  EXPECT_TRUE(message->HeaderTableFind("string_key", value));
+  EXPECT_EQ("A string!", value.GetString());
+  EXPECT_FALSE(message->HeaderTableFind("missing_key", value));
+}
+
 TEST_F(connected_test, basic_message_header_roundtrip) {
   Table table_in;
   table_in.insert(TableEntry("void_key", TableValue()));
@@ -894,3 +1061,28 @@ TEST_F(connected_test, basic_message_empty_table_roundtrip) {
   EXPECT_EQ(table_in.size(), table_out.size());
   EXPECT_TRUE(std::equal(table_in.begin(), table_in.end(), table_out.begin()));
 }
+
+TEST_F(connected_test, basic_message_lazy_header_roundtrip) {
+  Table table_in;
+  table_in.insert(TableEntry("string_key", "A string!"));
+  table_in.insert(TableEntry("int32_key", int32_t(32)));
+
+  BasicMessage::ptr_t message = BasicMessage::Create("Body");
+  message->ContentType("text/plain");
+  message->HeaderTable(table_in);
+
+  channel->SetLazyHeaderDecoding(true);
+  std::string queue = channel->DeclareQueue("");
+  channel->BasicPublish("", queue, message);
+
+  Envelope::ptr_t envelope;
+  ASSERT_TRUE(channel->BasicGet(envelope, queue));
+  const BasicMessage::ptr_t &received = envelope->Message();
+  EXPECT_TRUE(received->HeaderTableIsEncoded());
+  EXPECT_EQ("text/plain", received->ContentType());
+
+  TableValue value;
+  EXPECT_TRUE(received->HeaderTableFind("int32_key", value));
+  EXPECT_EQ(32, value.GetInt32());
+  EXPECT_EQ(table_in, received->HeaderTable());
+}